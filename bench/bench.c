@@ -0,0 +1,1420 @@
+// Host benchmark for the file-management core (make host-bench).
+//
+// Builds synthetic SD trees under <work>/sdmc:/ and runs the same code the
+// console does, so the "sdmc:/..." paths used throughout resolve relative
+// to the work directory. -l adds a delay to every simulated FS request
+// (see hostFsRequest in platform.h) to approximate a real card.
+
+#include "platform.h"
+#include "library.h"
+#include "dirlist.h"
+#include "state.h"
+#include "mover.h"
+#include "search.h"
+#include "moflex.h"
+#include "metacache.h"
+#include "verifier.h"
+#include "dupes.h"
+#include "cover.h"
+#include "scanner.h"
+#include "jobs.h"
+#include "recents.h"
+#include "fssession.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <png.h>
+#include <jpeglib.h>
+
+#define BENCH_PATH_LEN 512
+#define LONG_NAME_LEN  200
+#define DEEP_LEVELS    64
+
+static int maxFiles = 10000;
+static int repeat = 3;
+static bool keepTree = false;
+static char traceFile[BENCH_PATH_LEN] = ""; // absolute, since we chdir
+
+static double ticksToUs(u64 ticks) {
+    return (double)ticks * 1000000.0 / SYSCLOCK_ARM11;
+}
+
+static void reportHeader(void) {
+    printf("%-30s %8s %12s %12s %10s %12s\n", "operation", "n", "total ms", "per-op us", "fs reqs",
+           "bytes");
+}
+
+// One line per measurement; ticks and fsOps cover all repeats
+static void report(const char *op, int n, int runs, u64 ticks, u64 fsOps, u64 bytes) {
+    double totalMs = ticksToUs(ticks) / 1000.0 / runs;
+    double perOpUs = n > 0 ? ticksToUs(ticks) / runs / n : 0.0;
+    char bytesText[24] = "-";
+    if (bytes) {
+        snprintf(bytesText, sizeof(bytesText), "%llu", (unsigned long long)bytes);
+    }
+    printf("%-30s %8d %12.3f %12.3f %10llu %12s\n", op, n, totalMs, perOpUs,
+           (unsigned long long)(fsOps / runs), bytesText);
+}
+
+// Throughput line under a measurement
+static void reportRate(const char *op, int n, u64 ticks) {
+    double seconds = ticksToUs(ticks) / 1000000.0;
+    printf("%-30s %8d %12.0f files/s\n", op, n, seconds > 0 ? n / seconds : 0.0);
+}
+
+typedef struct {
+    u64 start;
+    u64 fsOps;
+} Timer;
+
+static void timerStart(Timer *timer) {
+    timer->fsOps = hostFsOps;
+    timer->start = svcGetSystemTick();
+}
+
+static u64 timerStop(Timer *timer, u64 *fsOps) {
+    u64 ticks = svcGetSystemTick() - timer->start;
+    *fsOps += hostFsOps - timer->fsOps;
+    return ticks;
+}
+
+// --- synthetic trees -------------------------------------------------------
+
+static void makeDir(const char *path) {
+    mkdir(path, 0777);
+}
+
+static void makeFile(const char *path, u32 seed) {
+    FILE *f = fopen(path, "wb");
+    if (f) {
+        fwrite(&seed, sizeof(seed), 1, f);
+        fclose(f);
+    }
+}
+
+// Pads a name out to length with a repeating pattern
+static void longName(char *out, int index, int length, const char *suffix) {
+    int len = snprintf(out, length + 1, "%06d ", index);
+    while (len < length - (int)strlen(suffix)) {
+        out[len] = "abcdefghijklmnopqrstuvwxyz"[len % 26];
+        len++;
+    }
+    strcpy(out + len, suffix);
+}
+
+// A collection of files .moflex files, optionally with long names, and
+// folders subfolders next to them
+static void makeCollection(const char *dir, int files, int folders, bool longNames, u32 seed) {
+    char path[BENCH_PATH_LEN];
+    char name[LONG_NAME_LEN + 1];
+    makeDir(dir);
+
+    for (int i = 0; i < files; i++) {
+        if (longNames) {
+            longName(name, i, LONG_NAME_LEN, ".moflex");
+        } else {
+            snprintf(name, sizeof(name), "Episode %d.moflex", i);
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        makeFile(path, seed + i);
+    }
+    for (int i = 0; i < folders; i++) {
+        snprintf(path, sizeof(path), "%s/Season %d", dir, i);
+        makeDir(path);
+    }
+}
+
+// Sync header with a 400x240 video descriptor and an audio one, padded to
+// 64 bytes (layout in moflex.h)
+static void moflexBlock(u8 *out, u64 timestamp, bool stereo) {
+    static const u8 descriptors[] = {
+        3, 13, 0, 0, 24, 0, 1, 0x01, 0x90, 0x00, 0xF0, 0, 0, 0, 0,
+        2, 6, 1, 0x00, 0x7D, 0x00, 0x01, 0,
+        0, 0,
+    };
+    memset(out, 0, 64);
+    out[0] = 0x4C;
+    out[1] = 0x32;
+    out[2] = 0xAA;
+    out[3] = 0xAB;
+    for (int i = 0; i < 8; i++) {
+        out[4 + i] = (u8)(timestamp >> (56 - 8 * i));
+    }
+    out[12] = 0x0F;
+    out[13] = 0xFF;
+    memcpy(out + 14, descriptors, sizeof(descriptors));
+    out[14 + 11] = stereo;
+}
+
+// A moflex-shaped file of the given size: a sync block at each end and a
+// hole in between, so large files take no space
+static void makeMoflex(const char *path, u64 size, u32 seconds, bool stereo) {
+    u8 block[64];
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return;
+    }
+    moflexBlock(block, 0, stereo);
+    fwrite(block, 1, sizeof(block), f);
+    fseeko(f, (off_t)(size - 1000), SEEK_SET);
+    moflexBlock(block, (u64)seconds * MOFLEX_TICKS_PER_SECOND, stereo);
+    fwrite(block, 1, sizeof(block), f);
+    fseeko(f, (off_t)(size - 1), SEEK_SET);
+    fputc(0, f);
+    fclose(f);
+}
+
+static void removeTree(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir) {
+        struct dirent *entry;
+        char child[BENCH_PATH_LEN * 2];
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            removeTree(child);
+        }
+        closedir(dir);
+        rmdir(path);
+    } else {
+        unlink(path);
+    }
+}
+
+// --- benchmarks ------------------------------------------------------------
+
+// The pre-index listing: readdir plus a stat per entry to find folders.
+// newlib's devoptab batches readdir like FSDIR_Read does, the stat is extra.
+static int legacyListing(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+    hostFsRequest();
+
+    int folders = 0;
+    int entries = 0;
+    struct dirent *entry;
+    char fullPath[BENCH_PATH_LEN * 2];
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (entries++ % 32 == 0) {
+            hostFsRequest();
+        }
+        struct stat st;
+        snprintf(fullPath, sizeof(fullPath), "%s/%s", path, entry->d_name);
+        hostFsRequest();
+        if (stat(fullPath, &st) == 0 && S_ISDIR(st.st_mode)) {
+            folders++;
+        }
+    }
+    closedir(dir);
+    return folders;
+}
+
+static void benchScan(int n) {
+    char dir[BENCH_PATH_LEN];
+    snprintf(dir, sizeof(dir), "sdmc:/MOFLEX/scan%d", n);
+    makeCollection(dir, n / 2, n - n / 2, false, 0);
+
+    u64 ticks = 0, fsOps = 0;
+    Timer timer;
+    char label[64];
+
+    for (int r = 0; r < repeat; r++) {
+        timerStart(&timer);
+        legacyListing(dir);
+        ticks += timerStop(&timer, &fsOps);
+    }
+    snprintf(label, sizeof(label), "listing.readdir+stat");
+    report(label, n, repeat, ticks, fsOps, 0);
+
+    ticks = fsOps = 0;
+    for (int r = 0; r < repeat; r++) {
+        LibraryIndex lib;
+        libraryInit(&lib, "sdmc:/MOFLEX/");
+        timerStart(&timer);
+        libraryRefresh(&lib, dir, NULL);
+        ticks += timerStop(&timer, &fsOps);
+        libraryFree(&lib);
+    }
+    report("library.refresh.cold", n, repeat, ticks, fsOps, 0);
+
+    LibraryIndex lib;
+    libraryInit(&lib, "sdmc:/MOFLEX/");
+    libraryRefresh(&lib, dir, NULL);
+    ticks = fsOps = 0;
+    for (int r = 0; r < repeat; r++) {
+        timerStart(&timer);
+        libraryRefresh(&lib, dir, NULL);
+        ticks += timerStop(&timer, &fsOps);
+    }
+    report("library.refresh.warm", n, repeat, ticks, fsOps, 0);
+
+    // Listing served from the index, and what it costs to hold
+    DirectoryList list;
+    initDirectoryList(&list, &lib, NULL, 25);
+    ticks = fsOps = 0;
+    for (int r = 0; r < repeat; r++) {
+        timerStart(&timer);
+        loadDirectory(&list, dir);
+        ticks += timerStop(&timer, &fsOps);
+    }
+    u64 bytes = (u64)list.capacity * sizeof(DirectoryEntry) + list.namesCapacity;
+    report("dirlist.load", n, repeat, ticks, fsOps, bytes);
+    freeDirectoryList(&list);
+
+    // Round trip through the index file
+    ticks = fsOps = 0;
+    for (int r = 0; r < repeat; r++) {
+        timerStart(&timer);
+        librarySave(&lib, "sdmc:/.clownsec_files");
+        libraryLoad(&lib, "sdmc:/.clownsec_files");
+        ticks += timerStop(&timer, &fsOps);
+    }
+    report("library.save+load", n, repeat, ticks, fsOps, 0);
+    libraryFree(&lib);
+}
+
+// Everything main() waits for before the first frame, with the index that
+// benchScan() saved: index load, journal and state check, first listing
+static void benchStartup(int n) {
+    char dir[BENCH_PATH_LEN];
+    snprintf(dir, sizeof(dir), "sdmc:/MOFLEX/scan%d", n);
+
+    u64 ticks = 0, fsOps = 0;
+    Timer timer;
+    for (int r = 0; r < repeat; r++) {
+        LibraryIndex lib;
+        AppState state;
+        DirectoryList list;
+        libraryInit(&lib, "sdmc:/MOFLEX/");
+        stateInit(&state);
+        initDirectoryList(&list, &lib, &state, 21);
+
+        timerStart(&timer);
+        libraryLoad(&lib, "sdmc:/.clownsec_files");
+        recoverJournal();
+        loadState(&state);
+        loadDirectory(&list, dir);
+        ticks += timerStop(&timer, &fsOps);
+
+        freeDirectoryList(&list);
+        stateFree(&state);
+        libraryFree(&lib);
+    }
+    report("startup.critical", n, repeat, ticks, fsOps, 0);
+}
+
+// Getting back to a collection launched before: the browser's way, index
+// and top listing first, then a refresh of the folder and the confirm
+// screen's summary from a warm movie cache, against the hot list's single
+// fingerprint check
+static void benchRecents(int n) {
+    char dir[BENCH_PATH_LEN];
+    snprintf(dir, sizeof(dir), "sdmc:/MOFLEX/scan%d", n);
+
+    LibraryIndex lib;
+    RecentsList recents;
+    libraryInit(&lib, "sdmc:/MOFLEX/");
+    libraryLoad(&lib, "sdmc:/.clownsec_files");
+    int node = libraryRefresh(&lib, dir, NULL);
+    u32 fingerprint = lib.nodes[node].fingerprint;
+    recentsInit(&recents);
+    recentsRecord(&recents, dir, lib.nodes[node].moflexCount, -1, &fingerprint, fingerprint);
+    recentsSave(&recents, RECENTS_FILE);
+    libraryFree(&lib);
+
+    MetaCache cache;
+    MetaSummary summary;
+    metaInit(&cache);
+    metaCollect(&cache, dir, NULL, "sdmc:/", &summary);
+    metaSave(&cache, META_FILE);
+    metaFree(&cache);
+
+    u64 ticks = 0, fsOps = 0;
+    Timer timer;
+    for (int r = 0; r < repeat; r++) {
+        DirectoryList list;
+        libraryInit(&lib, "sdmc:/MOFLEX/");
+        initDirectoryList(&list, &lib, NULL, 21);
+        metaInit(&cache);
+
+        timerStart(&timer);
+        libraryLoad(&lib, "sdmc:/.clownsec_files");
+        loadDirectory(&list, "sdmc:/MOFLEX/");
+        libraryRefresh(&lib, dir, NULL);
+        metaLoad(&cache, META_FILE);
+        metaCollect(&cache, dir, NULL, "sdmc:/", &summary);
+        ticks += timerStop(&timer, &fsOps);
+
+        metaFree(&cache);
+        freeDirectoryList(&list);
+        libraryFree(&lib);
+    }
+    report("recents.browse", n, repeat, ticks, fsOps, 0);
+
+    ticks = fsOps = 0;
+    bool same = true;
+    for (int r = 0; r < repeat; r++) {
+        timerStart(&timer);
+        recentsLoad(&recents, RECENTS_FILE);
+        same = same && recents.count == 1 && recentsCheck(&recents.entries[0], false);
+        ticks += timerStop(&timer, &fsOps);
+    }
+    report("recents.relaunch", n, repeat, ticks, fsOps, 0);
+    if (!same) {
+        printf("  recents: fingerprint check failed on an unchanged folder\n");
+    }
+}
+
+static void benchLongNames(int n) {
+    char dir[BENCH_PATH_LEN];
+    snprintf(dir, sizeof(dir), "sdmc:/MOFLEX/long%d", n);
+    makeCollection(dir, n, 0, true, 0);
+
+    u64 ticks = 0, fsOps = 0;
+    Timer timer;
+    for (int r = 0; r < repeat; r++) {
+        LibraryIndex lib;
+        libraryInit(&lib, "sdmc:/MOFLEX/");
+        timerStart(&timer);
+        libraryRefresh(&lib, dir, NULL);
+        ticks += timerStop(&timer, &fsOps);
+        libraryFree(&lib);
+    }
+    report("library.refresh.longnames", n, repeat, ticks, fsOps, 0);
+}
+
+// Natural sort of a folder's children, from the cached keys
+static void benchSort(int n) {
+    LibraryIndex lib;
+    libraryInit(&lib, "sdmc:/MOFLEX/");
+
+    LibraryScan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.listed = true;
+    scan.fingerprint = 1;
+    size_t capacity = (size_t)n * 32;
+    scan.names = (char *)malloc(capacity);
+    for (int i = 0; i < n; i++) {
+        // Scrambled so the input isn't already in order
+        int len = snprintf(scan.names + scan.namesSize, 32, "Season %d Disc %d",
+                           (int)((i * 2654435761u) % (u32)n), i % 7);
+        scan.namesSize += len + 1;
+    }
+    libraryApply(&lib, "sdmc:/MOFLEX/", &scan, NULL);
+    libraryScanFree(&scan);
+
+    u64 ticks = 0, fsOps = 0;
+    Timer timer;
+    for (int r = 0; r < repeat; r++) {
+        // Reverse the list so every run does the same amount of work
+        s32 previous = -1;
+        s32 c = lib.nodes[0].firstChild;
+        while (c >= 0) {
+            s32 next = lib.nodes[c].nextSibling;
+            lib.nodes[c].nextSibling = previous;
+            previous = c;
+            c = next;
+        }
+        lib.nodes[0].firstChild = previous;
+        lib.nodes[0].flags &= ~LIBRARY_NODE_SORTED;
+
+        timerStart(&timer);
+        librarySortChildren(&lib, 0);
+        ticks += timerStop(&timer, &fsOps);
+    }
+    report("sort.natural", n, repeat, ticks, fsOps, 0);
+    libraryFree(&lib);
+}
+
+static void benchDeep(void) {
+    char path[BENCH_PATH_LEN] = "sdmc:/MOFLEX/deep";
+    makeDir(path);
+    for (int i = 0; i < DEEP_LEVELS; i++) {
+        size_t len = strlen(path);
+        snprintf(path + len, sizeof(path) - len, "/d%02d", i);
+        makeDir(path);
+    }
+
+    LibraryIndex lib;
+    libraryInit(&lib, "sdmc:/MOFLEX/");
+    u64 ticks = 0, fsOps = 0;
+    Timer timer;
+
+    char level[BENCH_PATH_LEN] = "sdmc:/MOFLEX/deep";
+    timerStart(&timer);
+    for (int i = 0; i <= DEEP_LEVELS; i++) {
+        libraryRefresh(&lib, level, NULL);
+        size_t len = strlen(level);
+        snprintf(level + len, sizeof(level) - len, "/d%02d", i);
+    }
+    ticks = timerStop(&timer, &fsOps);
+    report("library.refresh.deep", DEEP_LEVELS + 1, 1, ticks, fsOps, 0);
+
+    ticks = fsOps = 0;
+    const int lookups = 1000;
+    timerStart(&timer);
+    for (int i = 0; i < lookups; i++) {
+        libraryFind(&lib, path);
+    }
+    ticks = timerStop(&timer, &fsOps);
+    report("library.find.deep", lookups, 1, ticks, fsOps, 0);
+    libraryFree(&lib);
+}
+
+// Library-wide search: the background walk over n files in collections of
+// 100, a second walk over the saved index, and queries typed a key at a time
+static void benchSearch(int n) {
+    static const char *const shows[] = {"Alpha", "Bravo", "Charlie", "Delta", "Echo", "Foxtrot"};
+    char base[BENCH_PATH_LEN];
+    char path[BENCH_PATH_LEN * 2];
+    snprintf(base, sizeof(base), "sdmc:/MOFLEX/search%d/", n);
+    makeDir(base);
+
+    for (int c = 0; c * 100 < n; c++) {
+        snprintf(path, sizeof(path), "%s%s Season %d", base, shows[c % 6], c);
+        makeDir(path);
+        for (int i = 0; i < 100 && c * 100 + i < n; i++) {
+            snprintf(path, sizeof(path), "%s%s Season %d/%s S%02dE%02d Part %d.moflex", base,
+                     shows[c % 6], c, shows[c % 6], c, i, i % 7);
+            makeFile(path, i);
+        }
+    }
+
+    u64 ticks = 0, fsOps = 0;
+    Timer timer;
+    SearchIndex index;
+    searchInit(&index, base);
+    remove(SEARCH_FILE);
+
+    // Cold walk, and then one that finds every folder unchanged
+    const char *labels[] = {"search.build", "search.rewalk"};
+    for (int pass = 0; pass < 2; pass++) {
+        SearchIndexer indexer;
+        ticks = fsOps = 0;
+        timerStart(&timer);
+        searchIndexerStart(&indexer, &index, SEARCH_FILE, false, NULL);
+        while (!indexer.done) {
+            svcSleepThread(1000000LL);
+        }
+        ticks = timerStop(&timer, &fsOps);
+        searchIndexerStop(&indexer);
+
+        u64 bytes = (u64)index.table.folderCapacity * sizeof(IndexFolder) +
+                    (u64)index.itemCapacity * (sizeof(SearchItem) + sizeof(u32)) +
+                    (u64)(index.wordCapacity + index.tailCapacity) * sizeof(SearchWord) +
+                    index.table.stringCapacity;
+        report(labels[pass], n, 1, ticks, fsOps, bytes);
+    }
+
+    // Every prefix of each query, as typed
+    static const char *const queries[] = {"charlie s03e4", "part 6", "season 1", "echo", "zulu"};
+    int lookups = 0;
+    int found = 0;
+    SearchResult *results = (SearchResult *)malloc(sizeof(SearchResult) * 64);
+    ticks = fsOps = 0;
+    for (int r = 0; r < repeat; r++) {
+        for (int q = 0; q < 5; q++) {
+            char typed[SEARCH_QUERY_LEN];
+            for (size_t len = 1; len <= strlen(queries[q]); len++) {
+                snprintf(typed, sizeof(typed), "%.*s", (int)len, queries[q]);
+                timerStart(&timer);
+                found += searchQuery(&index, typed, results, 64);
+                ticks += timerStop(&timer, &fsOps);
+                lookups++;
+            }
+        }
+    }
+    free(results);
+    report("search.query", lookups / repeat, repeat, ticks, fsOps, (u64)found / repeat);
+
+    ticks = fsOps = 0;
+    for (int r = 0; r < repeat; r++) {
+        timerStart(&timer);
+        searchSave(&index, SEARCH_FILE);
+        searchLoad(&index, SEARCH_FILE);
+        ticks += timerStop(&timer, &fsOps);
+    }
+    report("search.save+load", searchItemCount(&index), repeat, ticks, fsOps, 0);
+    searchFree(&index);
+}
+
+static void benchMoflex(int n) {
+    u64 ticks = 0, fsOps = 0;
+    Timer timer;
+
+    // Parsing alone, both ends of an in-memory file
+    u8 head[MOFLEX_READ_SIZE];
+    u8 tail[MOFLEX_READ_SIZE];
+    memset(head, 0, sizeof(head));
+    memset(tail, 0, sizeof(tail));
+    moflexBlock(head, 0, false);
+    moflexBlock(tail + sizeof(tail) - 1000, 1320 * MOFLEX_TICKS_PER_SECOND, false);
+    int parsed = 0;
+    timerStart(&timer);
+    for (int r = 0; r < repeat; r++) {
+        for (int i = 0; i < n; i++) {
+            MoflexInfo info;
+            u64 first, last;
+            parsed += moflexParseHead(head, sizeof(head), &info, &first) &&
+                      moflexParseTail(tail, sizeof(tail), &last) && info.width == 400;
+        }
+    }
+    ticks = timerStop(&timer, &fsOps);
+    report("moflex.parse", n, repeat, ticks, fsOps, 0);
+    reportRate("moflex.parse", n * repeat, ticks);
+    if (parsed != n * repeat) {
+        printf("moflex.parse: %d of %d headers parsed\n", parsed, n * repeat);
+    }
+
+    // A collection of n files of 1 GB each, probed cold and then from the cache
+    char dir[BENCH_PATH_LEN];
+    char path[BENCH_PATH_LEN * 2];
+    snprintf(dir, sizeof(dir), "sdmc:/MOFLEX/meta%d", n);
+    makeDir(dir);
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/Episode %d.moflex", dir, i);
+        makeMoflex(path, 1ULL << 30, 1320 + i % 60, i % 2);
+    }
+
+    MetaCache cache;
+    MetaSummary summary;
+    metaInit(&cache);
+    const char *labels[] = {"meta.collect (cold)", "meta.collect (cached)"};
+    for (int pass = 0; pass < 2; pass++) {
+        ticks = fsOps = 0;
+        timerStart(&timer);
+        metaCollect(&cache, dir, NULL, "sdmc:/", &summary);
+        ticks = timerStop(&timer, &fsOps);
+        report(labels[pass], summary.files, 1, ticks, fsOps, (u64)summary.probed);
+        reportRate(labels[pass], summary.files, ticks);
+    }
+    if (summary.known != n || summary.timed != n) {
+        printf("meta.collect: %d of %d headers parsed\n", summary.known, n);
+    }
+
+    ticks = fsOps = 0;
+    for (int r = 0; r < repeat; r++) {
+        timerStart(&timer);
+        metaSave(&cache, META_FILE);
+        metaLoad(&cache, META_FILE);
+        ticks += timerStop(&timer, &fsOps);
+    }
+    report("meta.save+load", cache.entryCount, repeat, ticks, fsOps, 0);
+    metaFree(&cache);
+}
+
+// A movie stream of VERIFY_BLOCK-sized blocks with rising timestamps and
+// noise in between, written out in full so every byte has to be read back
+#define VERIFY_BLOCK (32 * 1024)
+
+static void makeStream(const char *path, int blocks, u32 seed) {
+    static u8 block[VERIFY_BLOCK];
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return;
+    }
+    for (int b = 0; b < blocks; b++) {
+        for (int i = 64; i < VERIFY_BLOCK; i += 4) {
+            seed = seed * 1664525u + 1013904223u;
+            memcpy(block + i, &seed, 4);
+        }
+        moflexBlock(block, (u64)b * MOFLEX_TICKS_PER_SECOND / 2, false);
+        block[12] = (VERIFY_BLOCK - 1) >> 8;
+        block[13] = (VERIFY_BLOCK - 1) & 0xFF;
+        fwrite(block, 1, sizeof(block), f);
+    }
+    fclose(f);
+}
+
+// Blocks of the given sizes (at most 65536 bytes each) with rising
+// timestamps, each starting with moflexBlock()'s header. Returns the bytes
+// written to out.
+static u32 makeBlocks(u8 *out, const u32 *sizes, int count) {
+    u32 pos = 0;
+    u32 seed = 1;
+    for (int b = 0; b < count; b++) {
+        for (u32 i = 64; i < sizes[b]; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            out[pos + i] = (u8)(seed >> 24);
+        }
+        u8 header[64];
+        moflexBlock(header, (u64)b * MOFLEX_TICKS_PER_SECOND, false);
+        header[12] = (u8)((sizes[b] - 1) >> 8);
+        header[13] = (u8)((sizes[b] - 1) & 0xFF);
+        memcpy(out + pos, header, sizes[b] < 64 ? sizes[b] : 64);
+        pos += sizes[b];
+    }
+    return pos;
+}
+
+// Feeds size bytes to the checker in pieces of piece bytes, each in its own
+// allocation so a read outside the piece shows up under a sanitizer
+static MoflexVerdict checkPieces(const u8 *data, u32 size, u64 fileSize, u32 piece) {
+    MoflexCheck check;
+    moflexCheckInit(&check, fileSize);
+    for (u32 pos = 0; pos < size; pos += piece) {
+        u32 length = size - pos < piece ? size - pos : piece;
+        u8 *copy = (u8 *)malloc(length);
+        memcpy(copy, data + pos, length);
+        moflexCheckFeed(&check, copy, length);
+        free(copy);
+    }
+    return moflexCheckFinish(&check);
+}
+
+// The whole-file checker on streams built in memory: block headers split
+// across pieces, blocks shorter than the header gathered for them, a cut
+// tail and padding after the last block
+static void benchCheck(void) {
+    static const u32 straddled[] = {65536, 65499, 65536, 65536};
+    static const u32 tiny[] = {65536, 65476, 48, 65536};    // valid, under 128 bytes
+    static const u32 broken[] = {65536, 65499, 20, 65536};  // ends inside its header
+    static const u32 steady[] = {32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768};
+    static const u32 pieces[] = {100, 4096, 65536};
+
+    u8 *data = (u8 *)malloc(8 * 65536 + 2 * MOFLEX_READ_ALIGN);
+    if (!data) {
+        return;
+    }
+    struct {
+        const char *name;
+        const u32 *sizes;
+        int count;
+        u32 cut;   // bytes dropped from the end
+        u32 extra; // zero bytes after the last block
+        MoflexVerdict expected;
+    } cases[] = {
+        {"straddled", straddled, 4, 0, 0, MOFLEX_OK},
+        {"short block", tiny, 4, 0, 0, MOFLEX_OK},
+        {"block inside its header", broken, 4, 0, 0, MOFLEX_BAD_SYNC},
+        {"cut tail", steady, 8, 1000, 0, MOFLEX_TRUNCATED},
+        {"padding", steady, 8, 0, 1000, MOFLEX_OK},
+        {"too much padding", steady, 8, 0, MOFLEX_READ_ALIGN + 1000, MOFLEX_BAD_SYNC},
+    };
+
+    int failed = 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        u32 size = makeBlocks(data, cases[c].sizes, cases[c].count) - cases[c].cut;
+        memset(data + size, 0, cases[c].extra);
+        size += cases[c].extra;
+        for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++) {
+            MoflexVerdict verdict = checkPieces(data, size, size, pieces[p]);
+            if (verdict != cases[c].expected) {
+                printf("moflex.check: %s in %lu-byte pieces is \"%s\", expected \"%s\"\n", cases[c].name,
+                       (unsigned long)pieces[p], moflexVerdictText(verdict),
+                       moflexVerdictText(cases[c].expected));
+                failed++;
+            }
+        }
+    }
+
+    // Throughput with the verifier's read size, no IO involved
+    u32 size = makeBlocks(data, steady, 8);
+    Timer timer;
+    u64 fsOps = 0;
+    timerStart(&timer);
+    for (int r = 0; r < 256; r++) {
+        MoflexCheck check;
+        moflexCheckInit(&check, size);
+        moflexCheckFeed(&check, data, size);
+        moflexCheckFinish(&check);
+    }
+    u64 ticks = timerStop(&timer, &fsOps);
+    report("moflex.check", 256, 1, ticks, fsOps, (u64)size * 256);
+    if (failed == 0) {
+        printf("%-30s %8d cases ok\n", "moflex.check", (int)(sizeof(cases) / sizeof(cases[0])));
+    }
+    free(data);
+}
+
+static void benchVerify(void) {
+    const int files = 16;
+    const int blocks = 256; // 8 MB per file
+    char dir[BENCH_PATH_LEN] = "sdmc:/MOFLEX/verify";
+    char path[BENCH_PATH_LEN * 2];
+    makeDir(dir);
+    for (int i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "%s/Episode %d.moflex", dir, i);
+        makeStream(path, blocks, (u32)i);
+    }
+
+    // Two damaged ones: cut short in the middle of a block, and a sync
+    // header overwritten half way in
+    snprintf(path, sizeof(path), "%s/Episode 0.moflex", dir);
+    if (truncate(path, (off_t)blocks / 2 * VERIFY_BLOCK + 1000) != 0) {
+        perror(path);
+    }
+    snprintf(path, sizeof(path), "%s/Episode 1.moflex", dir);
+    FILE *f = fopen(path, "r+b");
+    if (f) {
+        fseeko(f, (off_t)blocks / 2 * VERIFY_BLOCK, SEEK_SET);
+        fwrite("junk", 1, 4, f);
+        fclose(f);
+    }
+
+    MetaCache cache;
+    MetaSummary summary;
+    metaInit(&cache);
+    metaCollect(&cache, dir, NULL, "sdmc:/", &summary);
+
+    LightEvent done;
+    LightEvent_Init(&done, RESET_ONESHOT);
+    Verifier verifier;
+    if (!verifierStart(&verifier, &cache, &done)) {
+        printf("verify: could not start the verifier\n");
+        metaFree(&cache);
+        return;
+    }
+
+    u64 fsOps = 0;
+    Timer timer;
+    timerStart(&timer);
+    int queued = verifierRequest(&verifier, dir, NULL, "sdmc:/");
+    while (verifierCompleted(&verifier) < (u32)queued) {
+        LightEvent_Wait(&done);
+    }
+    u64 ticks = timerStop(&timer, &fsOps);
+    u64 bytes = verifier.bytes;
+    report("verify (cold)", queued, 1, ticks, fsOps, bytes);
+    double seconds = ticksToUs(ticks) / 1000000.0;
+    printf("%-30s %8d %12.1f MB/s\n", "verify (cold)", queued, seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+
+    // Nothing changed, so nothing is read again
+    int requeued = verifierRequest(&verifier, dir, NULL, "sdmc:/");
+    verifierStop(&verifier);
+
+    metaSummarize(&cache, dir, &summary);
+    if (summary.verified != files || summary.bad != 2 || requeued != 0) {
+        printf("verify: %d of %d checked, %d damaged (expected 2), %d queued again\n",
+               summary.verified, files, summary.bad, requeued);
+    }
+    metaFree(&cache);
+}
+
+// A sparse file with a seed written at the start, the middle and the end,
+// and optionally one more byte somewhere no sample reaches
+static void makeMarked(const char *path, u64 size, u32 seed, u64 extra) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return;
+    }
+    const u64 offsets[] = {0, size / 2, size - sizeof(seed)};
+    for (int i = 0; i < 3; i++) {
+        fseeko(f, (off_t)offsets[i], SEEK_SET);
+        fwrite(&seed, sizeof(seed), 1, f);
+    }
+    if (extra) {
+        fseeko(f, (off_t)extra, SEEK_SET);
+        fputc(1, f);
+    }
+    fclose(f);
+    if (truncate(path, (off_t)size) != 0) {
+        perror(path);
+    }
+}
+
+static bool dupesPass(DupeFinder *finder, LightEvent *done, const char *label, int files) {
+    u64 fsOps = 0;
+    Timer timer;
+    timerStart(&timer);
+    dupesFinderRun(finder);
+    do {
+        LightEvent_Wait(done);
+    } while (dupesFinderPhase(finder) != DUPES_DONE || finder->run);
+    u64 ticks = timerStop(&timer, &fsOps);
+    report(label, files, 1, ticks, fsOps, finder->bytes);
+    reportRate(label, files, ticks);
+    return true;
+}
+
+// n files of distinct sizes in folders of 20. Every tenth file has a copy in
+// the next folder; a few more share a size with a file but differ in a
+// sampled region, or only somewhere in between.
+static void benchDupes(int n) {
+    char dir[BENCH_PATH_LEN];
+    char path[BENCH_PATH_LEN * 2];
+    snprintf(dir, sizeof(dir), "sdmc:/MOFLEX/dupes%d", n);
+    makeDir(dir);
+    u64 total = 0;
+    int copies = 0;
+    for (int i = 0; i < n; i++) {
+        if (i % 20 == 0) {
+            snprintf(path, sizeof(path), "%s/Show %d", dir, i / 20);
+            makeDir(path);
+        }
+        snprintf(path, sizeof(path), "%s/Show %d/Episode %d.moflex", dir, i / 20, i);
+        int original = i;
+        u32 seed = (u32)i;
+        u64 extra = 0;
+        if (i % 10 == 5) {
+            original = i - 5;
+            seed = (u32)original;
+            copies++;
+        } else if (i % 50 == 7) {
+            original = i - 7;
+        } else if (i % 50 == 9) {
+            original = i - 9;
+            seed = (u32)original;
+            extra = 100000 + (u64)i; // a single byte no sample covers
+        }
+        u64 size = 256 * 1024 + (u64)original * 64;
+        makeMarked(path, size, seed, extra);
+        total += size;
+    }
+
+    // Rooted at the tree, so the other benchmarks' files don't count
+    char base[BENCH_PATH_LEN + 1];
+    snprintf(base, sizeof(base), "%s/", dir);
+    DupeIndex index;
+    dupesInit(&index, base);
+    remove(DUPES_FILE);
+    LightEvent done;
+    LightEvent_Init(&done, RESET_ONESHOT);
+    DupeFinder finder;
+    if (!dupesFinderStart(&finder, &index, DUPES_FILE, "sdmc:/", &done)) {
+        printf("dupes: could not start the finder\n");
+        dupesFree(&index);
+        return;
+    }
+
+    dupesPass(&finder, &done, "dupes.pass (cold)", n);
+    int identical = 0;
+    for (int g = 0; g < index.groupCount; g++) {
+        identical += (index.groups[g].flags & DUPE_GROUP_IDENTICAL) != 0;
+    }
+    printf("%-30s %8d %12.1f MB read of %.1f MB (files hashed in full)\n", "dupes.pass (cold)", (int)finder.hashed,
+           (double)finder.bytes / 1e6, (double)total / 1e6);
+
+    dupesFinderStop(&finder);
+    dupesFree(&index);
+    dupesInit(&index, base);
+    dupesLoad(&index, DUPES_FILE);
+    dupesFinderStart(&finder, &index, DUPES_FILE, "sdmc:/", &done);
+    dupesPass(&finder, &done, "dupes.pass (cached)", n);
+    dupesFinderStop(&finder);
+
+    int identicalAgain = 0;
+    for (int g = 0; g < index.groupCount; g++) {
+        identicalAgain += (index.groups[g].flags & DUPE_GROUP_IDENTICAL) != 0;
+    }
+    if (identical != copies || identicalAgain != copies) {
+        printf("dupes: %d and %d identical groups, expected %d\n", identical, identicalAgain, copies);
+    }
+    dupesFree(&index);
+}
+
+static void benchMoves(int n) {
+    char source[BENCH_PATH_LEN];
+    char other[BENCH_PATH_LEN];
+    snprintf(source, sizeof(source), "sdmc:/MOFLEX/move%d", n);
+    snprintf(other, sizeof(other), "sdmc:/MOFLEX/swap%d", n);
+    makeCollection(source, n, 0, false, 0);
+
+    // Same names, half of them identical files, for the swap
+    makeDir(other);
+    char path[BENCH_PATH_LEN * 2];
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/Episode %d.moflex", other, i);
+        makeFile(path, i % 2 ? (u32)i : 0x80000000u + i);
+    }
+
+    u64 ticks = 0, fsOps = 0;
+    Timer timer;
+    MoveStats stats;
+    AppState state;
+
+    stateInit(&state);
+    snprintf(state.sourceDir, STATE_PATH_LEN, "%s", source);
+    timerStart(&timer);
+    moveCollection(source, "sdmc:/", NULL, &state, &stats, NULL);
+    ticks = timerStop(&timer, &fsOps);
+    report("mover.collection", stats.moved, 1, ticks, fsOps, 0);
+
+    ticks = fsOps = 0;
+    timerStart(&timer);
+    saveState(&state);
+    ticks += timerStop(&timer, &fsOps);
+    report("state.save", state.fileCount, 1, ticks, fsOps, 0);
+
+    AppState loaded;
+    stateInit(&loaded);
+    ticks = fsOps = 0;
+    timerStart(&timer);
+    loadState(&loaded);
+    ticks += timerStop(&timer, &fsOps);
+    report("state.load", loaded.fileCount, 1, ticks, fsOps, 0);
+    stateFree(&loaded);
+
+    ticks = fsOps = 0;
+    timerStart(&timer);
+    swapCollection(&state, other, NULL, "sdmc:/", &stats, NULL);
+    ticks = timerStop(&timer, &fsOps);
+    report("mover.swap", stats.moved, 1, ticks, fsOps, 0);
+
+    ticks = fsOps = 0;
+    timerStart(&timer);
+    restoreCollection(&state, "sdmc:/", &stats, NULL);
+    ticks = timerStop(&timer, &fsOps);
+    report("mover.restore", stats.moved, 1, ticks, fsOps, 0);
+    stateFree(&state);
+}
+
+// The files of one volume as a move selection; names holds their text
+static void volumeSelection(MetaCache *cache, const char *path, int volume, MoveSelection *selection,
+                            const char **list, char *names, size_t size) {
+    MetaVolume info;
+    metaVolume(cache, path, volume, &info, names, size);
+    for (int i = 0; i < info.files; i++) {
+        list[i] = names;
+        names += strlen(names) + 1;
+    }
+    selection->names = list;
+    selection->count = info.files;
+    moveSelectionSort(selection);
+}
+
+// A collection two and a half volumes long: the first volume goes to root,
+// then each switch should rename just the outgoing and incoming volumes
+static void benchVolumes(void) {
+    const int files = MOFLEX_LIMIT * 2 + MOFLEX_LIMIT / 2;
+    const char *source = "sdmc:/MOFLEX/volumes";
+    makeCollection(source, files, 0, false, 0);
+
+    static char names[MOFLEX_LIMIT * META_NAME_LEN];
+    static const char *list[MOFLEX_LIMIT];
+    MoveSelection selection;
+    MetaCache cache;
+    MetaSummary summary;
+    AppState state;
+    MoveStats stats;
+    Timer timer;
+    u64 ticks, fsOps = 0;
+    metaInit(&cache);
+    stateInit(&state);
+    snprintf(state.sourceDir, STATE_PATH_LEN, "%s", source);
+
+    timerStart(&timer);
+    metaCollect(&cache, source, &state, "sdmc:/", &summary);
+    ticks = timerStop(&timer, &fsOps);
+    report("meta.volumes", files, 1, ticks, fsOps, 0);
+
+    volumeSelection(&cache, source, 0, &selection, list, names, sizeof(names));
+    fsOps = 0;
+    timerStart(&timer);
+    moveCollection(source, "sdmc:/", &selection, &state, &stats, NULL);
+    ticks = timerStop(&timer, &fsOps);
+    report("mover.volume", stats.moved, 1, ticks, fsOps, 0);
+
+    int moved[2];
+    for (int volume = 1; volume < 3; volume++) {
+        volumeSelection(&cache, source, volume, &selection, list, names, sizeof(names));
+        fsOps = 0;
+        timerStart(&timer);
+        swapCollection(&state, source, &selection, "sdmc:/", &stats, NULL);
+        ticks = timerStop(&timer, &fsOps);
+        report("mover.volume.switch", stats.moved, 1, ticks, fsOps, 0);
+        moved[volume - 1] = stats.moved;
+    }
+
+    // The plan survives the files moving around
+    metaCollect(&cache, source, &state, "sdmc:/", &summary);
+    int inRoot = metaVolumeOf(&cache, source, stateFileName(&state, 0));
+    if (summary.volumes != 3 || moved[0] != MOFLEX_LIMIT * 2 || moved[1] != MOFLEX_LIMIT + MOFLEX_LIMIT / 2 ||
+        state.fileCount != MOFLEX_LIMIT / 2 || inRoot != 2) {
+        printf("volumes: %d volumes, switches moved %d and %d, %d files of volume %d in root\n",
+               summary.volumes, moved[0], moved[1], state.fileCount, inRoot + 1);
+    }
+
+    restoreCollection(&state, "sdmc:/", &stats, NULL);
+    stateFree(&state);
+    metaFree(&cache);
+}
+
+// A w x h test card: gradients with a checker pattern, so neither codec
+// gets an easy ride
+static u8 *makePicture(int w, int h, u32 seed) {
+    u8 *rgb = (u8 *)malloc((size_t)w * h * 3);
+    for (int y = 0; rgb && y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            u8 *p = rgb + ((size_t)y * w + x) * 3;
+            bool checker = ((x / 37) + (y / 29) + seed) & 1;
+            p[0] = (u8)(x * 255 / w);
+            p[1] = (u8)(y * 255 / h);
+            p[2] = checker ? 0xE0 : (u8)(seed * 40);
+        }
+    }
+    return rgb;
+}
+
+static void makePng(const char *path, int w, int h, u32 seed, bool interlaced) {
+    u8 *rgb = makePicture(w, h, seed);
+    FILE *f = fopen(path, "wb");
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (rgb && f && info && !setjmp(png_jmpbuf(png))) {
+        png_init_io(png, f);
+        png_set_IHDR(png, info, w, h, 8, PNG_COLOR_TYPE_RGB,
+                     interlaced ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                     PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png, info);
+        int passes = png_set_interlace_handling(png);
+        for (int pass = 0; pass < passes; pass++) {
+            for (int y = 0; y < h; y++) {
+                png_write_row(png, rgb + (size_t)y * w * 3);
+            }
+        }
+        png_write_end(png, NULL);
+    }
+    if (png) {
+        png_destroy_write_struct(&png, info ? &info : NULL);
+    }
+    if (f) {
+        fclose(f);
+    }
+    free(rgb);
+}
+
+static void makeJpeg(const char *path, int w, int h, u32 seed) {
+    u8 *rgb = makePicture(w, h, seed);
+    FILE *f = fopen(path, "wb");
+    if (rgb && f) {
+        struct jpeg_compress_struct info;
+        struct jpeg_error_mgr error;
+        info.err = jpeg_std_error(&error);
+        jpeg_create_compress(&info);
+        jpeg_stdio_dest(&info, f);
+        info.image_width = w;
+        info.image_height = h;
+        info.input_components = 3;
+        info.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&info);
+        jpeg_set_quality(&info, 85, TRUE);
+        jpeg_start_compress(&info, TRUE);
+        while (info.next_scanline < info.image_height) {
+            JSAMPROW row = rgb + (size_t)info.next_scanline * w * 3;
+            jpeg_write_scanlines(&info, &row, 1);
+        }
+        jpeg_finish_compress(&info);
+        jpeg_destroy_compress(&info);
+    }
+    if (f) {
+        fclose(f);
+    }
+    free(rgb);
+}
+
+static u8 *readWhole(const char *path, u32 *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = (u32)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    u8 *data = (u8 *)malloc(*size);
+    if (data && fread(data, 1, *size, f) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+static void timeDecode(const char *label, const char *path) {
+    static u16 tile[COVER_SIZE * COVER_SIZE];
+    u32 size = 0;
+    u8 *data = readWhole(path, &size);
+    if (!data) {
+        return;
+    }
+    u16 width = 0, height = 0;
+    bool ok = true;
+    u64 fsOps = 0;
+    Timer timer;
+    timerStart(&timer);
+    for (int r = 0; r < repeat; r++) {
+        ok = coverDecode(data, size, tile, &width, &height) && ok;
+    }
+    u64 ticks = timerStop(&timer, &fsOps);
+    report(label, 1, repeat, ticks, fsOps, size);
+    if (!ok) {
+        printf("%s: could not decode %s\n", label, path);
+    }
+    free(data);
+}
+
+// Scrolls through the folders one by one, asking for each with its
+// neighbours like the browser, and waits for each highlighted cover
+static u64 browseCovers(CoverCache *cache, LightEvent *done, char (*folders)[BENCH_PATH_LEN], int count,
+                        u64 *fsOps) {
+    Timer timer;
+    timerStart(&timer);
+    for (int i = 0; i < count; i++) {
+        const char *wanted[COVER_WANTED] = {folders[i], i + 1 < count ? folders[i + 1] : NULL,
+                                            i > 0 ? folders[i - 1] : NULL};
+        coverRequest(cache, wanted, COVER_WANTED);
+        for (;;) {
+            coverLock(cache);
+            bool found = coverFind(cache, folders[i]) != NULL;
+            coverUnlock(cache);
+            if (found) {
+                break;
+            }
+            LightEvent_Wait(done);
+        }
+    }
+    return timerStop(&timer, fsOps);
+}
+
+// The scanner counting a screenful of folders after another, with the job
+// pool at each size: 0 is the old single thread, 1 an Old 3DS (system
+// core), 3 a New 3DS (cores 1 to 3). Run once with FS requests overlapping
+// and once with the card serving one request at a time.
+static void benchJobs(void) {
+    const int folders = 210;
+    static char names[210][16];
+    static const char *list[210];
+    char path[BENCH_PATH_LEN];
+    const char *dir = "sdmc:/MOFLEX/jobs";
+    makeDir(dir);
+    for (int i = 0; i < folders; i++) {
+        snprintf(names[i], sizeof(names[i]), "Show %d", i);
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        makeCollection(path, 12, 2, false, (u32)i * 100);
+        list[i] = names[i];
+    }
+    char base[BENCH_PATH_LEN + 1];
+    snprintf(base, sizeof(base), "%s/", dir);
+
+    LightEvent done;
+    LightEvent_Init(&done, RESET_ONESHOT);
+    for (int serial = 0; serial < 2; serial++) {
+        hostFsSerial = serial;
+        for (int workers = 0; workers <= JOBS_MAX_WORKERS; workers++) {
+            JobPool pool;
+            jobPoolStart(&pool, workers, 0x3F);
+            LibraryIndex lib;
+            libraryInit(&lib, "sdmc:/MOFLEX/");
+            Scanner scanner;
+            scannerStart(&scanner, &lib, &pool, &done);
+
+            u64 fsOps = 0;
+            Timer timer;
+            timerStart(&timer);
+            scannerRequest(&scanner, base, list, folders);
+            while (scannerCompleted(&scanner) < (u32)folders) {
+                LightEvent_Wait(&done);
+            }
+            u64 ticks = timerStop(&timer, &fsOps);
+
+            scannerStop(&scanner);
+            u32 ran = 0, stolen = 0;
+            for (int i = 0; i < pool.workerCount; i++) {
+                ran += pool.workers[i].ran;
+                stolen += pool.workers[i].stolen;
+            }
+            jobPoolStop(&pool);
+            int counted = 0;
+            for (int i = 0; i < folders; i++) {
+                snprintf(path, sizeof(path), "%s/Show %d", dir, i);
+                int node = libraryFind(&lib, path);
+                counted += node >= 0 && lib.nodes[node].moflexCount == 12;
+            }
+            libraryFree(&lib);
+
+            char label[64];
+            snprintf(label, sizeof(label), "scan.jobs %d worker%s%s", workers, workers == 1 ? "" : "s",
+                     serial ? " 1card" : "");
+            report(label, folders, 1, ticks, fsOps, 0);
+            printf("%-30s %8d %12.0f folders/s, %u of them on workers, %u stolen\n", label, folders,
+                   ticks ? folders * (double)SYSCLOCK_ARM11 / ticks : 0.0, ran, stolen);
+            if (counted != folders) {
+                printf("jobs: %d of %d folders counted right\n", counted, folders);
+            }
+        }
+    }
+    hostFsSerial = false;
+}
+
+// Folders with large JPEG and PNG covers (one interlaced), one without a
+// cover and one with a damaged file, browsed cold and then again in a new
+// session that reads every tile from the pack
+static void benchCovers(void) {
+    const int count = 24;
+    static char folders[24][BENCH_PATH_LEN];
+    char path[BENCH_PATH_LEN * 2];
+    const char *dir = "sdmc:/MOFLEX/covers";
+    makeDir(dir);
+    int covers = 0;
+    for (int i = 0; i < count; i++) {
+        snprintf(folders[i], BENCH_PATH_LEN, "%s/Show %d", dir, i);
+        makeDir(folders[i]);
+        if (i == 5) {
+            continue; // no cover
+        }
+        if (i == 9) {
+            snprintf(path, sizeof(path), "%s/Show %d/cover.jpg", dir, i);
+            makeFile(path, 0xD8FF); // not a JPEG after all
+            continue;
+        }
+        if (i % 3 == 0) {
+            snprintf(path, sizeof(path), "%s/Show %d/cover.png", dir, i);
+            makePng(path, 800, 800, (u32)i, i == 3);
+        } else {
+            snprintf(path, sizeof(path), "%s/Show %d/cover.jpg", dir, i);
+            makeJpeg(path, 1200, 1600, (u32)i);
+        }
+        covers++;
+    }
+
+    snprintf(path, sizeof(path), "%s/Show 1/cover.jpg", dir);
+    timeDecode("cover.decode.jpeg", path);
+    snprintf(path, sizeof(path), "%s/Show 0/cover.png", dir);
+    timeDecode("cover.decode.png", path);
+    snprintf(path, sizeof(path), "%s/Show 3/cover.png", dir);
+    timeDecode("cover.decode.png.interlaced", path);
+
+    remove(COVER_FILE);
+    LightEvent done;
+    LightEvent_Init(&done, RESET_ONESHOT);
+    CoverCache cache;
+    if (!coverStart(&cache, COVER_FILE, &done)) {
+        printf("covers: could not start the cache\n");
+        return;
+    }
+    u64 fsOps = 0;
+    u64 ticks = browseCovers(&cache, &done, folders, count, &fsOps);
+    report("cover.browse (cold)", count, 1, ticks, fsOps, 0);
+    u32 decoded = cache.decoded;
+    coverStop(&cache);
+
+    coverStart(&cache, COVER_FILE, &done);
+    fsOps = 0;
+    ticks = browseCovers(&cache, &done, folders, count, &fsOps);
+    report("cover.browse (pack)", count, 1, ticks, fsOps, 0);
+
+    // The last folder kept its tile, at the portrait cover's shape
+    int ready = 0;
+    coverLock(&cache);
+    const CoverSlot *last = coverFind(&cache, folders[count - 1]);
+    for (int i = 0; i < COVER_SLOTS; i++) {
+        ready += cache.slots[i].state == COVER_READY;
+    }
+    bool lastReady = last && last->state == COVER_READY && last->width == COVER_SIZE * 3 / 4 &&
+                     last->height == COVER_SIZE;
+    coverUnlock(&cache);
+    u32 packed = cache.packed;
+    u32 redecoded = cache.decoded;
+    coverStop(&cache);
+
+    struct stat st;
+    u64 packBytes = stat(COVER_FILE, &st) == 0 ? (u64)st.st_size : 0;
+    printf("%-30s %8d %12.1f KB pack, %d tiles cached\n", "cover.pack", covers, packBytes / 1024.0, ready);
+    if (decoded != (u32)covers + 1 || packed != (u32)covers || redecoded != 0 || !lastReady) {
+        printf("covers: decoded %u then %u (expected %d then 0), %u from the pack, last %s\n", decoded,
+               redecoded, covers + 1, packed, lastReady ? "ready" : "wrong");
+    }
+}
+
+static void usage(const char *argv0) {
+    printf("usage: %s [-d workdir] [-n maxfiles] [-l latency_us] [-r repeat] [-k] [-t trace.json]\n", argv0);
+    printf("  -d  where to build the synthetic card (default /dev/shm, else /tmp)\n");
+    printf("  -n  largest tree size, 10 to 100000 (default %d)\n", maxFiles);
+    printf("  -l  delay per simulated FS request in microseconds (default 0)\n");
+    printf("  -r  runs per measurement (default %d)\n", repeat);
+    printf("  -k  keep the tree afterwards\n");
+    printf("  -t  record the run and write it as a Chrome trace\n");
+}
+
+int main(int argc, char **argv) {
+    const char *base = access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:n:l:r:kt:h")) != -1) {
+        switch (opt) {
+            case 'd': base = optarg; break;
+            case 'n': maxFiles = atoi(optarg); break;
+            case 'l': hostFsLatencyUs = (u32)atoi(optarg); break;
+            case 'r': repeat = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+            case 'k': keepTree = true; break;
+            case 't':
+                if (optarg[0] == '/' || !getcwd(traceFile, sizeof(traceFile) - 1 - strlen(optarg) - 1)) {
+                    snprintf(traceFile, sizeof(traceFile), "%s", optarg);
+                } else {
+                    strcat(traceFile, "/");
+                    strcat(traceFile, optarg);
+                }
+                break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (maxFiles < 10) {
+        maxFiles = 10;
+    }
+
+    char work[BENCH_PATH_LEN];
+    snprintf(work, sizeof(work), "%s/clownsec-bench.XXXXXX", base);
+    if (!mkdtemp(work) || chdir(work) != 0) {
+        perror(work);
+        return 1;
+    }
+    makeDir("sdmc:");
+    makeDir("sdmc:/MOFLEX");
+    fsSessionOpen();
+    if (traceFile[0] && !traceStart()) {
+        traceFile[0] = '\0';
+    }
+
+    printf("work dir %s, up to %d files, %u us per FS request\n\n", work, maxFiles, hostFsLatencyUs);
+    reportHeader();
+
+    for (int n = 10; n <= maxFiles; n *= 10) {
+        benchScan(n);
+        benchStartup(n);
+        benchRecents(n);
+        benchLongNames(n);
+        benchMoves(n);
+        benchSearch(n);
+        benchMoflex(n);
+        benchDupes(n);
+    }
+
+    // The sizes the browser sort has to cope with
+    const int sortSizes[] = {256, 4096, 65536};
+    for (int i = 0; i < 3; i++) {
+        benchSort(sortSizes[i]);
+    }
+    benchDeep();
+    benchCheck();
+    benchVerify();
+    benchVolumes();
+    benchCovers();
+    benchJobs();
+
+    if (traceFile[0]) {
+        traceStop();
+        if (traceDump(traceFile)) {
+            printf("\ntrace written to %s\n", traceFile);
+        } else {
+            printf("\ncould not write %s\n", traceFile);
+        }
+    }
+
+    fsSessionClose();
+    if (chdir("/") == 0 && !keepTree) {
+        removeTree(work);
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#---------------------------------------------------------------------------------
+# Native build of the file-management core (everything but the UI in main.c)
+# plus the benchmark in bench/. Included by the Makefile for the host goals.
+#
+#   make host                       build build-host/clownsec-bench
+#   make host-bench BENCH_ARGS=...  build and run it, e.g. BENCH_ARGS="-n 100000 -l 300"
+#   make host-clean
+#---------------------------------------------------------------------------------
+HOST_CC		?=	cc
+HOST_BUILD	:=	build-host
+HOST_CFLAGS	:=	-g -O2 -Wall -std=gnu11 -Isource
+HOST_LIBS	:=	-lpng -ljpeg -lz -lpthread
+
+HOST_CORE	:=	library state mover moveworker scanner foldertable search moflex metacache verifier dupes cover jobs recents dirlist fsdir fsfile fssession trace platform_host
+HOST_OFILES	:=	$(addprefix $(HOST_BUILD)/,$(addsuffix .o,$(HOST_CORE)))
+HOST_DEPS	:=	$(HOST_OFILES:.o=.d) $(HOST_BUILD)/bench.d
+
+.PHONY: host host-bench host-clean
+
+host: $(HOST_BUILD)/clownsec-bench
+
+host-bench: $(HOST_BUILD)/clownsec-bench
+	@$(HOST_BUILD)/clownsec-bench $(BENCH_ARGS)
+
+host-clean:
+	@echo clean host ...
+	@rm -fr $(HOST_BUILD)
+
+$(HOST_BUILD)/libclownsec-core.a: $(HOST_OFILES)
+	@echo $(notdir $@)
+	@$(AR) rcs $@ $^
+
+$(HOST_BUILD)/clownsec-bench: $(HOST_BUILD)/bench.o $(HOST_BUILD)/libclownsec-core.a
+	@echo $(notdir $@)
+	@$(HOST_CC) -o $@ $^ $(HOST_LIBS)
+
+$(HOST_BUILD)/%.o: source/%.c | $(HOST_BUILD)
+	@echo $(notdir $<)
+	@$(HOST_CC) $(HOST_CFLAGS) -MMD -MP -c $< -o $@
+
+$(HOST_BUILD)/bench.o: bench/bench.c | $(HOST_BUILD)
+	@echo $(notdir $<)
+	@$(HOST_CC) $(HOST_CFLAGS) -MMD -MP -c $< -o $@
+
+$(HOST_BUILD):
+	@mkdir -p $@
+
+-include $(HOST_DEPS)
@@ -0,0 +1,27 @@
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "platform.h"
+
+#include <stdlib.h>
+
+// Grows a realloc'd array to hold at least needed elements, doubling from
+// initial. The array is left as it was if that fails.
+static inline bool arrayReserve(void **array, int *capacity, int needed, size_t elementSize, int initial) {
+    if (needed <= *capacity) {
+        return true;
+    }
+    int grown = *capacity ? *capacity * 2 : initial;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    void *moved = realloc(*array, elementSize * grown);
+    if (!moved) {
+        return false;
+    }
+    *array = moved;
+    *capacity = grown;
+    return true;
+}
+
+#endif
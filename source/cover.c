@@ -0,0 +1,834 @@
+#include "cover.h"
+#include "array.h"
+#include "fsfile.h"
+#include "hash.h"
+#include "trace.h"
+
+#include <png.h>
+#include <jpeglib.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define COVER_STACK_SIZE  (32 * 1024)
+#define COVER_PRIORITY    0x3F // lowest, next to the scanner
+#define COVER_INDEX_MAGIC 0x49434C43 // "CLCI"
+#define INTERLACED_PIXELS (2048 * 2048) // interlaced PNGs are decoded whole
+#define COMPACT_BYTES     (1024 * 1024) // dead records worth a rewrite
+
+static const char *const coverNames[] = {"cover.png", "cover.jpg"};
+
+// Scaling
+
+// Averages boxes of source pixels into the tile, one source row at a time,
+// so only a row of the source is ever held
+typedef struct {
+    int srcWidth;
+    int srcHeight;
+    int width;
+    int height;
+    int row;                  // next source row
+    int outRow;               // tile row being gathered
+    int rows;                 // source rows gathered into it
+    u16 *tile;
+    u32 sums[COVER_SIZE * 3];
+    u16 spans[COVER_SIZE];    // source columns per tile column
+    u16 column[COVER_MAX_ROW]; // source column -> tile column
+} Scaler;
+
+static void fitSize(int srcWidth, int srcHeight, u16 *width, u16 *height) {
+    if (srcWidth <= COVER_SIZE && srcHeight <= COVER_SIZE) {
+        *width = srcWidth;
+        *height = srcHeight;
+    } else if (srcWidth >= srcHeight) {
+        *width = COVER_SIZE;
+        *height = (u16)((u64)srcHeight * COVER_SIZE / srcWidth);
+    } else {
+        *height = COVER_SIZE;
+        *width = (u16)((u64)srcWidth * COVER_SIZE / srcHeight);
+    }
+    if (*width == 0) {
+        *width = 1;
+    }
+    if (*height == 0) {
+        *height = 1;
+    }
+}
+
+static bool scalerInit(Scaler *scaler, int srcWidth, int srcHeight, u16 *tile) {
+    if (srcWidth <= 0 || srcHeight <= 0 || srcWidth > COVER_MAX_ROW) {
+        return false;
+    }
+    u16 width, height;
+    fitSize(srcWidth, srcHeight, &width, &height);
+    scaler->srcWidth = srcWidth;
+    scaler->srcHeight = srcHeight;
+    scaler->width = width;
+    scaler->height = height;
+    scaler->row = 0;
+    scaler->outRow = 0;
+    scaler->rows = 0;
+    scaler->tile = tile;
+    memset(scaler->sums, 0, sizeof(scaler->sums));
+    memset(scaler->spans, 0, sizeof(scaler->spans));
+    for (int x = 0; x < srcWidth; x++) {
+        u16 column = (u16)((u64)x * width / srcWidth);
+        scaler->column[x] = column;
+        scaler->spans[column]++;
+    }
+    return true;
+}
+
+static void scalerFlush(Scaler *scaler) {
+    if (scaler->rows == 0) {
+        return;
+    }
+    u16 *out = scaler->tile + scaler->outRow * scaler->width;
+    u32 *sum = scaler->sums;
+    for (int x = 0; x < scaler->width; x++, sum += 3) {
+        u32 count = (u32)scaler->spans[x] * scaler->rows;
+        u32 r = sum[0] / count;
+        u32 g = sum[1] / count;
+        u32 b = sum[2] / count;
+        out[x] = (u16)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+    }
+    memset(scaler->sums, 0, sizeof(u32) * 3 * scaler->width);
+    scaler->rows = 0;
+}
+
+// rgb is one source row, 8-bit RGB
+static void scalerRow(Scaler *scaler, const u8 *rgb) {
+    int outRow = (int)((u64)scaler->row * scaler->height / scaler->srcHeight);
+    if (outRow != scaler->outRow) {
+        scalerFlush(scaler);
+        scaler->outRow = outRow;
+    }
+    for (int x = 0; x < scaler->srcWidth; x++, rgb += 3) {
+        u32 *sum = scaler->sums + scaler->column[x] * 3;
+        sum[0] += rgb[0];
+        sum[1] += rgb[1];
+        sum[2] += rgb[2];
+    }
+    scaler->rows++;
+    scaler->row++;
+}
+
+// True if every tile row got its pixels
+static bool scalerFinish(Scaler *scaler) {
+    scalerFlush(scaler);
+    return scaler->row == scaler->srcHeight;
+}
+
+// Decoding
+
+typedef struct {
+    struct jpeg_error_mgr manager;
+    jmp_buf jump;
+} JpegError;
+
+static void jpegFail(j_common_ptr info) {
+    longjmp(((JpegError *)info->err)->jump, 1);
+}
+
+static void jpegQuiet(j_common_ptr info) {
+    (void)info;
+}
+
+static bool decodeJpeg(const u8 *data, u32 size, Scaler *scaler, u16 *tile, u8 *row) {
+    struct jpeg_decompress_struct info;
+    JpegError error;
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpegFail;
+    error.manager.output_message = jpegQuiet;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, (unsigned char *)data, size);
+    if (jpeg_read_header(&info, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    // Let the IDCT drop as much as it can while still leaving at least a
+    // tile's worth of pixels for the box filter
+    u16 width, height;
+    fitSize(info.image_width, info.image_height, &width, &height);
+    info.scale_num = 1;
+    info.scale_denom = 1;
+    for (unsigned denom = 8; denom > 1; denom /= 2) {
+        if (info.image_width / denom >= width && info.image_height / denom >= height) {
+            info.scale_denom = denom;
+            break;
+        }
+    }
+    info.out_color_space = JCS_RGB;
+    info.dct_method = JDCT_IFAST;
+    info.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&info);
+
+    bool ok = info.output_components == 3 && scalerInit(scaler, info.output_width, info.output_height, tile);
+    while (ok && info.output_scanline < info.output_height) {
+        JSAMPROW rows[1] = {row};
+        ok = jpeg_read_scanlines(&info, rows, 1) == 1;
+        if (ok) {
+            scalerRow(scaler, row);
+        }
+    }
+    if (ok) {
+        jpeg_finish_decompress(&info);
+    }
+    jpeg_destroy_decompress(&info);
+    return ok && scalerFinish(scaler);
+}
+
+typedef struct {
+    const u8 *data;
+    u32 size;
+    u32 offset;
+} PngSource;
+
+static void pngRead(png_structp png, png_bytep out, png_size_t length) {
+    PngSource *source = (PngSource *)png_get_io_ptr(png);
+    if (length > source->size - source->offset) {
+        png_error(png, "truncated");
+    }
+    memcpy(out, source->data + source->offset, length);
+    source->offset += length;
+}
+
+static void pngFail(png_structp png, png_const_charp message) {
+    (void)message;
+    png_longjmp(png, 1);
+}
+
+static void pngQuiet(png_structp png, png_const_charp message) {
+    (void)png;
+    (void)message;
+}
+
+static bool decodePng(const u8 *data, u32 size, Scaler *scaler, u16 *tile, u8 *row) {
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, pngFail, pngQuiet);
+    if (!png) {
+        return false;
+    }
+    png_infop info = png_create_info_struct(png);
+    u8 *volatile image = NULL;
+    if (!info || setjmp(png_jmpbuf(png))) {
+        free(image);
+        png_destroy_read_struct(&png, info ? &info : NULL, NULL);
+        return false;
+    }
+
+    PngSource source = {data, size, 0};
+    png_set_read_fn(png, &source, pngRead);
+    png_read_info(png, info);
+
+    // Everything becomes 8-bit RGB
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_strip_alpha(png);
+    png_set_gray_to_rgb(png);
+    int passes = png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    u32 width = png_get_image_width(png, info);
+    u32 height = png_get_image_height(png, info);
+    if (png_get_rowbytes(png, info) != (png_size_t)width * 3 || !scalerInit(scaler, width, height, tile)) {
+        png_error(png, "unsupported");
+    }
+
+    if (passes == 1) {
+        for (u32 y = 0; y < height; y++) {
+            png_read_row(png, row, NULL);
+            scalerRow(scaler, row);
+        }
+    } else {
+        // Later passes fill in rows of the earlier ones, so all of it has
+        // to be kept until the last
+        if ((u64)width * height > INTERLACED_PIXELS) {
+            png_error(png, "too large");
+        }
+        image = (u8 *)malloc((size_t)width * height * 3);
+        if (!image) {
+            png_error(png, "out of memory");
+        }
+        for (int pass = 0; pass < passes; pass++) {
+            for (u32 y = 0; y < height; y++) {
+                png_read_row(png, image + (size_t)y * width * 3, NULL);
+            }
+        }
+        for (u32 y = 0; y < height; y++) {
+            scalerRow(scaler, image + (size_t)y * width * 3);
+        }
+        free(image);
+        image = NULL;
+    }
+
+    png_destroy_read_struct(&png, &info, NULL);
+    return scalerFinish(scaler);
+}
+
+bool coverDecode(const u8 *data, u32 size, u16 *tile, u16 *width, u16 *height) {
+    static const u8 pngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    bool png = size >= sizeof(pngSignature) && memcmp(data, pngSignature, sizeof(pngSignature)) == 0;
+    bool jpeg = size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+    if (!png && !jpeg) {
+        return false;
+    }
+
+    Scaler *scaler = (Scaler *)malloc(sizeof(Scaler));
+    u8 *row = (u8 *)malloc(COVER_MAX_ROW * 3);
+    bool ok = scaler && row;
+    if (ok) {
+        ok = png ? decodePng(data, size, scaler, tile, row) : decodeJpeg(data, size, scaler, tile, row);
+    }
+    if (ok) {
+        *width = scaler->width;
+        *height = scaler->height;
+    }
+    free(row);
+    free(scaler);
+    return ok;
+}
+
+// Pack
+
+static inline FILE *packFile(CoverCache *cache) {
+    return (FILE *)cache->pack;
+}
+
+static inline const char *entryPath(const CoverCache *cache, const CoverEntry *entry) {
+    return cache->strings + entry->pathOffset;
+}
+
+static u32 recordBytes(u32 pathLength, u32 width, u32 height) {
+    return sizeof(CoverRecord) + pathLength + width * height * sizeof(u16);
+}
+
+static u32 recordChecksum(const CoverRecord *record, const char *path) {
+    u32 hash = fnv1a32(FNV1A_32_INIT, record, offsetof(CoverRecord, checksum));
+    return fnv1a32(hash, path, record->pathLength);
+}
+
+static int findEntry(CoverCache *cache, const char *path, u32 hash) {
+    for (int i = 0; i < cache->entryCount; i++) {
+        const CoverEntry *entry = &cache->entries[i];
+        if (entry->pathHash == hash && strcmp(entryPath(cache, entry), path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Indexes a record at dataOffset - sizeof(CoverRecord) - pathLength,
+// superseding any older one for the same folder
+static bool addEntry(CoverCache *cache, const CoverRecord *record, const char *path, u32 dataOffset) {
+    int index = findEntry(cache, path, record->pathHash);
+    if (index >= 0) {
+        CoverEntry *entry = &cache->entries[index];
+        cache->liveBytes -= recordBytes(entry->pathLength, entry->width, entry->height);
+    } else {
+        u32 needed = cache->stringSize + record->pathLength + 1;
+        if (needed > cache->stringCapacity) {
+            u32 capacity = cache->stringCapacity ? cache->stringCapacity * 2 : 4096;
+            while (capacity < needed) {
+                capacity *= 2;
+            }
+            char *strings = (char *)realloc(cache->strings, capacity);
+            if (!strings) {
+                return false;
+            }
+            cache->strings = strings;
+            cache->stringCapacity = capacity;
+        }
+        if (!arrayReserve((void **)&cache->entries, &cache->entryCapacity, cache->entryCount + 1,
+                          sizeof(CoverEntry), 64)) {
+            return false;
+        }
+        index = cache->entryCount++;
+        cache->entries[index].pathOffset = cache->stringSize;
+        memcpy(cache->strings + cache->stringSize, path, record->pathLength);
+        cache->strings[cache->stringSize + record->pathLength] = '\0';
+        cache->stringSize = needed;
+    }
+
+    CoverEntry *entry = &cache->entries[index];
+    entry->pathHash = record->pathHash;
+    entry->pathLength = record->pathLength;
+    entry->flags = record->flags;
+    entry->width = record->width;
+    entry->height = record->height;
+    entry->sourceSize = record->sourceSize;
+    entry->sourceMtime = record->sourceMtime;
+    entry->pixelHash = record->pixelHash;
+    entry->dataOffset = dataOffset;
+    cache->liveBytes += recordBytes(entry->pathLength, entry->width, entry->height);
+    return true;
+}
+
+static void clearEntries(CoverCache *cache) {
+    cache->entryCount = 0;
+    cache->stringSize = 0;
+    cache->liveBytes = 0;
+    cache->dataEnd = sizeof(CoverFileHeader);
+    cache->indexed = false;
+}
+
+// The index written on the last stop, if nothing was appended after it
+static bool loadIndex(CoverCache *cache, long size) {
+    FILE *f = packFile(cache);
+    CoverFooter footer;
+    CoverIndexHeader header;
+    if (size < (long)(sizeof(CoverFileHeader) + sizeof(header) + sizeof(footer)) ||
+        fseek(f, size - sizeof(footer), SEEK_SET) != 0 || fread(&footer, sizeof(footer), 1, f) != 1 ||
+        footer.magic != COVER_INDEX_MAGIC || footer.indexOffset < sizeof(CoverFileHeader) ||
+        footer.indexOffset > size - sizeof(header) - sizeof(footer) ||
+        fseek(f, footer.indexOffset, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, f) != 1 ||
+        header.magic != COVER_INDEX_MAGIC || header.dataEnd != footer.indexOffset ||
+        header.entryCount > 0x100000 ||
+        footer.indexOffset + sizeof(header) + (u64)header.entryCount * sizeof(CoverEntry) +
+                header.stringSize + sizeof(footer) != (u64)size) {
+        return false;
+    }
+
+    CoverEntry *entries = (CoverEntry *)malloc(sizeof(CoverEntry) * (header.entryCount + 1));
+    char *strings = (char *)malloc(header.stringSize + 1);
+    bool ok = entries && strings &&
+              fread(entries, sizeof(CoverEntry), header.entryCount, f) == header.entryCount &&
+              fread(strings, 1, header.stringSize, f) == header.stringSize;
+    if (ok) {
+        u32 checksum = fnv1a32(FNV1A_32_INIT, entries, sizeof(CoverEntry) * header.entryCount);
+        ok = fnv1a32(checksum, strings, header.stringSize) == header.checksum;
+    }
+
+    // Make sure every reference stays inside the pool and the records
+    u32 liveBytes = 0;
+    for (u32 i = 0; ok && i < header.entryCount; i++) {
+        const CoverEntry *entry = &entries[i];
+        u32 bytes = recordBytes(entry->pathLength, entry->width, entry->height);
+        ok = (u64)entry->pathOffset + entry->pathLength < header.stringSize + 1ULL &&
+             strings[entry->pathOffset + entry->pathLength] == '\0' &&
+             entry->width <= COVER_SIZE && entry->height <= COVER_SIZE &&
+             entry->dataOffset >= sizeof(CoverFileHeader) + sizeof(CoverRecord) + entry->pathLength &&
+             (u64)entry->dataOffset + entry->width * entry->height * sizeof(u16) <= header.dataEnd;
+        liveBytes += bytes;
+    }
+    if (!ok) {
+        free(entries);
+        free(strings);
+        return false;
+    }
+
+    free(cache->entries);
+    free(cache->strings);
+    cache->entries = entries;
+    cache->entryCount = header.entryCount;
+    cache->entryCapacity = header.entryCount + 1;
+    cache->strings = strings;
+    cache->stringSize = header.stringSize;
+    cache->stringCapacity = header.stringSize + 1;
+    cache->dataEnd = header.dataEnd;
+    cache->liveBytes = liveBytes;
+    cache->indexed = true;
+    return true;
+}
+
+// Rebuilds the index from the records themselves, up to the first one that
+// is torn or corrupt
+static void scanRecords(CoverCache *cache, long size) {
+    FILE *f = packFile(cache);
+    clearEntries(cache);
+    u32 position = sizeof(CoverFileHeader);
+    char path[COVER_PATH_LEN];
+    CoverRecord record;
+    while ((u64)position + sizeof(record) <= (u64)size && fseek(f, position, SEEK_SET) == 0 &&
+           fread(&record, sizeof(record), 1, f) == 1) {
+        u32 bytes = recordBytes(record.pathLength, record.width, record.height);
+        if (record.magic != COVER_MAGIC || record.pathLength >= COVER_PATH_LEN ||
+            record.width > COVER_SIZE || record.height > COVER_SIZE ||
+            (u64)position + bytes > (u64)size ||
+            fread(path, 1, record.pathLength, f) != record.pathLength ||
+            recordChecksum(&record, path) != record.checksum) {
+            break;
+        }
+        path[record.pathLength] = '\0';
+        if (!addEntry(cache, &record, path, position + sizeof(record) + record.pathLength)) {
+            break;
+        }
+        position += bytes;
+    }
+    cache->dataEnd = position;
+}
+
+static void openPack(CoverCache *cache) {
+    FILE *f = fopen(cache->file, "r+b");
+    CoverFileHeader header;
+    long size = 0;
+    bool ok = f && fread(&header, sizeof(header), 1, f) == 1 && header.magic == COVER_MAGIC &&
+              header.version == COVER_VERSION && fseek(f, 0, SEEK_END) == 0;
+    if (ok) {
+        size = ftell(f);
+    } else {
+        // Missing, or from another version: start over
+        if (f) {
+            fclose(f);
+        }
+        f = fopen(cache->file, "w+b");
+        header.magic = COVER_MAGIC;
+        header.version = COVER_VERSION;
+        if (f && fwrite(&header, sizeof(header), 1, f) != 1) {
+            fclose(f);
+            f = NULL;
+        }
+    }
+    cache->pack = f;
+    clearEntries(cache);
+    if (f && ok && !loadIndex(cache, size)) {
+        scanRecords(cache, size);
+    }
+}
+
+static bool readTile(CoverCache *cache, const CoverEntry *entry, u16 *tile) {
+    FILE *f = packFile(cache);
+    size_t count = (size_t)entry->width * entry->height;
+    return f && fseek(f, entry->dataOffset, SEEK_SET) == 0 && fread(tile, sizeof(u16), count, f) == count &&
+           fnv1a32(FNV1A_32_INIT, tile, count * sizeof(u16)) == entry->pixelHash;
+}
+
+// Writes a record for path at dataEnd; NULL pixels records a source that
+// could not be decoded
+static void appendRecord(CoverCache *cache, const char *path, u32 hash, u64 size, u64 mtime,
+                         const u16 *tile, u16 width, u16 height) {
+    FILE *f = packFile(cache);
+    if (!f) {
+        return;
+    }
+    CoverRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = COVER_MAGIC;
+    record.pathHash = hash;
+    record.pathLength = (u16)strlen(path);
+    record.flags = tile ? 0 : COVER_RECORD_MISSING;
+    record.width = tile ? width : 0;
+    record.height = tile ? height : 0;
+    record.sourceSize = size;
+    record.sourceMtime = mtime;
+    size_t count = (size_t)record.width * record.height;
+    record.pixelHash = fnv1a32(FNV1A_32_INIT, tile, count * sizeof(u16));
+    record.checksum = recordChecksum(&record, path);
+
+    // Anything past dataEnd is the old index, which this record replaces
+    bool ok = fseek(f, cache->dataEnd, SEEK_SET) == 0 && fwrite(&record, sizeof(record), 1, f) == 1 &&
+              fwrite(path, 1, record.pathLength, f) == record.pathLength &&
+              fwrite(tile, sizeof(u16), count, f) == count && fflush(f) == 0;
+    cache->indexed = false;
+    if (ok && addEntry(cache, &record, path, cache->dataEnd + sizeof(record) + record.pathLength)) {
+        cache->dataEnd += recordBytes(record.pathLength, record.width, record.height);
+    }
+}
+
+// Index after the records, then the footer pointing at it
+static bool writeIndex(CoverCache *cache, FILE *f) {
+    CoverIndexHeader header;
+    header.magic = COVER_INDEX_MAGIC;
+    header.entryCount = cache->entryCount;
+    header.stringSize = cache->stringSize;
+    header.dataEnd = cache->dataEnd;
+    header.checksum = fnv1a32(FNV1A_32_INIT, cache->entries, sizeof(CoverEntry) * cache->entryCount);
+    header.checksum = fnv1a32(header.checksum, cache->strings, cache->stringSize);
+    CoverFooter footer = {cache->dataEnd, COVER_INDEX_MAGIC};
+
+    bool ok = fseek(f, cache->dataEnd, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(cache->entries, sizeof(CoverEntry), cache->entryCount, f) == (size_t)cache->entryCount &&
+              fwrite(cache->strings, 1, cache->stringSize, f) == cache->stringSize &&
+              fwrite(&footer, sizeof(footer), 1, f) == 1 && fflush(f) == 0;
+    if (ok) {
+        // Drop whatever a longer pack left behind, so the footer is last
+        long end = ftell(f);
+        ok = end > 0 && ftruncate(fileno(f), end) == 0;
+    }
+    return ok;
+}
+
+// Copies the live records into a fresh pack next to the old one and
+// replaces it
+static bool compactPack(CoverCache *cache) {
+    char temp[COVER_PATH_LEN + 8];
+    snprintf(temp, sizeof(temp), "%s.new", cache->file);
+    FILE *out = fopen(temp, "w+b");
+    if (!out) {
+        return false;
+    }
+    CoverFileHeader header = {COVER_MAGIC, COVER_VERSION};
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+
+    u16 *tile = (u16 *)malloc(COVER_SIZE * COVER_SIZE * sizeof(u16));
+    ok = ok && tile;
+    u32 position = sizeof(header);
+    for (int i = 0; ok && i < cache->entryCount; i++) {
+        CoverEntry *entry = &cache->entries[i];
+        const char *path = entryPath(cache, entry);
+        CoverRecord record;
+        memset(&record, 0, sizeof(record));
+        record.magic = COVER_MAGIC;
+        record.pathHash = entry->pathHash;
+        record.pathLength = entry->pathLength;
+        record.flags = entry->flags;
+        record.width = entry->width;
+        record.height = entry->height;
+        record.sourceSize = entry->sourceSize;
+        record.sourceMtime = entry->sourceMtime;
+        record.pixelHash = entry->pixelHash;
+        record.checksum = recordChecksum(&record, path);
+
+        size_t count = (size_t)entry->width * entry->height;
+        ok = (count == 0 || readTile(cache, entry, tile)) &&
+             fwrite(&record, sizeof(record), 1, out) == 1 &&
+             fwrite(path, 1, record.pathLength, out) == record.pathLength &&
+             fwrite(tile, sizeof(u16), count, out) == count;
+        entry->dataOffset = position + sizeof(record) + record.pathLength;
+        position += recordBytes(record.pathLength, record.width, record.height);
+    }
+    free(tile);
+
+    cache->dataEnd = position;
+    ok = ok && writeIndex(cache, out);
+    fclose(out);
+    if (!ok) {
+        remove(temp);
+        return false;
+    }
+    fclose(packFile(cache));
+    cache->pack = NULL;
+    remove(cache->file);
+    return rename(temp, cache->file) == 0;
+}
+
+static void closePack(CoverCache *cache) {
+    FILE *f = packFile(cache);
+    if (!f) {
+        return;
+    }
+    u32 dead = cache->dataEnd - sizeof(CoverFileHeader) - cache->liveBytes;
+    if (dead >= COMPACT_BYTES && dead > cache->liveBytes) {
+        TRACE_SPAN("cover.compact", cache->entryCount, compactPack(cache));
+    } else if (!cache->indexed) {
+        cache->indexed = writeIndex(cache, f);
+    }
+    if (cache->pack) {
+        fclose(packFile(cache));
+        cache->pack = NULL;
+    }
+}
+
+// Tiles
+
+static u32 pathHash(const char *path) {
+    return fnv1a32(FNV1A_32_INIT, path, strlen(path));
+}
+
+static int findSlot(CoverCache *cache, const char *path, u32 hash) {
+    for (int i = 0; i < COVER_SLOTS; i++) {
+        const CoverSlot *slot = &cache->slots[i];
+        if (slot->state != COVER_EMPTY && slot->pathHash == hash && strcmp(slot->path, path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// The first wanted folder without a tile yet
+static bool nextWanted(CoverCache *cache, char *path) {
+    bool found = false;
+    coverLock(cache);
+    for (int i = 0; !found && i < cache->wantedCount; i++) {
+        if (findSlot(cache, cache->wanted[i], pathHash(cache->wanted[i])) < 0) {
+            memcpy(path, cache->wanted[i], COVER_PATH_LEN);
+            found = true;
+        }
+    }
+    coverUnlock(cache);
+    return found;
+}
+
+static void storeTile(CoverCache *cache, const char *path, CoverState state, const u16 *tile, u16 width,
+                      u16 height) {
+    coverLock(cache);
+    // An empty slot, or else the one asked for longest ago
+    int victim = 0;
+    for (int i = 0; i < COVER_SLOTS; i++) {
+        if (cache->slots[i].state == COVER_EMPTY) {
+            victim = i;
+            break;
+        }
+        if (cache->slots[i].usedAt < cache->slots[victim].usedAt) {
+            victim = i;
+        }
+    }
+    CoverSlot *slot = &cache->slots[victim];
+    snprintf(slot->path, sizeof(slot->path), "%s", path);
+    slot->pathHash = pathHash(path);
+    slot->state = state;
+    slot->width = state == COVER_READY ? width : 0;
+    slot->height = state == COVER_READY ? height : 0;
+    slot->usedAt = svcGetSystemTick();
+    memcpy(slot->pixels, tile, (size_t)slot->width * slot->height * sizeof(u16));
+    coverUnlock(cache);
+}
+
+// Finds the folder's cover and produces its tile, from the pack if the
+// source is unchanged
+static CoverState loadCover(CoverCache *cache, const char *folder, u16 *tile, u16 *width, u16 *height) {
+    size_t length = strlen(folder);
+    const char *slash = length > 0 && folder[length - 1] == '/' ? "" : "/";
+    char source[COVER_PATH_LEN + 16];
+    FileReader reader;
+    bool found = false;
+    for (size_t i = 0; !found && i < sizeof(coverNames) / sizeof(coverNames[0]); i++) {
+        snprintf(source, sizeof(source), "%s%s%s", folder, slash, coverNames[i]);
+        found = fileOpen(&reader, source);
+    }
+    if (!found) {
+        return COVER_MISSING;
+    }
+
+    u64 size = reader.size;
+    u64 mtime = fileMtime(source);
+    u32 hash = pathHash(folder);
+    int index = findEntry(cache, folder, hash);
+    if (index >= 0 && cache->entries[index].sourceSize == size && cache->entries[index].sourceMtime == mtime) {
+        const CoverEntry *entry = &cache->entries[index];
+        if (entry->flags & COVER_RECORD_MISSING) {
+            fileClose(&reader);
+            return COVER_MISSING;
+        }
+        if (readTile(cache, entry, tile)) {
+            fileClose(&reader);
+            cache->packed++;
+            *width = entry->width;
+            *height = entry->height;
+            return COVER_READY;
+        }
+        // A damaged tile is decoded again
+    }
+
+    bool ok = false;
+    if (size > 0 && size <= COVER_MAX_BYTES) {
+        u8 *data = (u8 *)malloc((size_t)size);
+        if (data && fileRead(&reader, 0, data, (u32)size) == size) {
+            u64 start = svcGetSystemTick();
+            TRACE_SPAN("cover.decode", (s32)size, ok = coverDecode(data, (u32)size, tile, width, height));
+            cache->decodeTicks += svcGetSystemTick() - start;
+            cache->decoded++;
+        }
+        free(data);
+    }
+    fileClose(&reader);
+    appendRecord(cache, folder, hash, size, mtime, ok ? tile : NULL, *width, *height);
+    return ok ? COVER_READY : COVER_MISSING;
+}
+
+static void coverMain(void *arg) {
+    CoverCache *cache = (CoverCache *)arg;
+    TRACE_SPAN("cover.open", 0, openPack(cache));
+    u16 *tile = (u16 *)malloc(COVER_SIZE * COVER_SIZE * sizeof(u16));
+    char *path = (char *)malloc(COVER_PATH_LEN);
+
+    while (tile && path && !cache->quit) {
+        if (cache->paused) {
+            svcSleepThread(10000000LL); // 10ms
+            continue;
+        }
+        if (!nextWanted(cache, path)) {
+            LightEvent_Wait(&cache->wake);
+            continue;
+        }
+        u16 width = 0;
+        u16 height = 0;
+        CoverState state;
+        TRACE_SPAN("cover.load", 0, state = loadCover(cache, path, tile, &width, &height));
+        storeTile(cache, path, state, tile, width, height);
+        __atomic_add_fetch(&cache->finished, 1, __ATOMIC_RELEASE);
+        if (cache->notify) {
+            LightEvent_Signal(cache->notify);
+        }
+    }
+
+    free(path);
+    free(tile);
+    closePack(cache);
+}
+
+bool coverStart(CoverCache *cache, const char *file, LightEvent *notify) {
+    memset(cache, 0, sizeof(CoverCache));
+    LightLock_Init(&cache->lock);
+    LightEvent_Init(&cache->wake, RESET_ONESHOT);
+    cache->notify = notify;
+    strncpy(cache->file, file, sizeof(cache->file) - 1);
+
+    cache->tiles = (u16 *)malloc(sizeof(u16) * COVER_SIZE * COVER_SIZE * COVER_SLOTS);
+    if (!cache->tiles) {
+        return false;
+    }
+    for (int i = 0; i < COVER_SLOTS; i++) {
+        cache->slots[i].pixels = cache->tiles + i * COVER_SIZE * COVER_SIZE;
+    }
+
+    // Pinned to the app core with the scanner; it only runs while the UI waits
+    cache->thread = threadCreate(coverMain, cache, COVER_STACK_SIZE, COVER_PRIORITY, -2, false);
+    if (!cache->thread) {
+        free(cache->tiles);
+        cache->tiles = NULL;
+        return false;
+    }
+    return true;
+}
+
+void coverStop(CoverCache *cache) {
+    if (!cache->thread) {
+        return;
+    }
+    cache->quit = true;
+    LightEvent_Signal(&cache->wake);
+    threadJoin(cache->thread, U64_MAX);
+    threadFree(cache->thread);
+    cache->thread = NULL;
+
+    free(cache->entries);
+    free(cache->strings);
+    free(cache->tiles);
+    cache->entries = NULL;
+    cache->strings = NULL;
+    cache->tiles = NULL;
+    memset(cache->slots, 0, sizeof(cache->slots));
+}
+
+void coverRequest(CoverCache *cache, const char *const *paths, int count) {
+    u64 now = svcGetSystemTick();
+    coverLock(cache);
+    cache->wantedCount = 0;
+    for (int i = 0; i < count && cache->wantedCount < COVER_WANTED; i++) {
+        if (!paths[i] || strlen(paths[i]) >= COVER_PATH_LEN) {
+            continue;
+        }
+        char *wanted = cache->wanted[cache->wantedCount++];
+        snprintf(wanted, COVER_PATH_LEN, "%s", paths[i]);
+        // Keep what is wanted now away from eviction
+        int slot = findSlot(cache, wanted, pathHash(wanted));
+        if (slot >= 0) {
+            cache->slots[slot].usedAt = now - i;
+        }
+    }
+    coverUnlock(cache);
+    LightEvent_Signal(&cache->wake);
+}
+
+const CoverSlot *coverFind(CoverCache *cache, const char *path) {
+    int slot = findSlot(cache, path, pathHash(path));
+    return slot >= 0 ? &cache->slots[slot] : NULL;
+}
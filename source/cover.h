@@ -0,0 +1,164 @@
+#ifndef COVER_H
+#define COVER_H
+
+#include "platform.h"
+
+// Cover art for the highlighted folder, decoded in the background.
+//
+// A folder's cover is its cover.png or cover.jpg. The worker decodes it,
+// box-filters it down to fit COVER_SIZE x COVER_SIZE (JPEGs are already
+// reduced by the decoder's DCT scaling, so a large cover never exists at
+// full size) and keeps the RGB565 result in a fixed set of COVER_SLOTS
+// tiles, evicting the least recently asked for. Folders without a usable
+// cover hold a slot too, so they are not looked up again.
+//
+// Every decoded tile is appended to COVER_FILE, keyed by folder path and the
+// source's size and mtime, so a later session reads the ready tile instead
+// of decoding again. The pack is a log of records with an index written
+// after them on stop; without a valid index (the app was killed mid-session)
+// the records are scanned instead. Superseded records are dropped by
+// rewriting the pack once they outweigh the live ones.
+//
+// The UI asks for the highlighted folder and its neighbours with
+// coverRequest(); the first is decoded first, the others are prefetched.
+
+#define COVER_FILE      "sdmc:/.clownsec_covers"
+#define COVER_MAGIC     0x56434C43 // "CLCV"
+#define COVER_VERSION   1
+#define COVER_PATH_LEN  512
+#define COVER_SIZE      160        // tiles fit in COVER_SIZE x COVER_SIZE
+#define COVER_SLOTS     20         // 1000 KB of tiles
+#define COVER_WANTED    3          // highlighted folder and its neighbours
+#define COVER_MAX_BYTES (8 * 1024 * 1024) // larger sources are not read
+#define COVER_MAX_ROW   8192       // widest source accepted
+
+typedef enum {
+    COVER_EMPTY,   // slot unused
+    COVER_READY,   // pixels are valid
+    COVER_MISSING, // no cover, or one that could not be decoded
+} CoverState;
+
+typedef struct {
+    char path[COVER_PATH_LEN]; // folder
+    u32 pathHash;
+    u16 state;                 // CoverState
+    u16 width;
+    u16 height;
+    u64 usedAt;                // tick of the last request, for eviction
+    u16 *pixels;               // width x height RGB565, rows top to bottom
+} CoverSlot;
+
+// Pack records and index
+#define COVER_RECORD_MISSING 0x0001 // source could not be decoded, no pixels
+
+typedef struct {
+    u32 magic;       // COVER_MAGIC, so a scan can tell a record from garbage
+    u32 pathHash;
+    u16 pathLength;  // followed by the path (no terminator), then the pixels
+    u16 flags;
+    u16 width;
+    u16 height;
+    u64 sourceSize;
+    u64 sourceMtime;
+    u32 pixelHash;   // FNV-1a over the pixels
+    u32 checksum;    // FNV-1a over the fields above and the path
+} CoverRecord;
+
+typedef struct {
+    u32 pathOffset;  // into the string pool
+    u32 pathHash;
+    u16 pathLength;
+    u16 flags;
+    u16 width;
+    u16 height;
+    u64 sourceSize;
+    u64 sourceMtime;
+    u32 pixelHash;
+    u32 dataOffset;  // of the pixels in the pack
+} CoverEntry;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+} CoverFileHeader;
+
+typedef struct {
+    u32 magic;
+    u32 entryCount;
+    u32 stringSize;
+    u32 dataEnd;     // the records end here
+    u32 checksum;    // FNV-1a over the entries and string pool
+} CoverIndexHeader;
+
+// Last bytes of the pack when the index is current
+typedef struct {
+    u32 indexOffset;
+    u32 magic;
+} CoverFooter;
+
+typedef struct {
+    Thread thread;
+    LightEvent wake;       // one-shot, signalled on a request or stop
+    LightEvent *notify;    // signalled after each tile, may be NULL
+    char file[COVER_PATH_LEN];
+
+    LightLock lock;        // guards the slots and the wanted list
+    CoverSlot slots[COVER_SLOTS];
+    u16 *tiles;            // pixels of all slots
+    char wanted[COVER_WANTED][COVER_PATH_LEN];
+    int wantedCount;
+
+    // Pack index, only touched by the worker
+    void *pack;            // FILE *, open for the session
+    CoverEntry *entries;
+    int entryCount;
+    int entryCapacity;
+    char *strings;
+    u32 stringSize;
+    u32 stringCapacity;
+    u32 dataEnd;           // where the next record goes
+    u32 liveBytes;         // of records still indexed
+    bool indexed;          // the index on the card matches the entries
+
+    volatile bool paused;
+    volatile bool quit;
+    volatile u32 finished; // tiles stored, for the UI to notice
+    u32 decoded;           // sources decoded this session
+    u32 packed;            // tiles read from the pack
+    u64 decodeTicks;       // spent decoding
+} CoverCache;
+
+// Decodes a PNG or JPEG held in memory into a tile no larger than
+// COVER_SIZE on either side, keeping the aspect ratio and never scaling up
+bool coverDecode(const u8 *data, u32 size, u16 *tile, u16 *width, u16 *height);
+
+bool coverStart(CoverCache *cache, const char *file, LightEvent *notify);
+
+// Writes the pack index, compacting first if worthwhile
+void coverStop(CoverCache *cache);
+
+// Replaces the wanted list: paths[0] is the highlighted folder, the rest are
+// prefetched in order. NULL entries are skipped.
+void coverRequest(CoverCache *cache, const char *const *paths, int count);
+
+// The slot holding path, or NULL if it is still being decoded. Only valid
+// while the lock is held.
+const CoverSlot *coverFind(CoverCache *cache, const char *path);
+
+static inline void coverLock(CoverCache *cache) {
+    LightLock_Lock(&cache->lock);
+}
+
+static inline void coverUnlock(CoverCache *cache) {
+    LightLock_Unlock(&cache->lock);
+}
+
+static inline void coverPause(CoverCache *cache, bool paused) {
+    cache->paused = paused;
+}
+
+static inline u32 coverFinished(CoverCache *cache) {
+    return __atomic_load_n(&cache->finished, __ATOMIC_ACQUIRE);
+}
+
+#endif
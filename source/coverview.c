@@ -0,0 +1,60 @@
+#include "coverview.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SCREEN_WIDTH  320
+#define SCREEN_HEIGHT 240
+
+void coverViewInit(CoverView *view) {
+    memset(view, 0, sizeof(CoverView));
+
+    // What consoleInit() sets up, so the HUD and keyboard can share it
+    gfxSetScreenFormat(GFX_BOTTOM, GSP_RGB565_OES);
+    gfxSetDoubleBuffering(GFX_BOTTOM, false);
+}
+
+// The framebuffer is the screen turned on its side: one column of 240
+// pixels after another, bottom to top
+static void drawTile(const CoverSlot *slot) {
+    u16 *frame = (u16 *)gfxGetFramebuffer(GFX_BOTTOM, GFX_LEFT, NULL, NULL);
+    memset(frame, 0, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u16));
+    if (!slot) {
+        return;
+    }
+
+    int left = (SCREEN_WIDTH - slot->width) / 2;
+    int top = (SCREEN_HEIGHT - slot->height) / 2;
+    for (int x = 0; x < slot->width; x++) {
+        u16 *column = frame + (left + x) * SCREEN_HEIGHT + (SCREEN_HEIGHT - 1 - top);
+        const u16 *pixel = slot->pixels + x;
+        for (int y = 0; y < slot->height; y++, pixel += slot->width) {
+            column[-y] = *pixel;
+        }
+    }
+}
+
+bool coverViewUpdate(CoverView *view, CoverCache *cache, const char *path) {
+    if (!path) {
+        path = "";
+    }
+    u32 finished = coverFinished(cache);
+    if (strcmp(view->path, path) != 0) {
+        snprintf(view->path, sizeof(view->path), "%s", path);
+        view->shown = COVER_SHOWN_NONE;
+    } else if (view->shown != COVER_SHOWN_NONE && finished == view->seen) {
+        return false;
+    }
+    view->seen = finished;
+
+    coverLock(cache);
+    const CoverSlot *slot = path[0] ? coverFind(cache, path) : NULL;
+    CoverShown shown = slot && slot->state == COVER_READY ? COVER_SHOWN_TILE : COVER_SHOWN_BLANK;
+    bool changed = view->shown != shown;
+    if (changed) {
+        drawTile(shown == COVER_SHOWN_TILE ? slot : NULL);
+        view->shown = shown;
+    }
+    coverUnlock(cache);
+    return changed;
+}
@@ -0,0 +1,39 @@
+#ifndef COVERVIEW_H
+#define COVERVIEW_H
+
+#include <3ds.h>
+
+#include "cover.h"
+
+// The highlighted folder's cover, centred on the bottom screen.
+//
+// The bottom screen is the same RGB565 framebuffer the HUD and the search
+// keyboard print to, so a tile is copied straight in, rotated to the
+// framebuffer's column order. The view only touches the screen when the
+// folder changes or its tile arrives; while a cover is still being decoded
+// the screen is left blank rather than showing the previous folder's.
+
+typedef enum {
+    COVER_SHOWN_NONE,  // unknown, another console has drawn over it
+    COVER_SHOWN_BLANK,
+    COVER_SHOWN_TILE,
+} CoverShown;
+
+typedef struct {
+    char path[COVER_PATH_LEN]; // folder being shown, "" for none
+    u32 seen;                  // coverFinished() at the last look
+    CoverShown shown;
+} CoverView;
+
+void coverViewInit(CoverView *view);
+
+// Shows path's cover, or nothing for NULL. Returns true if the screen
+// changed and needs presenting.
+bool coverViewUpdate(CoverView *view, CoverCache *cache, const char *path);
+
+// After the HUD or the keyboard has had the screen
+static inline void coverViewInvalidate(CoverView *view) {
+    view->shown = COVER_SHOWN_NONE;
+}
+
+#endif
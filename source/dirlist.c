@@ -0,0 +1,285 @@
+#include "dirlist.h"
+#include "fsdir.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+void initDirectoryList(DirectoryList *list, LibraryIndex *library, const AppState *active,
+                       int visibleLines) {
+    memset(list, 0, sizeof(DirectoryList));
+    list->library = library;
+    list->active = active;
+    list->visibleLines = visibleLines;
+}
+
+void freeDirectoryList(DirectoryList *list) {
+    free(list->entries);
+    free(list->names);
+    list->entries = NULL;
+    list->names = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    list->namesSize = 0;
+    list->namesCapacity = 0;
+}
+
+// Appends an entry, growing the entry array and the name arena as needed
+static bool addEntry(DirectoryList *list, const char *name, u16 nameLength, u16 flags, int node) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        DirectoryEntry *entries = (DirectoryEntry *)realloc(list->entries, sizeof(DirectoryEntry) * capacity);
+        if (!entries) {
+            return false;
+        }
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+
+    if (list->namesSize + nameLength + 1 > list->namesCapacity) {
+        u32 capacity = list->namesCapacity ? list->namesCapacity * 2 : 2048;
+        while (capacity < list->namesSize + nameLength + 1) {
+            capacity *= 2;
+        }
+        char *names = (char *)realloc(list->names, capacity);
+        if (!names) {
+            return false;
+        }
+        list->names = names;
+        list->namesCapacity = capacity;
+    }
+
+    DirectoryEntry *entry = &list->entries[list->count++];
+    entry->nameOffset = list->namesSize;
+    entry->nameLength = nameLength;
+    entry->flags = flags;
+    entry->moflexCount = -1;
+    entry->node = node;
+
+    memcpy(list->names + list->namesSize, name, nameLength);
+    list->names[list->namesSize + nameLength] = '\0';
+    list->namesSize += nameLength + 1;
+    return true;
+}
+
+// Fills the list from the index node's children, already in display order
+static void populateFromIndex(DirectoryList *list, int node) {
+    list->count = 0;
+    list->namesSize = 0;
+
+    // The index keeps children in natural order; a folder only needs sorting
+    // here if nodes were added to it outside a scan
+    LibraryIndex *lib = list->library;
+    libraryLock(lib);
+    librarySortChildren(lib, node);
+    for (int c = lib->nodes[node].firstChild; c >= 0; c = lib->nodes[c].nextSibling) {
+        // The index only holds directories
+        if (!addEntry(list, libraryNodeName(lib, c), lib->nodes[c].nameLength, ENTRY_DIRECTORY, c)) {
+            break;
+        }
+    }
+    libraryUnlock(lib);
+
+    updateEntryCounts(list);
+}
+
+static bool listDirectory(DirectoryList *list, const char *path) {
+    // The arrays from the previous listing are reused as they are
+    list->count = 0;
+    list->namesSize = 0;
+    list->selected = 0;
+    list->scrollOffset = 0;
+    if (list->currentPath != path) {
+        strncpy(list->currentPath, path, DIRLIST_PATH_LEN - 1);
+    }
+
+    // Serve the listing straight from the index when we have it; the main
+    // loop revalidates it once the first frame is up
+    libraryLock(list->library);
+    int node = libraryFind(list->library, path);
+    u16 flags = (node >= 0) ? list->library->nodes[node].flags : 0;
+    libraryUnlock(list->library);
+
+    if (flags & LIBRARY_NODE_SCANNED) {
+        // Already checked this session (we've been here, or the scanner has)
+        list->validated = (flags & LIBRARY_NODE_FRESH) != 0;
+    } else {
+        list->validated = true;
+        node = libraryRefresh(list->library, path, NULL);
+        if (node < 0) {
+            return false;
+        }
+    }
+
+    TRACE_SPAN("dirlist.populate", node, populateFromIndex(list, node));
+    return true;
+}
+
+bool loadDirectory(DirectoryList *list, const char *path) {
+    u64 start = svcGetSystemTick();
+    bool ok;
+    TRACE_SPAN("loadDirectory", 0, ok = listDirectory(list, path));
+    list->loadTicks = svcGetSystemTick() - start;
+    return ok;
+}
+
+bool selectEntry(DirectoryList *list, const char *name) {
+    int found = -1;
+    for (int i = 0; i < list->count; i++) {
+        if (strcmp(entryName(list, &list->entries[i]), name) == 0) {
+            found = i;
+            break;
+        }
+    }
+    if (found < 0) {
+        return false;
+    }
+
+    list->selected = found;
+    if (list->selected < list->scrollOffset ||
+        list->selected >= list->scrollOffset + list->visibleLines) {
+        list->scrollOffset = list->selected;
+    }
+    if (list->scrollOffset > list->count - list->visibleLines) {
+        list->scrollOffset = list->count > list->visibleLines ? list->count - list->visibleLines : 0;
+    }
+    return true;
+}
+
+static bool checkDirectory(DirectoryList *list) {
+    list->validated = true;
+
+    bool changed = false;
+    int node = libraryRefresh(list->library, list->currentPath, &changed);
+    if (node < 0) {
+        list->count = 0;
+        list->selected = 0;
+        list->scrollOffset = 0;
+        return true;
+    }
+    if (!changed) {
+        return false;
+    }
+
+    // Keep the cursor on the same folder if it is still there
+    char selectedName[FSDIR_NAME_LEN] = "";
+    if (list->count > 0) {
+        strncpy(selectedName, entryName(list, &list->entries[list->selected]), FSDIR_NAME_LEN - 1);
+    }
+
+    TRACE_SPAN("dirlist.populate", node, populateFromIndex(list, node));
+
+    if (!selectEntry(list, selectedName)) {
+        list->selected = 0;
+        list->scrollOffset = 0;
+    }
+    return true;
+}
+
+bool revalidateDirectory(DirectoryList *list) {
+    u64 start = svcGetSystemTick();
+    bool changed = checkDirectory(list);
+    list->loadTicks = svcGetSystemTick() - start;
+    return changed;
+}
+
+typedef struct {
+    const char *name; // folder name, inside the manifest's strings
+    int files;
+} RootOrigin;
+
+// Files of the active collection in root, by folder of the listing they
+// came from. Files are added a folder at a time, so runs share one origin
+// string and each run is compared once. Returns the number of folders; the
+// caller frees *out.
+static int countRootOrigins(const DirectoryList *list, RootOrigin **out) {
+    const AppState *active = list->active;
+    *out = NULL;
+    if (!active || !active->filesActive) {
+        return 0;
+    }
+
+    size_t prefix = strlen(list->currentPath);
+    RootOrigin *origins = NULL;
+    int count = 0;
+    int capacity = 0;
+    const char *run = NULL;
+    int match = -1; // origin the current run counts towards, -1 for none
+
+    for (int i = 0; i < active->fileCount; i++) {
+        const char *origin = stateFileOrigin(active, i);
+        if (origin != run) {
+            run = origin;
+            match = -1;
+            if (strncmp(origin, list->currentPath, prefix) == 0) {
+                const char *name = origin + prefix;
+                for (int o = 0; o < count && match < 0; o++) {
+                    if (strcmp(origins[o].name, name) == 0) {
+                        match = o;
+                    }
+                }
+                if (match < 0) {
+                    if (count == capacity) {
+                        int grown = capacity ? capacity * 2 : 4;
+                        RootOrigin *more = (RootOrigin *)realloc(origins, sizeof(RootOrigin) * grown);
+                        if (!more) {
+                            break;
+                        }
+                        origins = more;
+                        capacity = grown;
+                    }
+                    origins[count].name = name;
+                    origins[count].files = 0;
+                    match = count++;
+                }
+            }
+        }
+        if (match >= 0) {
+            origins[match].files++;
+        }
+    }
+
+    *out = origins;
+    return count;
+}
+
+// Counts include the files of the active collection that are in root. The
+// manifest is gone through once, before the lock is taken, so the rows only
+// compare names against the few folders it has files from.
+bool updateEntryCounts(DirectoryList *list) {
+    bool changed = false;
+    RootOrigin *origins;
+    int originCount = countRootOrigins(list, &origins);
+
+    libraryLock(list->library);
+    for (int i = 0; i < list->count; i++) {
+        DirectoryEntry *entry = &list->entries[i];
+        if (entry->node < 0 || entry->node >= list->library->nodeCount) {
+            continue;
+        }
+
+        // Counts loaded from the index are shown until rechecked; a folder
+        // the scanner couldn't open stays at (...)
+        const LibraryNode *node = &list->library->nodes[entry->node];
+        if (!(node->flags & LIBRARY_NODE_SCANNED)) {
+            continue;
+        }
+
+        int count = node->moflexCount;
+        for (int o = 0; o < originCount; o++) {
+            if (strcmp(origins[o].name, entryName(list, entry)) == 0) {
+                count += origins[o].files;
+                break;
+            }
+        }
+        if (count != entry->moflexCount) {
+            entry->moflexCount = count;
+            changed = true;
+        }
+    }
+    libraryUnlock(list->library);
+
+    free(origins);
+    return changed;
+}
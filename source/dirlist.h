@@ -0,0 +1,67 @@
+#ifndef DIRLIST_H
+#define DIRLIST_H
+
+#include "platform.h"
+#include "library.h"
+#include "state.h"
+
+// The folder listing shown by the browser, filled from the library index.
+//
+// Entries are packed records and their names live in one arena, both on
+// the regular heap and kept between navigations; both arrays only ever grow.
+
+#define DIRLIST_PATH_LEN 512
+
+#define ENTRY_DIRECTORY 0x0001
+
+typedef struct {
+    u32 nameOffset;  // into the list's name arena
+    u16 nameLength;
+    u16 flags;
+    s32 moflexCount; // -1 means not scanned yet
+    s32 node;        // library node, -1 if not indexed
+} DirectoryEntry;
+
+typedef struct {
+    DirectoryEntry *entries;
+    int count;
+    int capacity;
+    char *names;
+    u32 namesSize;
+    u32 namesCapacity;
+    int selected;
+    int scrollOffset;
+    int visibleLines;
+    bool validated; // false while showing cached index contents
+    u64 loadTicks;  // how long the last load or revalidation took
+    char currentPath[DIRLIST_PATH_LEN];
+
+    LibraryIndex *library;
+    const AppState *active; // its files in root are added to the counts
+} DirectoryList;
+
+void initDirectoryList(DirectoryList *list, LibraryIndex *library, const AppState *active,
+                       int visibleLines);
+void freeDirectoryList(DirectoryList *list);
+
+// Lists path, from the index if it has it (validated is then false until
+// revalidateDirectory() has checked it against the card).
+bool loadDirectory(DirectoryList *list, const char *path);
+
+// Re-enumerates the current directory and refreshes the listing if its
+// fingerprint changed. Returns true when the list needs redrawing.
+bool revalidateDirectory(DirectoryList *list);
+
+// Puts the cursor on the entry with this name, scrolling it into view.
+// Returns false (leaving the cursor alone) if there is none.
+bool selectEntry(DirectoryList *list, const char *name);
+
+// Copies counts that are known for this session into the entries. Returns
+// true if any entry changed.
+bool updateEntryCounts(DirectoryList *list);
+
+static inline const char *entryName(const DirectoryList *list, const DirectoryEntry *entry) {
+    return list->names + entry->nameOffset;
+}
+
+#endif
@@ -0,0 +1,807 @@
+#include "dupes.h"
+#include "array.h"
+#include "library.h"
+#include "fsdir.h"
+#include "fsfile.h"
+#include "hash.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define DUPES_STACK_SIZE (16 * 1024)
+#define DUPES_PRIORITY   0x3F // lowest, next to the scanner
+
+static int addFolder(DupeIndex *index, const char *path, size_t len) {
+    int f = folderTableAdd(&index->table, path, len, index->fileCount);
+    index->dirty |= f >= 0;
+    return f;
+}
+
+static DupeFile *addFile(DupeIndex *index, int folder, const char *name, u64 size) {
+    size_t len = strlen(name);
+    if (len > 0xFFFF ||
+        !arrayReserve((void **)&index->files, &index->fileCapacity, index->fileCount + 1, sizeof(DupeFile), 256) ||
+        !folderTableReserveStrings(&index->table, index->table.stringSize + len + 1)) {
+        return NULL;
+    }
+
+    DupeFile *file = &index->files[index->fileCount++];
+    memset(file, 0, sizeof(DupeFile));
+    file->nameOffset = index->table.stringSize;
+    file->nameLength = (u16)len;
+    file->folder = folder;
+    file->size = size;
+    memcpy(index->table.strings + index->table.stringSize, name, len + 1);
+    index->table.stringSize += len + 1;
+    index->dirty = true;
+    return file;
+}
+
+void dupesInit(DupeIndex *index, const char *basePath) {
+    memset(index, 0, sizeof(DupeIndex));
+    snprintf(index->basePath, sizeof(index->basePath), "%s", basePath);
+    LightLock_Init(&index->lock);
+}
+
+void dupesFree(DupeIndex *index) {
+    folderTableFree(&index->table);
+    free(index->files);
+    free(index->candidates);
+    free(index->groups);
+    index->files = NULL;
+    index->candidates = NULL;
+    index->groups = NULL;
+    index->fileCount = index->fileCapacity = 0;
+    index->candidateCount = index->candidateCapacity = 0;
+    index->groupCount = index->groupCapacity = 0;
+    index->wasted = 0;
+}
+
+// --- grouping --------------------------------------------------------------
+
+typedef struct {
+    u64 size;
+    u32 sample;
+    u32 full;
+    s32 file;
+} CandidateKey;
+
+static int compareKeys(const void *a, const void *b) {
+    const CandidateKey *x = (const CandidateKey *)a;
+    const CandidateKey *y = (const CandidateKey *)b;
+    if (x->size != y->size) {
+        return x->size < y->size ? -1 : 1;
+    }
+    if (x->sample != y->sample) {
+        return x->sample < y->sample ? -1 : 1;
+    }
+    if (x->full != y->full) {
+        return x->full < y->full ? -1 : 1;
+    }
+    return x->file - y->file;
+}
+
+static CandidateKey *sortedKeys(const DupeIndex *index, const s32 *files, int count) {
+    CandidateKey *keys = (CandidateKey *)malloc(sizeof(CandidateKey) * (count > 0 ? count : 1));
+    if (!keys) {
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        const DupeFile *file = &index->files[files[i]];
+        keys[i].size = file->size;
+        keys[i].sample = file->sample;
+        keys[i].full = file->full;
+        keys[i].file = files[i];
+    }
+    qsort(keys, count, sizeof(CandidateKey), compareKeys);
+    return keys;
+}
+
+static bool addGroup(DupeIndex *index, u64 size, int first, int count, u16 flags) {
+    if (!arrayReserve((void **)&index->groups, &index->groupCapacity, index->groupCount + 1, sizeof(DupeGroup), 64)) {
+        return false;
+    }
+    DupeGroup *group = &index->groups[index->groupCount++];
+    group->size = size;
+    group->first = first;
+    group->count = count;
+    group->flags = flags;
+    if (flags & DUPE_GROUP_IDENTICAL) {
+        index->wasted += size * (count - 1);
+    }
+    return true;
+}
+
+// Sorts the candidates by what is known about them and splits them into
+// groups: by size, then by sample once every file of the size has one, then
+// by full hash once every file with the sample has one
+static void buildGroups(DupeIndex *index) {
+    index->groupCount = 0;
+    index->wasted = 0;
+    CandidateKey *keys = sortedKeys(index, index->candidates, index->candidateCount);
+    if (!keys) {
+        return;
+    }
+    for (int i = 0; i < index->candidateCount; i++) {
+        index->candidates[i] = keys[i].file;
+    }
+
+    int count = index->candidateCount;
+    for (int i = 0, j; i < count; i = j) {
+        bool sampled = true;
+        for (j = i; j < count && keys[j].size == keys[i].size; j++) {
+            sampled = sampled && (index->files[keys[j].file].flags & DUPE_FILE_SAMPLED);
+        }
+        if (!sampled) {
+            addGroup(index, keys[i].size, i, j - i, 0);
+            continue;
+        }
+
+        for (int k = i, l; k < j; k = l) {
+            bool hashed = true;
+            for (l = k; l < j && keys[l].sample == keys[k].sample; l++) {
+                hashed = hashed && (index->files[keys[l].file].flags & DUPE_FILE_HASHED);
+            }
+            if (l - k < 2) {
+                continue;
+            }
+            if (!hashed) {
+                addGroup(index, keys[k].size, k, l - k, DUPE_GROUP_SAMPLED);
+                continue;
+            }
+            for (int m = k, n; m < l; m = n) {
+                for (n = m; n < l && keys[n].full == keys[m].full; n++) {
+                }
+                if (n - m >= 2) {
+                    addGroup(index, keys[m].size, m, n - m, DUPE_GROUP_SAMPLED | DUPE_GROUP_IDENTICAL);
+                }
+            }
+        }
+    }
+    free(keys);
+}
+
+// Every live file that shares its size with another one. Empty files are
+// left out, they are all the same.
+static void collectCandidates(DupeIndex *index) {
+    index->candidateCount = 0;
+    int live = 0;
+    s32 *files = (s32 *)malloc(sizeof(s32) * (index->fileCount > 0 ? index->fileCount : 1));
+    if (!files) {
+        buildGroups(index);
+        return;
+    }
+    for (int i = 0; i < index->fileCount; i++) {
+        if (!(index->files[i].flags & DUPE_FILE_DEAD) && index->files[i].size > 0) {
+            files[live++] = i;
+        }
+    }
+
+    CandidateKey *keys = sortedKeys(index, files, live);
+    free(files);
+    if (keys && arrayReserve((void **)&index->candidates, &index->candidateCapacity, live > 0 ? live : 1,
+                             sizeof(s32), 256)) {
+        for (int i = 0, j; i < live; i = j) {
+            for (j = i; j < live && keys[j].size == keys[i].size; j++) {
+            }
+            for (int k = i; j - i >= 2 && k < j; k++) {
+                index->candidates[index->candidateCount++] = keys[k].file;
+            }
+        }
+    }
+    free(keys);
+    buildGroups(index);
+}
+
+// --- persistence -----------------------------------------------------------
+
+bool dupesLoad(DupeIndex *index, const char *file) {
+    size_t size;
+    u8 *buffer = indexFileRead(file, sizeof(DupeFileHeader), &size);
+    if (!buffer) {
+        return false;
+    }
+
+    DupeFileHeader header;
+    memcpy(&header, buffer, sizeof(header));
+
+    size_t folderBytes = (size_t)header.folderCount * sizeof(IndexFolder);
+    size_t fileBytes = (size_t)header.fileCount * sizeof(DupeFile);
+    if (header.magic != DUPES_MAGIC ||
+        header.version != DUPES_VERSION ||
+        header.folderCount > 0x100000 || header.fileCount > 0x1000000 ||
+        sizeof(header) + folderBytes + fileBytes + header.stringSize != size) {
+        free(buffer);
+        return false;
+    }
+
+    const u8 *payload = buffer + sizeof(header);
+    if (fnv1a32(FNV1A_32_INIT, payload, size - sizeof(header)) != header.checksum) {
+        free(buffer);
+        return false;
+    }
+
+    const IndexFolder *folders = (const IndexFolder *)payload;
+    const DupeFile *files = (const DupeFile *)(payload + folderBytes);
+    const char *strings = (const char *)(payload + folderBytes + fileBytes);
+    bool ok = folderTableCheck(folders, header.folderCount, header.fileCount, strings, header.stringSize);
+    for (u32 i = 0; ok && i < header.fileCount; i++) {
+        const DupeFile *entry = &files[i];
+        ok = (u64)entry->nameOffset + entry->nameLength < header.stringSize &&
+             strings[entry->nameOffset + entry->nameLength] == '\0' &&
+             entry->folder >= 0 && (u32)entry->folder < header.folderCount;
+    }
+    if (!ok) {
+        free(buffer);
+        return false;
+    }
+
+    DupeIndex loaded;
+    dupesInit(&loaded, index->basePath);
+    int fileCount = (int)header.fileCount;
+    if (!folderTableLoad(&loaded.table, folders, (int)header.folderCount, strings, header.stringSize) ||
+        !arrayReserve((void **)&loaded.files, &loaded.fileCapacity, fileCount > 0 ? fileCount : 1,
+                      sizeof(DupeFile), 256)) {
+        dupesFree(&loaded);
+        free(buffer);
+        return false;
+    }
+    memcpy(loaded.files, files, fileBytes);
+    loaded.fileCount = fileCount;
+    free(buffer);
+
+    // The last report can be shown right away
+    collectCandidates(&loaded);
+
+    LightLock_Lock(&index->lock);
+    dupesFree(index);
+    lockedReplace(index, &loaded, lock);
+    LightLock_Unlock(&index->lock);
+    return true;
+}
+
+bool dupesSave(DupeIndex *index, const char *file) {
+    // Compact into a fresh index: dead folders and files are dropped
+    DupeIndex out;
+    dupesInit(&out, index->basePath);
+    bool ok = true;
+
+    for (int f = 0; f < index->table.folderCount && ok; f++) {
+        const IndexFolder *folder = &index->table.folders[f];
+        if (folder->flags & FOLDER_DEAD) {
+            continue;
+        }
+        int copy = addFolder(&out, dupesFolderPath(index, f), folder->pathLength);
+        if (copy < 0) {
+            ok = false;
+            break;
+        }
+        out.table.folders[copy].flags = folder->flags & ~FOLDER_SEEN;
+        out.table.folders[copy].fingerprint = folder->fingerprint;
+        for (int i = folder->first; i < folder->first + folder->count; i++) {
+            const DupeFile *entry = &index->files[i];
+            if (entry->flags & DUPE_FILE_DEAD) {
+                continue;
+            }
+            DupeFile *kept = addFile(&out, copy, dupesFileName(index, i), entry->size);
+            if (!kept) {
+                ok = false;
+                break;
+            }
+            kept->flags = entry->flags;
+            kept->sample = entry->sample;
+            kept->full = entry->full;
+        }
+        out.table.folders[copy].count = out.fileCount - out.table.folders[copy].first;
+    }
+    if (!ok) {
+        dupesFree(&out);
+        return false;
+    }
+
+    IndexSection sections[] = {
+        {out.table.folders, sizeof(IndexFolder) * out.table.folderCount},
+        {out.files, sizeof(DupeFile) * out.fileCount},
+        {out.table.strings, out.table.stringSize},
+    };
+    DupeFileHeader header;
+    header.magic = DUPES_MAGIC;
+    header.version = DUPES_VERSION;
+    header.folderCount = out.table.folderCount;
+    header.fileCount = out.fileCount;
+    header.stringSize = out.table.stringSize;
+    header.checksum = indexChecksum(sections, 3);
+    ok = indexFileWrite(file, &header, sizeof(header), sections, 3);
+
+    // Keep using the compacted copy, with its groups rebuilt for the new
+    // file indices
+    collectCandidates(&out);
+    out.dirty = !ok;
+    LightLock_Lock(&index->lock);
+    dupesFree(index);
+    lockedReplace(index, &out, lock);
+    LightLock_Unlock(&index->lock);
+    return ok;
+}
+
+// --- background pass -------------------------------------------------------
+
+// Whether the folder's files are still the ones listed, name and size, in
+// the same order
+static bool sameFiles(const DupeIndex *index, const IndexFolder *folder, const FolderScan *scan) {
+    if (!(folder->flags & FOLDER_LISTED) || folder->fingerprint != scan->fingerprint ||
+        folder->count != scan->fileCount) {
+        return false;
+    }
+    int i = folder->first;
+    int file = 0;
+    for (size_t off = 0; off < scan->size; off += strlen(scan->entries + off) + 1) {
+        if (scan->entries[off] != 'f') {
+            continue;
+        }
+        if (index->files[i].size != scan->sizes[file] || strcmp(dupesFileName(index, i), scan->entries + off + 1) != 0) {
+            return false;
+        }
+        i++;
+        file++;
+    }
+    return true;
+}
+
+// Stores a listing unless the folder is unchanged. Files that kept their
+// name and size keep their hashes.
+static void applyScan(DupeIndex *index, const char *path, const FolderScan *scan) {
+    LightLock_Lock(&index->lock);
+    size_t len = strlen(path);
+    int f = folderTableFind(&index->table, path, len);
+    if (f < 0) {
+        f = addFolder(index, path, len);
+    }
+    if (f < 0) {
+        LightLock_Unlock(&index->lock);
+        return;
+    }
+
+    IndexFolder *folder = &index->table.folders[f];
+    folder->flags |= FOLDER_SEEN;
+    folder->flags &= ~FOLDER_DEAD;
+    if (sameFiles(index, folder, scan)) {
+        LightLock_Unlock(&index->lock);
+        return;
+    }
+
+    int oldFirst = folder->first;
+    int oldCount = folder->count;
+    int first = index->fileCount;
+    int file = 0;
+    for (size_t off = 0; off < scan->size; off += strlen(scan->entries + off) + 1) {
+        if (scan->entries[off] != 'f') {
+            continue;
+        }
+        const char *name = scan->entries + off + 1;
+        u64 size = scan->sizes[file++];
+        DupeFile *added = addFile(index, f, name, size);
+        if (!added) {
+            break;
+        }
+        for (int i = oldFirst; i < oldFirst + oldCount; i++) {
+            const DupeFile *old = &index->files[i];
+            if (!(old->flags & DUPE_FILE_DEAD) && old->size == size && strcmp(dupesFileName(index, i), name) == 0) {
+                added = &index->files[index->fileCount - 1];
+                added->flags = old->flags;
+                added->sample = old->sample;
+                added->full = old->full;
+                break;
+            }
+        }
+    }
+    for (int i = oldFirst; i < oldFirst + oldCount; i++) {
+        index->files[i].flags |= DUPE_FILE_DEAD;
+    }
+
+    folder = &index->table.folders[f];
+    folder->first = first;
+    folder->count = index->fileCount - first;
+    folder->fingerprint = scan->fingerprint;
+    folder->flags |= FOLDER_LISTED;
+    index->dirty = true;
+    LightLock_Unlock(&index->lock);
+}
+
+// Folders that weren't reached are gone from the card
+static void finishListing(DupeIndex *index) {
+    LightLock_Lock(&index->lock);
+    for (int f = 0; f < index->table.folderCount; f++) {
+        IndexFolder *folder = &index->table.folders[f];
+        if (folder->flags & (FOLDER_SEEN | FOLDER_DEAD)) {
+            continue;
+        }
+        folder->flags |= FOLDER_DEAD;
+        for (int i = folder->first; i < folder->first + folder->count; i++) {
+            index->files[i].flags |= DUPE_FILE_DEAD;
+        }
+        index->dirty = true;
+    }
+    collectCandidates(index);
+    LightLock_Unlock(&index->lock);
+}
+
+static bool isHeld(DupeFinder *finder, const char *fullPath) {
+    LightLock_Lock(&finder->lock);
+    bool held = folderIsHeld(finder->hold, fullPath);
+    LightLock_Unlock(&finder->lock);
+    return held;
+}
+
+// Sleeps through a pause; false if the finder is stopping
+static bool waitWhilePaused(DupeFinder *finder) {
+    while (finder->paused && !finder->quit) {
+        svcSleepThread(10000000LL); // 10ms
+    }
+    return !finder->quit;
+}
+
+// Announces a file read before looking at paused, so a pause either sees it
+// or is seen by it. False if paused.
+static bool beginRead(DupeFinder *finder) {
+    __atomic_store_n(&finder->reading, true, __ATOMIC_SEQ_CST);
+    if (finder->paused) {
+        __atomic_store_n(&finder->reading, false, __ATOMIC_SEQ_CST);
+        return false;
+    }
+    return true;
+}
+
+static void endRead(DupeFinder *finder) {
+    __atomic_store_n(&finder->reading, false, __ATOMIC_SEQ_CST);
+}
+
+static void notify(DupeFinder *finder) {
+    if (finder->notify) {
+        LightEvent_Signal(finder->notify);
+    }
+}
+
+// Opens a file where it is now: in its folder, or in rootDir while its
+// collection is held there
+static bool openFile(DupeFinder *finder, int file, FileReader *reader) {
+    DupeIndex *index = finder->index;
+    char folderPath[DUPES_PATH_LEN + 256];
+    char name[FSDIR_NAME_LEN];
+    char path[DUPES_PATH_LEN + 256 + FSDIR_NAME_LEN];
+
+    LightLock_Lock(&index->lock);
+    const char *relative = dupesFolderPath(index, index->files[file].folder);
+    snprintf(folderPath, sizeof(folderPath), "%s%s", index->basePath, relative);
+    snprintf(name, sizeof(name), "%s", dupesFileName(index, file));
+    LightLock_Unlock(&index->lock);
+
+    snprintf(path, sizeof(path), "%s/%s", folderPath, name);
+    if (fileOpen(reader, path)) {
+        return true;
+    }
+    if (isHeld(finder, folderPath)) {
+        snprintf(path, sizeof(path), "%s%s", finder->rootDir, name);
+        return fileOpen(reader, path);
+    }
+    return false;
+}
+
+static u32 hashBytes(u32 hash, const u8 *data, u32 length) {
+    hash = fnv1a32Words(hash, (const u32 *)data, length / 4);
+    return fnv1a32(hash, data + (length & ~3u), length & 3);
+}
+
+// Whole file in DUPES_CHUNK reads. False if it could not be read or the
+// finder was paused or stopped part way.
+static bool hashFull(DupeFinder *finder, FileReader *reader, u8 *buffer, u32 *hash) {
+    *hash = FNV1A_32_INIT;
+    for (u64 offset = 0; offset < reader->size;) {
+        if (finder->paused || finder->quit) {
+            return false;
+        }
+        u32 want = reader->size - offset < DUPES_CHUNK ? (u32)(reader->size - offset) : DUPES_CHUNK;
+        u32 read = fileRead(reader, offset, buffer, want);
+        if (read == 0) {
+            return false;
+        }
+        *hash = hashBytes(*hash, buffer, read);
+        offset += read;
+        __atomic_add_fetch(&finder->bytes, read, __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+// Start, middle and end, each read aligned so it is one FSFILE_Read of whole
+// sectors; the last read runs to the end of the file
+static bool hashSample(DupeFinder *finder, FileReader *reader, u8 *buffer, u32 *hash) {
+    u64 size = reader->size;
+    u64 offsets[3] = {
+        0,
+        (size / 2) & ~(u64)(DUPES_SAMPLE_SIZE - 1),
+        (size - DUPES_SAMPLE_SIZE) & ~(u64)(DUPES_SAMPLE_SIZE - 1),
+    };
+    *hash = fnv1a32(FNV1A_32_INIT, &size, sizeof(size));
+    for (int i = 0; i < 3; i++) {
+        u32 want = i < 2 ? DUPES_SAMPLE_SIZE : (u32)(size - offsets[i]);
+        u32 read = fileRead(reader, offsets[i], buffer, want);
+        if (read != want) {
+            return false;
+        }
+        *hash = hashBytes(*hash, buffer, read);
+        __atomic_add_fetch(&finder->bytes, read, __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+// Fills in the sample of one candidate, or both hashes for a file small
+// enough that the samples would cover most of it anyway
+static void sampleFile(DupeFinder *finder, int file, u8 *buffer) {
+    FileReader reader;
+    if (!beginRead(finder)) {
+        return;
+    }
+    if (!openFile(finder, file, &reader)) {
+        endRead(finder);
+        return;
+    }
+    u32 sample = 0, full = 0;
+    bool small = reader.size < 4 * DUPES_SAMPLE_SIZE;
+    bool done;
+    TRACE_SPAN("dupes.sample", 0,
+               done = small ? hashFull(finder, &reader, buffer, &full) : hashSample(finder, &reader, buffer, &sample));
+    u64 size = reader.size;
+    fileClose(&reader);
+    endRead(finder);
+
+    DupeIndex *index = finder->index;
+    LightLock_Lock(&index->lock);
+    DupeFile *entry = &index->files[file];
+    if (done && size == entry->size) {
+        entry->sample = small ? full : sample;
+        entry->full = full;
+        entry->flags |= DUPE_FILE_SAMPLED | (small ? DUPE_FILE_HASHED : 0);
+        index->dirty = true;
+    }
+    LightLock_Unlock(&index->lock);
+}
+
+static bool hashFile(DupeFinder *finder, int file, u8 *buffer) {
+    FileReader reader;
+    if (!beginRead(finder)) {
+        return false;
+    }
+    if (!openFile(finder, file, &reader)) {
+        endRead(finder);
+        return true; // gone, it stays out of the identical groups
+    }
+    u32 full;
+    bool done;
+    TRACE_SPAN("dupes.hash", (u32)(reader.size >> 20), done = hashFull(finder, &reader, buffer, &full));
+    u64 size = reader.size;
+    fileClose(&reader);
+    endRead(finder);
+
+    DupeIndex *index = finder->index;
+    LightLock_Lock(&index->lock);
+    DupeFile *entry = &index->files[file];
+    if (done && size == entry->size) {
+        entry->full = full;
+        entry->flags |= DUPE_FILE_HASHED;
+        index->dirty = true;
+    }
+    LightLock_Unlock(&index->lock);
+    return done || !finder->paused;
+}
+
+// Breadth first from basePath, paths relative to it. False if the finder
+// stopped before every folder was listed.
+static bool listAll(DupeFinder *finder) {
+    DupeIndex *index = finder->index;
+    FolderQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    FolderScan scan;
+    memset(&scan, 0, sizeof(scan));
+    char path[DUPES_PATH_LEN];
+    char fullPath[DUPES_PATH_LEN + 256];
+
+    bool ok = folderQueuePush(&queue, "");
+    while (ok && waitWhilePaused(finder) && folderQueuePop(&queue, path, sizeof(path))) {
+        snprintf(fullPath, sizeof(fullPath), "%s%s", index->basePath, path);
+
+        bool listed;
+        TRACE_SPAN("dupes.scan", 0, listed = folderScan(fullPath, true, &scan));
+        if (listed && isHeld(finder, fullPath)) {
+            // Its files are in rootDir for now; keep what was indexed
+            LightLock_Lock(&index->lock);
+            int f = folderTableFind(&index->table, path, strlen(path));
+            if (f >= 0) {
+                index->table.folders[f].flags |= FOLDER_SEEN;
+            }
+            LightLock_Unlock(&index->lock);
+        } else if (listed) {
+            applyScan(index, path, &scan);
+        }
+        if (listed) {
+            ok = folderQueueChildren(&queue, path, &scan);
+        }
+
+        __atomic_add_fetch(&finder->folders, 1, __ATOMIC_RELEASE);
+        notify(finder);
+    }
+
+    folderQueueFree(&queue);
+    folderScanFree(&scan);
+    return ok && !finder->quit;
+}
+
+// Candidates that need a step, in candidate order so each run of same-size
+// (or same-sample) files is finished before the next one starts
+static s32 *pendingFiles(DupeIndex *index, u16 flag, u16 groupFlags, int *count) {
+    LightLock_Lock(&index->lock);
+    s32 *files = (s32 *)malloc(sizeof(s32) * (index->candidateCount + index->groupCount + 1));
+    *count = 0;
+    for (int g = 0; files && g < index->groupCount; g++) {
+        const DupeGroup *group = &index->groups[g];
+        if ((group->flags & groupFlags) != groupFlags) {
+            continue;
+        }
+        int before = *count;
+        for (int i = group->first; i < group->first + group->count; i++) {
+            if (!(index->files[index->candidates[i]].flags & flag)) {
+                files[(*count)++] = index->candidates[i];
+            }
+        }
+        if (*count > before) {
+            files[(*count)++] = -1; // end of a group
+        }
+    }
+    LightLock_Unlock(&index->lock);
+    return files;
+}
+
+static void regroup(DupeFinder *finder) {
+    DupeIndex *index = finder->index;
+    LightLock_Lock(&index->lock);
+    buildGroups(index);
+    LightLock_Unlock(&index->lock);
+    notify(finder);
+}
+
+static void runPass(DupeFinder *finder, u8 *buffer) {
+    DupeIndex *index = finder->index;
+    u64 start = svcGetSystemTick();
+    finder->folders = finder->sampled = finder->hashed = finder->toHash = 0;
+    finder->bytes = 0;
+
+    __atomic_store_n(&finder->phase, DUPES_LISTING, __ATOMIC_RELEASE);
+    if (!listAll(finder)) {
+        __atomic_store_n(&finder->phase, DUPES_IDLE, __ATOMIC_RELEASE);
+        return;
+    }
+    finishListing(index);
+
+    LightLock_Lock(&index->lock);
+    u32 live = 0;
+    for (int i = 0; i < index->fileCount; i++) {
+        live += !(index->files[i].flags & DUPE_FILE_DEAD);
+    }
+    finder->files = live;
+    LightLock_Unlock(&index->lock);
+
+    // Same size: sample each file, then split the groups by sample
+    __atomic_store_n(&finder->phase, DUPES_SAMPLING, __ATOMIC_RELEASE);
+    notify(finder);
+    int count;
+    s32 *files = pendingFiles(index, DUPE_FILE_SAMPLED, 0, &count);
+    for (int i = 0; files && i < count && waitWhilePaused(finder); i++) {
+        if (files[i] < 0) {
+            continue;
+        }
+        sampleFile(finder, files[i], buffer);
+        if (finder->paused) {
+            i--; // read it again once the move is done
+            continue;
+        }
+        __atomic_add_fetch(&finder->sampled, 1, __ATOMIC_RELEASE);
+    }
+    free(files);
+    regroup(finder);
+
+    // Same samples: read them whole, publishing each group as it is done
+    __atomic_store_n(&finder->phase, DUPES_HASHING, __ATOMIC_RELEASE);
+    files = pendingFiles(index, DUPE_FILE_HASHED, DUPE_GROUP_SAMPLED, &count);
+    for (int i = 0; files && i < count; i++) {
+        finder->toHash += files[i] >= 0;
+    }
+    for (int i = 0; files && i < count && waitWhilePaused(finder); i++) {
+        if (files[i] < 0) {
+            regroup(finder);
+            continue;
+        }
+        if (!hashFile(finder, files[i], buffer)) {
+            i--; // paused part way
+            continue;
+        }
+        __atomic_add_fetch(&finder->hashed, 1, __ATOMIC_RELEASE);
+        notify(finder);
+    }
+    free(files);
+    if (finder->quit) {
+        return;
+    }
+
+    if (index->dirty) {
+        TRACE_SPAN("dupes.save", index->fileCount, dupesSave(index, finder->file));
+    }
+    finder->passTicks = svcGetSystemTick() - start;
+    __atomic_store_n(&finder->phase, DUPES_DONE, __ATOMIC_RELEASE);
+    notify(finder);
+}
+
+static void finderMain(void *arg) {
+    DupeFinder *finder = (DupeFinder *)arg;
+    u8 *buffer = (u8 *)malloc(DUPES_CHUNK);
+    if (!buffer) {
+        return;
+    }
+
+    while (!finder->quit) {
+        if (!finder->run) {
+            LightEvent_Wait(&finder->wake);
+            continue;
+        }
+        finder->run = false;
+        TRACE_SPAN("dupes.pass", 0, runPass(finder, buffer));
+    }
+    free(buffer);
+}
+
+bool dupesFinderStart(DupeFinder *finder, DupeIndex *index, const char *file, const char *rootDir,
+                      LightEvent *notify) {
+    memset(finder, 0, sizeof(DupeFinder));
+    LightLock_Init(&finder->lock);
+    LightEvent_Init(&finder->wake, RESET_ONESHOT);
+    finder->index = index;
+    finder->notify = notify;
+    strncpy(finder->file, file, sizeof(finder->file) - 1);
+    strncpy(finder->rootDir, rootDir, sizeof(finder->rootDir) - 1);
+
+    // Pinned to the app core with the scanner; it only runs while the UI waits
+    finder->thread = threadCreate(finderMain, finder, DUPES_STACK_SIZE, DUPES_PRIORITY, -2, false);
+    return finder->thread != NULL;
+}
+
+void dupesFinderStop(DupeFinder *finder) {
+    if (!finder->thread) {
+        return;
+    }
+    finder->quit = true;
+    LightEvent_Signal(&finder->wake);
+    threadJoin(finder->thread, U64_MAX);
+    threadFree(finder->thread);
+    finder->thread = NULL;
+}
+
+void dupesFinderRun(DupeFinder *finder) {
+    DupePhase phase = dupesFinderPhase(finder);
+    if (phase == DUPES_IDLE || phase == DUPES_DONE) {
+        finder->run = true;
+        LightEvent_Signal(&finder->wake);
+    }
+}
+
+void dupesFinderPause(DupeFinder *finder, bool paused) {
+    __atomic_store_n(&finder->paused, paused, __ATOMIC_SEQ_CST);
+    while (paused && finder->thread && __atomic_load_n(&finder->reading, __ATOMIC_SEQ_CST)) {
+        svcSleepThread(1000000LL); // 1ms, a file stops at its next chunk
+    }
+}
+
+void dupesFinderHold(DupeFinder *finder, const char *path) {
+    LightLock_Lock(&finder->lock);
+    snprintf(finder->hold, sizeof(finder->hold), "%s", path ? path : "");
+    LightLock_Unlock(&finder->lock);
+}
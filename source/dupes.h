@@ -0,0 +1,162 @@
+#ifndef DUPES_H
+#define DUPES_H
+
+#include "platform.h"
+#include "foldertable.h"
+
+// Duplicate .moflex files anywhere under basePath, persisted to DUPES_FILE.
+//
+// A pass lists every folder with the file sizes the listing carries anyway,
+// then narrows down in three steps so most files are never opened: files
+// whose size no other file has are done; same-size files get a hash of
+// three DUPES_SAMPLE_SIZE regions (start, middle, end); files that still
+// match are hashed in full. Only files that agree on all three are reported
+// as identical.
+//
+// Folders carry the same fingerprint of their entry names as library nodes,
+// and a folder whose fingerprint and file sizes still match keeps its files
+// and their hashes, so a pass over an unchanged card reads nothing but the
+// listings. Groups are published as each step completes, so the report
+// fills in while the full hashes are still being read.
+
+#define DUPES_FILE        "sdmc:/.clownsec_dupes"
+#define DUPES_MAGIC       0x50444C43 // "CLDP"
+#define DUPES_VERSION     1
+#define DUPES_PATH_LEN    512
+#define DUPES_SAMPLE_SIZE 4096
+#define DUPES_CHUNK       (256 * 1024) // full hash read size
+
+#define DUPE_FILE_SAMPLED 0x0001 // sample is valid
+#define DUPE_FILE_HASHED  0x0002 // full is valid
+#define DUPE_FILE_DEAD    0x8000 // superseded by a newer listing, dropped on save
+
+#define DUPE_GROUP_SAMPLED   0x0001 // same samples, not just the same size
+#define DUPE_GROUP_IDENTICAL 0x0002 // same full hash
+
+typedef struct {
+    u32 nameOffset; // into the string pool
+    u16 nameLength;
+    u16 flags;
+    s32 folder;
+    u64 size;
+    u32 sample;     // hash of the sampled regions
+    u32 full;       // hash of the whole file
+} DupeFile;
+
+// Files that are, or may be, copies of each other; members are
+// candidates[first, first + count)
+typedef struct {
+    u64 size;
+    s32 first;
+    s32 count;
+    u16 flags;
+} DupeGroup;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 folderCount;
+    u32 fileCount;
+    u32 stringSize;
+    u32 checksum; // FNV-1a over the tables and string pool
+} DupeFileHeader;
+
+typedef struct {
+    FolderTable table;  // folders are ranges of files; names share its strings
+    DupeFile *files;
+    int fileCount;
+    int fileCapacity;
+
+    // Result of the last step, rebuilt from the hashes above
+    s32 *candidates;    // files sharing their size with another, by size, sample, full
+    int candidateCount;
+    int candidateCapacity;
+    DupeGroup *groups;
+    int groupCount;
+    int groupCapacity;
+    u64 wasted;         // bytes taken by the extra copies of identical files
+
+    char basePath[256]; // ends with '/'
+    bool dirty;
+    LightLock lock;     // held by the report and around every change
+} DupeIndex;
+
+void dupesInit(DupeIndex *index, const char *basePath);
+void dupesFree(DupeIndex *index);
+bool dupesLoad(DupeIndex *index, const char *file);
+
+// Compacts the index and writes it out. Only the finder may call this while
+// it is running.
+bool dupesSave(DupeIndex *index, const char *file);
+
+static inline const char *dupesFolderPath(const DupeIndex *index, int folder) {
+    return folderTablePath(&index->table, folder);
+}
+
+static inline const char *dupesFileName(const DupeIndex *index, int file) {
+    return index->table.strings + index->files[file].nameOffset;
+}
+
+static inline void dupesLock(DupeIndex *index) {
+    LightLock_Lock(&index->lock);
+}
+
+static inline void dupesUnlock(DupeIndex *index) {
+    LightLock_Unlock(&index->lock);
+}
+
+typedef enum {
+    DUPES_IDLE,
+    DUPES_LISTING,
+    DUPES_SAMPLING,
+    DUPES_HASHING,
+    DUPES_DONE,
+} DupePhase;
+
+// Runs passes at the lowest priority, one per dupesFinderRun(). While a move
+// batch owns the card it is paused with no file open, like the verifier.
+typedef struct {
+    Thread thread;
+    DupeIndex *index;
+    LightEvent wake;       // one-shot, signalled on a new pass or stop
+    LightEvent *notify;    // signalled after each folder and hash step, may be NULL
+    char file[DUPES_PATH_LEN];
+    char rootDir[DUPES_PATH_LEN];
+
+    LightLock lock;        // guards hold
+    char hold[DUPES_PATH_LEN]; // folder whose files are in rootDir
+
+    volatile bool paused;
+    volatile bool reading; // a file is open
+    volatile bool quit;
+    volatile bool run;     // a pass was asked for
+    volatile DupePhase phase;
+    u32 folders;           // listed this pass
+    u32 files;             // live files seen this pass
+    u32 sampled;           // files sampled this pass
+    u32 hashed;            // files hashed in full this pass
+    u32 toHash;            // files that need a full hash this pass
+    u64 bytes;             // read this pass
+    u64 passTicks;         // length of the last finished pass
+} DupeFinder;
+
+bool dupesFinderStart(DupeFinder *finder, DupeIndex *index, const char *file, const char *rootDir,
+                      LightEvent *notify);
+void dupesFinderStop(DupeFinder *finder);
+
+// Starts a pass, unless one is running already
+void dupesFinderRun(DupeFinder *finder);
+
+// Files of the collection sitting in rootDir are read from there and the
+// folder keeps its indexed entries instead of being relisted. NULL to clear.
+void dupesFinderHold(DupeFinder *finder, const char *path);
+
+// Pausing waits until the current file is closed; a file read part way is
+// read again once unpaused
+void dupesFinderPause(DupeFinder *finder, bool paused);
+
+static inline DupePhase dupesFinderPhase(DupeFinder *finder) {
+    return __atomic_load_n(&finder->phase, __ATOMIC_ACQUIRE);
+}
+
+#endif
@@ -0,0 +1,318 @@
+#include "foldertable.h"
+#include "array.h"
+#include "hash.h"
+#include "fsdir.h"
+#include "library.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+void folderTableFree(FolderTable *table) {
+    free(table->folders);
+    free(table->strings);
+    free(table->slots);
+    memset(table, 0, sizeof(FolderTable));
+}
+
+bool folderTableReserveStrings(FolderTable *table, u32 needed) {
+    if (needed <= table->stringCapacity) {
+        return true;
+    }
+    u32 capacity = table->stringCapacity ? table->stringCapacity * 2 : 16384;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    char *strings = (char *)realloc(table->strings, capacity);
+    if (!strings) {
+        return false;
+    }
+    table->strings = strings;
+    table->stringCapacity = capacity;
+    return true;
+}
+
+static void insertSlot(s32 *slots, u32 slotCount, u32 hash, s32 folder) {
+    u32 mask = slotCount - 1;
+    u32 i = hash & mask;
+    while (slots[i] >= 0) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = folder;
+}
+
+static bool rehash(FolderTable *table, u32 slotCount) {
+    s32 *slots = (s32 *)malloc(sizeof(s32) * slotCount);
+    if (!slots) {
+        return false;
+    }
+    memset(slots, 0xFF, sizeof(s32) * slotCount);
+    for (int f = 0; f < table->folderCount; f++) {
+        u32 hash = fnv1a32(FNV1A_32_INIT, folderTablePath(table, f), table->folders[f].pathLength);
+        insertSlot(slots, slotCount, hash, f);
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->slotCount = slotCount;
+    return true;
+}
+
+int folderTableFind(const FolderTable *table, const char *path, size_t len) {
+    if (!table->slotCount) {
+        return -1;
+    }
+    u32 mask = table->slotCount - 1;
+    for (u32 i = fnv1a32(FNV1A_32_INIT, path, len) & mask; table->slots[i] >= 0; i = (i + 1) & mask) {
+        const IndexFolder *folder = &table->folders[table->slots[i]];
+        if (folder->pathLength == len && memcmp(folderTablePath(table, table->slots[i]), path, len) == 0) {
+            return table->slots[i];
+        }
+    }
+    return -1;
+}
+
+int folderTableAdd(FolderTable *table, const char *path, size_t len, s32 first) {
+    if (len > 0xFFFF) {
+        return -1;
+    }
+    if ((u32)(table->folderCount + 1) * 2 > table->slotCount &&
+        !rehash(table, table->slotCount ? table->slotCount * 2 : 256)) {
+        return -1;
+    }
+    if (!arrayReserve((void **)&table->folders, &table->folderCapacity, table->folderCount + 1,
+                      sizeof(IndexFolder), 64) ||
+        !folderTableReserveStrings(table, table->stringSize + len + 1)) {
+        return -1;
+    }
+
+    IndexFolder *folder = &table->folders[table->folderCount];
+    folder->pathOffset = table->stringSize;
+    folder->pathLength = (u16)len;
+    folder->flags = 0;
+    folder->fingerprint = 0;
+    folder->first = first;
+    folder->count = 0;
+    memcpy(table->strings + table->stringSize, path, len);
+    table->strings[table->stringSize + len] = '\0';
+    table->stringSize += len + 1;
+
+    insertSlot(table->slots, table->slotCount, fnv1a32(FNV1A_32_INIT, path, len), table->folderCount);
+    return table->folderCount++;
+}
+
+u8 *indexFileRead(const char *file, size_t headerSize, size_t *size) {
+    FILE *f = fopen(file, "rb");
+    if (!f) {
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    u8 *buffer = length >= (long)headerSize ? (u8 *)malloc(length) : NULL;
+    if (buffer && fread(buffer, 1, length, f) != (size_t)length) {
+        free(buffer);
+        buffer = NULL;
+    }
+    fclose(f);
+
+    *size = buffer ? (size_t)length : 0;
+    return buffer;
+}
+
+bool folderTableCheck(const IndexFolder *folders, u32 folderCount, u32 entryCount,
+                      const char *strings, u32 stringSize) {
+    bool ok = stringSize == 0 || strings[stringSize - 1] == '\0';
+    for (u32 i = 0; ok && i < folderCount; i++) {
+        const IndexFolder *folder = &folders[i];
+        ok = (u64)folder->pathOffset + folder->pathLength < stringSize &&
+             strings[folder->pathOffset + folder->pathLength] == '\0' &&
+             folder->first >= 0 && folder->count >= 0 &&
+             (u64)folder->first + folder->count <= entryCount;
+    }
+    return ok;
+}
+
+bool folderTableLoad(FolderTable *table, const IndexFolder *folders, int folderCount,
+                     const char *strings, u32 stringSize) {
+    if (!arrayReserve((void **)&table->folders, &table->folderCapacity, folderCount > 0 ? folderCount : 1,
+                      sizeof(IndexFolder), 64) ||
+        !folderTableReserveStrings(table, stringSize)) {
+        return false;
+    }
+    memcpy(table->folders, folders, sizeof(IndexFolder) * folderCount);
+    memcpy(table->strings, strings, stringSize);
+    table->folderCount = folderCount;
+    table->stringSize = stringSize;
+
+    u32 slotCount = 256;
+    while (slotCount < (u32)folderCount * 2) {
+        slotCount *= 2;
+    }
+    if (!rehash(table, slotCount)) {
+        return false;
+    }
+
+    for (int i = 0; i < folderCount; i++) {
+        table->folders[i].flags &= ~FOLDER_SEEN;
+    }
+    return true;
+}
+
+u32 indexChecksum(const IndexSection *sections, int count) {
+    u32 checksum = FNV1A_32_INIT;
+    for (int i = 0; i < count; i++) {
+        checksum = fnv1a32(checksum, sections[i].data, sections[i].size);
+    }
+    return checksum;
+}
+
+bool indexFileWrite(const char *file, const void *header, size_t headerSize,
+                    const IndexSection *sections, int count) {
+    FILE *f = fopen(file, "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(header, headerSize, 1, f) == 1;
+    for (int i = 0; ok && i < count; i++) {
+        ok = fwrite(sections[i].data, 1, sections[i].size, f) == sections[i].size;
+    }
+    ok = fclose(f) == 0 && ok;
+    return ok;
+}
+
+bool folderScanPush(FolderScan *scan, char type, const char *name) {
+    size_t len = strlen(name) + 2;
+    if (scan->size + len > scan->capacity) {
+        size_t grown = scan->capacity ? scan->capacity * 2 : 4096;
+        while (grown < scan->size + len) {
+            grown *= 2;
+        }
+        char *moved = (char *)realloc(scan->entries, grown);
+        if (!moved) {
+            return false;
+        }
+        scan->entries = moved;
+        scan->capacity = grown;
+    }
+    scan->entries[scan->size] = type;
+    memcpy(scan->entries + scan->size + 1, name, len - 1);
+    scan->size += len;
+    return true;
+}
+
+bool folderScan(const char *path, bool sizes, FolderScan *scan) {
+    scan->size = 0;
+    scan->fileCount = 0;
+    scan->fingerprint = 0;
+
+    DirReader reader;
+    if (!dirOpen(&reader, path)) {
+        return false;
+    }
+    if (sizes) {
+        dirWantSizes(&reader);
+    }
+
+    int entries = 0;
+    bool ok = true;
+    DirEntry entry;
+    while (dirNext(&reader, &entry)) {
+        if (entry.name[0] == '.') {
+            continue;
+        }
+        entries++;
+        scan->fingerprint = libraryFingerprintAdd(scan->fingerprint, entry.name);
+
+        if (entry.isDirectory) {
+            ok = ok && folderScanPush(scan, 'd', entry.name);
+        } else if (isMoflexFile(entry.name)) {
+            ok = ok && folderScanPush(scan, 'f', entry.name);
+            if (ok && sizes) {
+                ok = arrayReserve((void **)&scan->sizes, &scan->sizeCapacity, scan->fileCount + 1,
+                                  sizeof(u64), 64);
+                if (ok) {
+                    scan->sizes[scan->fileCount] = entry.size;
+                }
+            }
+            scan->fileCount += ok;
+        }
+    }
+    dirClose(&reader);
+    scan->fingerprint = libraryFingerprintFinish(scan->fingerprint, entries);
+    return ok;
+}
+
+void folderScanFree(FolderScan *scan) {
+    free(scan->entries);
+    free(scan->sizes);
+    memset(scan, 0, sizeof(FolderScan));
+}
+
+bool folderQueuePush(FolderQueue *queue, const char *path) {
+    size_t len = strlen(path) + 1;
+    if (queue->size + len > queue->capacity) {
+        size_t grown = queue->capacity ? queue->capacity * 2 : 4096;
+        while (grown < queue->size + len) {
+            grown *= 2;
+        }
+        char *moved = (char *)realloc(queue->paths, grown);
+        if (!moved) {
+            return false;
+        }
+        queue->paths = moved;
+        queue->capacity = grown;
+    }
+    memcpy(queue->paths + queue->size, path, len);
+    queue->size += len;
+    return true;
+}
+
+bool folderQueuePop(FolderQueue *queue, char *path, size_t size) {
+    if (queue->head >= queue->size) {
+        return false;
+    }
+    snprintf(path, size, "%s", queue->paths + queue->head);
+    queue->head += strlen(queue->paths + queue->head) + 1;
+
+    // Reuse the front once half the buffer has been walked
+    if (queue->head > queue->capacity / 2) {
+        memmove(queue->paths, queue->paths + queue->head, queue->size - queue->head);
+        queue->size -= queue->head;
+        queue->head = 0;
+    }
+    return true;
+}
+
+bool folderQueueChildren(FolderQueue *queue, const char *path, const FolderScan *scan) {
+    char child[512];
+    bool ok = true;
+    for (size_t off = 0; ok && off < scan->size; off += strlen(scan->entries + off) + 1) {
+        if (scan->entries[off] != 'd') {
+            continue;
+        }
+        int written = snprintf(child, sizeof(child), "%s%s%s", path, path[0] ? "/" : "",
+                               scan->entries + off + 1);
+        if (written > 0 && written < (int)sizeof(child)) {
+            ok = folderQueuePush(queue, child);
+        }
+    }
+    return ok;
+}
+
+void folderQueueFree(FolderQueue *queue) {
+    free(queue->paths);
+    memset(queue, 0, sizeof(FolderQueue));
+}
+
+bool folderIsHeld(const char *hold, const char *fullPath) {
+    size_t len = strlen(hold);
+    while (len > 0 && hold[len - 1] == '/') {
+        len--;
+    }
+    size_t fullLen = strlen(fullPath);
+    while (fullLen > 0 && fullPath[fullLen - 1] == '/') {
+        fullLen--;
+    }
+    return len > 0 && len == fullLen && strncmp(hold, fullPath, len) == 0;
+}
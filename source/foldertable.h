@@ -0,0 +1,120 @@
+#ifndef FOLDERTABLE_H
+#define FOLDERTABLE_H
+
+#include "platform.h"
+
+// The folder side of the indexes that keep entries per folder (search.h,
+// dupes.h).
+//
+// Folders are keyed by their path below the index's basePath and found
+// through an open-addressing hash of it. Each carries the fingerprint of its
+// entry names, taken like libraryScan() takes it, so an unchanged folder
+// keeps its entries, and a range of the owner's entry table. The string pool
+// belongs to the table but the owner keeps its entry names in it too.
+//
+// An index file is a header, then the folder table, the owner's tables and
+// the string pool, with an FNV-1a checksum over everything after the
+// header. It is read whole and validated in memory before anything is used.
+
+#define FOLDER_LISTED 0x0001 // fingerprint and entries are valid
+#define FOLDER_DEAD   0x4000 // gone from the card, dropped on save
+#define FOLDER_SEEN   0x8000 // listed or held this session, never saved
+
+typedef struct {
+    u32 pathOffset;  // below basePath, no slash at either end; "" is basePath itself
+    u16 pathLength;
+    u16 flags;
+    u32 fingerprint; // as LibraryNode.fingerprint
+    s32 first;       // its entries are the owner's [first, first + count)
+    s32 count;
+} IndexFolder;
+
+typedef struct {
+    IndexFolder *folders;
+    int folderCount;
+    int folderCapacity;
+    char *strings;   // folder paths and the owner's entry names
+    u32 stringSize;
+    u32 stringCapacity;
+    s32 *slots;      // folder path hash -> folder
+    u32 slotCount;
+} FolderTable;
+
+void folderTableFree(FolderTable *table);
+bool folderTableReserveStrings(FolderTable *table, u32 needed);
+
+// Returns the folder with this path, or -1
+int folderTableFind(const FolderTable *table, const char *path, size_t len);
+
+// Adds a folder with no entries yet, starting at first. Returns its index,
+// or -1 if out of memory.
+int folderTableAdd(FolderTable *table, const char *path, size_t len, s32 first);
+
+static inline const char *folderTablePath(const FolderTable *table, int folder) {
+    return table->strings + table->folders[folder].pathOffset;
+}
+
+// Reads an index file whole. Returns the buffer, or NULL if the file can't
+// be read or is shorter than its header.
+u8 *indexFileRead(const char *file, size_t headerSize, size_t *size);
+
+// Checks a loaded folder table and string pool: every path inside the pool
+// and every entry range inside the owner's entryCount
+bool folderTableCheck(const IndexFolder *folders, u32 folderCount, u32 entryCount,
+                      const char *strings, u32 stringSize);
+
+// Copies in a checked folder table and string pool. Nothing from a previous
+// session has been seen yet.
+bool folderTableLoad(FolderTable *table, const IndexFolder *folders, int folderCount,
+                     const char *strings, u32 stringSize);
+
+typedef struct {
+    const void *data;
+    size_t size;
+} IndexSection;
+
+u32 indexChecksum(const IndexSection *sections, int count);
+
+// Writes the header, then the sections back to back
+bool indexFileWrite(const char *file, const void *header, size_t headerSize,
+                    const IndexSection *sections, int count);
+
+// One folder's listing: a type byte ('d' or 'f') then the name, each
+// '\0'-terminated, and with sizes asked for, the size of each file in the
+// same order
+typedef struct {
+    char *entries;
+    size_t size;
+    size_t capacity;
+    u64 *sizes;
+    int fileCount;
+    int sizeCapacity;
+    u32 fingerprint;
+} FolderScan;
+
+// Lists subfolders and .moflex files. Sizes are free on the console.
+bool folderScan(const char *path, bool sizes, FolderScan *scan);
+bool folderScanPush(FolderScan *scan, char type, const char *name);
+void folderScanFree(FolderScan *scan);
+
+// Paths relative to basePath waiting to be listed, breadth first
+typedef struct {
+    char *paths;
+    size_t size;
+    size_t capacity;
+    size_t head;
+} FolderQueue;
+
+bool folderQueuePush(FolderQueue *queue, const char *path);
+
+// Takes the next path; false once the queue is empty
+bool folderQueuePop(FolderQueue *queue, char *path, size_t size);
+
+// Queues the subfolders of a listing of path
+bool folderQueueChildren(FolderQueue *queue, const char *path, const FolderScan *scan);
+void folderQueueFree(FolderQueue *queue);
+
+// Whether fullPath is the held folder, trailing slashes aside
+bool folderIsHeld(const char *hold, const char *fullPath);
+
+#endif
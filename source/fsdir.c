@@ -0,0 +1,151 @@
+#include "fsdir.h"
+#include "fssession.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// The host charges its simulated FS latency where the console would make
+// a request
+#ifdef __3DS__
+#define chargeRequest() ((void)0)
+#else
+#define chargeRequest() hostFsRequest()
+#endif
+
+// readdir() path: everything off the console, and the console itself when
+// the FS session couldn't open the SD archive
+static bool stdioOpen(DirReader *reader, const char *path) {
+    snprintf(reader->path, sizeof(reader->path), "%s", path);
+    chargeRequest();
+    reader->dir = opendir(path);
+    return reader->dir != NULL;
+}
+
+static bool stdioNext(DirReader *reader, DirEntry *entry) {
+    struct dirent *dirent;
+    do {
+        dirent = readdir((DIR *)reader->dir);
+        if (!dirent) {
+            return false;
+        }
+    } while (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0);
+
+    // Charged like the console: one request per batch of entries
+    if (reader->batchPos++ % FSDIR_BATCH == 0) {
+        chargeRequest();
+    }
+
+    snprintf(entry->name, FSDIR_NAME_LEN, "%s", dirent->d_name);
+    entry->size = 0;
+
+#ifdef DT_DIR
+    if (dirent->d_type != DT_UNKNOWN && !reader->sizes) {
+        entry->isDirectory = dirent->d_type == DT_DIR;
+        return true;
+    }
+#endif
+
+    // Filesystem without d_type: same cost as the old readdir+stat path.
+    // Sizes alone are free on the console.
+    char fullPath[sizeof(reader->path) + FSDIR_NAME_LEN + 1];
+    size_t len = strlen(reader->path);
+    const char *sep = (len > 0 && reader->path[len - 1] == '/') ? "" : "/";
+    snprintf(fullPath, sizeof(fullPath), "%s%s%s", reader->path, sep, entry->name);
+    struct stat st;
+    if (!reader->sizes) {
+        chargeRequest();
+    }
+    bool found = stat(fullPath, &st) == 0;
+    entry->isDirectory = found && S_ISDIR(st.st_mode);
+    entry->size = (found && !entry->isDirectory) ? (u64)st.st_size : 0;
+    return true;
+}
+
+static void stdioClose(DirReader *reader) {
+    if (reader->dir) {
+        closedir((DIR *)reader->dir);
+        reader->dir = NULL;
+    }
+}
+
+#ifdef __3DS__
+
+bool dirOpen(DirReader *reader, const char *path) {
+    memset(reader, 0, sizeof(DirReader));
+
+    // Without the session's archive the listing still works, a stat() per
+    // entry slower
+    FS_Archive archive;
+    if (!fsSessionArchive(&archive)) {
+        return stdioOpen(reader, path);
+    }
+
+    // Only this call needs the encoded path, so it can live on the stack
+    u16 path16[FS_PATH_UNITS];
+    FS_Path fsPath;
+    if (!fsSessionPath(path, path16, &fsPath)) {
+        return false;
+    }
+
+    reader->batch = (FS_DirectoryEntry *)malloc(sizeof(FS_DirectoryEntry) * FSDIR_BATCH);
+    if (!reader->batch) {
+        return false;
+    }
+
+    if (R_FAILED(FSUSER_OpenDirectory(&reader->handle, archive, fsPath))) {
+        free(reader->batch);
+        reader->batch = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool dirNext(DirReader *reader, DirEntry *entry) {
+    if (reader->dir) {
+        return stdioNext(reader, entry);
+    }
+    if (reader->batchPos == reader->batchCount) {
+        u32 read = 0;
+        if (R_FAILED(FSDIR_Read(reader->handle, &read, FSDIR_BATCH, reader->batch)) || read == 0) {
+            return false;
+        }
+        reader->batchCount = read;
+        reader->batchPos = 0;
+    }
+
+    const FS_DirectoryEntry *fsEntry = &reader->batch[reader->batchPos++];
+    ssize_t len = utf16_to_utf8((u8 *)entry->name, fsEntry->name, FSDIR_NAME_LEN - 1);
+    entry->name[len > 0 ? len : 0] = '\0';
+    entry->isDirectory = (fsEntry->attributes & FS_ATTRIBUTE_DIRECTORY) != 0;
+    entry->size = fsEntry->fileSize;
+    return true;
+}
+
+void dirClose(DirReader *reader) {
+    stdioClose(reader);
+    if (reader->batch) {
+        FSDIR_Close(reader->handle);
+        free(reader->batch);
+        reader->batch = NULL;
+    }
+}
+
+#else // host shim
+
+bool dirOpen(DirReader *reader, const char *path) {
+    memset(reader, 0, sizeof(DirReader));
+    return stdioOpen(reader, path);
+}
+
+bool dirNext(DirReader *reader, DirEntry *entry) {
+    return stdioNext(reader, entry);
+}
+
+void dirClose(DirReader *reader) {
+    stdioClose(reader);
+}
+
+#endif
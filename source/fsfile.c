@@ -0,0 +1,127 @@
+#include "fsfile.h"
+#include "fssession.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef __3DS__
+#define chargeRequest() ((void)0)
+#else
+#define chargeRequest() hostFsRequest()
+#endif
+
+// stdio path: everything off the console, and the console itself when the
+// FS session couldn't open the SD archive
+static bool stdioOpen(FileReader *reader, const char *path) {
+    // Open and size, two requests on the console
+    chargeRequest();
+    chargeRequest();
+    FILE *f = fopen(path, "rb");
+    struct stat st;
+    if (!f || fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (f) {
+            fclose(f);
+        }
+        return false;
+    }
+    reader->file = f;
+    reader->size = (u64)st.st_size;
+    return true;
+}
+
+static u32 stdioRead(FileReader *reader, u64 offset, void *buffer, u32 size) {
+    chargeRequest();
+    FILE *f = (FILE *)reader->file;
+    if (fseeko(f, (off_t)offset, SEEK_SET) != 0) {
+        return 0;
+    }
+    return (u32)fread(buffer, 1, size, f);
+}
+
+static void stdioClose(FileReader *reader) {
+    if (reader->file) {
+        fclose((FILE *)reader->file);
+        reader->file = NULL;
+    }
+}
+
+#ifdef __3DS__
+
+bool fileOpen(FileReader *reader, const char *path) {
+    memset(reader, 0, sizeof(FileReader));
+
+    FS_Archive archive;
+    if (!fsSessionArchive(&archive)) {
+        return stdioOpen(reader, path);
+    }
+
+    u16 path16[FS_PATH_UNITS];
+    FS_Path fsPath;
+    if (!fsSessionPath(path, path16, &fsPath)) {
+        return false;
+    }
+
+    if (R_FAILED(FSUSER_OpenFile(&reader->handle, archive, fsPath, FS_OPEN_READ, 0))) {
+        return false;
+    }
+    if (R_FAILED(FSFILE_GetSize(reader->handle, &reader->size))) {
+        FSFILE_Close(reader->handle);
+        return false;
+    }
+    reader->open = true;
+    return true;
+}
+
+u32 fileRead(FileReader *reader, u64 offset, void *buffer, u32 size) {
+    if (reader->file) {
+        return stdioRead(reader, offset, buffer, size);
+    }
+    u32 read = 0;
+    if (R_FAILED(FSFILE_Read(reader->handle, &read, offset, buffer, size))) {
+        return 0;
+    }
+    return read;
+}
+
+void fileClose(FileReader *reader) {
+    stdioClose(reader);
+    if (reader->open) {
+        FSFILE_Close(reader->handle);
+        reader->open = false;
+    }
+}
+
+u64 fileMtime(const char *path) {
+    u64 mtime = 0;
+    if (R_FAILED(sdmc_getmtime(path, &mtime))) {
+        return 0;
+    }
+    return mtime;
+}
+
+#else // host shim
+
+bool fileOpen(FileReader *reader, const char *path) {
+    memset(reader, 0, sizeof(FileReader));
+    return stdioOpen(reader, path);
+}
+
+u32 fileRead(FileReader *reader, u64 offset, void *buffer, u32 size) {
+    return stdioRead(reader, offset, buffer, size);
+}
+
+void fileClose(FileReader *reader) {
+    stdioClose(reader);
+}
+
+u64 fileMtime(const char *path) {
+    struct stat st;
+    hostFsRequest();
+    if (stat(path, &st) != 0) {
+        return 0;
+    }
+    return (u64)st.st_mtim.tv_sec * 1000000000ULL + (u64)st.st_mtim.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef FSFILE_H
+#define FSFILE_H
+
+#include "platform.h"
+
+// Positioned reads of a single file.
+//
+// On the console a file is opened with FSUSER_OpenFile on the session's SD
+// archive and every read is one FSFILE_Read at an explicit offset, with no
+// stdio buffering in between, so callers choose exactly how much of a file
+// is touched and at what alignment. Elsewhere, or without the FS session's
+// archive, it is stdio, with one simulated FS request per call on a PC like
+// fsdir.h.
+
+typedef struct {
+#ifdef __3DS__
+    Handle handle;
+    bool open;
+#endif
+    void *file; // FILE *, set while reading through stdio
+    u64 size;
+} FileReader;
+
+// Goes through stdio on the console too while the FS session isn't open
+bool fileOpen(FileReader *reader, const char *path);
+
+// Returns the bytes read, 0 on failure or at the end of the file
+u32 fileRead(FileReader *reader, u64 offset, void *buffer, u32 size);
+void fileClose(FileReader *reader);
+
+// Modification time as the FS reports it, 0 if it can't be read
+u64 fileMtime(const char *path);
+
+#endif
@@ -0,0 +1,111 @@
+#include "fssession.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __3DS__
+
+typedef struct {
+    FS_Archive archive;
+    bool open;
+    u16 source16[FS_PATH_UNITS];
+    u16 dest16[FS_PATH_UNITS];
+} FsSession;
+
+static FsSession session;
+
+bool fsSessionOpen(void) {
+    if (!session.open) {
+        session.open = R_SUCCEEDED(FSUSER_OpenArchive(&session.archive, ARCHIVE_SDMC,
+                                                      fsMakePath(PATH_EMPTY, "")));
+    }
+    return session.open;
+}
+
+void fsSessionClose(void) {
+    if (session.open) {
+        fsSessionCommit();
+        FSUSER_CloseArchive(session.archive);
+        session.open = false;
+    }
+}
+
+void fsSessionCommit(void) {
+    if (session.open) {
+        FSUSER_ControlArchive(session.archive, ARCHIVE_ACTION_COMMIT_SAVE_DATA, NULL, 0, NULL, 0);
+    }
+}
+
+bool fsSessionPath(const char *path, u16 *buffer, FS_Path *out) {
+    if (strncmp(path, "sdmc:", 5) == 0) {
+        path += 5;
+    }
+
+    ssize_t units = utf8_to_utf16(buffer, (const u8 *)path, FS_PATH_UNITS - 1);
+    if (units <= 0 || units >= FS_PATH_UNITS - 1) {
+        return false;
+    }
+    while (units > 1 && buffer[units - 1] == '/') {
+        units--;
+    }
+    buffer[units] = 0;
+
+    out->type = PATH_UTF16;
+    out->size = (units + 1) * sizeof(u16);
+    out->data = buffer;
+    return true;
+}
+
+bool fsSessionArchive(FS_Archive *archive) {
+    *archive = session.archive;
+    return session.open;
+}
+
+bool fsRenameFile(const char *sourcePath, const char *destPath) {
+    if (!session.open) {
+        return rename(sourcePath, destPath) == 0;
+    }
+
+    FS_Path source, dest;
+    if (!fsSessionPath(sourcePath, session.source16, &source) ||
+        !fsSessionPath(destPath, session.dest16, &dest)) {
+        return false;
+    }
+    return R_SUCCEEDED(FSUSER_RenameFile(session.archive, source, session.archive, dest));
+}
+
+bool fsDeleteFile(const char *path) {
+    if (!session.open) {
+        return remove(path) == 0;
+    }
+
+    FS_Path fsPath;
+    if (!fsSessionPath(path, session.source16, &fsPath)) {
+        return false;
+    }
+    return R_SUCCEEDED(FSUSER_DeleteFile(session.archive, fsPath));
+}
+
+#else // host shim
+
+bool fsSessionOpen(void) {
+    return true;
+}
+
+void fsSessionClose(void) {
+}
+
+void fsSessionCommit(void) {
+}
+
+bool fsRenameFile(const char *sourcePath, const char *destPath) {
+    hostFsRequest();
+    return rename(sourcePath, destPath) == 0;
+}
+
+bool fsDeleteFile(const char *path) {
+    hostFsRequest();
+    return remove(path) == 0;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef FSSESSION_H
+#define FSSESSION_H
+
+#include "platform.h"
+
+// The SD archive, opened once for the life of the app.
+//
+// Renames and deletes go straight to FSUSER with UTF-16 paths encoded into
+// buffers the session keeps, instead of through newlib, which converts and
+// allocates on every call. Directory reads (fsdir.h) share the same handle.
+// Without a session, or off the console, everything falls back to stdio.
+
+#define FS_PATH_UNITS 512 // UTF-16 units per encoded path, terminator included
+
+bool fsSessionOpen(void);
+
+// Commits outstanding writes and closes the archive
+void fsSessionClose(void);
+
+// Commits the archive once for a batch of changes
+void fsSessionCommit(void);
+
+#ifdef __3DS__
+// Encodes "sdmc:/dir/name" as an archive path into buffer. Trailing slashes
+// are dropped except for the root.
+bool fsSessionPath(const char *path, u16 *buffer, FS_Path *out);
+
+// Returns false if the session isn't open
+bool fsSessionArchive(FS_Archive *archive);
+#endif
+
+// Renames/deletes reuse the session's path buffers, so they are meant to be
+// called from one thread at a time (the move worker, or startup recovery).
+bool fsRenameFile(const char *sourcePath, const char *destPath);
+bool fsDeleteFile(const char *path);
+
+#endif
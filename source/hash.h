@@ -0,0 +1,29 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "platform.h"
+
+#define FNV1A_32_INIT 0x811C9DC5u
+
+// FNV-1a, used for fingerprints and file checksums. Pass FNV1A_32_INIT to
+// start, or a previous result to continue over more data.
+static inline u32 fnv1a32(u32 hash, const void *data, size_t len) {
+    const u8 *p = (const u8 *)data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x01000193u;
+    }
+    return hash;
+}
+
+// The same over 32-bit words, four times fewer steps for bulk data such as
+// whole files. Not interchangeable with fnv1a32().
+static inline u32 fnv1a32Words(u32 hash, const u32 *words, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        hash ^= words[i];
+        hash *= 0x01000193u;
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#include "hud.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <malloc.h>
+
+// Set up by libctru's heap allocation at startup
+extern u32 __ctru_heap_size;
+extern u32 __ctru_linear_heap_size;
+
+static u32 ticksToUs(u64 ticks) {
+    return (u32)(ticks * 1000000ULL / SYSCLOCK_ARM11);
+}
+
+// Prints one full-width line, overwriting whatever was there
+static void hudLine(int row, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void hudLine(int row, const char *format, ...) {
+    char line[41];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    printf("\x1b[%d;1H%-40s", row, line);
+}
+
+void hudInit(Hud *hud) {
+    memset(hud, 0, sizeof(Hud));
+}
+
+void hudToggle(Hud *hud) {
+    PrintConsole *top = consoleSelect(&hud->console);
+    if (!hud->initialized) {
+        consoleInit(GFX_BOTTOM, &hud->console);
+        hud->initialized = true;
+    }
+
+    hud->visible = !hud->visible;
+    consoleClear();
+    consoleSelect(top);
+
+    hud->lastDraw = 0; // draw right away
+    hud->framePeak = 0;
+    hud->busyTicks = 0;
+    hud->presents = 0;
+}
+
+void hudFrameEnd(Hud *hud, bool presented) {
+    hud->frameTicks = svcGetSystemTick() - hud->frameStart;
+    if (hud->frameTicks > hud->framePeak) {
+        hud->framePeak = hud->frameTicks;
+    }
+    hud->busyTicks += hud->frameTicks;
+    hud->presents += presented;
+}
+
+void hudMoveProgress(Hud *hud, u32 filesPerSecond, int done, int total) {
+    hud->moveRate = filesPerSecond;
+    hud->moveDone = done;
+    hud->moveTotal = total;
+}
+
+void hudStartupPhase(Hud *hud, const char *name, u64 ticks) {
+    u32 ms = (u32)(ticks / CPU_TICKS_PER_MSEC);
+    if (!hud->slowPhase || ms > hud->slowPhaseMs) {
+        hud->slowPhase = name;
+        hud->slowPhaseMs = ms;
+    }
+}
+
+void hudStartupDone(Hud *hud, u64 ticks) {
+    hud->startupMs = (u32)(ticks / CPU_TICKS_PER_MSEC);
+}
+
+bool hudUpdate(Hud *hud, const DirectoryList *list, Scanner *scanner, Verifier *verifier) {
+    if (!hud->visible) {
+        return false;
+    }
+    u64 now = svcGetSystemTick();
+    u64 elapsed = now - hud->lastDraw;
+    if (hud->lastDraw && elapsed < (u64)(HUD_INTERVAL_MS * CPU_TICKS_PER_MSEC)) {
+        return false;
+    }
+    if (hud->lastDraw) {
+        hud->cpuPercent = (u32)(hud->busyTicks * 100 / elapsed);
+        hud->presentRate = (u32)((u64)hud->presents * SYSCLOCK_ARM11 / elapsed);
+    }
+    hud->lastDraw = now;
+    hud->busyTicks = 0;
+    hud->presents = 0;
+
+    PrintConsole *top = consoleSelect(&hud->console);
+
+    u32 frame = ticksToUs(hud->frameTicks);
+    u32 peak = ticksToUs(hud->framePeak);
+    u32 load = ticksToUs(list->loadTicks);
+    struct mallinfo heap = mallinfo();
+    u32 linearUsed = __ctru_linear_heap_size - linearSpaceFree();
+
+    hudLine(1, "Performance (SELECT to hide)");
+    hudLine(2, "----------------------------");
+    hudLine(4, "Frame    %lu.%02lu ms  peak %lu.%02lu ms",
+            (unsigned long)(frame / 1000), (unsigned long)(frame % 1000 / 10),
+            (unsigned long)(peak / 1000), (unsigned long)(peak % 1000 / 10));
+    hudLine(5, "UI CPU   %lu%%  %lu frames/s",
+            (unsigned long)hud->cpuPercent, (unsigned long)hud->presentRate);
+    hudLine(6, "Dir load %lu.%02lu ms  %d entries",
+            (unsigned long)(load / 1000), (unsigned long)(load % 1000 / 10), list->count);
+    hudLine(7, "Redraw   %d lines", hud->linesDrawn);
+    hudLine(8, "Scan     %lu folders/s  %lu done",
+            (unsigned long)scannerFoldersPerSecond(scanner),
+            (unsigned long)scannerCompleted(scanner));
+    hudLine(9, "Queued   %lu folders%s", (unsigned long)scannerPending(scanner),
+            scanner->paused ? " (paused)" : "");
+    hudLine(10, "Move     %lu files/s  %d/%d",
+            (unsigned long)hud->moveRate, hud->moveDone, hud->moveTotal);
+    u32 verifyRate = verifierBytesPerSecond(verifier) / 1000; // KB/s
+    hudLine(11, "Verify   %lu.%lu MB/s  %lu left%s",
+            (unsigned long)(verifyRate / 1000), (unsigned long)(verifyRate % 1000 / 100),
+            (unsigned long)verifierPending(verifier), verifier->paused ? " (paused)" : "");
+    hudLine(12, "Heap     %lu / %lu KB",
+            (unsigned long)(heap.uordblks / 1024), (unsigned long)(__ctru_heap_size / 1024));
+    hudLine(13, "Linear   %lu / %lu KB",
+            (unsigned long)(linearUsed / 1024), (unsigned long)(__ctru_linear_heap_size / 1024));
+    hudLine(14, "Startup  %lu ms  %s %lu ms", (unsigned long)hud->startupMs,
+            hud->slowPhase ? hud->slowPhase : "-", (unsigned long)hud->slowPhaseMs);
+    hudLine(15, "Tracing  %s", traceEnabled ? "on" : "off");
+    const JobPool *jobs = scanner->jobs;
+    char cores[16] = "";
+    for (int i = 0; jobs && i < jobs->workerCount && i < 4; i++) {
+        snprintf(cores + strlen(cores), sizeof(cores) - strlen(cores), " %d", jobs->workers[i].core);
+    }
+    hudLine(16, "Jobs     %d workers%s%s%s", jobs ? jobs->workerCount : 0, cores[0] ? ", cores" : "", cores,
+            jobs && jobs->speedup ? ", 804 MHz" : "");
+
+    consoleSelect(top);
+    hud->framePeak = 0;
+    return true;
+}
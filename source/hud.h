@@ -0,0 +1,75 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <3ds.h>
+
+#include "dirlist.h"
+#include "scanner.h"
+#include "verifier.h"
+
+// Performance HUD on the bottom screen, toggled with SELECT.
+//
+// Shows frame time, UI thread CPU use and presented frames per second, the
+// lines written by the last browser redraw, the last directory load,
+// scanner throughput and queue, move rate, verifier read rate and heap
+// usage, how long startup took to the first frame with its slowest phase,
+// and the cores the scan jobs run on. The bottom console is only set up the
+// first time the HUD is shown, and it redraws at most every HUD_INTERVAL_MS.
+
+#define HUD_INTERVAL_MS 500
+
+typedef struct {
+    PrintConsole console;
+    bool initialized;
+    bool visible;
+
+    u64 frameStart;
+    u64 frameTicks; // work done in the last frame, vblank wait excluded
+    u64 framePeak;  // worst frame since the last redraw
+    u64 lastDraw;
+
+    u64 busyTicks;  // UI thread work since the last redraw
+    u32 presents;   // frames flushed and swapped since the last redraw
+    u32 cpuPercent;
+    u32 presentRate;
+
+    int linesDrawn; // console lines written by the last browser redraw
+
+    u32 moveRate;   // files/s of the running or last move batch
+    int moveDone;
+    int moveTotal;
+
+    u32 startupMs;  // from main() to the first frame, 0 until it is drawn
+    const char *slowPhase;
+    u32 slowPhaseMs;
+} Hud;
+
+void hudInit(Hud *hud);
+void hudToggle(Hud *hud);
+
+static inline void hudFrameBegin(Hud *hud) {
+    hud->frameStart = svcGetSystemTick();
+}
+
+// presented says whether this iteration flushed and swapped a frame
+void hudFrameEnd(Hud *hud, bool presented);
+static inline void hudLinesDrawn(Hud *hud, int lines) {
+    hud->linesDrawn = lines;
+}
+
+// Something else drew on the bottom screen; redraw on the next update
+static inline void hudInvalidate(Hud *hud) {
+    hud->lastDraw = 0;
+}
+
+void hudMoveProgress(Hud *hud, u32 filesPerSecond, int done, int total);
+
+// One startup phase took ticks; name must stay valid
+void hudStartupPhase(Hud *hud, const char *name, u64 ticks);
+void hudStartupDone(Hud *hud, u64 ticks);
+
+// Redraws the HUD if it is visible and due. Leaves the top console selected.
+// Returns true if the bottom screen changed and needs presenting.
+bool hudUpdate(Hud *hud, const DirectoryList *list, Scanner *scanner, Verifier *verifier);
+
+#endif
@@ -0,0 +1,216 @@
+#include "jobs.h"
+
+#include <string.h>
+
+#define JOBS_STACK_SIZE (16 * 1024)
+#define QUEUE_MASK      (JOBS_QUEUE_SIZE - 1)
+
+static bool push(JobQueue *queue, const Job *job) {
+    LightLock_Lock(&queue->lock);
+    bool ok = queue->tail - queue->head < JOBS_QUEUE_SIZE;
+    if (ok) {
+        queue->jobs[queue->tail++ & QUEUE_MASK] = *job;
+    }
+    LightLock_Unlock(&queue->lock);
+    return ok;
+}
+
+static bool popFront(JobQueue *queue, Job *job) {
+    LightLock_Lock(&queue->lock);
+    bool ok = queue->head != queue->tail;
+    if (ok) {
+        *job = queue->jobs[queue->head++ & QUEUE_MASK];
+    }
+    LightLock_Unlock(&queue->lock);
+    return ok;
+}
+
+static bool popBack(JobQueue *queue, Job *job) {
+    LightLock_Lock(&queue->lock);
+    bool ok = queue->head != queue->tail;
+    if (ok) {
+        *job = queue->jobs[--queue->tail & QUEUE_MASK];
+    }
+    LightLock_Unlock(&queue->lock);
+    return ok;
+}
+
+// Own queue first, then the back of everyone else's. self is -1 for a
+// thread outside the pool.
+static bool findJob(JobPool *pool, int self, Job *job, bool *stolen) {
+    *stolen = false;
+    if (self >= 0 && popFront(&pool->workers[self].queue, job)) {
+        return true;
+    }
+    for (int i = 1; i <= pool->workerCount; i++) {
+        int victim = (self + i) % pool->workerCount;
+        if (victim != self && popBack(&pool->workers[victim].queue, job)) {
+            *stolen = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void runJob(const Job *job) {
+    JobGroup *group = job->group;
+    job->func(job->arg);
+    if (__atomic_sub_fetch(&group->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        LightEvent_Signal(&group->done);
+    }
+    __atomic_sub_fetch(&group->active, 1, __ATOMIC_RELEASE);
+}
+
+static void workerMain(void *arg) {
+    JobWorker *worker = (JobWorker *)arg;
+    JobPool *pool = worker->pool;
+    u32 bit = 1u << worker->index;
+    Job job;
+    bool stolen;
+
+    while (!pool->quit) {
+        if (findJob(pool, worker->index, &job, &stolen)) {
+            runJob(&job);
+            worker->ran++;
+            worker->stolen += stolen;
+            continue;
+        }
+
+        // Say we're idle before the last look, so a submit either finds
+        // the bit or its job is seen here
+        __atomic_or_fetch(&pool->idle, bit, __ATOMIC_SEQ_CST);
+        if (findJob(pool, worker->index, &job, &stolen)) {
+            __atomic_and_fetch(&pool->idle, ~bit, __ATOMIC_SEQ_CST);
+            runJob(&job);
+            worker->ran++;
+            worker->stolen += stolen;
+            continue;
+        }
+        if (!pool->quit) {
+            LightEvent_Wait(&worker->wake);
+        }
+        __atomic_and_fetch(&pool->idle, ~bit, __ATOMIC_SEQ_CST);
+    }
+}
+
+// Where the workers may run: -1 for anywhere on a PC
+static int pickCores(JobPool *pool, int threads, int *cores) {
+    int count = 0;
+#ifdef __3DS__
+    // The system core takes app threads once the app has a share of it
+    pool->syscore = R_SUCCEEDED(APT_GetAppCpuTimeLimit(&pool->syscoreLimit)) &&
+                    R_SUCCEEDED(APT_SetAppCpuTimeLimit(JOBS_SYSCORE_PERCENT));
+    if (pool->syscore) {
+        cores[count++] = 1;
+    }
+    bool isNew = false;
+    if (R_SUCCEEDED(APT_CheckNew3DS(&isNew)) && isNew) {
+        osSetSpeedupEnable(true);
+        pool->speedup = true;
+        cores[count++] = 2;
+        cores[count++] = 3;
+    }
+    if (threads > 0 && count > threads) {
+        count = threads;
+    }
+#else
+    count = threads < JOBS_MAX_WORKERS ? threads : JOBS_MAX_WORKERS;
+    for (int i = 0; i < count; i++) {
+        cores[i] = -1;
+    }
+#endif
+    return count;
+}
+
+int jobPoolStart(JobPool *pool, int threads, s32 priority) {
+    memset(pool, 0, sizeof(JobPool));
+    int cores[JOBS_MAX_WORKERS];
+    int count = pickCores(pool, threads, cores);
+
+    for (int i = 0; i < count; i++) {
+        JobWorker *worker = &pool->workers[pool->workerCount];
+        worker->pool = pool;
+        worker->index = pool->workerCount;
+        worker->core = cores[i];
+        LightLock_Init(&worker->queue.lock);
+        LightEvent_Init(&worker->wake, RESET_ONESHOT);
+
+        // A core we may not use just refuses the thread
+        worker->thread = threadCreate(workerMain, worker, JOBS_STACK_SIZE, priority, cores[i], false);
+        if (worker->thread) {
+            pool->workerCount++;
+        }
+    }
+    return pool->workerCount;
+}
+
+void jobPoolStop(JobPool *pool) {
+    pool->quit = true;
+    for (int i = 0; i < pool->workerCount; i++) {
+        LightEvent_Signal(&pool->workers[i].wake);
+    }
+    for (int i = 0; i < pool->workerCount; i++) {
+        threadJoin(pool->workers[i].thread, U64_MAX);
+        threadFree(pool->workers[i].thread);
+        pool->workers[i].thread = NULL;
+    }
+    pool->workerCount = 0;
+#ifdef __3DS__
+    if (pool->speedup) {
+        osSetSpeedupEnable(false);
+        pool->speedup = false;
+    }
+    if (pool->syscore) {
+        APT_SetAppCpuTimeLimit(pool->syscoreLimit);
+        pool->syscore = false;
+    }
+#endif
+}
+
+void jobGroupInit(JobGroup *group) {
+    group->pending = 0;
+    group->active = 0;
+    LightEvent_Init(&group->done, RESET_ONESHOT);
+}
+
+void jobSubmit(JobPool *pool, JobGroup *group, JobFunc func, void *arg) {
+    Job job = {func, arg, group};
+    __atomic_add_fetch(&group->active, 1, __ATOMIC_ACQ_REL);
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_ACQ_REL);
+
+    bool queued = false;
+    int count = pool ? pool->workerCount : 0;
+    for (int i = 0; !queued && i < count; i++) {
+        queued = push(&pool->workers[(pool->next + i) % count].queue, &job);
+    }
+    if (!queued) {
+        runJob(&job);
+        return;
+    }
+    pool->next++;
+
+    u32 idle = __atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < count; i++) {
+        if (idle & (1u << i)) {
+            LightEvent_Signal(&pool->workers[i].wake);
+        }
+    }
+}
+
+void jobGroupWait(JobPool *pool, JobGroup *group) {
+    Job job;
+    bool stolen;
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        if (pool && findJob(pool, -1, &job, &stolen)) {
+            runJob(&job);
+        } else {
+            LightEvent_Wait(&group->done);
+        }
+    }
+
+    // The worker that ran the last job may still be inside the signal; the
+    // group can only be reused or freed once every job is out
+    while (__atomic_load_n(&group->active, __ATOMIC_ACQUIRE) > 0) {
+        svcSleepThread(0);
+    }
+}
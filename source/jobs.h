@@ -0,0 +1,85 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "platform.h"
+
+// Small work-stealing job pool for the background scans.
+//
+// Each worker has its own queue. Jobs are handed out round robin, a worker
+// runs its own queue front to back, and one that runs dry steals from the
+// back of the others, the work furthest from the front of the request.
+// Whoever waits for a group runs queued jobs too, and with no workers at all
+// a job simply runs as it is submitted.
+//
+// On the console the workers go where the app core is not: the system core
+// (core 1), once the app has been given JOBS_SYSCORE_PERCENT of it, and on a
+// New 3DS cores 2 and 3 with the faster clock and L2 cache turned on. A core
+// that refuses a thread is skipped. On a PC the pool has as many threads as
+// asked for.
+
+#define JOBS_MAX_WORKERS     4
+#define JOBS_QUEUE_SIZE      64 // per worker, must be a power of two
+#define JOBS_SYSCORE_PERCENT 30
+
+typedef void (*JobFunc)(void *arg);
+
+// Jobs submitted together; jobGroupWait() returns once all of them ran.
+// The group may go away as soon as it returns, so each job leaves active
+// only after its signal, as its last touch of the group.
+typedef struct {
+    volatile u32 pending;  // jobs not finished yet
+    volatile u32 active;   // jobs that may still touch the group
+    LightEvent done;       // one-shot, signalled when pending drops to 0
+} JobGroup;
+
+typedef struct {
+    JobFunc func;
+    void *arg;
+    JobGroup *group;
+} Job;
+
+typedef struct {
+    LightLock lock;
+    Job jobs[JOBS_QUEUE_SIZE];
+    u32 head;              // next to run
+    u32 tail;              // next free
+} JobQueue;
+
+typedef struct JobPool JobPool;
+
+typedef struct {
+    JobPool *pool;
+    Thread thread;
+    int index;
+    int core;              // -1 on a PC
+    LightEvent wake;       // one-shot, signalled on a submit while idle
+    JobQueue queue;
+    u32 ran;               // jobs run, stolen ones included
+    u32 stolen;
+} JobWorker;
+
+struct JobPool {
+    JobWorker workers[JOBS_MAX_WORKERS];
+    int workerCount;
+    u32 next;              // round robin for submits
+    volatile u32 idle;     // bit per worker waiting for work
+    volatile bool quit;
+    bool syscore;          // core 1 was granted
+    u32 syscoreLimit;      // the app's share of core 1 before the pool
+    bool speedup;          // New 3DS clock and L2 cache turned on
+};
+
+// Starts up to threads workers, or one per core the console lets us use
+// when threads is 0. Returns the number started.
+int jobPoolStart(JobPool *pool, int threads, s32 priority);
+void jobPoolStop(JobPool *pool);
+
+void jobGroupInit(JobGroup *group);
+
+// Queues func(arg) as part of group. A full queue runs it right here.
+void jobSubmit(JobPool *pool, JobGroup *group, JobFunc func, void *arg);
+
+// Runs queued jobs until every job of the group has finished
+void jobGroupWait(JobPool *pool, JobGroup *group);
+
+#endif
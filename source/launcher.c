@@ -0,0 +1,189 @@
+#include "launcher.h"
+#include "hash.h"
+#include "trace.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LAUNCHER_STACK_SIZE (16 * 1024)
+
+// 3D Movie Player title IDs, most likely first
+static const u64 titleIds[] = {
+    0x0004000000036A00ULL, // CIA installed version (most common on emulator/CFW)
+    0x0004001000021A00ULL, // USA (preinstalled)
+    0x0004001000021B01ULL, // EUR (preinstalled)
+    0x0004001000020F00ULL, // JPN (preinstalled)
+};
+#define TITLE_ID_COUNT (sizeof(titleIds) / sizeof(titleIds[0]))
+
+static const FS_MediaType mediaTypes[] = {MEDIATYPE_SD, MEDIATYPE_NAND};
+
+static u32 fileChecksum(const LaunchFile *file) {
+    return fnv1a32(FNV1A_32_INIT, file, offsetof(LaunchFile, checksum));
+}
+
+static bool readCache(u64 *titleId, FS_MediaType *mediaType) {
+    FILE *f = fopen(LAUNCHER_FILE, "rb");
+    if (!f) {
+        return false;
+    }
+    LaunchFile file;
+    bool ok = fread(&file, sizeof(file), 1, f) == 1;
+    fclose(f);
+
+    ok = ok && file.magic == LAUNCHER_MAGIC && file.version == LAUNCHER_VERSION &&
+         file.checksum == fileChecksum(&file);
+    if (ok) {
+        *titleId = file.titleId;
+        *mediaType = (FS_MediaType)file.mediaType;
+    }
+    return ok;
+}
+
+static void writeCache(u64 titleId, FS_MediaType mediaType) {
+    LaunchFile file;
+    memset(&file, 0, sizeof(file));
+    file.magic = LAUNCHER_MAGIC;
+    file.version = LAUNCHER_VERSION;
+    file.titleId = titleId;
+    file.mediaType = (u32)mediaType;
+    file.checksum = fileChecksum(&file);
+
+    FILE *f = fopen(LAUNCHER_FILE, "wb");
+    if (f) {
+        fwrite(&file, sizeof(file), 1, f);
+        fclose(f);
+    }
+}
+
+// Still installed where the cache says
+static bool confirmTitle(u64 titleId, FS_MediaType mediaType) {
+    AM_TitleEntry entry;
+    return R_SUCCEEDED(AM_GetTitleInfo(mediaType, 1, &titleId, &entry));
+}
+
+// Lists the titles on one media type and picks the preferred known one
+static bool findTitle(FS_MediaType mediaType, u64 *titleId) {
+    u32 count = 0;
+    if (R_FAILED(AM_GetTitleCount(mediaType, &count)) || count == 0) {
+        return false;
+    }
+    u64 *installed = (u64 *)malloc(sizeof(u64) * count);
+    if (!installed) {
+        return false;
+    }
+    u32 read = 0;
+    bool found = false;
+    if (R_SUCCEEDED(AM_GetTitleList(&read, mediaType, count, installed))) {
+        for (u32 i = 0; !found && i < TITLE_ID_COUNT; i++) {
+            for (u32 t = 0; t < read; t++) {
+                if (installed[t] == titleIds[i]) {
+                    *titleId = titleIds[i];
+                    found = true;
+                    break;
+                }
+            }
+        }
+    }
+    free(installed);
+    return found;
+}
+
+static void resolve(Launcher *launcher) {
+    u64 start = svcGetSystemTick();
+    LaunchStatus status = LAUNCH_MISSING;
+
+    if (R_FAILED(amInit())) {
+        status = LAUNCH_NO_AM;
+    } else {
+        u64 titleId;
+        FS_MediaType mediaType;
+        if (readCache(&titleId, &mediaType) && confirmTitle(titleId, mediaType)) {
+            launcher->cached = true;
+            status = LAUNCH_READY;
+        } else {
+            for (size_t m = 0; status != LAUNCH_READY && m < sizeof(mediaTypes) / sizeof(mediaTypes[0]); m++) {
+                if (findTitle(mediaTypes[m], &titleId)) {
+                    mediaType = mediaTypes[m];
+                    status = LAUNCH_READY;
+                }
+            }
+            if (status == LAUNCH_READY) {
+                writeCache(titleId, mediaType);
+            } else {
+                remove(LAUNCHER_FILE);
+            }
+        }
+        amExit();
+
+        if (status == LAUNCH_READY) {
+            launcher->titleId = titleId;
+            launcher->mediaType = mediaType;
+        }
+    }
+
+    launcher->ticks = svcGetSystemTick() - start;
+    if (traceEnabled) {
+        traceRecord("launcher.resolve", start, launcher->cached);
+    }
+    __atomic_store_n(&launcher->status, status, __ATOMIC_RELEASE);
+    if (launcher->notify) {
+        LightEvent_Signal(launcher->notify);
+    }
+}
+
+static void launcherMain(void *arg) {
+    resolve((Launcher *)arg);
+}
+
+void launcherStart(Launcher *launcher, LightEvent *notify) {
+    memset(launcher, 0, sizeof(Launcher));
+    launcher->notify = notify;
+    launcher->status = LAUNCH_RESOLVING;
+
+    // Just below the UI: it is a few IPC calls, done well before anyone
+    // has picked a collection
+    s32 priority = 0x30;
+    svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+    if (priority < 0x3F) {
+        priority++;
+    }
+
+    launcher->thread = threadCreate(launcherMain, launcher, LAUNCHER_STACK_SIZE, priority, -2, false);
+    if (!launcher->thread) {
+        resolve(launcher);
+    }
+}
+
+void launcherStop(Launcher *launcher) {
+    if (!launcher->thread) {
+        return;
+    }
+    threadJoin(launcher->thread, U64_MAX);
+    threadFree(launcher->thread);
+    launcher->thread = NULL;
+}
+
+bool launcherJump(Launcher *launcher) {
+    if (launcherStatus(launcher) != LAUNCH_READY) {
+        return false;
+    }
+
+    u8 buf[0x300];
+    u8 hmac[0x20];
+    memset(buf, 0, sizeof(buf));
+    memset(hmac, 0, sizeof(hmac));
+
+    Result rc = APT_PrepareToDoApplicationJump(0, launcher->titleId, launcher->mediaType);
+    if (R_SUCCEEDED(rc)) {
+        rc = APT_DoApplicationJump(buf, sizeof(buf), hmac);
+    }
+    if (R_FAILED(rc)) {
+        // Resolve from scratch next time
+        remove(LAUNCHER_FILE);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <3ds.h>
+
+// Finds the installed 3D Movie Player once per launch, in the background.
+//
+// The title and media type found last time are cached in LAUNCHER_FILE and
+// confirmed with a single AM_GetTitleInfo. Only if that fails (first run,
+// or the title was removed) are the installed titles listed, one
+// AM_GetTitleList per media type, and matched against the known IDs in
+// order of preference. AM is brought up for the lookup and closed again, so
+// the launch itself only needs APT.
+//
+// The confirmation screen asks launcherStatus() before moving anything, so
+// a missing player is reported up front instead of after a full move and
+// rollback.
+
+#define LAUNCHER_FILE    "sdmc:/.clownsec_launch"
+#define LAUNCHER_MAGIC   0x544C4C43 // "CLLT"
+#define LAUNCHER_VERSION 1
+
+typedef enum {
+    LAUNCH_RESOLVING, // not known yet
+    LAUNCH_READY,     // titleId on mediaType
+    LAUNCH_MISSING,   // no known title installed
+    LAUNCH_NO_AM,     // AM could not be started
+} LaunchStatus;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u64 titleId;
+    u32 mediaType;
+    u32 checksum; // FNV-1a over the fields above
+} LaunchFile;
+
+typedef struct {
+    Thread thread;
+    LightEvent *notify; // signalled once the status is known, may be NULL
+    volatile LaunchStatus status;
+    u64 titleId;
+    FS_MediaType mediaType;
+    bool cached;        // confirmed from LAUNCHER_FILE without listing titles
+    u64 ticks;          // how long resolving took
+} Launcher;
+
+// Starts resolving; without a thread it resolves right here
+void launcherStart(Launcher *launcher, LightEvent *notify);
+void launcherStop(Launcher *launcher);
+
+static inline LaunchStatus launcherStatus(Launcher *launcher) {
+    return __atomic_load_n(&launcher->status, __ATOMIC_ACQUIRE);
+}
+
+// Jumps to the resolved title. On failure the cached target is dropped, so
+// the next start lists the titles again.
+bool launcherJump(Launcher *launcher);
+
+#endif
@@ -0,0 +1,643 @@
+#include "library.h"
+#include "hash.h"
+#include "fsdir.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+u32 libraryFingerprintAdd(u32 fingerprint, const char *name) {
+    return fingerprint + fnv1a32(FNV1A_32_INIT, name, strlen(name));
+}
+
+u32 libraryFingerprintFinish(u32 fingerprint, int entries) {
+    return fingerprint ^ (u32)entries * 0x9E3779B9u;
+}
+
+static bool reserveNodes(LibraryIndex *lib, int needed) {
+    if (needed <= lib->nodeCapacity) {
+        return true;
+    }
+    int capacity = lib->nodeCapacity ? lib->nodeCapacity * 2 : 64;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    LibraryNode *nodes = (LibraryNode *)realloc(lib->nodes, sizeof(LibraryNode) * capacity);
+    if (!nodes) {
+        return false;
+    }
+    lib->nodes = nodes;
+    lib->nodeCapacity = capacity;
+    return true;
+}
+
+static bool reserveStrings(LibraryIndex *lib, u32 needed) {
+    if (needed <= lib->stringCapacity) {
+        return true;
+    }
+    u32 capacity = lib->stringCapacity ? lib->stringCapacity * 2 : 4096;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    char *strings = (char *)realloc(lib->strings, capacity);
+    if (!strings) {
+        return false;
+    }
+    lib->strings = strings;
+    lib->stringCapacity = capacity;
+    return true;
+}
+
+size_t libraryCollationKey(const char *name, u8 *out) {
+    size_t len = 0;
+    const u8 *p = (const u8 *)name;
+
+    while (*p) {
+        if (*p >= '0' && *p <= '9') {
+            while (*p == '0' && p[1] >= '0' && p[1] <= '9') {
+                p++; // leading zeros don't change the value
+            }
+            const u8 *digits = p;
+            while (*p >= '0' && *p <= '9') {
+                p++;
+            }
+            size_t count = p - digits;
+            if (count > 0xFF) {
+                count = 0xFF;
+            }
+            out[len++] = '0';
+            out[len++] = (u8)count;
+            memcpy(out + len, digits, count);
+            len += count;
+        } else {
+            out[len++] = (*p >= 'A' && *p <= 'Z') ? *p + ('a' - 'A') : *p;
+            p++;
+        }
+    }
+
+    return len;
+}
+
+static int addNode(LibraryIndex *lib, int parent, const char *name) {
+    size_t len = strlen(name);
+    if (len > 0x3FFF || !reserveNodes(lib, lib->nodeCount + 1) ||
+        !reserveStrings(lib, lib->stringSize + len + 1 + len * 3)) {
+        return -1;
+    }
+
+    LibraryNode *node = &lib->nodes[lib->nodeCount];
+    node->nameOffset = lib->stringSize;
+    node->nameLength = (u16)len;
+    node->flags = 0;
+    node->parent = parent;
+    node->firstChild = -1;
+    node->nextSibling = -1;
+    node->moflexCount = -1;
+    node->fingerprint = 0;
+
+    memcpy(lib->strings + lib->stringSize, name, len + 1);
+    lib->stringSize += len + 1;
+
+    // The collation key follows the name in the pool
+    node->keyLength = (u16)libraryCollationKey(name, (u8 *)lib->strings + lib->stringSize);
+    node->reserved = 0;
+    lib->stringSize += node->keyLength;
+
+    lib->dirty = true;
+    return lib->nodeCount++;
+}
+
+void libraryInit(LibraryIndex *lib, const char *basePath) {
+    memset(lib, 0, sizeof(LibraryIndex));
+    LightLock_Init(&lib->lock);
+    strncpy(lib->basePath, basePath, sizeof(lib->basePath) - 1);
+    addNode(lib, -1, "");
+}
+
+void libraryFree(LibraryIndex *lib) {
+    free(lib->nodes);
+    free(lib->strings);
+    lib->nodes = NULL;
+    lib->strings = NULL;
+    lib->nodeCount = lib->nodeCapacity = 0;
+    lib->stringSize = lib->stringCapacity = 0;
+}
+
+static int findChild(const LibraryIndex *lib, int parent, const char *name, size_t len) {
+    for (int c = lib->nodes[parent].firstChild; c >= 0; c = lib->nodes[c].nextSibling) {
+        if (lib->nodes[c].nameLength == len &&
+            memcmp(lib->strings + lib->nodes[c].nameOffset, name, len) == 0) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+// Walks path components below basePath, optionally creating missing nodes.
+static int lookup(LibraryIndex *lib, const char *path, bool create) {
+    size_t baseLen = strlen(lib->basePath);
+    if (strncmp(path, lib->basePath, baseLen - 1) != 0) {
+        return -1;
+    }
+
+    const char *p = path + baseLen - 1;
+    if (*p != '\0' && *p != '/') {
+        return -1;
+    }
+
+    int node = 0;
+    while (*p != '\0') {
+        while (*p == '/') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        const char *end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+
+        int child = findChild(lib, node, p, len);
+        if (child < 0) {
+            if (!create) {
+                return -1;
+            }
+            char name[256];
+            if (len >= sizeof(name)) {
+                return -1;
+            }
+            memcpy(name, p, len);
+            name[len] = '\0';
+            child = addNode(lib, node, name);
+            if (child < 0) {
+                return -1;
+            }
+            lib->nodes[child].nextSibling = lib->nodes[node].firstChild;
+            lib->nodes[node].firstChild = child;
+            lib->nodes[node].flags &= ~LIBRARY_NODE_SORTED;
+        }
+
+        node = child;
+        p += len;
+    }
+
+    return node;
+}
+
+int libraryFind(const LibraryIndex *lib, const char *path) {
+    return lookup((LibraryIndex *)lib, path, false);
+}
+
+typedef struct {
+    const u8 *key;
+    const char *name;
+    u16 keyLength;
+    s32 node;
+} SortItem;
+
+static int compareSortItems(const void *a, const void *b) {
+    const SortItem *x = (const SortItem *)a;
+    const SortItem *y = (const SortItem *)b;
+
+    int result = memcmp(x->key, y->key, x->keyLength < y->keyLength ? x->keyLength : y->keyLength);
+    if (result == 0) {
+        result = (int)x->keyLength - (int)y->keyLength;
+    }
+    // Same key ("a01" and "A1"): fall back to the raw name so the order is stable
+    return result != 0 ? result : strcmp(x->name, y->name);
+}
+
+bool librarySortChildren(LibraryIndex *lib, int node) {
+    if (lib->nodes[node].flags & LIBRARY_NODE_SORTED) {
+        return true;
+    }
+
+    int count = 0;
+    for (int c = lib->nodes[node].firstChild; c >= 0; c = lib->nodes[c].nextSibling) {
+        count++;
+    }
+
+    SortItem *items = (SortItem *)malloc(sizeof(SortItem) * (count + 1));
+    if (!items) {
+        return false;
+    }
+
+    int i = 0;
+    for (int c = lib->nodes[node].firstChild; c >= 0; c = lib->nodes[c].nextSibling) {
+        items[i].key = libraryNodeKey(lib, c);
+        items[i].name = libraryNodeName(lib, c);
+        items[i].keyLength = lib->nodes[c].keyLength;
+        items[i].node = c;
+        i++;
+    }
+    qsort(items, count, sizeof(SortItem), compareSortItems);
+
+    // Relink the children in order
+    s32 *link = &lib->nodes[node].firstChild;
+    for (i = 0; i < count; i++) {
+        *link = items[i].node;
+        link = &lib->nodes[items[i].node].nextSibling;
+    }
+    *link = -1;
+    free(items);
+
+    lib->nodes[node].flags |= LIBRARY_NODE_SORTED;
+    lib->dirty = true;
+    return true;
+}
+
+static bool pushName(LibraryScan *scan, const char *name) {
+    size_t len = strlen(name) + 1;
+    if (scan->namesSize + len > scan->namesCapacity) {
+        size_t capacity = scan->namesCapacity ? scan->namesCapacity * 2 : 1024;
+        while (capacity < scan->namesSize + len) {
+            capacity *= 2;
+        }
+        char *grown = (char *)realloc(scan->names, capacity);
+        if (!grown) {
+            return false;
+        }
+        scan->names = grown;
+        scan->namesCapacity = capacity;
+    }
+    memcpy(scan->names + scan->namesSize, name, len);
+    scan->namesSize += len;
+    return true;
+}
+
+bool libraryScan(const char *path, const u32 *knownFingerprint, LibraryScan *scan) {
+    memset(scan, 0, sizeof(LibraryScan));
+
+    DirReader reader;
+    if (!dirOpen(&reader, path)) {
+        return false;
+    }
+
+    // Single pass: the entry attributes say which names are directories, so
+    // nothing here needs a stat()
+    int entries = 0;
+    bool ok = true;
+
+    DirEntry entry;
+    while (dirNext(&reader, &entry)) {
+        if (entry.name[0] == '.') {
+            continue;
+        }
+
+        entries++;
+        scan->fingerprint = libraryFingerprintAdd(scan->fingerprint, entry.name);
+
+        if (entry.isDirectory) {
+            ok = ok && pushName(scan, entry.name);
+        } else if (isMoflexFile(entry.name)) {
+            scan->moflexCount++;
+        }
+    }
+
+    dirClose(&reader);
+    scan->fingerprint = libraryFingerprintFinish(scan->fingerprint, entries);
+
+    if (!ok || (knownFingerprint && *knownFingerprint == scan->fingerprint)) {
+        // Unchanged (or out of memory): the child list is not needed
+        scan->namesSize = 0;
+        return ok;
+    }
+
+    scan->listed = true;
+    return true;
+}
+
+void libraryScanFree(LibraryScan *scan) {
+    free(scan->names);
+    memset(scan, 0, sizeof(LibraryScan));
+}
+
+int libraryApply(LibraryIndex *lib, const char *path, const LibraryScan *scan, bool *changed) {
+    if (changed) {
+        *changed = false;
+    }
+
+    int node = lookup(lib, path, true);
+    if (node < 0) {
+        return -1;
+    }
+
+    lib->nodes[node].flags |= LIBRARY_NODE_FRESH;
+    if ((lib->nodes[node].flags & LIBRARY_NODE_SCANNED) &&
+        lib->nodes[node].fingerprint == scan->fingerprint) {
+        return node;
+    }
+    if (!scan->listed) {
+        // The node changed since the scan looked at it; leave it for the
+        // next refresh rather than trusting a child list we didn't build
+        lib->nodes[node].flags &= ~LIBRARY_NODE_FRESH;
+        return node;
+    }
+
+    // Rebuild the child list, keeping nodes (and their cached counts) for
+    // subdirectories that are still there
+    s32 oldFirst = lib->nodes[node].firstChild;
+    s32 newFirst = -1;
+    lib->nodes[node].firstChild = -1;
+
+    for (size_t off = 0; off < scan->namesSize; off += strlen(scan->names + off) + 1) {
+        const char *name = scan->names + off;
+
+        int child = -1;
+        s32 *link = &oldFirst;
+        while (*link >= 0) {
+            if (strcmp(libraryNodeName(lib, *link), name) == 0) {
+                child = *link;
+                *link = lib->nodes[child].nextSibling;
+                break;
+            }
+            link = &lib->nodes[*link].nextSibling;
+        }
+
+        if (child < 0) {
+            child = addNode(lib, node, name);
+            if (child < 0) {
+                continue;
+            }
+        }
+
+        lib->nodes[child].nextSibling = newFirst;
+        newFirst = child;
+    }
+
+    // Anything left on the old list was removed from the card; those nodes are
+    // unreachable now and get dropped when the index is compacted on save.
+    lib->nodes[node].firstChild = newFirst;
+    lib->nodes[node].moflexCount = scan->moflexCount;
+    lib->nodes[node].fingerprint = scan->fingerprint;
+    lib->nodes[node].flags |= LIBRARY_NODE_SCANNED;
+    lib->nodes[node].flags &= ~LIBRARY_NODE_SORTED;
+    lib->dirty = true;
+
+    // Sorted once here, and the order is saved with the index, so listings
+    // are only sorted again after the folder changes
+    librarySortChildren(lib, node);
+
+    if (changed) {
+        *changed = true;
+    }
+    return node;
+}
+
+int libraryRefresh(LibraryIndex *lib, const char *path, bool *changed) {
+    if (changed) {
+        *changed = false;
+    }
+
+    // Only the lookup and the apply hold the lock; the directory IO doesn't
+    u32 known = 0;
+    bool haveKnown = false;
+    LightLock_Lock(&lib->lock);
+    int node = lookup(lib, path, false);
+    if (node >= 0 && (lib->nodes[node].flags & LIBRARY_NODE_SCANNED)) {
+        known = lib->nodes[node].fingerprint;
+        haveKnown = true;
+    }
+    LightLock_Unlock(&lib->lock);
+
+    LibraryScan scan;
+    bool scanned;
+    TRACE_SPAN("library.scan", node, scanned = libraryScan(path, haveKnown ? &known : NULL, &scan));
+    if (!scanned) {
+        libraryScanFree(&scan);
+        return -1;
+    }
+
+    LightLock_Lock(&lib->lock);
+    TRACE_SPAN("library.apply", scan.listed, node = libraryApply(lib, path, &scan, changed));
+    LightLock_Unlock(&lib->lock);
+
+    libraryScanFree(&scan);
+    return node;
+}
+
+// Every node is reached from the root exactly once, through the child list
+// of the parent it names, so no walk over the links can loop
+static bool checkTree(const LibraryNode *nodes, s32 count) {
+    u8 *seen = (u8 *)calloc(count, 1);
+    s32 *stack = (s32 *)malloc(sizeof(s32) * count);
+    bool ok = seen && stack && nodes[0].nextSibling < 0;
+    s32 reached = 0;
+    int top = 0;
+
+    if (ok) {
+        seen[0] = 1;
+        reached = 1;
+        stack[top++] = 0;
+    }
+    while (ok && top > 0) {
+        s32 node = stack[--top];
+        for (s32 c = nodes[node].firstChild; c >= 0; c = nodes[c].nextSibling) {
+            if (seen[c] || nodes[c].parent != node) {
+                ok = false;
+                break;
+            }
+            seen[c] = 1;
+            reached++;
+            stack[top++] = c;
+        }
+    }
+
+    free(stack);
+    free(seen);
+    return ok && reached == count;
+}
+
+bool libraryLoad(LibraryIndex *lib, const char *file) {
+    FILE *f = fopen(file, "rb");
+    if (!f) {
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (size < (long)sizeof(LibraryFileHeader)) {
+        fclose(f);
+        return false;
+    }
+
+    // Read the whole index in one go, then validate it in memory
+    u8 *buffer = (u8 *)malloc(size);
+    if (!buffer) {
+        fclose(f);
+        return false;
+    }
+    size_t read = fread(buffer, 1, size, f);
+    fclose(f);
+
+    LibraryFileHeader header;
+    memcpy(&header, buffer, sizeof(header));
+
+    size_t nodeBytes = (size_t)header.nodeCount * sizeof(LibraryNode);
+    if (read != (size_t)size ||
+        header.magic != LIBRARY_MAGIC ||
+        header.version != LIBRARY_VERSION ||
+        header.nodeCount == 0 ||
+        header.nodeCount > 0x100000 ||
+        sizeof(header) + nodeBytes + header.stringSize != (size_t)size) {
+        free(buffer);
+        return false;
+    }
+
+    const u8 *payload = buffer + sizeof(header);
+    if (fnv1a32(FNV1A_32_INIT, payload, nodeBytes + header.stringSize) != header.checksum) {
+        free(buffer);
+        return false;
+    }
+
+    // Make sure every link and name stays inside the tables
+    const LibraryNode *nodes = (const LibraryNode *)payload;
+    const char *strings = (const char *)(payload + nodeBytes);
+    s32 count = (s32)header.nodeCount;
+    for (s32 i = 0; i < count; i++) {
+        const LibraryNode *n = &nodes[i];
+        if ((u64)n->nameOffset + n->nameLength + 1 + n->keyLength > header.stringSize ||
+            strings[n->nameOffset + n->nameLength] != '\0' ||
+            n->parent < -1 || n->parent >= count || n->firstChild < -1 || n->firstChild >= count ||
+            n->nextSibling < -1 || n->nextSibling >= count || (i == 0) != (n->parent < 0)) {
+            free(buffer);
+            return false;
+        }
+    }
+    if (!checkTree(nodes, count)) {
+        free(buffer);
+        return false;
+    }
+
+    LibraryIndex loaded;
+    memset(&loaded, 0, sizeof(loaded));
+    if (!reserveNodes(&loaded, count) || !reserveStrings(&loaded, header.stringSize)) {
+        libraryFree(&loaded);
+        free(buffer);
+        return false;
+    }
+    memcpy(loaded.nodes, nodes, nodeBytes);
+    memcpy(loaded.strings, strings, header.stringSize);
+    loaded.nodeCount = count;
+    loaded.stringSize = header.stringSize;
+    memcpy(loaded.basePath, lib->basePath, sizeof(loaded.basePath));
+
+    // Nothing from a previous session has been checked yet
+    for (s32 i = 0; i < count; i++) {
+        loaded.nodes[i].flags &= ~LIBRARY_NODE_FRESH;
+    }
+
+    LightLock_Lock(&lib->lock);
+    libraryFree(lib);
+    lockedReplace(lib, &loaded, lock);
+    LightLock_Unlock(&lib->lock);
+
+    free(buffer);
+    return true;
+}
+
+bool librarySave(LibraryIndex *lib, const char *file) {
+    LightLock_Lock(&lib->lock);
+
+    // Compact into a fresh index so nodes orphaned by rescans are dropped and
+    // the tree is stored in depth-first order.
+    LibraryIndex out;
+    memset(&out, 0, sizeof(out));
+    memcpy(out.basePath, lib->basePath, sizeof(out.basePath));
+
+    int *stack = (int *)malloc(sizeof(int) * lib->nodeCount * 2);
+    if (!stack || addNode(&out, -1, "") < 0) {
+        free(stack);
+        libraryFree(&out);
+        LightLock_Unlock(&lib->lock);
+        return false;
+    }
+    out.nodes[0] = lib->nodes[0];
+    out.nodes[0].nameOffset = 0;
+    out.nodes[0].firstChild = -1;
+
+    // Pairs of (old index, new index) still to expand
+    int top = 0;
+    stack[top++] = 0;
+    stack[top++] = 0;
+    bool ok = true;
+
+    while (top > 0 && ok) {
+        int dst = stack[--top];
+        int src = stack[--top];
+
+        // Children are appended so a sorted list stays sorted. addNode() may
+        // move the nodes, so the previous child is kept as an index.
+        int last = -1;
+        for (int c = lib->nodes[src].firstChild; c >= 0; c = lib->nodes[c].nextSibling) {
+            int copy = addNode(&out, dst, libraryNodeName(lib, c));
+            if (copy < 0) {
+                ok = false;
+                break;
+            }
+            out.nodes[copy].flags = lib->nodes[c].flags;
+            out.nodes[copy].moflexCount = lib->nodes[c].moflexCount;
+            out.nodes[copy].fingerprint = lib->nodes[c].fingerprint;
+            if (last < 0) {
+                out.nodes[dst].firstChild = copy;
+            } else {
+                out.nodes[last].nextSibling = copy;
+            }
+            last = copy;
+
+            stack[top++] = c;
+            stack[top++] = copy;
+        }
+    }
+    free(stack);
+
+    if (!ok) {
+        libraryFree(&out);
+        LightLock_Unlock(&lib->lock);
+        return false;
+    }
+
+    // Session-only flags stay in memory
+    for (int i = 0; i < out.nodeCount; i++) {
+        out.nodes[i].flags &= ~LIBRARY_NODE_FRESH;
+    }
+
+    LibraryFileHeader header;
+    header.magic = LIBRARY_MAGIC;
+    header.version = LIBRARY_VERSION;
+    header.nodeCount = out.nodeCount;
+    header.stringSize = out.stringSize;
+    header.checksum = fnv1a32(FNV1A_32_INIT, out.nodes, sizeof(LibraryNode) * out.nodeCount);
+    header.checksum = fnv1a32(header.checksum, out.strings, out.stringSize);
+
+    FILE *f = fopen(file, "wb");
+    if (f) {
+        ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+             fwrite(out.nodes, sizeof(LibraryNode), out.nodeCount, f) == (size_t)out.nodeCount &&
+             fwrite(out.strings, 1, out.stringSize, f) == out.stringSize;
+        fclose(f);
+    } else {
+        ok = false;
+    }
+
+    // Keep using the compacted copy; node indices change here, so nothing
+    // may hold on to them across a save
+    out.dirty = !ok;
+    libraryFree(lib);
+    lockedReplace(lib, &out, lock);
+    LightLock_Unlock(&lib->lock);
+    return ok;
+}
+
+bool isMoflexFile(const char *filename) {
+    size_t len = strlen(filename);
+    if (len < 8) { // ".moflex" is 7 characters
+        return false;
+    }
+
+    const char *ext = filename + len - 7;
+    return (strcasecmp(ext, ".moflex") == 0);
+}
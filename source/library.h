@@ -0,0 +1,122 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "platform.h"
+
+// Persistent index of the folder tree under BASE_PATH.
+//
+// Every directory we have seen gets a node holding its name, its position in
+// the tree, the number of .moflex files directly inside it and a fingerprint
+// of its entry names. The whole index is saved to a single versioned file so
+// the browser can come up without touching the SD card, and a directory is
+// only rescanned when its fingerprint no longer matches.
+
+#define LIBRARY_MAGIC   0x58444C43 // "CLDX"
+#define LIBRARY_VERSION 2
+
+#define LIBRARY_NODE_SCANNED 0x0001 // fingerprint and moflexCount are valid
+#define LIBRARY_NODE_SORTED  0x0002 // children are linked in natural order
+#define LIBRARY_NODE_FRESH   0x8000 // checked against the card this session, never saved
+
+typedef struct {
+    u32 nameOffset;  // offset into the string pool
+    u16 nameLength;
+    u16 flags;
+    u16 keyLength;   // collation key, stored right after the name's terminator
+    u16 reserved;
+    s32 parent;      // -1 for the root node
+    s32 firstChild;  // -1 when there are no subdirectories
+    s32 nextSibling; // -1 for the last child
+    s32 moflexCount; // .moflex files directly inside, -1 if never scanned
+    u32 fingerprint; // order-independent hash of the entry names
+} LibraryNode;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 nodeCount;
+    u32 stringSize;
+    u32 checksum;    // FNV-1a over the node table and string pool
+} LibraryFileHeader;
+
+typedef struct {
+    LibraryNode *nodes;
+    int nodeCount;
+    int nodeCapacity;
+    char *strings;
+    u32 stringSize;
+    u32 stringCapacity;
+    char basePath[256]; // directory represented by node 0, ends with '/'
+    bool dirty;         // changed since the last load/save
+    LightLock lock;     // held around node access once the scanner is running
+} LibraryIndex;
+
+// Result of enumerating one directory, gathered without touching the index
+// so the IO can run outside the lock.
+typedef struct {
+    char *names;          // subdirectory names, each '\0'-terminated
+    size_t namesSize;
+    size_t namesCapacity;
+    u32 fingerprint;
+    int moflexCount;
+    bool listed;          // names holds the full subdirectory list
+} LibraryScan;
+
+void libraryInit(LibraryIndex *lib, const char *basePath);
+void libraryFree(LibraryIndex *lib);
+bool libraryLoad(LibraryIndex *lib, const char *file);
+bool librarySave(LibraryIndex *lib, const char *file);
+
+static inline void libraryLock(LibraryIndex *lib) {
+    LightLock_Lock(&lib->lock);
+}
+
+static inline void libraryUnlock(LibraryIndex *lib) {
+    LightLock_Unlock(&lib->lock);
+}
+
+// Returns the node for a path under basePath, or -1 if it is not indexed.
+// Node indices stay valid until the next librarySave().
+int libraryFind(const LibraryIndex *lib, const char *path);
+
+// Enumerates a directory. The subdirectory list is only kept when the
+// fingerprint differs from knownFingerprint (pass NULL if there is none).
+bool libraryScan(const char *path, const u32 *knownFingerprint, LibraryScan *scan);
+void libraryScanFree(LibraryScan *scan);
+
+// The fingerprint a scan takes, one entry at a time: start from 0, add each
+// name not starting with '.', then finish with their count. Other indexes
+// build theirs the same way so the values can be compared.
+u32 libraryFingerprintAdd(u32 fingerprint, const char *name);
+u32 libraryFingerprintFinish(u32 fingerprint, int entries);
+
+// Stores a scan in the index; the caller holds the lock.
+int libraryApply(LibraryIndex *lib, const char *path, const LibraryScan *scan, bool *changed);
+
+// Re-enumerates a single directory and updates its node. The child list is
+// only rebuilt when its fingerprint changed.
+// Returns the node index, or -1 if the directory can't be opened.
+// Takes the lock itself, only around the index updates.
+int libraryRefresh(LibraryIndex *lib, const char *path, bool *changed);
+
+static inline const char *libraryNodeName(const LibraryIndex *lib, int node) {
+    return lib->strings + lib->nodes[node].nameOffset;
+}
+
+static inline const u8 *libraryNodeKey(const LibraryIndex *lib, int node) {
+    return (const u8 *)lib->strings + lib->nodes[node].nameOffset + lib->nodes[node].nameLength + 1;
+}
+
+// Links a node's children in natural order (case-insensitive, numbers by
+// value) using the cached keys. Does nothing if they already are.
+bool librarySortChildren(LibraryIndex *lib, int node);
+
+// Builds the natural-order collation key for a name: ASCII letters are
+// folded to lower case and every digit run becomes '0', its significant
+// digit count, then the digits, so "Season 2" < "Season 10" under memcmp.
+// out needs room for 3 bytes per name byte.
+size_t libraryCollationKey(const char *name, u8 *out);
+
+bool isMoflexFile(const char *filename);
+
+#endif
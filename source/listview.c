@@ -0,0 +1,125 @@
+#include "listview.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+void listViewLine(int row, const char *format, ...) {
+    char line[LISTVIEW_WIDTH + 1];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    printf("\x1b[%d;1H%-*s", row, LISTVIEW_WIDTH, line);
+}
+
+void listViewInit(ListView *view, int firstRow, int rows, int limit) {
+    memset(view, 0, sizeof(ListView));
+    view->firstRow = firstRow;
+    view->rows = rows < LISTVIEW_MAX_ROWS ? rows : LISTVIEW_MAX_ROWS;
+    view->limit = limit;
+}
+
+static void drawRow(const ListView *view, const DirectoryList *list, int row, const ListViewRow *shown) {
+    int line = view->firstRow + row;
+    if (shown->entry < 0) {
+        listViewLine(line, "%s", "");
+        return;
+    }
+
+    const DirectoryEntry *entry = &list->entries[shown->entry];
+    const char *cursor = shown->selected ? "> " : "  ";
+    const char *name = entryName(list, entry);
+
+    // Long names are cut so the count stays visible and nothing wraps
+    char suffix[16];
+    if ((entry->flags & ENTRY_DIRECTORY) && shown->count < 0) {
+        snprintf(suffix, sizeof(suffix), " (...)");
+    } else if (entry->flags & ENTRY_DIRECTORY) {
+        // Over the limit is flagged so it's visible before opening
+        snprintf(suffix, sizeof(suffix), " (%d%s)", (int)shown->count,
+                 shown->count > view->limit ? "!" : "");
+    } else {
+        suffix[0] = '\0';
+    }
+    int room = LISTVIEW_WIDTH - 8 - (int)strlen(suffix);
+    listViewLine(line, "%s%s%.*s%s", cursor, (entry->flags & ENTRY_DIRECTORY) ? "[DIR] " : "      ",
+             room, name, suffix);
+}
+
+static void drawHeader(const ListView *view, const DirectoryList *list, const AppState *active) {
+    consoleClear();
+    listViewLine(1, "Clownsec Moflex Launcher");
+    listViewLine(2, "========================");
+    listViewLine(4, "Current: %s", list->currentPath);
+    if (active->filesActive) {
+        const char *name = strrchr(active->sourceDir, '/');
+        listViewLine(5, "In root: %s (%d files)", name ? name + 1 : active->sourceDir, active->fileCount);
+    }
+
+    int footer = view->firstRow + view->rows + 2;
+    listViewLine(footer, "A: Open  B: Back  X: Dupes  Y: Search  L/R: Page");
+    listViewLine(footer + 1, "START: Exit  SELECT: HUD%s", traceEnabled ? "  Tracing: L+R+SELECT" : "");
+}
+
+int listViewDraw(ListView *view, const DirectoryList *list, const AppState *active) {
+    int written = 0;
+
+    if (!view->valid || strcmp(view->drawnPath, list->currentPath) != 0) {
+        drawHeader(view, list, active);
+        strncpy(view->drawnPath, list->currentPath, DIRLIST_PATH_LEN - 1);
+        for (int row = 0; row < view->rows; row++) {
+            view->drawn[row].entry = -2; // matches nothing, so every row is drawn
+        }
+        view->drawnOffset = -1;
+        view->drawnStatus[0] = '\0';
+        view->valid = true;
+        written += 5;
+    }
+
+    if (strcmp(view->drawnStatus, view->status) != 0) {
+        listViewLine(3, "%s", view->status);
+        memcpy(view->drawnStatus, view->status, sizeof(view->status));
+        written++;
+    }
+
+    for (int row = 0; row < view->rows; row++) {
+        ListViewRow shown = {-1, 0, false};
+        int index = list->scrollOffset + row;
+        if (index < list->count) {
+            shown.entry = index;
+            shown.count = list->entries[index].moflexCount;
+            shown.selected = index == list->selected;
+        }
+
+        ListViewRow *drawn = &view->drawn[row];
+        if (drawn->entry != shown.entry || drawn->count != shown.count ||
+            drawn->selected != shown.selected) {
+            drawRow(view, list, row, &shown);
+            *drawn = shown;
+            written++;
+        }
+    }
+
+    // Position within the folder, below the rows
+    if (view->drawnOffset != list->scrollOffset || view->drawnTotal != list->count) {
+        int line = view->firstRow + view->rows;
+        int endIdx = list->scrollOffset + view->rows;
+        if (endIdx > list->count) {
+            endIdx = list->count;
+        }
+        if (list->count == 0) {
+            listViewLine(line, "(Empty directory)");
+        } else if (list->count > view->rows) {
+            listViewLine(line, "(%d-%d of %d)", list->scrollOffset + 1, endIdx, list->count);
+        } else {
+            listViewLine(line, "%s", "");
+        }
+        view->drawnOffset = list->scrollOffset;
+        view->drawnTotal = list->count;
+        written++;
+    }
+
+    return written;
+}
@@ -0,0 +1,63 @@
+#ifndef LISTVIEW_H
+#define LISTVIEW_H
+
+#include <3ds.h>
+#include <stdio.h>
+
+#include "dirlist.h"
+#include "state.h"
+
+// The browser listing on the top console, redrawn line by line.
+//
+// The view remembers what every row on screen shows. Each draw compares
+// that with the listing and only rewrites the rows that differ: the old and
+// new selection after a cursor move, every row after a scroll, a row whose
+// count came in. The header and footer are only written on a full redraw,
+// which happens on the first draw, after listViewInvalidate() and when the
+// listing moves to another folder. Either way the work is bounded by the
+// rows on screen, not by the size of the folder.
+
+#define LISTVIEW_WIDTH    49 // one short of the console, so a row never wraps
+#define LISTVIEW_MAX_ROWS 32
+
+typedef struct {
+    s32 entry;    // index shown on this row, -1 when blank
+    s32 count;
+    bool selected;
+} ListViewRow;
+
+typedef struct {
+    int firstRow; // console row (1-based) of the first entry
+    int rows;
+    int limit;    // counts above this are flagged
+    bool valid;   // false forces a full redraw
+
+    ListViewRow drawn[LISTVIEW_MAX_ROWS];
+    int drawnOffset;
+    int drawnTotal;
+    char drawnPath[DIRLIST_PATH_LEN];
+
+    char status[LISTVIEW_WIDTH + 1]; // under the title, "" for none
+    char drawnStatus[LISTVIEW_WIDTH + 1];
+} ListView;
+
+void listViewInit(ListView *view, int firstRow, int rows, int limit);
+
+static inline void listViewInvalidate(ListView *view) {
+    view->valid = false;
+}
+
+// Sets the line under the title; it is drawn with the next listViewDraw()
+static inline void listViewStatus(ListView *view, const char *text) {
+    snprintf(view->status, sizeof(view->status), "%s", text);
+}
+
+// Brings the console up to date with the listing. Returns the number of
+// console lines written.
+int listViewDraw(ListView *view, const DirectoryList *list, const AppState *active);
+
+// Prints one line of LISTVIEW_WIDTH at a console row, overwriting whatever
+// was there
+void listViewLine(int row, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
@@ -2,56 +2,276 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <dirent.h>
 #include <sys/stat.h>
 
-#define MAX_ENTRIES 256
-#define MAX_PATH_LEN 512
-#define STATE_FILE "sdmc:/.clownsec_state"
+#include "library.h"
+#include "state.h"
+#include "mover.h"
+#include "moveworker.h"
+#include "scanner.h"
+#include "fssession.h"
+#include "dirlist.h"
+#include "trace.h"
+#include "hud.h"
+#include "listview.h"
+#include "search.h"
+#include "touchkeys.h"
+#include "metacache.h"
+#include "verifier.h"
+#include "dupes.h"
+#include "launcher.h"
+#include "jobs.h"
+#include "cover.h"
+#include "coverview.h"
+#include "recents.h"
+
+#define MAX_PATH_LEN DIRLIST_PATH_LEN
 #define FILES_LIST "sdmc:/.clownsec_files"
 #define BASE_PATH "sdmc:/MOFLEX/"
 #define ROOT_PATH "sdmc:/"
+#define OLDMOFLEX_PATH "sdmc:/MOFLEX/OLDMOFLEX"
+#define VISIBLE_LINES 21 // rows 6-26, leaving the header and footer on screen
+#define LIST_FIRST_ROW 6
+
+// Folder tree and moflex counts, persisted to FILES_LIST between launches
+static LibraryIndex library;
+
+// Collection currently sitting in the SD root, if any. It stays there while
+// browsing so picking another collection only swaps the files that differ.
+static AppState activeState;
+
+// Fills in counts for the folders on screen while the browser is idle,
+// spreading the folders over the cores the app core leaves free
+static Scanner scanner;
+static JobPool jobs;
+
+// Folder listing shown by the browser
+static DirectoryList dirList;
+
+// Live metrics on the otherwise unused bottom screen
+static Hud hud;
+
+// What the browser has on the top screen, redrawn line by line
+static ListView view;
+
+// Every folder and movie under BASE_PATH by name, kept up to date by a
+// background walk and persisted to SEARCH_FILE
+static SearchIndex search;
+static SearchIndexer indexer;
+
+// Runtime and sizes of the collections opened so far, by file, persisted to
+// META_FILE
+static MetaCache meta;
+static bool metaLoaded; // read on the first confirmation screen
+
+// Reads whole movies in the background when asked, so damaged ones are
+// flagged before they are moved
+static Verifier verifier;
+
+// Copies of the same movie across the library, found by a background pass
+// each time the report is opened and persisted to DUPES_FILE
+static DupeIndex dupes;
+static DupeFinder dupeFinder;
+
+// Names of the volume being moved, for the move worker's selection
+static char volumeNames[MOFLEX_LIMIT * META_NAME_LEN];
+static const char *volumeList[MOFLEX_LIMIT];
+static MoveSelection volumeSelection;
+
+// Typing for the search screen, in place of the HUD
+static TouchKeys touchKeys;
+
+// Startup work that can wait for the browser: a v1.0 collection restored
+// from root, then stray root files swept into OLDMOFLEX
+static MoveWorker tidyWorker;
+static AppState tidyState;
+
+// The Movie Player to launch, looked up in the background at startup
+static Launcher launcher;
+
+// Cover art of the highlighted folder on the bottom screen while the HUD is
+// hidden, decoded in the background and kept in COVER_FILE
+static CoverCache covers;
+static CoverView coverView;
+
+// Collections launched lately and the pinned ones, shown first and
+// persisted to RECENTS_FILE
+static RecentsList recents;
+
+// Startup timing, for the HUD and the trace
+static u64 startupAt;
+static u64 phaseStart;
+
+// Signalled by the scanner, indexer, finder and move workers so an idle UI wakes up for
+// their news instead of polling them every frame
+static LightEvent uiWake;
+
+#define MOVE_FAILURES_SHOWN 5
+#define SEARCH_RESULTS_SHOWN VISIBLE_LINES
+
+// While the indexer is still walking, results are refreshed this often
+#define SEARCH_REFRESH_MS 500
+
+// How long the idle UI sleeps between pad reads when no worker wakes it
+#define UI_POLL_NS 16666667LL // one frame
+
+// Set to 1 to flush and swap every vblank like before, for comparing the
+// HUD's UI CPU and frames/s figures
+#ifndef UI_ALWAYS_PRESENT
+#define UI_ALWAYS_PRESENT 0
+#endif
+
+// A held D-pad direction repeats after REPEAT_DELAY_MS. The interval then
+// shrinks from REPEAT_START_MS to REPEAT_MIN_MS over REPEAT_ACCEL_MS, after
+// which every further second held moves one more entry per repeat.
+#define REPEAT_DELAY_MS 300
+#define REPEAT_START_MS 120
+#define REPEAT_MIN_MS   30
+#define REPEAT_ACCEL_MS 1500
 
 typedef struct {
-    char name[256];
-    bool isDirectory;
-    int moflexCount; // -1 means not scanned yet
-} DirectoryEntry;
-
-typedef struct {
-    DirectoryEntry *entries;
-    int count;
-    int capacity;
-    int selected;
-    int scrollOffset;
-    char currentPath[MAX_PATH_LEN];
-} DirectoryList;
-
-// State management (kept small to avoid stack overflow)
+    u32 key; // KEY_UP or KEY_DOWN while one is being repeated, else 0
+    u64 pressedAt;
+    u64 nextAt;
+} KeyRepeat;
+
+typedef enum {
+    SCREEN_RECENTS, // recent and favorite collections, A relaunches
+    SCREEN_BROWSE,  // directory listing
+    SCREEN_CONFIRM, // collection picked, A moves it to root and launches
+    SCREEN_MOVING,  // a move worker is running, progress redrawn in place
+    SCREEN_MESSAGE, // result text on screen until one of dismissKeys
+    SCREEN_SEARCH,  // type-ahead search over the whole library
+    SCREEN_DUPES,   // duplicate report, filled in by the finder as it goes
+    SCREEN_QUIT,
+} Screen;
+
+typedef enum {
+    TIDY_NONE,
+    TIDY_RESTORE, // tidyState back to its folder
+    TIDY_SWEEP,   // root .moflex files to OLDMOFLEX_PATH
+} TidyJob;
+
+typedef enum {
+    MOVE_FOR_LAUNCH,  // collection moved or swapped into root, then launch
+    MOVE_FOR_RECOVER, // launch failed, putting the files back
+    MOVE_FOR_EXIT,    // restoring before the app quits
+} MovePurpose;
+
+// The browser and its dialogs as one state machine. Handlers only react to
+// input and worker news and mark what changed; a frame is drawn, flushed and
+// swapped only when something did, otherwise the loop sleeps.
 typedef struct {
-    char sourceDir[MAX_PATH_LEN];
-    bool filesActive;
-} AppState;
+    Screen screen;
+    bool dirty;   // the current screen needs redrawing
+    bool present; // the console changed and needs flushing and swapping
+    bool launched;
+
+    // SCREEN_CONFIRM
+    char selectedPath[MAX_PATH_LEN];
+    int selectedCount;
+    bool alreadyActive;
+    MetaSummary summary;
+    int volume;              // picked with Left/Right when summary.volumes > 1
+    MetaVolume volumeInfo;
+    char verifyPath[MAX_PATH_LEN]; // collection the verifier was last asked about
+    u32 homeFingerprint;     // of the folder with all its files, for the recents
+    bool homeKnown;          // none of its files were in root when it was opened
+
+    // SCREEN_MOVING
+    MoveWorker worker;
+    MovePurpose purpose;
+    bool cancellable;
+    bool freshCollection; // activeState was started for this move
+    MoveEvent progress;
+    char failures[MOVE_FAILURES_SHOWN][48];
+    int failureCount;
+
+    // SCREEN_MESSAGE
+    u32 dismissKeys;
+    Screen next;
+
+    // SCREEN_SEARCH, kept between visits
+    char query[SEARCH_QUERY_LEN];
+    SearchResult results[SEARCH_RESULTS_SHOWN];
+    int resultCount;
+    int resultSelected;
+    u64 queryTicks;   // time the last query took
+    u64 queryAt;
+    u32 queryFolders; // indexer progress the results reflect
+
+    // SCREEN_DUPES
+    int dupesScroll;  // first report line on screen
+    int dupesLines;   // report lines at the last draw
+    u64 dupesAt;      // time of the last draw
+    DupePhase dupesPhase; // finder phase at the last draw
+
+    // SCREEN_RECENTS
+    int recentSelected;
+
+    // Startup housekeeping; only browsing is offered until it is done
+    TidyJob tidy;
+    u64 tidyAt;
+
+    KeyRepeat repeat;
+} Ui;
+
+static Ui ui;
 
 // Function prototypes
 void initGfx(void);
 void exitGfx(void);
-bool loadDirectory(DirectoryList *list, const char *path);
-void freeDirectoryList(DirectoryList *list);
-void displayDirectory(const DirectoryList *list);
-int countMoflexFiles(const char *path);
-bool moveFiles(const char *sourceDir, const char *destDir);
-void saveState(const AppState *state);
-bool loadState(AppState *state);
-void clearState(void);
-bool launchMoviePlayer(void);
-bool isMoflexFile(const char *filename);
-void cleanupOldMoflexFiles(void);
+void showBrowser(void);
+int dpadSteps(u32 kDown, u32 kHeld);
+void moveSelection(int delta);
+void pageSelection(int pages);
+void requestVisibleCounts(const DirectoryList *list);
+void printMoveStats(const MoveStats *stats);
+void formatDuration(u64 ms, char *out, size_t size);
+void formatSize(u64 bytes, char *out, size_t size);
+bool waitForKey(u32 keys);
+void quitApp(void);
+void handleBrowse(u32 kDown, u32 kHeld);
+void openCollection(const char *path);
+void handleConfirm(u32 kDown);
+void launchSelected(void);
+void handleMoving(u32 kDown);
+void drawConfirm(void);
+void drawMoveProgress(void);
+void selectVolume(int volume);
+int activeVolume(void);
+void startMove(MovePurpose purpose, MoveJobKind kind, const char *sourcePath, const MoveSelection *only,
+               bool cancellable);
+void finishMove(void);
+void showMessage(u32 dismissKeys, Screen next);
+void showSearch(void);
+void handleSearch(u32 kDown, u32 kHeld);
+void runSearch(void);
+void drawSearch(void);
+void openSearchResult(const SearchResult *result);
+void leaveSearch(void);
+void showRecents(void);
+void handleRecents(u32 kDown, u32 kHeld);
+void drawRecents(void);
+void relaunchRecent(int i);
+void showDupes(void);
+void handleDupes(u32 kDown, u32 kHeld);
+void drawDupes(void);
+void startupPhase(const char *name);
+void updateCover(void);
+void startTidy(void);
+void pollTidy(void);
 
 int main(int argc, char **argv) {
-    // Initialize services
+    startupAt = phaseStart = svcGetSystemTick();
+
+    // Initialize services. AM is only used by the launcher's lookup.
     gfxInitDefault();
     consoleInit(GFX_TOP, NULL);
+    hudInit(&hud);
+    coverViewInit(&coverView);
+    LightEvent_Init(&uiWake, RESET_ONESHOT);
+    memset(&ui, 0, sizeof(ui));
 
     // Initialize filesystem access
     Result rc = fsInit();
@@ -59,81 +279,64 @@ int main(int argc, char **argv) {
         printf("Failed to initialize filesystem\n");
         printf("Error: 0x%08lX\n", rc);
         printf("Press START to exit\n");
-        while (aptMainLoop()) {
-            hidScanInput();
-            if (hidKeysDown() & KEY_START) break;
-            gfxFlushBuffers();
-            gfxSwapBuffers();
-            gspWaitForVBlank();
-        }
+        waitForKey(KEY_START);
         gfxExit();
         return 1;
     }
 
-    // Initialize AM service for launching apps
-    rc = amInit();
-    if (R_FAILED(rc)) {
-        printf("Failed to initialize AM service\n");
-        printf("Error: 0x%08lX\n", rc);
-        printf("Press START to exit\n");
-        while (aptMainLoop()) {
-            hidScanInput();
-            if (hidKeysDown() & KEY_START) break;
-            gfxFlushBuffers();
-            gfxSwapBuffers();
-            gspWaitForVBlank();
-        }
-        fsExit();
-        gfxExit();
-        return 1;
-    }
-
-    // Check if we need to restore files
-    AppState state = {0};
-    if (loadState(&state) && state.filesActive) {
-        consoleClear();
-        printf("Clownsec Moflex Launcher\n");
-        printf("========================\n\n");
-        printf("Restoring files from root...\n");
-        printf("Source: %s\n\n", state.sourceDir);
-
-        if (moveFiles(ROOT_PATH, state.sourceDir)) {
-            printf("Files restored successfully!\n");
-            clearState();
-        } else {
-            printf("ERROR: Failed to restore files!\n");
-            printf("Please manually move files back.\n");
-        }
+    // Keep the SD archive open for renames, directory and file reads.
+    // Without it those go through stdio instead, which works but is slower,
+    // so the browser says so.
+    bool fsSession = fsSessionOpen();
 
-        printf("\nPress START to continue\n");
-        while (aptMainLoop()) {
-            hidScanInput();
-            if (hidKeysDown() & KEY_START) break;
-            gfxFlushBuffers();
-            gfxSwapBuffers();
-            gspWaitForVBlank();
-        }
+    // Tracing from the very start is opt-in through a file on the card
+    if (traceConfigured()) {
+        traceStart();
+    }
+    startupPhase("startup.services");
+
+    // Bring up the library index; a missing or stale file just means the
+    // browser falls back to scanning the card. The search index is read by
+    // the indexer and the movie details on the first confirmation screen.
+    libraryInit(&library, BASE_PATH);
+    TRACE_SPAN("library.load", 0, libraryLoad(&library, FILES_LIST));
+    searchInit(&search, BASE_PATH);
+    dupesInit(&dupes, BASE_PATH);
+    metaInit(&meta);
+    startupPhase("startup.library");
+
+    // Finish or undo a batch of moves that was cut short by power loss,
+    // before the state file is trusted
+    recoverJournal();
+
+    // Read the state once. A collection with a manifest can stay in root:
+    // picking another one swaps just the files that differ, and it is
+    // restored when we exit. v1.0 state is restored in the background.
+    stateInit(&activeState);
+    bool hasState = loadState(&activeState);
+    if (!hasState || !activeState.filesActive) {
+        stateFree(&activeState);
+    } else if (activeState.legacy) {
+        tidyState = activeState;
+        stateInit(&activeState);
+        ui.tidy = TIDY_RESTORE;
+    }
+    if (!hasState) {
+        ui.tidy = TIDY_SWEEP; // moflex files already in root go to OLDMOFLEX
     }
 
+    // The hot list is what the app opens on, if there is one
+    TRACE_SPAN("recents.load", 0, recentsLoad(&recents, RECENTS_FILE));
+
     // Create MOFLEX folder if it doesn't exist
     mkdir("sdmc:/MOFLEX", 0777);
-
-    // Check for and cleanup old moflex files in root
-    cleanupOldMoflexFiles();
-
-    consoleClear();
-    printf("Clownsec Moflex Launcher\n");
-    printf("========================\n\n");
-    printf("Loading directory...\n");
-    printf("Path: %s\n", BASE_PATH);
-    gfxFlushBuffers();
-    gfxSwapBuffers();
+    startupPhase("startup.state");
 
     // Main directory browser
-    DirectoryList dirList = {0};
-    strncpy(dirList.currentPath, BASE_PATH, MAX_PATH_LEN - 1);
+    initDirectoryList(&dirList, &library, &activeState, VISIBLE_LINES);
+    listViewInit(&view, LIST_FIRST_ROW, VISIBLE_LINES, MOFLEX_LIMIT);
 
-    if (!loadDirectory(&dirList, dirList.currentPath)) {
+    if (!loadDirectory(&dirList, BASE_PATH)) {
         consoleClear();
         printf("\x1b[1;1H");
         printf("MOFLEX Folder Not Found\n");
@@ -147,586 +350,1459 @@ int main(int argc, char **argv) {
         printf("    Comedy/\n");
         printf("    SciFi/\n\n");
         printf("Press START to exit\n");
-        while (aptMainLoop()) {
-            hidScanInput();
-            if (hidKeysDown() & KEY_START) break;
-            gfxFlushBuffers();
-            gfxSwapBuffers();
-            gspWaitForVBlank();
-        }
+        waitForKey(KEY_START);
+        stateFree(&tidyState);
         freeDirectoryList(&dirList);
-        amExit();
+        libraryFree(&library);
+        searchFree(&search);
+        metaFree(&meta);
+        traceShutdown();
+        fsSessionClose();
         fsExit();
         gfxExit();
         return 1;
     }
+    if (!fsSession) {
+        listViewStatus(&view, "Warning: SD archive not open, using stdio");
+    }
+    startupPhase("startup.listing");
+
+    // Counting starts right away; without a thread, counts just show up as
+    // each folder is opened
+    jobPoolStart(&jobs, 0, 0x3F);
+    scannerStart(&scanner, &library, &jobs, &uiWake);
+    verifierStart(&verifier, &meta, &uiWake);
+    requestVisibleCounts(&dirList);
+    searchIndexerStart(&indexer, &search, SEARCH_FILE, true, &uiWake);
+    searchIndexerHold(&indexer, activeState.filesActive ? activeState.sourceDir : NULL);
+    startTidy();
+    launcherStart(&launcher, &uiWake);
+    coverStart(&covers, COVER_FILE, &uiWake);
+    startupPhase("startup.workers");
+
+    if (recents.count > 0) {
+        showRecents();
+    } else {
+        ui.screen = SCREEN_BROWSE;
+        ui.dirty = true;
+    }
+    u32 countsSeen = scannerCompleted(&scanner);
+    u32 verifiedSeen = verifierCompleted(&verifier);
+    LaunchStatus targetSeen = launcherStatus(&launcher);
 
-    consoleClear();
-    printf("Clownsec Moflex Launcher\n");
-    printf("========================\n\n");
-    printf("Directory loaded successfully!\n");
-    printf("Found %d directories\n\n", dirList.count);
-    printf("Starting browser...\n");
-    gfxFlushBuffers();
-    gfxSwapBuffers();
-    svcSleepThread(1000000000LL); // Wait 1 second
-
-    bool running = true;
-    bool needsRedraw = true;
-
-    while (running && aptMainLoop()) {
+    while (ui.screen != SCREEN_QUIT && aptMainLoop()) {
+        hudFrameBegin(&hud);
         hidScanInput();
         u32 kDown = hidKeysDown();
         u32 kHeld = hidKeysHeld();
 
-        if (kDown & KEY_START) {
-            running = false;
+        switch (ui.screen) {
+            case SCREEN_RECENTS:
+                handleRecents(kDown, kHeld);
+                break;
+            case SCREEN_BROWSE:
+                handleBrowse(kDown, kHeld);
+                break;
+            case SCREEN_CONFIRM:
+                handleConfirm(kDown);
+                break;
+            case SCREEN_MOVING:
+                handleMoving(kDown);
+                break;
+            case SCREEN_SEARCH:
+                handleSearch(kDown, kHeld);
+                break;
+            case SCREEN_DUPES:
+                handleDupes(kDown, kHeld);
+                break;
+            case SCREEN_MESSAGE:
+                if ((kDown & ui.dismissKeys) && ui.next == SCREEN_BROWSE) {
+                    showBrowser();
+                } else if (kDown & ui.dismissKeys) {
+                    ui.screen = ui.next;
+                }
+                break;
+            case SCREEN_QUIT:
+                break;
         }
 
-        if (kDown & KEY_UP) {
-            if (dirList.selected > 0) {
-                dirList.selected--;
-                if (dirList.selected < dirList.scrollOffset) {
-                    dirList.scrollOffset = dirList.selected;
-                }
-                needsRedraw = true;
+        pollTidy();
+
+        // Pick up counts the scanner stored since the last frame
+        u32 counts = scannerCompleted(&scanner);
+        if (counts != countsSeen) {
+            countsSeen = counts;
+            if (updateEntryCounts(&dirList) && ui.screen == SCREEN_BROWSE) {
+                ui.dirty = true;
             }
         }
 
-        if (kDown & KEY_DOWN) {
-            if (dirList.selected < dirList.count - 1) {
-                dirList.selected++;
-                int visibleLines = 25;
-                if (dirList.selected >= dirList.scrollOffset + visibleLines) {
-                    dirList.scrollOffset = dirList.selected - visibleLines + 1;
-                }
-                needsRedraw = true;
+        // Verdicts are in the cache already, the dialog just sums them up
+        u32 verified = verifierCompleted(&verifier);
+        if (verified != verifiedSeen) {
+            verifiedSeen = verified;
+            if (ui.screen == SCREEN_CONFIRM) {
+                metaSummarize(&meta, ui.selectedPath, &ui.summary);
+                ui.dirty = true;
             }
         }
 
-        if (kDown & KEY_A) {
-            if (dirList.count > 0) {
-                DirectoryEntry *entry = &dirList.entries[dirList.selected];
-
-                if (entry->isDirectory) {
-                    // First, count the moflex files if not already counted
-                    if (entry->moflexCount == -1) {
-                        char fullPath[MAX_PATH_LEN];
-                        snprintf(fullPath, MAX_PATH_LEN, "%s%s", dirList.currentPath, entry->name);
-                        entry->moflexCount = countMoflexFiles(fullPath);
-                    }
-
-                    // Show confirmation dialog
-                    consoleClear();
-                    printf("Clownsec Moflex Launcher\n");
-                    printf("========================\n\n");
-                    printf("Selected: %s\n", entry->name);
-                    printf("Moflex files: %d\n\n", entry->moflexCount);
-
-                    if (entry->moflexCount > 126) {
-                        printf("WARNING: More than 126 files!\n");
-                        printf("3D Movie Player may crash.\n\n");
-                    }
-
-                    if (entry->moflexCount == 0) {
-                        printf("No moflex files found!\n");
-                        printf("\nPress B to go back\n");
-
-                        while (aptMainLoop()) {
-                            hidScanInput();
-                            if (hidKeysDown() & KEY_B) break;
-                            gfxFlushBuffers();
-                            gfxSwapBuffers();
-                            gspWaitForVBlank();
-                        }
-                        needsRedraw = true;
-                        continue;
-                    }
-
-                    printf("Press A to move files and launch\n");
-                    printf("Press B to cancel\n");
-
-                    bool waitingConfirm = true;
-                    bool confirmed = false;
-
-                    while (waitingConfirm && aptMainLoop()) {
-                        hidScanInput();
-                        u32 kConfirm = hidKeysDown();
-
-                        if (kConfirm & KEY_A) {
-                            confirmed = true;
-                            waitingConfirm = false;
-                        }
-                        if (kConfirm & KEY_B) {
-                            waitingConfirm = false;
-                        }
-
-                        gfxFlushBuffers();
-                        gfxSwapBuffers();
-                        gspWaitForVBlank();
-                    }
-
-                    if (confirmed) {
-                        char sourcePath[MAX_PATH_LEN];
-                        snprintf(sourcePath, MAX_PATH_LEN, "%s%s", dirList.currentPath, entry->name);
-
-                        consoleClear();
-                        printf("Clownsec Moflex Launcher\n");
-                        printf("========================\n\n");
-                        printf("Moving files to root...\n");
-                        printf("From: %s\n\n", sourcePath);
-
-                        if (moveFiles(sourcePath, ROOT_PATH)) {
-                            printf("Files moved successfully!\n\n");
-
-                            // Save state
-                            AppState newState = {0};
-                            strncpy(newState.sourceDir, sourcePath, MAX_PATH_LEN - 1);
-                            newState.filesActive = true;
-                            saveState(&newState);
-
-                            printf("Launching 3D Movie Player...\n");
-                            printf("When done, exit and relaunch\n");
-                            printf("this app to restore files.\n\n");
-
-                            gfxFlushBuffers();
-                            gfxSwapBuffers();
-                            gspWaitForVBlank();
-
-                            svcSleepThread(2000000000LL); // Wait 2 seconds
-
-                            if (launchMoviePlayer()) {
-                                // App will exit here to launch Movie Player
-                                running = false;
-                            } else {
-                                printf("Failed to launch Movie Player!\n");
-                                printf("Restoring files...\n");
-                                moveFiles(ROOT_PATH, sourcePath);
-                                clearState();
-                                printf("\nPress START to exit\n");
-
-                                while (aptMainLoop()) {
-                                    hidScanInput();
-                                    if (hidKeysDown() & KEY_START) {
-                                        running = false;
-                                        break;
-                                    }
-                                    gfxFlushBuffers();
-                                    gfxSwapBuffers();
-                                    gspWaitForVBlank();
-                                }
-                            }
-                        } else {
-                            printf("ERROR: Failed to move files!\n");
-                            printf("\nPress B to go back\n");
-
-                            while (aptMainLoop()) {
-                                hidScanInput();
-                                if (hidKeysDown() & KEY_B) break;
-                                gfxFlushBuffers();
-                                gfxSwapBuffers();
-                                gspWaitForVBlank();
-                            }
-                            needsRedraw = true;
-                        }
-                    } else {
-                        needsRedraw = true;
-                    }
-                }
+        LaunchStatus target = launcherStatus(&launcher);
+        if (target != targetSeen) {
+            targetSeen = target;
+            ui.dirty |= ui.screen == SCREEN_CONFIRM || ui.screen == SCREEN_RECENTS;
+        }
+
+        if (ui.dirty) {
+            switch (ui.screen) {
+                case SCREEN_RECENTS:
+                    drawRecents();
+                    break;
+                case SCREEN_BROWSE:
+                    hudLinesDrawn(&hud, listViewDraw(&view, &dirList, &activeState));
+                    break;
+                case SCREEN_CONFIRM:
+                    drawConfirm();
+                    break;
+                case SCREEN_MOVING:
+                    drawMoveProgress();
+                    break;
+                case SCREEN_SEARCH:
+                    drawSearch();
+                    break;
+                case SCREEN_DUPES:
+                    drawDupes();
+                    break;
+                default:
+                    break; // messages are printed once, when shown
             }
+            ui.dirty = false;
+            ui.present = true;
         }
 
-        if (kDown & KEY_B) {
-            // Go back to parent directory
-            if (strcmp(dirList.currentPath, BASE_PATH) != 0) {
-                // Remove last directory component
-                char *lastSlash = strrchr(dirList.currentPath, '/');
-                if (lastSlash != NULL && lastSlash != dirList.currentPath) {
-                    // Find second to last slash
-                    *lastSlash = '\0';
-                    lastSlash = strrchr(dirList.currentPath, '/');
-                    if (lastSlash != NULL) {
-                        *(lastSlash + 1) = '\0';
-                    }
-                } else {
-                    strncpy(dirList.currentPath, BASE_PATH, MAX_PATH_LEN - 1);
-                }
+        updateCover();
+
+        // The keyboard has the bottom screen while searching
+        if (ui.screen != SCREEN_SEARCH && hudUpdate(&hud, &dirList, &scanner, &verifier)) {
+            ui.present = true;
+        }
 
-                freeDirectoryList(&dirList);
-                loadDirectory(&dirList, dirList.currentPath);
-                needsRedraw = true;
+        if (ui.present || UI_ALWAYS_PRESENT) {
+            gfxFlushBuffers();
+            gfxSwapBuffers();
+            hudFrameEnd(&hud, true);
+            if (phaseStart) {
+                startupPhase("startup.frame");
+                hudStartupDone(&hud, svcGetSystemTick() - startupAt);
+                phaseStart = 0;
             }
+            gspWaitForVBlank();
+            ui.present = false;
+        } else {
+            // Nothing changed: sleep until a worker has news or it is time
+            // to look at the pad again
+            hudFrameEnd(&hud, false);
+            LightEvent_WaitTimeout(&uiWake, UI_POLL_NS);
         }
+    }
 
-        if (needsRedraw) {
-            displayDirectory(&dirList);
-            needsRedraw = false;
+    // The app is being closed from outside with a move still running
+    if (ui.screen == SCREEN_MOVING) {
+        if (ui.cancellable) {
+            moveWorkerCancel(&ui.worker);
         }
+        bool moved = moveWorkerJoin(&ui.worker);
+        if (ui.freshCollection && !moved) {
+            stateFree(&activeState);
+        }
+        scannerPause(&scanner, false);
+        searchIndexerPause(&indexer, false);
+        verifierPause(&verifier, false);
+        dupesFinderPause(&dupeFinder, false);
+        coverPause(&covers, false);
+    }
+
+    // Housekeeping has to finish; a half-restored v1.0 collection has no
+    // manifest to finish it from
+    if (ui.tidy != TIDY_NONE) {
+        moveWorkerJoin(&tidyWorker);
+        stateFree(&tidyState);
+    }
 
+    // Put the collection back unless the Movie Player is about to use it
+    if (activeState.filesActive && !ui.launched) {
+        consoleClear();
+        printf("Clownsec Moflex Launcher\n");
+        printf("========================\n\n");
+        printf("Restoring files from root...\n");
+        printf("Source: %s\n\n", activeState.sourceDir);
         gfxFlushBuffers();
         gfxSwapBuffers();
-        gspWaitForVBlank();
+        moveWorkerStart(&ui.worker, MOVE_JOB_RESTORE, &activeState, NULL, NULL, ROOT_PATH, NULL);
+        moveWorkerJoin(&ui.worker);
     }
+    stateFree(&activeState);
 
     // Cleanup
+    scannerStop(&scanner);
+    jobPoolStop(&jobs);
+    verifierStop(&verifier);
+    searchIndexerStop(&indexer);
+    dupesFinderStop(&dupeFinder);
+    launcherStop(&launcher);
+    coverStop(&covers);
     freeDirectoryList(&dirList);
-    amExit();
+    if (library.dirty) {
+        TRACE_SPAN("library.save", library.nodeCount, librarySave(&library, FILES_LIST));
+    }
+
+    // A finished walk has saved already; keep what an unfinished one found,
+    // unless the Movie Player is waiting on us
+    if (search.dirty && !ui.launched) {
+        TRACE_SPAN("search.save", search.itemCount, searchSave(&search, SEARCH_FILE));
+    }
+    searchFree(&search);
+    if (dupes.dirty && !ui.launched) {
+        TRACE_SPAN("dupes.save", dupes.fileCount, dupesSave(&dupes, DUPES_FILE));
+    }
+    dupesFree(&dupes);
+    if (meta.dirty) {
+        TRACE_SPAN("meta.save", meta.entryCount, metaSave(&meta, META_FILE));
+    }
+    metaFree(&meta);
+    if (recents.dirty) {
+        TRACE_SPAN("recents.save", recents.count, recentsSave(&recents, RECENTS_FILE));
+    }
+    libraryFree(&library);
+    traceShutdown();
+    fsSessionClose();
     fsExit();
     gfxExit();
 
     return 0;
 }
 
-bool loadDirectory(DirectoryList *list, const char *path) {
-    // Allocate memory for entries
-    list->capacity = MAX_ENTRIES;
-    list->entries = (DirectoryEntry *)linearAlloc(sizeof(DirectoryEntry) * list->capacity);
-    if (!list->entries) {
-        return false;
+// Presents what has been printed, then sleeps on vblank until one of keys
+// is pressed. Returns false if the app is being closed instead.
+bool waitForKey(u32 keys) {
+    gfxFlushBuffers();
+    gfxSwapBuffers();
+
+    while (aptMainLoop()) {
+        hidScanInput();
+        if (hidKeysDown() & keys) {
+            return true;
+        }
+        gspWaitForVBlank();
     }
+    return false;
+}
 
-    list->count = 0;
-    list->selected = 0;
-    list->scrollOffset = 0;
-    strncpy(list->currentPath, path, MAX_PATH_LEN - 1);
+// START: puts the collection in root back first, if there is one
+void quitApp(void) {
+    if (activeState.filesActive) {
+        consoleClear();
+        printf("Clownsec Moflex Launcher\n");
+        printf("========================\n\n");
+        printf("Restoring files from root...\n");
+        printf("Source: %s\n\n", activeState.sourceDir);
+        startMove(MOVE_FOR_EXIT, MOVE_JOB_RESTORE, NULL, NULL, false);
+    } else {
+        ui.screen = SCREEN_QUIT;
+    }
+}
 
-    DIR *dir = opendir(path);
-    if (!dir) {
-        linearFree(list->entries);
-        list->entries = NULL;
-        return false;
+void handleBrowse(u32 kDown, u32 kHeld) {
+    if (kDown & KEY_START) {
+        quitApp();
+        return;
     }
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL && list->count < MAX_ENTRIES) {
-        // Skip . and ..
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+    // L+R+SELECT toggles tracing; turning it off writes the trace out.
+    // SELECT on its own shows or hides the HUD.
+    if ((kDown & KEY_SELECT) && (kHeld & (KEY_L | KEY_R)) == (KEY_L | KEY_R)) {
+        if (traceEnabled) {
+            traceStop();
+            traceDump(TRACE_FILE);
+        } else {
+            traceStart();
         }
+        listViewInvalidate(&view); // the footer says whether it is on
+        ui.dirty = true;
+    } else if (kDown & KEY_SELECT) {
+        hudToggle(&hud);
+        coverViewInvalidate(&coverView);
+        ui.present = true;
+    }
 
-        // Skip hidden files
-        if (entry->d_name[0] == '.') {
-            continue;
+    if (kDown & KEY_Y) {
+        showSearch();
+        return;
+    }
+    if (kDown & KEY_X) {
+        showDupes();
+        return;
+    }
+
+    int steps = dpadSteps(kDown, kHeld);
+    if (steps != 0) {
+        moveSelection(steps);
+    }
+
+    // L and R page, unless they're being held for the trace toggle
+    if (!(kHeld & KEY_SELECT)) {
+        if ((kDown & KEY_L) && !(kHeld & KEY_R)) {
+            pageSelection(-1);
+        }
+        if ((kDown & KEY_R) && !(kHeld & KEY_L)) {
+            pageSelection(1);
         }
+    }
 
-        struct stat st;
-        char fullPath[MAX_PATH_LEN];
-        snprintf(fullPath, MAX_PATH_LEN, "%s%s", path, entry->d_name);
+    if ((kDown & KEY_A) && dirList.count > 0) {
+        DirectoryEntry *entry = &dirList.entries[dirList.selected];
 
-        if (stat(fullPath, &st) == 0) {
-            // Only show directories, skip files
-            if (!S_ISDIR(st.st_mode)) {
-                continue;
+        if (entry->flags & ENTRY_DIRECTORY) {
+            char path[MAX_PATH_LEN];
+            snprintf(path, sizeof(path), "%s%s", dirList.currentPath, entryName(&dirList, entry));
+            openCollection(path);
+            entry->moflexCount = ui.selectedCount;
+            return;
+        }
+    }
+
+    if (kDown & KEY_B) {
+        // Go back to parent directory
+        if (strcmp(dirList.currentPath, BASE_PATH) != 0) {
+            // Remove last directory component
+            char *lastSlash = strrchr(dirList.currentPath, '/');
+            if (lastSlash != NULL && lastSlash != dirList.currentPath) {
+                // Find second to last slash
+                *lastSlash = '\0';
+                lastSlash = strrchr(dirList.currentPath, '/');
+                if (lastSlash != NULL) {
+                    *(lastSlash + 1) = '\0';
+                }
+            } else {
+                strncpy(dirList.currentPath, BASE_PATH, MAX_PATH_LEN - 1);
             }
 
-            DirectoryEntry *dirEntry = &list->entries[list->count];
-            strncpy(dirEntry->name, entry->d_name, 255);
-            dirEntry->name[255] = '\0';
-            dirEntry->isDirectory = true; // Always true now
-            dirEntry->moflexCount = -1; // Not scanned yet
+            loadDirectory(&dirList, dirList.currentPath);
+            requestVisibleCounts(&dirList);
+            ui.dirty = true;
+        } else if (recents.count > 0) {
+            // From the top, back to the hot list
+            showRecents();
+            return;
+        }
+    }
 
-            list->count++;
+    if (!ui.dirty && !dirList.validated) {
+        // The cached listing is already on screen, now check it; names may
+        // have changed under the same rows
+        if (revalidateDirectory(&dirList)) {
+            requestVisibleCounts(&dirList);
+            listViewInvalidate(&view);
+            ui.dirty = true;
         }
     }
+}
+
+// Counts and sums up a collection for the confirm screen
+void openCollection(const char *path) {
+    // Confirm the cached count against the card; this is a single
+    // directory pass and only rebuilds if it changed
+    snprintf(ui.selectedPath, MAX_PATH_LEN, "%s", path);
+    int node = libraryRefresh(&library, ui.selectedPath, NULL);
+    int inRoot = stateFilesFrom(&activeState, ui.selectedPath);
+    libraryLock(&library);
+    ui.selectedCount = (node >= 0) ? library.nodes[node].moflexCount : 0;
+    ui.homeFingerprint = (node >= 0) ? library.nodes[node].fingerprint : 0;
+    libraryUnlock(&library);
+    ui.homeKnown = node >= 0 && inRoot == 0;
+
+    // Files of the active collection are in root right now
+    ui.alreadyActive = activeState.filesActive &&
+                       strcmp(activeState.sourceDir, ui.selectedPath) == 0;
+    ui.selectedCount += inRoot;
+
+    // Headers are only read for files that are new or changed
+    memset(&ui.summary, 0, sizeof(ui.summary));
+    if (!metaLoaded) {
+        TRACE_SPAN("meta.load", 0, metaLoad(&meta, META_FILE));
+        metaLoaded = true;
+    }
+    if (ui.selectedCount > 0) {
+        TRACE_SPAN("meta.collect", ui.selectedCount,
+                   metaCollect(&meta, ui.selectedPath, &activeState, ROOT_PATH, &ui.summary));
+    }
 
-    closedir(dir);
+    // Too many for the player at once: offer the part in root, or the first
+    if (ui.summary.volumes > 1) {
+        int active = activeVolume();
+        selectVolume(active >= 0 ? active : 0);
+    }
 
-    // Sort: directories first, then alphabetically
-    for (int i = 0; i < list->count - 1; i++) {
-        for (int j = i + 1; j < list->count; j++) {
-            bool swap = false;
+    ui.screen = SCREEN_CONFIRM;
+    ui.dirty = true;
+}
 
-            if (list->entries[i].isDirectory && !list->entries[j].isDirectory) {
-                continue;
-            } else if (!list->entries[i].isDirectory && list->entries[j].isDirectory) {
-                swap = true;
-            } else if (strcasecmp(list->entries[i].name, list->entries[j].name) > 0) {
-                swap = true;
-            }
+void drawConfirm(void) {
+    const char *name = strrchr(ui.selectedPath, '/');
 
-            if (swap) {
-                DirectoryEntry temp = list->entries[i];
-                list->entries[i] = list->entries[j];
-                list->entries[j] = temp;
+    consoleClear();
+    printf("Clownsec Moflex Launcher\n");
+    printf("========================\n\n");
+    printf("Selected: %s\n", name ? name + 1 : ui.selectedPath);
+    printf("Moflex files: %d\n\n", ui.selectedCount);
+
+    if (ui.summary.volumes > 1) {
+        printf("Volume %d of %d: files %d-%d\n", ui.volume + 1, ui.summary.volumes,
+               ui.volumeInfo.first, ui.volumeInfo.first + ui.volumeInfo.files - 1);
+        printf("  %.44s\n", ui.volumeInfo.firstName);
+        printf("  to %.41s\n", ui.volumeInfo.lastName);
+        printf("Left/Right: Pick a volume\n\n");
+    }
+
+    if (ui.summary.files > 0) {
+        char text[24];
+        if (ui.summary.timed > 0) {
+            formatDuration(ui.summary.totalMs, text, sizeof(text));
+            if (ui.summary.timed < ui.summary.files) {
+                printf("Runtime: %s (%d unknown)\n", text, ui.summary.files - ui.summary.timed);
+            } else {
+                printf("Runtime: %s\n", text);
             }
         }
+        formatSize(ui.summary.largestSize, text, sizeof(text));
+        printf("Largest: %.30s (%s)\n", ui.summary.largest, text);
+        if (ui.summary.stereo > 0) {
+            printf("3D: %d of %d files\n", ui.summary.stereo, ui.summary.files);
+        }
+        if (ui.summary.known < ui.summary.files) {
+            printf("Not moflex: %d files\n", ui.summary.files - ui.summary.known);
+        }
+
+        u32 left = verifierPending(&verifier);
+        if (left > 0 && strcmp(ui.verifyPath, ui.selectedPath) == 0) {
+            u32 rate = verifierBytesPerSecond(&verifier) / 100000; // 0.1 MB/s
+            printf("Checking files: %lu left (%lu.%lu MB/s)\n", (unsigned long)left,
+                   (unsigned long)(rate / 10), (unsigned long)(rate % 10));
+        } else if (ui.summary.verified < ui.summary.files) {
+            printf("X: Check files (%d unchecked)\n", ui.summary.files - ui.summary.verified);
+        } else {
+            printf("All files checked\n");
+        }
+        printf("\n");
     }
 
-    return true;
+    if (ui.summary.bad > 0) {
+        printf("WARNING: %d damaged file%s, e.g.\n", ui.summary.bad, ui.summary.bad > 1 ? "s" : "");
+        printf("%.32s (%s)\n", ui.summary.firstBad, moflexVerdictText(ui.summary.firstBadVerdict));
+        printf("3D Movie Player may fail on %s.\n\n", ui.summary.bad > 1 ? "them" : "it");
+    }
+
+    if (ui.selectedCount > MOFLEX_LIMIT && ui.summary.volumes <= 1) {
+        printf("WARNING: More than %d files!\n", MOFLEX_LIMIT);
+        printf("3D Movie Player may crash.\n\n");
+    }
+
+    if (ui.selectedCount == 0) {
+        printf("No moflex files found!\n");
+        printf("\nPress B to go back\n");
+    } else {
+        LaunchStatus target = launcherStatus(&launcher);
+        if (ui.tidy != TIDY_NONE) {
+            printf("Tidying the SD root, please wait...\n");
+        } else if (target == LAUNCH_RESOLVING) {
+            printf("Looking for 3D Movie Player...\n");
+        } else if (target != LAUNCH_READY) {
+            printf("3D Movie Player not found%s.\n", target == LAUNCH_NO_AM ? " (AM failed)" : "");
+            printf("Nothing can be moved.\n");
+        } else if (ui.alreadyActive) {
+            printf("Already in the SD root.\n");
+            printf("Press A to launch\n");
+        } else if (ui.summary.volumes > 1) {
+            printf("Press A to move volume %d and launch\n", ui.volume + 1);
+        } else if (activeState.filesActive) {
+            printf("Press A to swap collections and launch\n");
+        } else {
+            printf("Press A to move files and launch\n");
+        }
+        printf("Press B to cancel\n");
+    }
 }
 
-void freeDirectoryList(DirectoryList *list) {
-    if (list->entries) {
-        linearFree(list->entries);
-        list->entries = NULL;
+void handleConfirm(u32 kDown) {
+    if (kDown & KEY_B) {
+        showBrowser();
+        return;
+    }
+    if ((kDown & KEY_X) && ui.summary.verified < ui.summary.files) {
+        // Whole files are read in the background; the dialog stays usable
+        strncpy(ui.verifyPath, ui.selectedPath, MAX_PATH_LEN - 1);
+        verifierRequest(&verifier, ui.selectedPath, &activeState, ROOT_PATH);
+        ui.dirty = true;
+        return;
     }
-    list->count = 0;
-    list->capacity = 0;
+    if ((kDown & (KEY_LEFT | KEY_RIGHT)) && ui.summary.volumes > 1) {
+        int step = (kDown & KEY_RIGHT) ? 1 : ui.summary.volumes - 1;
+        selectVolume((ui.volume + step) % ui.summary.volumes);
+        ui.dirty = true;
+        return;
+    }
+    // Nothing moves unless there is a player to launch afterwards
+    if (!(kDown & KEY_A) || ui.selectedCount == 0 || ui.tidy != TIDY_NONE ||
+        launcherStatus(&launcher) != LAUNCH_READY) {
+        return;
+    }
+    launchSelected();
 }
 
-void displayDirectory(const DirectoryList *list) {
+// Moves or swaps the selected collection into root, or just launches if it
+// is there already
+void launchSelected(void) {
+    // Only the picked volume moves; the worker matches names against it
+    const MoveSelection *only = NULL;
+    if (ui.summary.volumes > 1 && !ui.alreadyActive) {
+        metaVolume(&meta, ui.selectedPath, ui.volume, &ui.volumeInfo, volumeNames, sizeof(volumeNames));
+        const char *name = volumeNames;
+        for (int i = 0; i < ui.volumeInfo.files; i++) {
+            volumeList[i] = name;
+            name += strlen(name) + 1;
+        }
+        volumeSelection.names = volumeList;
+        volumeSelection.count = ui.volumeInfo.files;
+        moveSelectionSort(&volumeSelection);
+        only = &volumeSelection;
+    }
+
     consoleClear();
     printf("Clownsec Moflex Launcher\n");
     printf("========================\n\n");
-    printf("Current: %s\n\n", list->currentPath);
 
-    if (list->count == 0) {
-        printf("(Empty directory)\n\n");
+    if (ui.alreadyActive) {
+        memset(&ui.worker.stats, 0, sizeof(MoveStats));
+        ui.purpose = MOVE_FOR_LAUNCH;
+        ui.freshCollection = false;
+        ui.worker.result = true;
+        finishMove();
+    } else if (activeState.filesActive) {
+        printf("Swapping collections in root...\n");
+        printf("From: %s\n", activeState.sourceDir);
+        printf("To:   %s\n", ui.selectedPath);
+        if (only) {
+            printf("Volume %d of %d\n", ui.volume + 1, ui.summary.volumes);
+        }
+        printf("\n");
+        startMove(MOVE_FOR_LAUNCH, MOVE_JOB_SWAP, ui.selectedPath, only, true);
     } else {
-        int visibleLines = 25;
-        int endIdx = list->scrollOffset + visibleLines;
-        if (endIdx > list->count) {
-            endIdx = list->count;
+        printf("Moving files to root...\n");
+        printf("From: %s\n", ui.selectedPath);
+        if (only) {
+            printf("Volume %d of %d\n", ui.volume + 1, ui.summary.volumes);
         }
+        printf("\n");
 
-        for (int i = list->scrollOffset; i < endIdx; i++) {
-            const DirectoryEntry *entry = &list->entries[i];
+        // Every file that makes it to root goes in the manifest
+        stateInit(&activeState);
+        strncpy(activeState.sourceDir, ui.selectedPath, MAX_PATH_LEN - 1);
+        startMove(MOVE_FOR_LAUNCH, MOVE_JOB_COLLECTION, ui.selectedPath, only, true);
+        ui.freshCollection = true;
+    }
+}
 
-            if (i == list->selected) {
-                printf("> ");
-            } else {
-                printf("  ");
-            }
+// Picks one volume of the selected collection for the confirm screen
+void selectVolume(int volume) {
+    ui.volume = volume;
+    metaVolume(&meta, ui.selectedPath, volume, &ui.volumeInfo, NULL, 0);
+    ui.alreadyActive = activeVolume() == volume &&
+                       stateFilesFrom(&activeState, ui.selectedPath) == ui.volumeInfo.files;
+}
 
-            if (entry->isDirectory) {
-                printf("[DIR] %s\n", entry->name);
-            } else {
-                printf("      %s\n", entry->name);
-            }
+// Volume of the selected collection that is in root right now, or -1
+int activeVolume(void) {
+    if (!activeState.filesActive || strcmp(activeState.sourceDir, ui.selectedPath) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < activeState.fileCount; i++) {
+        if (strcmp(stateFileOrigin(&activeState, i), ui.selectedPath) == 0) {
+            return metaVolumeOf(&meta, ui.selectedPath, stateFileName(&activeState, i));
         }
+    }
+    return -1;
+}
+
+// Hands the renames to a worker and switches to the progress screen, which
+// is drawn below whatever has been printed so far
+void startMove(MovePurpose purpose, MoveJobKind kind, const char *sourcePath, const MoveSelection *only,
+               bool cancellable) {
+    ui.purpose = purpose;
+    ui.cancellable = cancellable;
+    ui.freshCollection = false;
+    ui.failureCount = 0;
+    memset(&ui.progress, 0, sizeof(ui.progress));
+
+    // Leave the card to the renames until they're done
+    scannerPause(&scanner, true);
+    searchIndexerPause(&indexer, true);
+    verifierPause(&verifier, true);
+    dupesFinderPause(&dupeFinder, true);
+    coverPause(&covers, true);
+
+    printf("\x1b[s"); // progress is redrawn from here
+    moveWorkerStart(&ui.worker, kind, &activeState, sourcePath, only, ROOT_PATH, &uiWake);
+    ui.screen = SCREEN_MOVING;
+    ui.dirty = true;
+}
+
+void handleMoving(u32 kDown) {
+    // Check before draining so the final events are always shown
+    bool finished = moveWorkerFinished(&ui.worker);
 
-        if (list->count > visibleLines) {
-            printf("\n(%d-%d of %d)\n",
-                   list->scrollOffset + 1,
-                   endIdx,
-                   list->count);
+    MoveEvent event;
+    while (moveMonitorPop(&ui.worker.monitor, &event)) {
+        if (event.type == MOVE_EVENT_FAILED) {
+            memcpy(ui.failures[ui.failureCount % MOVE_FAILURES_SHOWN], event.name, sizeof(event.name));
+            ui.failureCount++;
+        } else {
+            ui.progress = event;
+            hudMoveProgress(&hud, event.filesPerSecond, event.done, event.total);
         }
+        ui.dirty = true;
     }
 
-    printf("\nA: Select  B: Back  START: Exit\n");
+    if (!finished) {
+        if (ui.cancellable && !ui.worker.monitor.cancel && (kDown & KEY_B)) {
+            moveWorkerCancel(&ui.worker);
+            ui.dirty = true;
+        }
+        return;
+    }
+
+    drawMoveProgress();
+    moveWorkerJoin(&ui.worker);
+    hudMoveProgress(&hud, moveFilesPerSecond(&ui.worker.stats), ui.worker.stats.moved, ui.progress.total);
+    scannerPause(&scanner, false);
+
+    // The collection in root, if any, changed with the move
+    searchIndexerHold(&indexer, activeState.filesActive ? activeState.sourceDir : NULL);
+    searchIndexerPause(&indexer, false);
+    verifierPause(&verifier, false);
+    dupesFinderHold(&dupeFinder, activeState.filesActive ? activeState.sourceDir : NULL);
+    dupesFinderPause(&dupeFinder, false);
+    coverPause(&covers, false);
+    printf("\n");
+    finishMove();
 }
 
-int countMoflexFiles(const char *path) {
-    int count = 0;
+void drawMoveProgress(void) {
+    char bar[21];
+    int filled = ui.progress.total ? ui.progress.done * 20 / ui.progress.total : 0;
+    for (int i = 0; i < 20; i++) {
+        bar[i] = i < filled ? '#' : '-';
+    }
+    bar[20] = '\0';
+
+    printf("\x1b[u");
+    printf("[%s] %d/%d    \n", bar, ui.progress.done, ui.progress.total);
+    printf("%lu files/s  ETA %lu.%lus      \n", (unsigned long)ui.progress.filesPerSecond,
+           (unsigned long)(ui.progress.etaMs / 1000), (unsigned long)(ui.progress.etaMs % 1000 / 100));
+    printf("> %-36.36s\n", ui.progress.name);
+    if (ui.worker.monitor.cancel) {
+        printf("Cancelling, putting files back...\n");
+    } else {
+        printf(ui.cancellable ? "Press B to cancel                \n" : "\n");
+    }
+    for (int i = 0; i < ui.failureCount && i < MOVE_FAILURES_SHOWN; i++) {
+        printf("Failed: %.40s\n", ui.failures[i]);
+    }
+}
 
-    DIR *dir = opendir(path);
-    if (!dir) {
-        return 0;
+// Acts on the result of the move that just finished (or on a collection
+// that was already in root): launch, report, or quit
+void finishMove(void) {
+    bool moved = ui.worker.result;
+    ui.present = true;
+
+    if (ui.purpose == MOVE_FOR_EXIT) {
+        // Whatever could not be moved back stays in the state file
+        stateFree(&activeState);
+        ui.screen = SCREEN_QUIT;
+        return;
     }
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') {
-            continue;
+    if (ui.purpose == MOVE_FOR_RECOVER) {
+        if (moved) {
+            stateFree(&activeState);
         }
+        printf("\nPress START to exit\n");
+        showMessage(KEY_START, SCREEN_QUIT);
+        return;
+    }
 
-        if (isMoflexFile(entry->d_name)) {
-            count++;
+    if (!moved) {
+        if (ui.freshCollection) {
+            stateFree(&activeState);
+        }
+        if (ui.worker.monitor.cancel) {
+            // Same rollback as a failure, just asked for
+            printf("Cancelled, files were put back.\n");
+        } else if (ui.worker.stats.empty) {
+            printf("Nothing to move, no moflex files found.\n");
+        } else {
+            // Anything that did move has already been put back,
+            // and a failed swap leaves the old collection in root
+            printf("ERROR: Failed to move files!\n");
         }
+        printf("\nPress B to go back\n");
+        showMessage(KEY_B, SCREEN_BROWSE);
+        return;
     }
 
-    closedir(dir);
-    return count;
-}
+    if (!ui.alreadyActive) {
+        printf("Files moved successfully!\n");
+        printMoveStats(&ui.worker.stats);
+        printf("\n");
+    }
 
-bool isMoflexFile(const char *filename) {
-    size_t len = strlen(filename);
-    if (len < 8) { // ".moflex" is 7 characters
-        return false;
+    // Record the emptied folder, then stop the scanner:
+    // node indices change on save, so the listing is
+    // done with the index now
+    int node = libraryRefresh(&library, ui.selectedPath, NULL);
+    if (node >= 0) {
+        // Its fingerprint with the files out is what a relaunch from the
+        // hot list checks while they are still in root
+        libraryLock(&library);
+        u32 movedFingerprint = library.nodes[node].fingerprint;
+        libraryUnlock(&library);
+        recentsRecord(&recents, ui.selectedPath, ui.selectedCount, ui.summary.volumes > 1 ? ui.volume : -1,
+                      ui.homeKnown ? &ui.homeFingerprint : NULL, movedFingerprint);
+        TRACE_SPAN("recents.save", recents.count, recentsSave(&recents, RECENTS_FILE));
+    }
+    scannerStop(&scanner);
+    jobPoolStop(&jobs);
+    verifierStop(&verifier);
+    dupesFinderStop(&dupeFinder);
+    coverStop(&covers);
+    if (library.dirty) {
+        TRACE_SPAN("library.save", library.nodeCount, librarySave(&library, FILES_LIST));
+    }
+    if (meta.dirty) {
+        TRACE_SPAN("meta.save", meta.entryCount, metaSave(&meta, META_FILE));
     }
 
-    const char *ext = filename + len - 7;
-    return (strcasecmp(ext, ".moflex") == 0);
-}
+    printf("Launching 3D Movie Player...\n");
+    printf("When done, exit and relaunch\n");
+    printf("this app to restore files.\n\n");
 
-void cleanupOldMoflexFiles() {
-    // Check if state file exists - if it does, we don't need to cleanup
-    AppState state = {0};
-    if (loadState(&state)) {
-        return; // State exists, don't cleanup
+    gfxFlushBuffers();
+    gfxSwapBuffers();
+    gspWaitForVBlank();
+
+    bool jumped;
+    TRACE_SPAN("launcher.jump", 0, jumped = launcherJump(&launcher));
+    if (jumped) {
+        // App will exit here to launch Movie Player
+        ui.launched = true;
+        ui.screen = SCREEN_QUIT;
+    } else {
+        printf("Failed to launch Movie Player!\n");
+        printf("Restoring files...\n");
+        startMove(MOVE_FOR_RECOVER, MOVE_JOB_RESTORE, NULL, NULL, false);
     }
+}
 
-    // Check if there are any moflex files in root
-    DIR *dir = opendir(ROOT_PATH);
-    if (!dir) return;
+// Leaves what has been printed on screen until one of dismissKeys
+void showMessage(u32 dismissKeys, Screen next) {
+    ui.screen = SCREEN_MESSAGE;
+    ui.dismissKeys = dismissKeys;
+    ui.next = next;
+    ui.present = true;
+}
 
-    bool foundMoflex = false;
-    struct dirent *entry;
+// Back to the listing from a dialog, which has overwritten all of it
+void showBrowser(void) {
+    ui.screen = SCREEN_BROWSE;
+    listViewInvalidate(&view);
+    ui.dirty = true;
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') continue;
-        if (isMoflexFile(entry->d_name)) {
-            foundMoflex = true;
-            break;
+// Swaps the listing for the search screen and the HUD for the keyboard.
+// The last query and its results are still there.
+void showSearch(void) {
+    ui.screen = SCREEN_SEARCH;
+    consoleClear();
+    touchKeysShow(&touchKeys);
+    runSearch();
+}
+
+// Back to the listing, and to the HUD if it was up
+void leaveSearch(void) {
+    touchKeysHide(&touchKeys);
+    hudInvalidate(&hud);
+    coverViewInvalidate(&coverView);
+    showBrowser();
+}
+
+void handleSearch(u32 kDown, u32 kHeld) {
+    if (kDown & (KEY_Y | KEY_START)) {
+        leaveSearch();
+        return;
+    }
+
+    size_t length = strlen(ui.query);
+    bool changed = false;
+
+    if (kDown & KEY_TOUCH) {
+        touchPosition touch;
+        hidTouchRead(&touch);
+        int key = touchKeysHit(&touch);
+        if (key == TOUCHKEY_DELETE || key == TOUCHKEY_CLEAR) {
+            if (length > 0) {
+                length = key == TOUCHKEY_CLEAR ? 0 : length - 1;
+                ui.query[length] = '\0';
+                changed = true;
+            }
+        } else if (key != 0 && !(key == ' ' && length == 0) && length < SEARCH_QUERY_LEN - 1) {
+            ui.query[length++] = (char)key;
+            ui.query[length] = '\0';
+            changed = true;
         }
     }
-    closedir(dir);
 
-    if (!foundMoflex) {
-        return; // No moflex files in root, nothing to cleanup
+    if (kDown & KEY_B) {
+        if (length == 0) {
+            leaveSearch();
+            return;
+        }
+        ui.query[length - 1] = '\0';
+        changed = true;
     }
 
-    // Found old moflex files, move them to OLDMOFLEX
-    consoleClear();
-    printf("Clownsec Moflex Launcher\n");
-    printf("========================\n\n");
-    printf("Found existing moflex files in root!\n");
-    printf("Moving them to /MOFLEX/OLDMOFLEX/...\n\n");
+    if (kDown & KEY_X) {
+        // The system keyboard takes over both screens until it returns
+        SwkbdState keyboard;
+        char text[SEARCH_QUERY_LEN];
+        swkbdInit(&keyboard, SWKBD_TYPE_NORMAL, 2, SEARCH_QUERY_LEN - 1);
+        swkbdSetInitialText(&keyboard, ui.query);
+        swkbdSetHintText(&keyboard, "Movie or folder name");
+        if (swkbdInputText(&keyboard, text, sizeof(text)) == SWKBD_BUTTON_CONFIRM) {
+            memcpy(ui.query, text, sizeof(ui.query));
+            changed = true;
+        }
+        consoleClear();
+        touchKeysShow(&touchKeys);
+        ui.dirty = true;
+    }
 
-    // Create OLDMOFLEX folder
-    mkdir("sdmc:/MOFLEX/OLDMOFLEX", 0777);
+    if (changed) {
+        ui.resultSelected = 0;
+        runSearch();
+    }
 
-    // Move files
-    if (moveFiles(ROOT_PATH, "sdmc:/MOFLEX/OLDMOFLEX")) {
-        printf("Files moved successfully!\n");
-    } else {
-        printf("Warning: Some files may not have moved.\n");
+    int steps = dpadSteps(kDown, kHeld);
+    if (steps != 0 && ui.resultCount > 0) {
+        int target = ui.resultSelected + steps;
+        if (target > ui.resultCount - 1) {
+            target = ui.resultCount - 1;
+        }
+        if (target < 0) {
+            target = 0;
+        }
+        if (target != ui.resultSelected) {
+            ui.resultSelected = target;
+            ui.dirty = true;
+        }
     }
 
-    printf("\nPress START to continue\n");
-    gfxFlushBuffers();
-    gfxSwapBuffers();
+    if ((kDown & KEY_A) && ui.resultCount > 0) {
+        openSearchResult(&ui.results[ui.resultSelected]);
+        return;
+    }
 
-    while (aptMainLoop()) {
-        hidScanInput();
-        if (hidKeysDown() & KEY_START) break;
-        gfxFlushBuffers();
-        gfxSwapBuffers();
-        gspWaitForVBlank();
+    // Pick up what the indexer has added since, a couple of times a second
+    if (searchIndexerFolders(&indexer) != ui.queryFolders &&
+        svcGetSystemTick() - ui.queryAt >= (u64)(SEARCH_REFRESH_MS * CPU_TICKS_PER_MSEC)) {
+        runSearch();
     }
 }
 
-bool moveFiles(const char *sourceDir, const char *destDir) {
-    DIR *dir = opendir(sourceDir);
-    if (!dir) {
-        return false;
+void runSearch(void) {
+    u64 start = svcGetSystemTick();
+    ui.queryFolders = searchIndexerFolders(&indexer);
+    ui.resultCount = 0;
+    if (ui.query[0] != '\0') {
+        TRACE_SPAN("search.query", strlen(ui.query),
+                   ui.resultCount = searchQuery(&search, ui.query, ui.results, SEARCH_RESULTS_SHOWN));
     }
+    ui.queryAt = svcGetSystemTick();
+    ui.queryTicks = ui.queryAt - start;
 
-    bool success = true;
-    struct dirent *entry;
+    if (ui.resultSelected >= ui.resultCount) {
+        ui.resultSelected = ui.resultCount > 0 ? ui.resultCount - 1 : 0;
+    }
+    ui.dirty = true;
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.') {
-            continue;
-        }
+// Every row is rewritten in place; there are never more than a screenful
+void drawSearch(void) {
+    listViewLine(1, "Clownsec Moflex Launcher");
+    listViewLine(2, "========================");
+    listViewLine(4, "Search: %s_", ui.query);
+
+    char progress[32] = "";
+    if (!indexer.done) {
+        snprintf(progress, sizeof(progress), "  (indexing, %lu folders)",
+                 (unsigned long)searchIndexerFolders(&indexer));
+    }
+    if (ui.query[0] == '\0') {
+        listViewLine(5, "%d names%s", searchItemCount(&search), progress);
+    } else {
+        listViewLine(5, "%d%s results in %lu us%s", ui.resultCount,
+                     ui.resultCount == SEARCH_RESULTS_SHOWN ? "+" : "",
+                     (unsigned long)(ui.queryTicks * 1000 / CPU_TICKS_PER_MSEC), progress);
+    }
 
-        if (!isMoflexFile(entry->d_name)) {
+    for (int i = 0; i < SEARCH_RESULTS_SHOWN; i++) {
+        if (i >= ui.resultCount) {
+            listViewLine(LIST_FIRST_ROW + i, "%s", "");
             continue;
         }
+        const SearchResult *result = &ui.results[i];
+        listViewLine(LIST_FIRST_ROW + i, "%s%s%s  (%s)", i == ui.resultSelected ? "> " : "  ",
+                     result->isFolder ? "[DIR] " : "", result->name,
+                     result->folder[0] ? result->folder : "MOFLEX");
+    }
 
-        char sourcePath[MAX_PATH_LEN];
-        char destPath[MAX_PATH_LEN];
+    int footer = LIST_FIRST_ROW + VISIBLE_LINES + 2;
+    listViewLine(footer, "A: Open  B: Delete  X: Keyboard  Y: Back");
+    listViewLine(footer + 1, "Touch the bottom screen to type");
+}
+
+// Shows a result in the browser: a folder inside its parent, a movie as its
+// collection, which is what A launches
+void openSearchResult(const SearchResult *result) {
+    char path[MAX_PATH_LEN];
+    char name[SEARCH_NAME_LEN];
+    const char *folder = result->folder;
 
-        // Add slash only if sourceDir doesn't end with one
-        size_t sourceLen = strlen(sourceDir);
-        if (sourceLen > 0 && sourceDir[sourceLen - 1] == '/') {
-            snprintf(sourcePath, MAX_PATH_LEN, "%s%s", sourceDir, entry->d_name);
+    if (result->isFolder) {
+        snprintf(path, sizeof(path), "%s%s%s", BASE_PATH, folder, folder[0] ? "/" : "");
+        snprintf(name, sizeof(name), "%s", result->name);
+    } else {
+        const char *slash = strrchr(folder, '/');
+        if (slash != NULL) {
+            snprintf(path, sizeof(path), "%s%.*s/", BASE_PATH, (int)(slash - folder), folder);
         } else {
-            snprintf(sourcePath, MAX_PATH_LEN, "%s/%s", sourceDir, entry->d_name);
+            snprintf(path, sizeof(path), "%s", BASE_PATH);
         }
+        snprintf(name, sizeof(name), "%s", slash ? slash + 1 : folder);
+    }
 
-        // Add slash only if destDir doesn't end with one
-        size_t destLen = strlen(destDir);
-        if (destLen > 0 && destDir[destLen - 1] == '/') {
-            snprintf(destPath, MAX_PATH_LEN, "%s%s", destDir, entry->d_name);
-        } else {
-            snprintf(destPath, MAX_PATH_LEN, "%s/%s", destDir, entry->d_name);
+    // The index can be behind the card; fall back to the top
+    if (!loadDirectory(&dirList, path)) {
+        loadDirectory(&dirList, BASE_PATH);
+    }
+    selectEntry(&dirList, name);
+    requestVisibleCounts(&dirList);
+    leaveSearch();
+}
+
+// The hot list, over whatever was on the top screen
+void showRecents(void) {
+    ui.screen = SCREEN_RECENTS;
+    if (ui.recentSelected >= recents.count) {
+        ui.recentSelected = recents.count > 0 ? recents.count - 1 : 0;
+    }
+    consoleClear();
+    ui.dirty = true;
+}
+
+void handleRecents(u32 kDown, u32 kHeld) {
+    if (kDown & KEY_START) {
+        quitApp();
+        return;
+    }
+    if ((kDown & KEY_B) || recents.count == 0) {
+        showBrowser();
+        return;
+    }
+    if (kDown & KEY_SELECT) {
+        hudToggle(&hud);
+        coverViewInvalidate(&coverView);
+        ui.present = true;
+    }
+
+    int steps = dpadSteps(kDown, kHeld);
+    if (steps != 0) {
+        int target = ui.recentSelected + steps;
+        if (target > recents.count - 1) {
+            target = recents.count - 1;
+        }
+        if (target < 0) {
+            target = 0;
+        }
+        if (target != ui.recentSelected) {
+            ui.recentSelected = target;
+            ui.dirty = true;
         }
+    }
 
-        if (rename(sourcePath, destPath) != 0) {
-            printf("Failed to move: %s\n", entry->d_name);
-            success = false;
-        } else {
-            // Force filesystem sync after each file on real hardware
-            FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_EMPTY, 0, (u8*)""}};
-            FSUSER_ControlArchive(sdmcArchive, ARCHIVE_ACTION_COMMIT_SAVE_DATA, NULL, 0, NULL, 0);
-            svcSleepThread(50000000LL); // 50ms delay for hardware
+    if (kDown & KEY_X) {
+        // The cursor follows the entry into its group
+        ui.recentSelected = recentsToggleFavorite(&recents, ui.recentSelected);
+        ui.dirty = true;
+    } else if (kDown & KEY_Y) {
+        recentsRemove(&recents, ui.recentSelected);
+        if (ui.recentSelected >= recents.count && ui.recentSelected > 0) {
+            ui.recentSelected--;
         }
+        ui.dirty = true;
+    } else if (kDown & KEY_A) {
+        relaunchRecent(ui.recentSelected);
     }
+}
 
-    closedir(dir);
+// Every row is rewritten in place; the list is never longer than a screenful
+void drawRecents(void) {
+    listViewLine(1, "Clownsec Moflex Launcher");
+    listViewLine(2, "========================");
+    listViewLine(4, "Recent collections");
+
+    LaunchStatus target = launcherStatus(&launcher);
+    if (ui.tidy != TIDY_NONE) {
+        listViewLine(5, "Tidying the SD root, please wait...");
+    } else if (target == LAUNCH_RESOLVING) {
+        listViewLine(5, "Looking for 3D Movie Player...");
+    } else if (target != LAUNCH_READY) {
+        listViewLine(5, "3D Movie Player not found%s", target == LAUNCH_NO_AM ? " (AM failed)" : "");
+    } else {
+        listViewLine(5, "%s", "");
+    }
 
-    // Final sync to ensure all operations are committed
-    FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_EMPTY, 0, (u8*)""}};
-    FSUSER_ControlArchive(sdmcArchive, ARCHIVE_ACTION_COMMIT_SAVE_DATA, NULL, 0, NULL, 0);
-    svcSleepThread(100000000LL); // 100ms final delay
+    size_t base = strlen(BASE_PATH);
+    for (int i = 0; i < RECENTS_MAX; i++) {
+        if (i >= recents.count) {
+            listViewLine(LIST_FIRST_ROW + i, "%s", "");
+            continue;
+        }
+        const RecentEntry *entry = &recents.entries[i];
+        const char *name = strncmp(entry->path, BASE_PATH, base) == 0 ? entry->path + base : entry->path;
+        bool inRoot = activeState.filesActive && strcmp(activeState.sourceDir, entry->path) == 0;
+        char volume[16] = "";
+        if (entry->volume >= 0) {
+            snprintf(volume, sizeof(volume), ", vol %ld", (long)entry->volume + 1);
+        }
+        listViewLine(LIST_FIRST_ROW + i, "%s%s%s  (%ld%s%s)", i == ui.recentSelected ? "> " : "  ",
+                     (entry->flags & RECENT_FAVORITE) ? "* " : "", name, (long)entry->moflexCount, volume,
+                     inRoot ? ", in root" : "");
+    }
 
-    return success;
+    int footer = LIST_FIRST_ROW + VISIBLE_LINES + 2;
+    listViewLine(footer, "A: Launch  X: Favorite  Y: Remove  B: Browse");
+    listViewLine(footer + 1, "START: Exit  SELECT: HUD");
 }
 
-void saveState(const AppState *state) {
-    FILE *f = fopen(STATE_FILE, "wb");
-    if (f) {
-        fwrite(state, sizeof(AppState), 1, f);
-        fflush(f);
-        fclose(f);
+// One directory pass instead of the browse and count: if the folder is as
+// it was at the last launch, the saved count stands and the move starts
+// right away. Otherwise it is opened like one picked in the browser.
+void relaunchRecent(int i) {
+    // Nothing moves unless there is a player to launch afterwards
+    if (ui.tidy != TIDY_NONE || launcherStatus(&launcher) != LAUNCH_READY) {
+        return;
+    }
+
+    const RecentEntry *entry = &recents.entries[i];
+    bool inRoot = activeState.filesActive && strcmp(activeState.sourceDir, entry->path) == 0;
 
-        // Force filesystem sync to ensure state is written on real hardware
-        FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_EMPTY, 0, (u8*)""}};
-        FSUSER_ControlArchive(sdmcArchive, ARCHIVE_ACTION_COMMIT_SAVE_DATA, NULL, 0, NULL, 0);
-        svcSleepThread(100000000LL); // 100ms delay
+    // A volume is picked again on the confirm screen, starting from the last
+    if (entry->volume >= 0 || entry->moflexCount <= 0 || !recentsCheck(entry, inRoot)) {
+        int volume = entry->volume;
+        openCollection(entry->path);
+        if (volume >= 0 && volume < ui.summary.volumes && activeVolume() < 0) {
+            selectVolume(volume);
+        }
+        return;
     }
+
+    snprintf(ui.selectedPath, MAX_PATH_LEN, "%s", entry->path);
+    ui.selectedCount = entry->moflexCount;
+    ui.alreadyActive = inRoot;
+    ui.homeFingerprint = entry->homeFingerprint;
+    ui.homeKnown = !inRoot;
+    memset(&ui.summary, 0, sizeof(ui.summary));
+    launchSelected();
 }
 
-bool loadState(AppState *state) {
-    FILE *f = fopen(STATE_FILE, "rb");
-    if (!f) {
-        return false;
+// Opens the duplicate report with what the last pass found and starts a new
+// pass, which only reads files that are new or changed since
+void showDupes(void) {
+    if (!dupeFinder.thread) {
+        TRACE_SPAN("dupes.load", 0, dupesLoad(&dupes, DUPES_FILE));
+        dupesFinderStart(&dupeFinder, &dupes, DUPES_FILE, ROOT_PATH, &uiWake);
+        dupesFinderHold(&dupeFinder, activeState.filesActive ? activeState.sourceDir : NULL);
     }
+    dupesFinderRun(&dupeFinder);
 
-    size_t read = fread(state, sizeof(AppState), 1, f);
-    fclose(f);
+    ui.screen = SCREEN_DUPES;
+    ui.dupesScroll = 0;
+    consoleClear();
+    ui.dirty = true;
+}
+
+void handleDupes(u32 kDown, u32 kHeld) {
+    if (kDown & (KEY_B | KEY_X | KEY_START)) {
+        showBrowser();
+        return;
+    }
 
-    return (read == 1);
+    int steps = dpadSteps(kDown, kHeld);
+    if (kDown & KEY_L) {
+        steps -= VISIBLE_LINES;
+    }
+    if (kDown & KEY_R) {
+        steps += VISIBLE_LINES;
+    }
+    if (steps != 0) {
+        int target = ui.dupesScroll + steps;
+        if (target > ui.dupesLines - VISIBLE_LINES) {
+            target = ui.dupesLines - VISIBLE_LINES;
+        }
+        if (target < 0) {
+            target = 0;
+        }
+        if (target != ui.dupesScroll) {
+            ui.dupesScroll = target;
+            ui.dirty = true;
+        }
+    }
+
+    // Follow the pass a couple of times a second, and right away when it
+    // moves on to the next step
+    DupePhase phase = dupesFinderPhase(&dupeFinder);
+    bool running = phase != DUPES_IDLE && phase != DUPES_DONE;
+    if (phase != ui.dupesPhase ||
+        (running && svcGetSystemTick() - ui.dupesAt >= (u64)(SEARCH_REFRESH_MS * CPU_TICKS_PER_MSEC))) {
+        ui.dirty = true;
+    }
 }
 
-void clearState(void) {
-    remove(STATE_FILE);
+// The report as lines: a heading per group, then its files
+void drawDupes(void) {
+    ui.dupesAt = svcGetSystemTick();
+    ui.dupesPhase = dupesFinderPhase(&dupeFinder);
+    listViewLine(1, "Clownsec Moflex Launcher");
+    listViewLine(2, "========================");
 
-    // Force filesystem sync after removing state file
-    FS_Archive sdmcArchive = {ARCHIVE_SDMC, {PATH_EMPTY, 0, (u8*)""}};
-    FSUSER_ControlArchive(sdmcArchive, ARCHIVE_ACTION_COMMIT_SAVE_DATA, NULL, 0, NULL, 0);
-    svcSleepThread(100000000LL); // 100ms delay
+    switch (ui.dupesPhase) {
+        case DUPES_LISTING:
+            listViewLine(4, "Listing folders... %lu", (unsigned long)dupeFinder.folders);
+            break;
+        case DUPES_SAMPLING:
+            listViewLine(4, "Comparing same-size files... %lu of %lu",
+                         (unsigned long)dupeFinder.sampled, (unsigned long)dupes.candidateCount);
+            break;
+        case DUPES_HASHING:
+            listViewLine(4, "Reading likely copies... %lu of %lu",
+                         (unsigned long)dupeFinder.hashed, (unsigned long)dupeFinder.toHash);
+            break;
+        case DUPES_DONE: {
+            u32 ms = (u32)(dupeFinder.passTicks / CPU_TICKS_PER_MSEC);
+            listViewLine(4, "%lu files checked in %lu.%lu s", (unsigned long)dupeFinder.files,
+                         (unsigned long)(ms / 1000), (unsigned long)(ms % 1000 / 100));
+            break;
+        }
+        default:
+            listViewLine(4, "Starting...");
+            break;
+    }
+
+    char wasted[24];
+    int line = 0;
+    int row = LIST_FIRST_ROW;
+    int end = ui.dupesScroll + VISIBLE_LINES;
+    dupesLock(&dupes);
+    formatSize(dupes.wasted, wasted, sizeof(wasted));
+    listViewLine(5, "%d groups, %s in extra copies", dupes.groupCount, wasted);
+    for (int g = 0; g < dupes.groupCount; g++) {
+        const DupeGroup *group = &dupes.groups[g];
+        if (line + 1 + group->count <= ui.dupesScroll || line >= end) {
+            line += 1 + group->count; // off screen, skip the formatting
+            continue;
+        }
+        if (line++ >= ui.dupesScroll) {
+            char size[24];
+            formatSize(group->size, size, sizeof(size));
+            const char *kind = (group->flags & DUPE_GROUP_IDENTICAL) ? "identical"
+                             : (group->flags & DUPE_GROUP_SAMPLED)   ? "likely copies"
+                                                                     : "same size";
+            listViewLine(row++, "%d files, %s each (%s)", group->count, size, kind);
+        }
+        for (int i = group->first; i < group->first + group->count; i++, line++) {
+            if (line < ui.dupesScroll || line >= end) {
+                continue;
+            }
+            int file = dupes.candidates[i];
+            const char *folder = dupesFolderPath(&dupes, dupes.files[file].folder);
+            listViewLine(row++, "  %s%s%s", folder, folder[0] ? "/" : "", dupesFileName(&dupes, file));
+        }
+    }
+    dupesUnlock(&dupes);
+    ui.dupesLines = line;
+
+    if (line == 0 && ui.dupesPhase == DUPES_DONE) {
+        listViewLine(row++, "No duplicates found");
+    }
+    while (row < LIST_FIRST_ROW + VISIBLE_LINES) {
+        listViewLine(row++, "%s", "");
+    }
+
+    int footer = LIST_FIRST_ROW + VISIBLE_LINES + 2;
+    listViewLine(footer, "Up/Down: Scroll  L/R: Page  B: Back");
+    listViewLine(footer + 1, "Copies are only listed, nothing is deleted");
+}
+
+// Entries the cursor should move this frame: one on a fresh press, then
+// auto-repeat while the direction stays held
+int dpadSteps(u32 kDown, u32 kHeld) {
+    KeyRepeat *repeat = &ui.repeat;
+    u64 now = svcGetSystemTick();
+
+    if (kDown & (KEY_UP | KEY_DOWN)) {
+        repeat->key = (kDown & KEY_UP) ? KEY_UP : KEY_DOWN;
+        repeat->pressedAt = now;
+        repeat->nextAt = now + (u64)(REPEAT_DELAY_MS * CPU_TICKS_PER_MSEC);
+        return repeat->key == KEY_UP ? -1 : 1;
+    }
+    if (!(kHeld & repeat->key)) {
+        repeat->key = 0;
+        return 0;
+    }
+    if (now < repeat->nextAt) {
+        return 0;
+    }
+
+    u32 repeating = (u32)((now - repeat->pressedAt) / CPU_TICKS_PER_MSEC) - REPEAT_DELAY_MS;
+    u32 interval = REPEAT_MIN_MS;
+    int steps = 1;
+    if (repeating < REPEAT_ACCEL_MS) {
+        interval = REPEAT_START_MS - (REPEAT_START_MS - REPEAT_MIN_MS) * repeating / REPEAT_ACCEL_MS;
+    } else {
+        steps += (repeating - REPEAT_ACCEL_MS) / 1000;
+        if (steps > VISIBLE_LINES) {
+            steps = VISIBLE_LINES;
+        }
+    }
+    repeat->nextAt = now + (u64)(interval * CPU_TICKS_PER_MSEC);
+    return repeat->key == KEY_UP ? -steps : steps;
 }
 
-bool launchMoviePlayer(void) {
-    // 3D Movie Player title IDs for different regions
-    u64 titleIds[] = {
-        0x0004000000036A00ULL,  // CIA installed version (most common on emulator/CFW)
-        0x0004001000021A00ULL,  // USA (preinstalled)
-        0x0004001000021B01ULL,  // EUR (preinstalled)
-        0x0004001000020F00ULL   // JPN (preinstalled)
-    };
+// Moves the cursor, scrolling just enough to keep it on screen
+void moveSelection(int delta) {
+    int target = dirList.selected + delta;
+    if (target > dirList.count - 1) {
+        target = dirList.count - 1;
+    }
+    if (target < 0) {
+        target = 0;
+    }
+    if (target == dirList.selected) {
+        return;
+    }
 
-    // Try both SD and NAND media types
-    FS_MediaType mediaTypes[] = {MEDIATYPE_SD, MEDIATYPE_NAND};
+    dirList.selected = target;
+    if (dirList.selected < dirList.scrollOffset) {
+        dirList.scrollOffset = dirList.selected;
+    } else if (dirList.selected >= dirList.scrollOffset + VISIBLE_LINES) {
+        dirList.scrollOffset = dirList.selected - VISIBLE_LINES + 1;
+    }
+    requestVisibleCounts(&dirList);
+    ui.dirty = true;
+}
 
-    for (int m = 0; m < 2; m++) {
-        for (int i = 0; i < 4; i++) {
-            // Check if title is actually installed before trying to launch
-            AM_TitleEntry titleEntry;
-            Result rc = AM_GetTitleInfo(mediaTypes[m], 1, &titleIds[i], &titleEntry);
+// Scrolls a screenful and moves the cursor along with it
+void pageSelection(int pages) {
+    int delta = pages * VISIBLE_LINES;
+    int lastOffset = dirList.count > VISIBLE_LINES ? dirList.count - VISIBLE_LINES : 0;
+    int offset = dirList.scrollOffset + delta;
+    if (offset > lastOffset) {
+        offset = lastOffset;
+    }
+    if (offset < 0) {
+        offset = 0;
+    }
+    bool scrolled = offset != dirList.scrollOffset;
+    dirList.scrollOffset = offset;
+
+    int before = dirList.selected;
+    moveSelection(delta);
+    if (scrolled && dirList.selected == before) {
+        requestVisibleCounts(&dirList);
+        ui.dirty = true;
+    }
+}
 
-            if (R_FAILED(rc)) {
-                // Title not installed on this media type, try next
-                continue;
+// Asks the scanner for the folders on screen, nearest the cursor first
+void requestVisibleCounts(const DirectoryList *list) {
+    const char *names[VISIBLE_LINES];
+    int count = 0;
+
+    int endIdx = list->scrollOffset + VISIBLE_LINES;
+    if (endIdx > list->count) {
+        endIdx = list->count;
+    }
+
+    for (int distance = 0; count < VISIBLE_LINES; distance++) {
+        int above = list->selected - distance;
+        int below = list->selected + distance;
+        bool inRange = false;
+
+        if (above >= list->scrollOffset && above < endIdx) {
+            inRange = true;
+            if (list->entries[above].flags & ENTRY_DIRECTORY) {
+                names[count++] = entryName(list, &list->entries[above]);
             }
+        }
+        if (distance > 0 && below >= list->scrollOffset && below < endIdx) {
+            inRange = true;
+            if ((list->entries[below].flags & ENTRY_DIRECTORY) && count < VISIBLE_LINES) {
+                names[count++] = entryName(list, &list->entries[below]);
+            }
+        }
+        if (!inRange) {
+            break;
+        }
+    }
 
-            // Title is installed, try to launch it
-            u8 buf[0x300];
-            u8 hmac[0x20];
-            memset(buf, 0, sizeof(buf));
-            memset(hmac, 0, sizeof(hmac));
-
-            rc = APT_PrepareToDoApplicationJump(0, titleIds[i], mediaTypes[m]);
-            if (R_SUCCEEDED(rc)) {
-                rc = APT_DoApplicationJump(buf, sizeof(buf), hmac);
-                if (R_SUCCEEDED(rc)) {
-                    return true;
-                }
+    scannerRequest(&scanner, list->currentPath, names, count);
+}
+
+// Asks for the highlighted folder's cover and its neighbours, and shows it
+// when it is in. Dialogs keep the cover of the folder they are about.
+void updateCover(void) {
+    if (hud.visible || (ui.screen != SCREEN_BROWSE && ui.screen != SCREEN_RECENTS)) {
+        return;
+    }
+    static char near[COVER_WANTED][MAX_PATH_LEN];
+    const char *paths[COVER_WANTED] = {NULL};
+    const int offsets[COVER_WANTED] = {0, 1, -1}; // the way a scroll usually goes first
+    for (int i = 0; i < COVER_WANTED; i++) {
+        if (ui.screen == SCREEN_RECENTS) {
+            int index = ui.recentSelected + offsets[i];
+            if (index >= 0 && index < recents.count) {
+                paths[i] = recents.entries[index].path;
             }
+            continue;
+        }
+        int index = dirList.selected + offsets[i];
+        if (index >= 0 && index < dirList.count && (dirList.entries[index].flags & ENTRY_DIRECTORY)) {
+            snprintf(near[i], MAX_PATH_LEN, "%s%s", dirList.currentPath, entryName(&dirList, &dirList.entries[index]));
+            paths[i] = near[i];
         }
     }
 
-    return false;
+    if (strcmp(coverView.path, paths[0] ? paths[0] : "") != 0) {
+        coverRequest(&covers, paths, COVER_WANTED);
+    }
+    if (coverViewUpdate(&coverView, &covers, paths[0])) {
+        ui.present = true;
+    }
+}
+
+// Ends a startup phase: traced, and the slowest one goes on the HUD
+void startupPhase(const char *name) {
+    u64 now = svcGetSystemTick();
+    if (traceEnabled) {
+        traceRecord(name, phaseStart, 0);
+    }
+    hudStartupPhase(&hud, name, now - phaseStart);
+    phaseStart = now;
+}
+
+// Starts ui.tidy on its worker; the browser is already up
+void startTidy(void) {
+    ui.tidyAt = svcGetSystemTick();
+    if (ui.tidy == TIDY_RESTORE) {
+        listViewStatus(&view, "Restoring files from root...");
+        moveWorkerStart(&tidyWorker, MOVE_JOB_RESTORE, &tidyState, NULL, NULL, ROOT_PATH, &uiWake);
+    } else if (ui.tidy == TIDY_SWEEP) {
+        moveWorkerStart(&tidyWorker, MOVE_JOB_SWEEP, NULL, OLDMOFLEX_PATH, NULL, ROOT_PATH, &uiWake);
+    }
+}
+
+// Picks up a finished housekeeping job and starts the next one
+void pollTidy(void) {
+    if (ui.tidy == TIDY_NONE || !moveWorkerFinished(&tidyWorker)) {
+        return;
+    }
+    bool ok = moveWorkerJoin(&tidyWorker);
+    int moved = tidyWorker.stats.moved;
+    char status[LISTVIEW_WIDTH + 1];
+    status[0] = '\0';
+
+    if (ui.tidy == TIDY_RESTORE) {
+        if (traceEnabled) {
+            traceRecord("tidy.restore", ui.tidyAt, moved);
+        }
+        libraryRefresh(&library, tidyState.sourceDir, NULL);
+        if (ok) {
+            snprintf(status, sizeof(status), "Restored %d files from root", moved);
+        } else {
+            snprintf(status, sizeof(status), "ERROR: Restore failed, move files back");
+        }
+        stateFree(&tidyState);
+
+        // Old files left in root are swept like on a first launch
+        ui.tidy = ok ? TIDY_SWEEP : TIDY_NONE;
+        startTidy();
+    } else {
+        if (traceEnabled) {
+            traceRecord("tidy.sweep", ui.tidyAt, moved);
+        }
+        if (!ok) {
+            snprintf(status, sizeof(status), "Warning: Some root files did not move");
+        } else if (moved > 0) {
+            snprintf(status, sizeof(status), "Moved %d root files to OLDMOFLEX", moved);
+        }
+        ui.tidy = TIDY_NONE;
+    }
+
+    if (status[0]) {
+        listViewStatus(&view, status);
+    }
+    if (moved > 0) {
+        // Counts and maybe a new OLDMOFLEX folder; checked when idle
+        updateEntryCounts(&dirList);
+        dirList.validated = false;
+    }
+    if (ui.screen == SCREEN_BROWSE || ui.screen == SCREEN_CONFIRM || ui.screen == SCREEN_RECENTS) {
+        ui.dirty = true;
+    }
+}
+
+void printMoveStats(const MoveStats *stats) {
+    u32 ms = (u32)(stats->ticks / CPU_TICKS_PER_MSEC);
+    printf("%d files in %lu ms (%lu files/s)\n",
+           stats->moved, (unsigned long)ms, (unsigned long)moveFilesPerSecond(stats));
+}
+
+// "1h 05m" or "12m 30s"
+void formatDuration(u64 ms, char *out, size_t size) {
+    u64 seconds = ms / 1000;
+    if (seconds >= 3600) {
+        snprintf(out, size, "%luh %02lum", (unsigned long)(seconds / 3600), (unsigned long)(seconds / 60 % 60));
+    } else {
+        snprintf(out, size, "%lum %02lus", (unsigned long)(seconds / 60), (unsigned long)(seconds % 60));
+    }
+}
+
+// "1.4 GB" or "350 MB"
+void formatSize(u64 bytes, char *out, size_t size) {
+    if (bytes >= (1ULL << 30)) {
+        u64 tenths = bytes * 10 / (1ULL << 30);
+        snprintf(out, size, "%lu.%lu GB", (unsigned long)(tenths / 10), (unsigned long)(tenths % 10));
+    } else {
+        snprintf(out, size, "%lu MB", (unsigned long)(bytes >> 20));
+    }
 }
@@ -0,0 +1,561 @@
+#include "metacache.h"
+#include "array.h"
+#include "hash.h"
+#include "fsdir.h"
+#include "fsfile.h"
+#include "library.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Returns the offset of the copy, or -1 if out of memory
+static s64 addString(MetaCache *cache, const char *text, size_t len) {
+    u32 needed = cache->stringSize + (u32)len + 1;
+    if (needed > cache->stringCapacity) {
+        u32 capacity = cache->stringCapacity ? cache->stringCapacity * 2 : 4096;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        char *strings = (char *)realloc(cache->strings, capacity);
+        if (!strings) {
+            return -1;
+        }
+        cache->strings = strings;
+        cache->stringCapacity = capacity;
+    }
+    u32 offset = cache->stringSize;
+    memcpy(cache->strings + offset, text, len);
+    cache->strings[offset + len] = '\0';
+    cache->stringSize = needed;
+    return offset;
+}
+
+void metaInit(MetaCache *cache) {
+    memset(cache, 0, sizeof(MetaCache));
+    LightLock_Init(&cache->lock);
+}
+
+void metaFree(MetaCache *cache) {
+    free(cache->collections);
+    free(cache->entries);
+    free(cache->strings);
+    cache->collections = NULL;
+    cache->entries = NULL;
+    cache->strings = NULL;
+    cache->collectionCount = cache->collectionCapacity = 0;
+    cache->entryCount = cache->entryCapacity = 0;
+    cache->stringSize = cache->stringCapacity = 0;
+    cache->dirty = false;
+}
+
+static int findCollection(const MetaCache *cache, const char *path, size_t len, u32 hash) {
+    for (int i = 0; i < cache->collectionCount; i++) {
+        const MetaCollection *collection = &cache->collections[i];
+        if (collection->pathHash == hash && collection->pathLength == len &&
+            memcmp(cache->strings + collection->pathOffset, path, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool entryIs(const MetaCache *cache, int entry, const char *name, size_t len) {
+    const MetaEntry *e = &cache->entries[entry];
+    return e->nameLength == len && memcmp(cache->strings + e->nameOffset, name, len) == 0;
+}
+
+// Entry for a name in a collection's block, trying hint first: listings
+// usually come back in the same order as last time
+static int findEntry(const MetaCache *cache, int collection, const char *name, size_t len, int hint) {
+    const MetaCollection *c = &cache->collections[collection];
+    int end = c->firstEntry + c->entryCount;
+    if (hint >= c->firstEntry && hint < end && entryIs(cache, hint, name, len)) {
+        return hint;
+    }
+    for (int i = c->firstEntry; i < end; i++) {
+        if (entryIs(cache, i, name, len)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int metaFindCollection(const MetaCache *cache, const char *path) {
+    size_t len = strlen(path);
+    return findCollection(cache, path, len, fnv1a32(FNV1A_32_INIT, path, len));
+}
+
+static void summarize(MetaSummary *summary, const MetaEntry *entry, const char *name) {
+    summary->files++;
+    summary->totalBytes += entry->size;
+    if (entry->size > summary->largestSize) {
+        summary->largestSize = entry->size;
+        snprintf(summary->largest, sizeof(summary->largest), "%s", name);
+    }
+    if (entry->info.flags & MOFLEX_INFO_VALID) {
+        summary->known++;
+    }
+    if (entry->info.flags & MOFLEX_INFO_TIMED) {
+        summary->timed++;
+        summary->totalMs += entry->info.durationMs;
+    }
+    if (entry->info.flags & MOFLEX_INFO_STEREO) {
+        summary->stereo++;
+    }
+    if (entry->verdict != MOFLEX_UNCHECKED) {
+        summary->verified++;
+    }
+    if (entry->verdict != MOFLEX_UNCHECKED && entry->verdict != MOFLEX_OK) {
+        if (summary->bad++ == 0) {
+            summary->firstBadVerdict = (MoflexVerdict)entry->verdict;
+            snprintf(summary->firstBad, sizeof(summary->firstBad), "%s", name);
+        }
+    }
+}
+
+static void summarizeCollection(const MetaCache *cache, int collection, MetaSummary *summary) {
+    int probed = summary->probed;
+    memset(summary, 0, sizeof(MetaSummary));
+    summary->probed = probed;
+    if (collection < 0) {
+        return;
+    }
+    const MetaCollection *c = &cache->collections[collection];
+    summary->volumes = c->volumes;
+    for (int i = c->firstEntry; i < c->firstEntry + c->entryCount; i++) {
+        summarize(summary, &cache->entries[i], metaEntryName(cache, &cache->entries[i]));
+    }
+}
+
+void metaSummarize(MetaCache *cache, const char *path, MetaSummary *summary) {
+    metaLock(cache);
+    summarizeCollection(cache, metaFindCollection(cache, path), summary);
+    metaUnlock(cache);
+}
+
+bool metaVolume(MetaCache *cache, const char *path, int volume, MetaVolume *out, char *names, size_t size) {
+    memset(out, 0, sizeof(MetaVolume));
+    metaLock(cache);
+    int collection = metaFindCollection(cache, path);
+    if (collection < 0 || volume < 0 || volume >= cache->collections[collection].volumes) {
+        metaUnlock(cache);
+        return false;
+    }
+
+    // Collect the volume's entries by position, then write them out in order
+    const MetaCollection *c = &cache->collections[collection];
+    s32 members[MOFLEX_LIMIT];
+    int first = volume * MOFLEX_LIMIT;
+    for (int i = c->firstEntry; i < c->firstEntry + c->entryCount; i++) {
+        const MetaEntry *entry = &cache->entries[i];
+        if (entry->volume == volume && entry->order >= first && entry->order - first < MOFLEX_LIMIT) {
+            members[entry->order - first] = i;
+            out->files++;
+        }
+    }
+    out->first = first + 1;
+
+    size_t used = 0;
+    for (int i = 0; i < out->files; i++) {
+        const MetaEntry *entry = &cache->entries[members[i]];
+        const char *name = metaEntryName(cache, entry);
+        if (i == 0) {
+            snprintf(out->firstName, sizeof(out->firstName), "%s", name);
+        }
+        if (i == out->files - 1) {
+            snprintf(out->lastName, sizeof(out->lastName), "%s", name);
+        }
+        if (names && used + entry->nameLength + 1 <= size) {
+            memcpy(names + used, name, entry->nameLength + 1);
+            used += entry->nameLength + 1;
+        }
+    }
+    metaUnlock(cache);
+    return true;
+}
+
+int metaVolumeOf(MetaCache *cache, const char *path, const char *name) {
+    metaLock(cache);
+    int collection = metaFindCollection(cache, path);
+    int entry = collection >= 0 ? findEntry(cache, collection, name, strlen(name), -1) : -1;
+    int volume = entry >= 0 ? cache->entries[entry].volume : -1;
+    metaUnlock(cache);
+    return volume;
+}
+
+bool metaRecordVerdict(MetaCache *cache, const char *path, const char *name, u64 size, u64 mtime,
+                       MoflexVerdict verdict, u32 digest) {
+    bool stored = false;
+    metaLock(cache);
+    int collection = metaFindCollection(cache, path);
+    int entry = collection >= 0 ? findEntry(cache, collection, name, strlen(name), -1) : -1;
+    if (entry >= 0 && cache->entries[entry].size == size && cache->entries[entry].mtime == mtime) {
+        cache->entries[entry].verdict = (u16)verdict;
+        cache->entries[entry].digest = digest;
+        cache->dirty = true;
+        stored = true;
+    }
+    metaUnlock(cache);
+    return stored;
+}
+
+// Appends an entry for dir/name, probing the file unless the collection's
+// old entry for it still matches. size is what the listing said, or
+// U64_MAX to get it from the file. Returns false if out of memory.
+static bool collectFile(MetaCache *cache, int collection, const char *dir, const char *name, u64 size,
+                        u8 *buffer, int position, MetaSummary *summary, bool *changed) {
+    char path[STATE_PATH_LEN + META_NAME_LEN];
+    size_t dirLength = strlen(dir);
+    snprintf(path, sizeof(path), "%s%s%s", dir, (dirLength && dir[dirLength - 1] == '/') ? "" : "/", name);
+
+    MetaEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.mtime = fileMtime(path);
+
+    FileReader reader;
+    bool opened = false;
+    if (size == U64_MAX) {
+        if (!fileOpen(&reader, path)) {
+            return true; // gone since the listing
+        }
+        opened = true;
+        size = reader.size;
+    }
+    entry.size = size;
+
+    // A cached file costs the mtime lookup and nothing else
+    size_t len = strlen(name);
+    int hint = collection >= 0 ? cache->collections[collection].firstEntry + position : -1;
+    int old = collection >= 0 ? findEntry(cache, collection, name, len, hint) : -1;
+    if (old >= 0 && cache->entries[old].size == entry.size && cache->entries[old].mtime == entry.mtime) {
+        entry.info = cache->entries[old].info;
+        entry.verdict = cache->entries[old].verdict;
+        entry.digest = cache->entries[old].digest;
+    } else {
+        if (!opened && !fileOpen(&reader, path)) {
+            return true;
+        }
+        opened = true;
+        TRACE_SPAN("meta.probe", (u32)(entry.size >> 20), moflexProbe(&reader, buffer, &entry.info));
+        summary->probed++;
+        *changed = true;
+    }
+    if (opened) {
+        fileClose(&reader);
+    }
+
+    s64 offset = addString(cache, name, len);
+    if (offset < 0 || !arrayReserve((void **)&cache->entries, &cache->entryCapacity, cache->entryCount + 1,
+                                    sizeof(MetaEntry), 256)) {
+        return false;
+    }
+    entry.nameOffset = (u32)offset;
+    entry.nameLength = (u16)len;
+    cache->entries[cache->entryCount++] = entry;
+    return true;
+}
+
+typedef struct {
+    const u8 *key;
+    const char *name;
+    u16 keyLength;
+    s32 entry;
+} VolumeItem;
+
+// Same order as the browser's (library.c)
+static int compareVolumeItems(const void *a, const void *b) {
+    const VolumeItem *x = (const VolumeItem *)a;
+    const VolumeItem *y = (const VolumeItem *)b;
+
+    int result = memcmp(x->key, y->key, x->keyLength < y->keyLength ? x->keyLength : y->keyLength);
+    if (result == 0) {
+        result = (int)x->keyLength - (int)y->keyLength;
+    }
+    return result != 0 ? result : strcmp(x->name, y->name);
+}
+
+// Numbers a fresh block in natural order and splits it into volumes of
+// MOFLEX_LIMIT files. Falls back to listing order if out of memory.
+static void planVolumes(MetaCache *cache, int collection) {
+    MetaCollection *c = &cache->collections[collection];
+    int count = c->entryCount;
+    MetaEntry *entries = cache->entries + c->firstEntry;
+
+    size_t keyBytes = 0;
+    for (int i = 0; i < count; i++) {
+        keyBytes += (size_t)entries[i].nameLength * 3;
+    }
+    VolumeItem *items = (VolumeItem *)malloc(sizeof(VolumeItem) * (count + 1));
+    u8 *keys = (u8 *)malloc(keyBytes + 1);
+
+    if (items && keys) {
+        u8 *key = keys;
+        for (int i = 0; i < count; i++) {
+            items[i].name = metaEntryName(cache, &entries[i]);
+            items[i].key = key;
+            items[i].keyLength = (u16)libraryCollationKey(items[i].name, key);
+            items[i].entry = i;
+            key += items[i].keyLength;
+        }
+        qsort(items, count, sizeof(VolumeItem), compareVolumeItems);
+        for (int i = 0; i < count; i++) {
+            entries[items[i].entry].order = (u16)i;
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            entries[i].order = (u16)i;
+        }
+    }
+    free(items);
+    free(keys);
+
+    for (int i = 0; i < count; i++) {
+        entries[i].volume = entries[i].order / MOFLEX_LIMIT;
+    }
+    c->volumes = (u16)((count + MOFLEX_LIMIT - 1) / MOFLEX_LIMIT);
+}
+
+bool metaCollect(MetaCache *cache, const char *path, const AppState *active, const char *rootDir,
+                 MetaSummary *summary) {
+    memset(summary, 0, sizeof(MetaSummary));
+
+    u8 *buffer = (u8 *)malloc(MOFLEX_READ_SIZE);
+    if (!buffer) {
+        return false;
+    }
+
+    // Held throughout; the verifier only ever waits on it to store a result
+    metaLock(cache);
+    size_t pathLength = strlen(path);
+    u32 hash = fnv1a32(FNV1A_32_INIT, path, pathLength);
+    int collection = findCollection(cache, path, pathLength, hash);
+
+    // The new block goes at the end; it is dropped again if nothing changed
+    int start = cache->entryCount;
+    u32 stringStart = cache->stringSize;
+    bool changed = collection < 0;
+    bool ok = true;
+
+    DirReader reader;
+    bool listed = dirOpen(&reader, path);
+    if (listed) {
+        DirEntry entry;
+        dirWantSizes(&reader);
+        while (ok && dirNext(&reader, &entry)) {
+            if (!entry.isDirectory && entry.name[0] != '.' && isMoflexFile(entry.name)) {
+                ok = collectFile(cache, collection, path, entry.name, entry.size, buffer,
+                                 cache->entryCount - start, summary, &changed);
+            }
+        }
+        dirClose(&reader);
+    }
+
+    if (active && active->filesActive) {
+        for (int i = 0; ok && i < active->fileCount; i++) {
+            if (strcmp(stateFileOrigin(active, i), path) == 0) {
+                ok = collectFile(cache, collection, rootDir, stateFileName(active, i), U64_MAX, buffer,
+                                 cache->entryCount - start, summary, &changed);
+            }
+        }
+    }
+    free(buffer);
+
+    int count = cache->entryCount - start;
+    if (ok && !changed && count == cache->collections[collection].entryCount) {
+        cache->entryCount = start;
+        cache->stringSize = stringStart;
+    } else {
+        if (ok && collection < 0) {
+            s64 offset = addString(cache, path, pathLength);
+            ok = offset >= 0 && arrayReserve((void **)&cache->collections, &cache->collectionCapacity,
+                                             cache->collectionCount + 1, sizeof(MetaCollection), 64);
+            if (ok) {
+                collection = cache->collectionCount++;
+                MetaCollection *c = &cache->collections[collection];
+                memset(c, 0, sizeof(MetaCollection));
+                c->pathOffset = (u32)offset;
+                c->pathLength = (u16)pathLength;
+                c->pathHash = hash;
+            }
+        }
+        if (ok) {
+            cache->collections[collection].firstEntry = start;
+            cache->collections[collection].entryCount = count;
+            planVolumes(cache, collection);
+            cache->dirty = true;
+        } else {
+            cache->entryCount = start;
+            cache->stringSize = stringStart;
+            listed = false;
+        }
+    }
+
+    summarizeCollection(cache, collection, summary);
+    metaUnlock(cache);
+    return listed;
+}
+
+// --- persistence -----------------------------------------------------------
+
+bool metaLoad(MetaCache *cache, const char *file) {
+    FILE *f = fopen(file, "rb");
+    if (!f) {
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < (long)sizeof(MetaFileHeader)) {
+        fclose(f);
+        return false;
+    }
+
+    // Read the whole cache in one go, then validate it in memory
+    u8 *buffer = (u8 *)malloc(size);
+    if (!buffer) {
+        fclose(f);
+        return false;
+    }
+    size_t read = fread(buffer, 1, size, f);
+    fclose(f);
+
+    MetaFileHeader header;
+    memcpy(&header, buffer, sizeof(header));
+
+    size_t collectionBytes = (size_t)header.collectionCount * sizeof(MetaCollection);
+    size_t entryBytes = (size_t)header.entryCount * sizeof(MetaEntry);
+    if (read != (size_t)size ||
+        header.magic != META_MAGIC ||
+        header.version != META_VERSION ||
+        header.collectionCount > 0x100000 || header.entryCount > 0x1000000 ||
+        sizeof(header) + collectionBytes + entryBytes + header.stringSize != (size_t)size) {
+        free(buffer);
+        return false;
+    }
+
+    const u8 *payload = buffer + sizeof(header);
+    if (fnv1a32(FNV1A_32_INIT, payload, size - sizeof(header)) != header.checksum) {
+        free(buffer);
+        return false;
+    }
+
+    // Make sure every reference stays inside the tables
+    const MetaCollection *collections = (const MetaCollection *)payload;
+    const MetaEntry *entries = (const MetaEntry *)(payload + collectionBytes);
+    const char *strings = (const char *)(payload + collectionBytes + entryBytes);
+    bool ok = header.stringSize == 0 || strings[header.stringSize - 1] == '\0';
+    for (u32 i = 0; ok && i < header.collectionCount; i++) {
+        const MetaCollection *c = &collections[i];
+        ok = (u64)c->pathOffset + c->pathLength < header.stringSize &&
+             strings[c->pathOffset + c->pathLength] == '\0' &&
+             c->firstEntry >= 0 && c->entryCount >= 0 &&
+             (u64)c->firstEntry + c->entryCount <= header.entryCount &&
+             c->volumes == (c->entryCount + MOFLEX_LIMIT - 1) / MOFLEX_LIMIT;
+        for (s32 j = 0; ok && j < c->entryCount; j++) {
+            const MetaEntry *e = &entries[c->firstEntry + j];
+            ok = e->order < c->entryCount && e->volume == e->order / MOFLEX_LIMIT;
+        }
+    }
+    for (u32 i = 0; ok && i < header.entryCount; i++) {
+        const MetaEntry *e = &entries[i];
+        ok = (u64)e->nameOffset + e->nameLength < header.stringSize &&
+             strings[e->nameOffset + e->nameLength] == '\0';
+    }
+    if (!ok) {
+        free(buffer);
+        return false;
+    }
+
+    MetaCache loaded;
+    metaInit(&loaded);
+    int collectionCount = (int)header.collectionCount;
+    int entryCount = (int)header.entryCount;
+    if (!arrayReserve((void **)&loaded.collections, &loaded.collectionCapacity,
+                      collectionCount > 0 ? collectionCount : 1, sizeof(MetaCollection), 64) ||
+        !arrayReserve((void **)&loaded.entries, &loaded.entryCapacity, entryCount > 0 ? entryCount : 1,
+                      sizeof(MetaEntry), 256) ||
+        (header.stringSize && addString(&loaded, strings, header.stringSize - 1) < 0)) {
+        metaFree(&loaded);
+        free(buffer);
+        return false;
+    }
+    memcpy(loaded.collections, collections, collectionBytes);
+    memcpy(loaded.entries, entries, entryBytes);
+    loaded.collectionCount = collectionCount;
+    loaded.entryCount = entryCount;
+    free(buffer);
+
+    metaLock(cache);
+    metaFree(cache);
+    lockedReplace(cache, &loaded, lock);
+    metaUnlock(cache);
+    return true;
+}
+
+bool metaSave(MetaCache *cache, const char *file) {
+    // Compact into a fresh cache, leaving out superseded blocks
+    MetaCache out;
+    metaInit(&out);
+    metaLock(cache);
+    bool ok = arrayReserve((void **)&out.collections, &out.collectionCapacity,
+                           cache->collectionCount > 0 ? cache->collectionCount : 1, sizeof(MetaCollection), 64);
+
+    for (int c = 0; c < cache->collectionCount && ok; c++) {
+        const MetaCollection *collection = &cache->collections[c];
+        MetaCollection copy = *collection;
+        s64 offset = addString(&out, cache->strings + collection->pathOffset, collection->pathLength);
+        ok = offset >= 0 && arrayReserve((void **)&out.entries, &out.entryCapacity,
+                                         out.entryCount + collection->entryCount + 1, sizeof(MetaEntry), 256);
+        if (!ok) {
+            break;
+        }
+        copy.pathOffset = (u32)offset;
+        copy.firstEntry = out.entryCount;
+
+        for (int i = collection->firstEntry; i < collection->firstEntry + collection->entryCount && ok; i++) {
+            MetaEntry entry = cache->entries[i];
+            offset = addString(&out, cache->strings + entry.nameOffset, entry.nameLength);
+            ok = offset >= 0;
+            entry.nameOffset = (u32)offset;
+            out.entries[out.entryCount++] = entry;
+        }
+        out.collections[out.collectionCount++] = copy;
+    }
+    if (!ok) {
+        metaUnlock(cache);
+        metaFree(&out);
+        return false;
+    }
+
+    MetaFileHeader header;
+    header.magic = META_MAGIC;
+    header.version = META_VERSION;
+    header.collectionCount = out.collectionCount;
+    header.entryCount = out.entryCount;
+    header.stringSize = out.stringSize;
+    header.checksum = fnv1a32(FNV1A_32_INIT, out.collections, sizeof(MetaCollection) * out.collectionCount);
+    header.checksum = fnv1a32(header.checksum, out.entries, sizeof(MetaEntry) * out.entryCount);
+    header.checksum = fnv1a32(header.checksum, out.strings, out.stringSize);
+
+    FILE *f = fopen(file, "wb");
+    if (f) {
+        ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+             fwrite(out.collections, sizeof(MetaCollection), out.collectionCount, f) ==
+                 (size_t)out.collectionCount &&
+             fwrite(out.entries, sizeof(MetaEntry), out.entryCount, f) == (size_t)out.entryCount &&
+             fwrite(out.strings, 1, out.stringSize, f) == out.stringSize;
+        fclose(f);
+    } else {
+        ok = false;
+    }
+
+    // Keep using the compacted copy
+    out.dirty = !ok;
+    metaFree(cache);
+    lockedReplace(cache, &out, lock);
+    metaUnlock(cache);
+    return ok;
+}
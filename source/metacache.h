@@ -0,0 +1,144 @@
+#ifndef METACACHE_H
+#define METACACHE_H
+
+#include "platform.h"
+#include "moflex.h"
+#include "state.h"
+
+// Moflex header details for every file of the collections we have looked
+// at, persisted to META_FILE.
+//
+// Entries are grouped by collection and keyed by name, size and mtime: a
+// file whose size and mtime still match keeps its entry, anything else is
+// probed again (two small reads, see moflex.h). Renames keep the mtime, so
+// a collection's files stay cached while they sit in the SD root. A changed
+// collection gets a fresh block of entries at the end of the table and the
+// old block is dropped when the cache is saved.
+//
+// Entries also carry the verdict of the background verifier (verifier.h)
+// and a digest of the file contents, valid for the same size and mtime, so
+// a file is only ever read in full once.
+//
+// Each fresh block is also split into volumes of at most MOFLEX_LIMIT files
+// in natural filename order, so a collection too large for the 3D Movie
+// Player can be moved in one volume at a time. The plan is stored with the
+// entries and only redone when the collection changes.
+
+#define META_FILE     "sdmc:/.clownsec_meta"
+#define META_MAGIC    0x444D4C43 // "CLMD"
+#define META_VERSION  3
+#define META_NAME_LEN 256
+
+typedef struct {
+    u32 nameOffset; // into the string pool
+    u16 nameLength;
+    u16 verdict;    // MoflexVerdict
+    u64 size;
+    u64 mtime;
+    MoflexInfo info;
+    u32 digest;     // of the whole file, once verified
+    u16 volume;     // 0-based
+    u16 order;      // position in the collection, natural order
+} MetaEntry;
+
+typedef struct {
+    u32 pathOffset;  // full path, as the browser has it
+    u16 pathLength;
+    u16 volumes;     // entryCount split into MOFLEX_LIMIT-file volumes
+    u32 pathHash;
+    s32 firstEntry;  // its files are entries [firstEntry, firstEntry + entryCount)
+    s32 entryCount;
+} MetaCollection;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 collectionCount;
+    u32 entryCount;
+    u32 stringSize;
+    u32 checksum; // FNV-1a over the tables and string pool
+} MetaFileHeader;
+
+typedef struct {
+    MetaCollection *collections;
+    int collectionCount;
+    int collectionCapacity;
+    MetaEntry *entries;
+    int entryCount;
+    int entryCapacity;
+    char *strings;
+    u32 stringSize;
+    u32 stringCapacity;
+    bool dirty;
+    LightLock lock; // held around every change once the verifier runs
+} MetaCache;
+
+// A collection at a glance, for the confirmation screen
+typedef struct {
+    int files;
+    int volumes;
+    int probed;       // read from the card this time, the rest were cached
+    int known;        // have a valid header
+    int timed;        // have a duration
+    int stereo;
+    int verified;     // checked by the verifier, good or bad
+    int bad;
+    MoflexVerdict firstBadVerdict;
+    char firstBad[META_NAME_LEN];
+    u64 totalMs;
+    u64 totalBytes;
+    u64 largestSize;
+    char largest[META_NAME_LEN];
+} MetaSummary;
+
+void metaInit(MetaCache *cache);
+void metaFree(MetaCache *cache);
+bool metaLoad(MetaCache *cache, const char *file);
+bool metaSave(MetaCache *cache, const char *file);
+
+// Brings the entries of the collection at path up to date and sums them up.
+// Files of it that active has moved to rootDir are read from there.
+bool metaCollect(MetaCache *cache, const char *path, const AppState *active, const char *rootDir,
+                 MetaSummary *summary);
+
+// Sums up what the cache has for a collection, without touching the card.
+// probed is left as it is.
+void metaSummarize(MetaCache *cache, const char *path, MetaSummary *summary);
+
+// One volume of a collection
+typedef struct {
+    int files;
+    int first;        // position of its first file in the collection, 1-based
+    char firstName[META_NAME_LEN];
+    char lastName[META_NAME_LEN];
+} MetaVolume;
+
+// Describes volume of the collection at path, as of the last metaCollect(),
+// and copies its file names into names, '\0'-separated in natural order, if
+// names is not NULL. size must allow for MOFLEX_LIMIT * META_NAME_LEN bytes.
+bool metaVolume(MetaCache *cache, const char *path, int volume, MetaVolume *out, char *names, size_t size);
+
+// Volume the named file of a collection is in, or -1 if it is not cached
+int metaVolumeOf(MetaCache *cache, const char *path, const char *name);
+
+// Stores a verifier result, unless the entry has changed in the meantime
+bool metaRecordVerdict(MetaCache *cache, const char *path, const char *name, u64 size, u64 mtime,
+                       MoflexVerdict verdict, u32 digest);
+
+static inline void metaLock(MetaCache *cache) {
+    LightLock_Lock(&cache->lock);
+}
+
+static inline void metaUnlock(MetaCache *cache) {
+    LightLock_Unlock(&cache->lock);
+}
+
+// Collection index for a path, or -1. The caller holds the lock; indices
+// are valid until it is released.
+int metaFindCollection(const MetaCache *cache, const char *path);
+
+static inline const char *metaEntryName(const MetaCache *cache, const MetaEntry *entry) {
+    return cache->strings + entry->nameOffset;
+}
+
+#endif
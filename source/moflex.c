@@ -0,0 +1,230 @@
+#include "moflex.h"
+
+#include <string.h>
+
+#define SYNC_HEADER_SIZE 14
+
+static u16 readU16(const u8 *p) {
+    return (u16)(p[0] << 8 | p[1]);
+}
+
+static u64 readU64(const u8 *p) {
+    u64 value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = value << 8 | p[i];
+    }
+    return value;
+}
+
+// Walks the descriptor list after a sync header. Returns the offset just
+// past its terminator, or 0 if it runs off the data or has a type or size
+// that doesn't belong in one.
+static u32 walkDescriptors(const u8 *data, u32 size, u32 pos, MoflexInfo *info) {
+    int videoStreams = 0;
+
+    while (pos + 2 <= size) {
+        u8 type = data[pos];
+        u8 length = data[pos + 1];
+        pos += 2;
+
+        if (type == 0) {
+            return length == 0 ? pos : 0;
+        }
+        bool known = (type == 1 && length == 12) || (type == 2 && length == 6) ||
+                     (type == 3 && length == 13) || (type == 4 && length == 2);
+        if (!known || pos + length > size) {
+            return 0;
+        }
+
+        if (info && type == 3) {
+            const u8 *video = data + pos;
+            if (videoStreams++ == 0) {
+                info->rateNum = readU16(video + 1);
+                info->rateDen = readU16(video + 3);
+                info->width = readU16(video + 5);
+                info->height = readU16(video + 7);
+                if (video[9] != 0) {
+                    info->flags |= MOFLEX_INFO_STEREO;
+                }
+            } else {
+                info->flags |= MOFLEX_INFO_STEREO;
+            }
+        } else if (info) {
+            info->flags |= MOFLEX_INFO_AUDIO;
+        }
+        pos += length;
+    }
+    return 0;
+}
+
+bool moflexParseHead(const u8 *data, u32 size, MoflexInfo *info, u64 *firstTimestamp) {
+    memset(info, 0, sizeof(MoflexInfo));
+    if (size < SYNC_HEADER_SIZE || readU16(data) != MOFLEX_SYNC || readU16(data + 12) == 0) {
+        return false;
+    }
+    if (!walkDescriptors(data, size, SYNC_HEADER_SIZE, info)) {
+        memset(info, 0, sizeof(MoflexInfo));
+        return false;
+    }
+    if (firstTimestamp) {
+        *firstTimestamp = readU64(data + 4);
+    }
+    info->flags |= MOFLEX_INFO_VALID;
+    return true;
+}
+
+bool moflexParseTail(const u8 *data, u32 size, u64 *lastTimestamp) {
+    if (size < SYNC_HEADER_SIZE + 2) {
+        return false;
+    }
+    for (u32 pos = size - SYNC_HEADER_SIZE - 2 + 1; pos-- > 0;) {
+        if (data[pos] != (MOFLEX_SYNC >> 8) || data[pos + 1] != (MOFLEX_SYNC & 0xFF)) {
+            continue;
+        }
+        if (readU16(data + pos + 12) != 0 &&
+            walkDescriptors(data, size, pos + SYNC_HEADER_SIZE, NULL)) {
+            *lastTimestamp = readU64(data + pos + 4);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool moflexProbe(FileReader *reader, u8 *buffer, MoflexInfo *info) {
+    u32 length = reader->size < MOFLEX_READ_SIZE ? (u32)reader->size : MOFLEX_READ_SIZE;
+    u32 read = fileRead(reader, 0, buffer, length);
+
+    u64 first = 0;
+    if (!moflexParseHead(buffer, read, info, &first)) {
+        return false;
+    }
+
+    // The last MOFLEX_READ_ALIGN bytes or more, from an aligned offset
+    u64 tail = reader->size > MOFLEX_READ_ALIGN ? reader->size - MOFLEX_READ_ALIGN : 0;
+    tail &= ~(u64)(MOFLEX_READ_ALIGN - 1);
+    if (tail > 0) {
+        length = (u32)(reader->size - tail);
+        read = fileRead(reader, tail, buffer, length);
+    }
+
+    u64 last;
+    if (moflexParseTail(buffer, read, &last) && last > first) {
+        info->durationMs = (u32)((last - first) * 1000 / MOFLEX_TICKS_PER_SECOND);
+        info->flags |= MOFLEX_INFO_TIMED;
+    }
+    return true;
+}
+
+// --- whole-file check ------------------------------------------------------
+
+void moflexCheckInit(MoflexCheck *check, u64 fileSize) {
+    memset(check, 0, sizeof(MoflexCheck));
+    check->fileSize = fileSize;
+    check->verdict = MOFLEX_OK;
+}
+
+// Looks at the header gathered for the block at blockStart
+static void checkHeader(MoflexCheck *check) {
+    const u8 *header = check->header;
+    u32 fill = check->headerFill;
+    check->gathering = false;
+
+    bool sync = fill >= 2 && readU16(header) == MOFLEX_SYNC;
+    u32 descriptorsEnd = (sync && fill >= SYNC_HEADER_SIZE && readU16(header + 12) != 0)
+                             ? walkDescriptors(header, fill, SYNC_HEADER_SIZE, NULL)
+                             : 0;
+    if (descriptorsEnd == 0) {
+        if (!sync && check->blocks > 0 && check->fileSize - check->blockStart <= MOFLEX_READ_ALIGN) {
+            check->nextBlock = check->fileSize; // padding
+        } else {
+            check->verdict = (sync && check->blockStart + fill >= check->fileSize) ? MOFLEX_TRUNCATED
+                                                                                   : MOFLEX_BAD_SYNC;
+        }
+        return;
+    }
+
+    // A block can't end inside its own header
+    u32 blockSize = (u32)readU16(header + 12) + 1;
+    if (blockSize < descriptorsEnd) {
+        check->verdict = MOFLEX_BAD_SYNC;
+        return;
+    }
+
+    u64 timestamp = readU64(header + 4);
+    if (check->blocks > 0 && timestamp < check->lastTimestamp) {
+        check->verdict = MOFLEX_BAD_TIME;
+        return;
+    }
+    check->lastTimestamp = timestamp;
+    check->blocks++;
+    check->nextBlock = check->blockStart + blockSize;
+}
+
+void moflexCheckFeed(MoflexCheck *check, const u8 *data, u32 size) {
+    u64 end = check->offset + size;
+
+    while (check->verdict == MOFLEX_OK) {
+        if (!check->gathering) {
+            if (check->nextBlock >= end) {
+                break;
+            }
+
+            // A block shorter than the header gathered for it: the next
+            // one starts in bytes already copied, maybe from the last piece
+            u64 gathered = check->blockStart + check->headerFill;
+            u32 keep = 0;
+            if (check->nextBlock < gathered) {
+                keep = (u32)(gathered - check->nextBlock);
+                memmove(check->header, check->header + (check->nextBlock - check->blockStart), keep);
+            }
+            check->gathering = true;
+            check->blockStart = check->nextBlock;
+            check->headerFill = keep;
+        }
+
+        // A header can straddle two pieces; nothing before this one is read
+        u64 pos = check->blockStart + check->headerFill;
+        if (pos < check->offset) {
+            check->verdict = MOFLEX_BAD_SYNC;
+            break;
+        }
+        u32 take = MOFLEX_CHECK_HEADER - check->headerFill;
+        if (take > end - pos) {
+            take = (u32)(end - pos);
+        }
+        memcpy(check->header + check->headerFill, data + (pos - check->offset), take);
+        check->headerFill += take;
+        if (check->headerFill < MOFLEX_CHECK_HEADER) {
+            break;
+        }
+        checkHeader(check);
+    }
+    check->offset = end;
+}
+
+MoflexVerdict moflexCheckFinish(MoflexCheck *check) {
+    if (check->verdict == MOFLEX_OK && check->gathering) {
+        checkHeader(check); // the file ended within a header
+    }
+    if (check->verdict == MOFLEX_OK) {
+        if (check->offset < check->fileSize) {
+            check->verdict = MOFLEX_UNREADABLE;
+        } else if (check->blocks == 0) {
+            check->verdict = MOFLEX_BAD_SYNC;
+        } else if (check->nextBlock > check->fileSize) {
+            check->verdict = MOFLEX_TRUNCATED;
+        }
+    }
+    return check->verdict;
+}
+
+const char *moflexVerdictText(MoflexVerdict verdict) {
+    switch (verdict) {
+        case MOFLEX_OK:         return "ok";
+        case MOFLEX_BAD_SYNC:   return "broken blocks";
+        case MOFLEX_BAD_TIME:   return "bad timestamps";
+        case MOFLEX_TRUNCATED:  return "truncated";
+        case MOFLEX_UNREADABLE: return "unreadable";
+        default:                return "not checked";
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef MOFLEX_H
+#define MOFLEX_H
+
+#include "platform.h"
+#include "fsfile.h"
+
+// What a .moflex file holds, read from its first and last few KB.
+//
+// A moflex stream is a run of blocks, each starting with a sync header:
+//
+//   0   u16  0x4C32
+//   2   u16  (not used here)
+//   4   u64  timestamp, MOFLEX_TICKS_PER_SECOND
+//   12  u16  block size - 1
+//   14  stream descriptors, each { u8 type, u8 size, size bytes }, ending
+//       with type 0
+//
+// Type 3 (13 bytes) describes a video stream: u8 index, u16 frame rate
+// numerator and denominator, u16 width and height, u8 layout, 3 more
+// bytes. Types 1, 2 and 4 describe audio. All values are big-endian.
+//
+// The descriptors come from the first block. The duration is the timestamp
+// of the last sync header, found by scanning the tail backwards for one
+// whose descriptor list checks out. Each end is a single read of at most
+// MOFLEX_READ_SIZE at a MOFLEX_READ_ALIGN boundary, so a probe costs two
+// reads however large the file is.
+
+#define MOFLEX_SYNC             0x4C32
+#define MOFLEX_TICKS_PER_SECOND 1000000ULL
+#define MOFLEX_READ_ALIGN       4096
+#define MOFLEX_READ_SIZE        8192
+#define MOFLEX_LIMIT            126 // files in the SD root; the 3D Movie Player crashes beyond this
+
+#define MOFLEX_INFO_VALID  0x0001 // the first block parsed
+#define MOFLEX_INFO_STEREO 0x0002 // two video streams, or a 3D layout
+#define MOFLEX_INFO_AUDIO  0x0004
+#define MOFLEX_INFO_TIMED  0x0008 // durationMs is known
+
+typedef struct {
+    u32 durationMs;
+    u16 width;
+    u16 height;
+    u16 rateNum;  // frame rate, rateNum / rateDen per second
+    u16 rateDen;
+    u16 flags;
+    u16 reserved;
+} MoflexInfo;
+
+// Parses the sync header at the start of the file. firstTimestamp may be
+// NULL.
+bool moflexParseHead(const u8 *data, u32 size, MoflexInfo *info, u64 *firstTimestamp);
+
+// Finds the last complete sync header in the tail of a file
+bool moflexParseTail(const u8 *data, u32 size, u64 *lastTimestamp);
+
+// Reads both ends of an open file into buffer (MOFLEX_READ_SIZE bytes) and
+// parses them. Returns false if it is not a moflex stream.
+bool moflexProbe(FileReader *reader, u8 *buffer, MoflexInfo *info);
+
+// Outcome of checking a whole file, kept in the metadata cache
+typedef enum {
+    MOFLEX_UNCHECKED = 0,
+    MOFLEX_OK,
+    MOFLEX_BAD_SYNC,   // a block doesn't start with a sync header where the last one ended
+    MOFLEX_BAD_TIME,   // timestamps go backwards
+    MOFLEX_TRUNCATED,  // the last block runs past the end of the file
+    MOFLEX_UNREADABLE, // a read failed part way through
+} MoflexVerdict;
+
+// Streaming check of the block structure, fed the file front to back in
+// pieces of any size. Every block has to start with a valid sync header at
+// the offset the previous one's size points to, with a timestamp no earlier
+// than the last, and the last block has to end with the file. Up to
+// MOFLEX_READ_ALIGN bytes without a sync header may follow it as padding.
+#define MOFLEX_CHECK_HEADER 128 // bytes gathered for each sync header
+
+typedef struct {
+    u64 fileSize;
+    u64 offset;        // file position of the next byte fed
+    u64 blockStart;    // block whose header is being gathered
+    u64 nextBlock;
+    u64 lastTimestamp;
+    u32 blocks;
+    u32 headerFill;
+    bool gathering;
+    MoflexVerdict verdict; // MOFLEX_OK until a problem is found
+    u8 header[MOFLEX_CHECK_HEADER];
+} MoflexCheck;
+
+void moflexCheckInit(MoflexCheck *check, u64 fileSize);
+void moflexCheckFeed(MoflexCheck *check, const u8 *data, u32 size);
+MoflexVerdict moflexCheckFinish(MoflexCheck *check);
+
+const char *moflexVerdictText(MoflexVerdict verdict);
+
+#endif
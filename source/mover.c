@@ -0,0 +1,705 @@
+#include "mover.h"
+#include "hash.h"
+#include "library.h"
+#include "fsdir.h"
+#include "fssession.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+// Joins a directory and a file name, adding a slash only if needed
+static void joinPath(char *out, const char *dir, const char *name) {
+    size_t len = strlen(dir);
+    if (len > 0 && dir[len - 1] == '/') {
+        snprintf(out, MOVER_PATH_LEN, "%s%s", dir, name);
+    } else {
+        snprintf(out, MOVER_PATH_LEN, "%s/%s", dir, name);
+    }
+}
+
+// Splits "dir/name" in place, returning the name; dir keeps no trailing slash
+static const char *splitPath(char *path) {
+    char *slash = strrchr(path, '/');
+    if (!slash) {
+        return path;
+    }
+    *slash = '\0';
+    return slash + 1;
+}
+
+static bool pathExists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+void moveMonitorInit(MoveMonitor *monitor) {
+    memset(monitor, 0, sizeof(MoveMonitor));
+}
+
+static bool monitorPush(MoveMonitor *monitor, const MoveEvent *event) {
+    u32 head = __atomic_load_n(&monitor->head, __ATOMIC_RELAXED);
+    u32 tail = __atomic_load_n(&monitor->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= MOVE_QUEUE_SIZE) {
+        return false;
+    }
+
+    monitor->events[head & (MOVE_QUEUE_SIZE - 1)] = *event;
+    __atomic_store_n(&monitor->head, head + 1, __ATOMIC_RELEASE);
+    if (monitor->notify) {
+        LightEvent_Signal(monitor->notify);
+    }
+    return true;
+}
+
+bool moveMonitorPop(MoveMonitor *monitor, MoveEvent *event) {
+    u32 tail = __atomic_load_n(&monitor->tail, __ATOMIC_RELAXED);
+    u32 head = __atomic_load_n(&monitor->head, __ATOMIC_ACQUIRE);
+    if (tail == head) {
+        return false;
+    }
+
+    *event = monitor->events[tail & (MOVE_QUEUE_SIZE - 1)];
+    __atomic_store_n(&monitor->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void reportProgress(MovePlan *plan, int done, u64 elapsed, const char *path) {
+    MoveEvent event;
+    event.type = MOVE_EVENT_PROGRESS;
+    event.done = done;
+    event.total = plan->count;
+    event.filesPerSecond = elapsed ? (u32)((u64)done * SYSCLOCK_ARM11 / elapsed) : 0;
+    event.etaMs = done ? (u32)(elapsed * (plan->count - done) / done / CPU_TICKS_PER_MSEC) : 0;
+    strncpy(event.name, strrchr(path, '/') + 1, sizeof(event.name) - 1);
+    event.name[sizeof(event.name) - 1] = '\0';
+
+    // A dropped progress event is superseded by the next one anyway
+    monitorPush(plan->monitor, &event);
+}
+
+static void reportFailure(MovePlan *plan, const char *path) {
+    const char *name = strrchr(path, '/') + 1;
+    if (!plan->monitor) {
+        printf("Failed to move: %s\n", name);
+        return;
+    }
+
+    MoveEvent event;
+    memset(&event, 0, sizeof(event));
+    event.type = MOVE_EVENT_FAILED;
+    strncpy(event.name, name, sizeof(event.name) - 1);
+
+    // Failures shouldn't be lost, so give the UI a few frames to drain
+    for (int tries = 0; tries < 100 && !monitorPush(plan->monitor, &event); tries++) {
+        svcSleepThread(1000000LL);
+    }
+}
+
+static u32 addString(MovePlan *plan, const char *str) {
+    size_t len = strlen(str) + 1;
+    if (plan->stringSize + len > plan->stringCapacity) {
+        u32 capacity = plan->stringCapacity ? plan->stringCapacity * 2 : 8192;
+        while (capacity < plan->stringSize + len) {
+            capacity *= 2;
+        }
+        char *strings = (char *)realloc(plan->strings, capacity);
+        if (!strings) {
+            return 0xFFFFFFFFu;
+        }
+        plan->strings = strings;
+        plan->stringCapacity = capacity;
+    }
+
+    u32 offset = plan->stringSize;
+    memcpy(plan->strings + offset, str, len);
+    plan->stringSize += len;
+    return offset;
+}
+
+void planInit(MovePlan *plan, JournalRecovery recovery, u32 flags) {
+    memset(plan, 0, sizeof(MovePlan));
+    plan->recovery = recovery;
+    plan->flags = flags;
+}
+
+void planFree(MovePlan *plan) {
+    free(plan->ops);
+    free(plan->done);
+    free(plan->strings);
+    planInit(plan, plan->recovery, plan->flags);
+}
+
+bool planAdd(MovePlan *plan, const char *sourcePath, const char *destPath) {
+    if (plan->count == plan->capacity) {
+        int capacity = plan->capacity ? plan->capacity * 2 : 128;
+        MoveOp *ops = (MoveOp *)realloc(plan->ops, sizeof(MoveOp) * capacity);
+        if (!ops) {
+            return false;
+        }
+        plan->ops = ops;
+        bool *done = (bool *)realloc(plan->done, sizeof(bool) * capacity);
+        if (!done) {
+            return false;
+        }
+        plan->done = done;
+        plan->capacity = capacity;
+    }
+
+    u32 source = addString(plan, sourcePath);
+    u32 dest = addString(plan, destPath);
+    if (source == 0xFFFFFFFFu || dest == 0xFFFFFFFFu) {
+        return false;
+    }
+
+    plan->ops[plan->count].sourceOffset = source;
+    plan->ops[plan->count].destOffset = dest;
+    plan->done[plan->count] = false;
+    plan->count++;
+    return true;
+}
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+void moveSelectionSort(MoveSelection *selection) {
+    qsort(selection->names, selection->count, sizeof(const char *), compareNames);
+}
+
+bool moveSelectionHas(const MoveSelection *selection, const char *name) {
+    return !selection ||
+           bsearch(&name, selection->names, selection->count, sizeof(const char *), compareNames) != NULL;
+}
+
+bool planMoflexFiles(MovePlan *plan, const char *sourceDir, const char *destDir,
+                     const MoveSelection *only) {
+    DirReader reader;
+    if (!dirOpen(&reader, sourceDir)) {
+        return false;
+    }
+
+    bool ok = true;
+    DirEntry entry;
+    while (ok && dirNext(&reader, &entry)) {
+        if (entry.name[0] == '.' || entry.isDirectory || !isMoflexFile(entry.name) ||
+            !moveSelectionHas(only, entry.name)) {
+            continue;
+        }
+
+        char sourcePath[MOVER_PATH_LEN];
+        char destPath[MOVER_PATH_LEN];
+        joinPath(sourcePath, sourceDir, entry.name);
+        joinPath(destPath, destDir, entry.name);
+        ok = planAdd(plan, sourcePath, destPath);
+    }
+
+    dirClose(&reader);
+    return ok;
+}
+
+bool hasMoflexFiles(const char *dir) {
+    DirReader reader;
+    if (!dirOpen(&reader, dir)) {
+        return false;
+    }
+
+    bool found = false;
+    DirEntry entry;
+    while (!found && dirNext(&reader, &entry)) {
+        found = entry.name[0] != '.' && !entry.isDirectory && isMoflexFile(entry.name);
+    }
+
+    dirClose(&reader);
+    return found;
+}
+
+static bool writeJournal(const MovePlan *plan) {
+    JournalHeader header;
+    header.magic = JOURNAL_MAGIC;
+    header.version = JOURNAL_VERSION;
+    header.recovery = plan->recovery;
+    header.flags = plan->flags;
+    header.opCount = plan->count;
+    header.stringSize = plan->stringSize;
+    header.checksum = fnv1a32(FNV1A_32_INIT, plan->ops, sizeof(MoveOp) * plan->count);
+    header.checksum = fnv1a32(header.checksum, plan->strings, plan->stringSize);
+
+    FILE *f = fopen(JOURNAL_FILE, "wb");
+    if (!f) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(plan->ops, sizeof(MoveOp), plan->count, f) == (size_t)plan->count &&
+              fwrite(plan->strings, 1, plan->stringSize, f) == plan->stringSize;
+    if (ok && (plan->flags & JOURNAL_WRITES_STATE)) {
+        ok = stateWrite(f, plan->postState);
+    }
+    ok = (fclose(f) == 0) && ok;
+    return ok;
+}
+
+static bool readJournal(MovePlan *plan, AppState *postState) {
+    FILE *f = fopen(JOURNAL_FILE, "rb");
+    if (!f) {
+        return false;
+    }
+
+    planInit(plan, JOURNAL_REPLAY, 0);
+
+    JournalHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              header.magic == JOURNAL_MAGIC &&
+              header.version == JOURNAL_VERSION &&
+              header.opCount <= 0x10000 && header.stringSize <= 0x1000000;
+
+    if (ok) {
+        planInit(plan, (JournalRecovery)header.recovery, header.flags);
+        plan->ops = (MoveOp *)malloc(sizeof(MoveOp) * (header.opCount + 1));
+        plan->done = (bool *)calloc(header.opCount + 1, sizeof(bool));
+        plan->strings = (char *)malloc(header.stringSize + 1);
+        ok = plan->ops && plan->done && plan->strings &&
+             fread(plan->ops, sizeof(MoveOp), header.opCount, f) == header.opCount &&
+             fread(plan->strings, 1, header.stringSize, f) == header.stringSize;
+        plan->count = plan->capacity = header.opCount;
+        plan->stringSize = plan->stringCapacity = header.stringSize;
+    }
+    if (ok && (plan->flags & JOURNAL_WRITES_STATE)) {
+        ok = stateRead(f, postState);
+    }
+    fclose(f);
+
+    if (ok) {
+        u32 checksum = fnv1a32(FNV1A_32_INIT, plan->ops, sizeof(MoveOp) * plan->count);
+        ok = fnv1a32(checksum, plan->strings, plan->stringSize) == header.checksum &&
+             plan->stringSize > 0 && plan->strings[plan->stringSize - 1] == '\0';
+    }
+    for (int i = 0; ok && i < plan->count; i++) {
+        ok = plan->ops[i].sourceOffset < plan->stringSize &&
+             plan->ops[i].destOffset < plan->stringSize;
+    }
+
+    if (!ok) {
+        planFree(plan);
+    }
+    return ok;
+}
+
+bool planExecute(MovePlan *plan, MoveStats *stats) {
+    memset(stats, 0, sizeof(MoveStats));
+    if (plan->count == 0) {
+        return true;
+    }
+
+    // Nothing moves until the plan is safely on the card
+    bool journaled;
+    TRACE_SPAN("journal.write", plan->count, journaled = writeJournal(plan));
+    if (!journaled) {
+        reportFailure(plan, JOURNAL_FILE);
+        return false;
+    }
+
+    u64 start = svcGetSystemTick();
+    bool cancelled = false;
+    for (int i = 0; i < plan->count; i++) {
+        if (plan->monitor && plan->monitor->cancel) {
+            cancelled = true;
+            break;
+        }
+
+        TRACE_SPAN("rename", i, plan->done[i] = fsRenameFile(planSource(plan, i), planDest(plan, i)));
+        if (plan->done[i]) {
+            stats->moved++;
+        } else {
+            reportFailure(plan, planSource(plan, i));
+            stats->failed++;
+        }
+
+        if (plan->monitor) {
+            reportProgress(plan, i + 1, svcGetSystemTick() - start, planSource(plan, i));
+        }
+    }
+    stats->ticks = svcGetSystemTick() - start;
+
+    return stats->failed == 0 && !cancelled;
+}
+
+void planRollback(MovePlan *plan) {
+    // The journal is still in place, so a crash here is recovered from it
+    for (int i = plan->count - 1; i >= 0; i--) {
+        if (plan->done[i] && fsRenameFile(planDest(plan, i), planSource(plan, i))) {
+            plan->done[i] = false;
+        }
+    }
+}
+
+void planFinish(void) {
+    TRACE_SPAN("journal.delete", 0, fsDeleteFile(JOURNAL_FILE));
+
+    // One commit for the whole batch, state file and journal included
+    TRACE_SPAN("commit", 0, fsSessionCommit());
+}
+
+bool moveCollection(const char *sourceDir, const char *destDir, const MoveSelection *only,
+                    AppState *manifest, MoveStats *stats, MoveMonitor *monitor) {
+    MovePlan plan;
+    planInit(&plan, JOURNAL_ROLLBACK, JOURNAL_CLEARS_STATE);
+    plan.monitor = monitor;
+    memset(stats, 0, sizeof(MoveStats));
+
+    // An empty plan would "succeed" with nothing in root to launch
+    bool planned = planMoflexFiles(&plan, sourceDir, destDir, only);
+    if (!planned || plan.count == 0) {
+        stats->empty = planned;
+        stateFree(manifest);
+        planFree(&plan);
+        return false;
+    }
+
+    bool success = planExecute(&plan, stats);
+
+    for (int i = 0; success && i < plan.count; i++) {
+        char origin[MOVER_PATH_LEN];
+        strncpy(origin, planSource(&plan, i), MOVER_PATH_LEN - 1);
+        origin[MOVER_PATH_LEN - 1] = '\0';
+        const char *name = splitPath(origin);
+        success = stateAddFile(manifest, origin, name);
+    }
+
+    if (success) {
+        manifest->filesActive = true;
+        saveState(manifest);
+    } else {
+        // Nothing of the half-built manifest may reach a later save
+        planRollback(&plan);
+        stateFree(manifest);
+        success = false;
+    }
+
+    planFinish();
+    planFree(&plan);
+    return success;
+}
+
+bool restoreCollection(AppState *state, const char *rootDir, MoveStats *stats,
+                       MoveMonitor *monitor) {
+    MovePlan plan;
+    planInit(&plan, JOURNAL_REPLAY, JOURNAL_CLEARS_STATE);
+    plan.monitor = monitor;
+    memset(stats, 0, sizeof(MoveStats));
+
+    bool planned = true;
+    if (state->legacy) {
+        // States saved by v1.0 carry no manifest, so sweep root as it used to
+        planned = planMoflexFiles(&plan, rootDir, state->sourceDir, NULL);
+    } else {
+        for (int i = 0; planned && i < state->fileCount; i++) {
+            char sourcePath[MOVER_PATH_LEN];
+            char destPath[MOVER_PATH_LEN];
+            joinPath(sourcePath, rootDir, stateFileName(state, i));
+            joinPath(destPath, stateFileOrigin(state, i), stateFileName(state, i));
+            planned = planAdd(&plan, sourcePath, destPath);
+        }
+    }
+
+    if (!planned) {
+        planFree(&plan);
+        return false;
+    }
+
+    bool success = planExecute(&plan, stats);
+
+    // Keep only what didn't make it, so the next launch retries just those
+    if (!state->legacy) {
+        int remaining = 0;
+        for (int i = 0; i < state->fileCount; i++) {
+            if (!plan.done[i]) {
+                state->files[remaining++] = state->files[i];
+            }
+        }
+        state->fileCount = remaining;
+    }
+
+    if (success) {
+        clearState();
+    } else if (!state->legacy) {
+        saveState(state);
+    }
+
+    planFinish();
+    planFree(&plan);
+    return success;
+}
+
+// Cheap identity check for a same-named file in two collections: equal
+// size and equal first and last few KB.
+static bool sameFile(const char *pathA, const char *pathB) {
+    struct stat stA, stB;
+    if (stat(pathA, &stA) != 0 || stat(pathB, &stB) != 0 || stA.st_size != stB.st_size) {
+        return false;
+    }
+
+    FILE *a = fopen(pathA, "rb");
+    FILE *b = fopen(pathB, "rb");
+    bool same = a && b;
+
+    static u8 bufA[4096], bufB[4096];
+    long offsets[2] = {0, stA.st_size > (off_t)sizeof(bufA) ? (long)(stA.st_size - sizeof(bufA)) : 0};
+    for (int i = 0; same && i < 2; i++) {
+        same = fseek(a, offsets[i], SEEK_SET) == 0 && fseek(b, offsets[i], SEEK_SET) == 0;
+        size_t readA = same ? fread(bufA, 1, sizeof(bufA), a) : 0;
+        size_t readB = same ? fread(bufB, 1, sizeof(bufB), b) : 0;
+        same = same && readA == readB && memcmp(bufA, bufB, readA) == 0;
+    }
+
+    if (a) fclose(a);
+    if (b) fclose(b);
+    return same;
+}
+
+typedef struct {
+    const char *name;
+    int op;
+} NamedOp;
+
+static int compareNamedOps(const void *a, const void *b) {
+    return strcmp(((const NamedOp *)a)->name, ((const NamedOp *)b)->name);
+}
+
+bool swapCollection(AppState *state, const char *sourceDir, const MoveSelection *only,
+                    const char *rootDir, MoveStats *stats, MoveMonitor *monitor) {
+    memset(stats, 0, sizeof(MoveStats));
+
+    // What the new selection needs, sorted so root files can be matched
+    MovePlan incoming;
+    planInit(&incoming, JOURNAL_REPLAY, 0);
+    if (!planMoflexFiles(&incoming, sourceDir, rootDir, only)) {
+        planFree(&incoming);
+        return false;
+    }
+
+    NamedOp *names = (NamedOp *)malloc(sizeof(NamedOp) * (incoming.count + 1));
+    bool *kept = (bool *)calloc(incoming.count + 1, sizeof(bool));
+    if (!names || !kept) {
+        free(names);
+        free(kept);
+        planFree(&incoming);
+        return false;
+    }
+    for (int i = 0; i < incoming.count; i++) {
+        names[i].name = strrchr(planDest(&incoming, i), '/') + 1;
+        names[i].op = i;
+    }
+    qsort(names, incoming.count, sizeof(NamedOp), compareNamedOps);
+
+    AppState next;
+    stateInit(&next);
+    strncpy(next.sourceDir, sourceDir, STATE_PATH_LEN - 1);
+    next.filesActive = true;
+
+    MovePlan plan;
+    planInit(&plan, JOURNAL_REPLAY, JOURNAL_WRITES_STATE);
+    plan.postState = &next;
+    plan.monitor = monitor;
+
+    char rootPath[MOVER_PATH_LEN];
+    char otherPath[MOVER_PATH_LEN];
+    bool ok = true;
+
+    // Outgoing first, so a same-named incoming file never finds its slot taken
+    for (int i = 0; ok && i < state->fileCount; i++) {
+        NamedOp key = {stateFileName(state, i), -1};
+        const char *name = key.name;
+        joinPath(rootPath, rootDir, name);
+
+        // Another volume of the same collection: what both share stays put
+        if (strcmp(stateFileOrigin(state, i), sourceDir) == 0 && moveSelectionHas(only, name)) {
+            ok = stateAddFile(&next, sourceDir, name);
+            continue;
+        }
+
+        const NamedOp *match = (const NamedOp *)bsearch(&key, names, incoming.count,
+                                                        sizeof(NamedOp), compareNamedOps);
+        if (match) {
+            joinPath(otherPath, sourceDir, name);
+            if (sameFile(rootPath, otherPath)) {
+                // Already in root; it still belongs to its old folder
+                kept[match->op] = true;
+                ok = stateAddFile(&next, stateFileOrigin(state, i), name);
+                continue;
+            }
+        }
+
+        joinPath(otherPath, stateFileOrigin(state, i), name);
+        ok = planAdd(&plan, rootPath, otherPath);
+    }
+
+    int firstIncoming = plan.count;
+    for (int i = 0; ok && i < incoming.count; i++) {
+        if (kept[i]) {
+            continue;
+        }
+        ok = planAdd(&plan, planSource(&incoming, i), planDest(&incoming, i));
+    }
+
+    // Build the new manifest up front; the journal carries it so a crash
+    // mid-swap still ends with a state that matches root
+    for (int i = firstIncoming; ok && i < plan.count; i++) {
+        strncpy(otherPath, planSource(&plan, i), MOVER_PATH_LEN - 1);
+        otherPath[MOVER_PATH_LEN - 1] = '\0';
+        const char *name = splitPath(otherPath);
+        ok = stateAddFile(&next, otherPath, name);
+    }
+
+    free(names);
+    free(kept);
+    planFree(&incoming);
+
+    bool success = ok && planExecute(&plan, stats);
+    if (success) {
+        saveState(&next);
+        stateFree(state);
+        *state = next;
+    } else {
+        planRollback(&plan);
+        stateFree(&next);
+    }
+
+    planFinish();
+    planFree(&plan);
+    return success;
+}
+
+bool moveAllMoflex(const char *sourceDir, const char *destDir, MoveStats *stats,
+                   MoveMonitor *monitor) {
+    MovePlan plan;
+    planInit(&plan, JOURNAL_REPLAY, 0);
+    plan.monitor = monitor;
+    memset(stats, 0, sizeof(MoveStats));
+
+    bool success = planMoflexFiles(&plan, sourceDir, destDir, NULL) && planExecute(&plan, stats);
+
+    planFinish();
+    planFree(&plan);
+    return success;
+}
+
+// Builds the state a recovered batch really leaves: the embedded postState
+// (empty unless the journal carries one) without the files that never left
+// their folder, plus the ones stuck in root with the folder each belongs in.
+// A rollback's stuck files couldn't be taken back, a replay's couldn't go
+// home.
+static bool buildLeftState(const MovePlan *plan, const AppState *postState, AppState *left) {
+    // Stuck ops by source path; an incoming file that never moved is still
+    // at its manifest entry's origin
+    NamedOp *stuck = (NamedOp *)malloc(sizeof(NamedOp) * (plan->count + 1));
+    bool *incoming = (bool *)calloc(plan->count + 1, sizeof(bool));
+    bool ok = stuck && incoming;
+    int stuckCount = 0;
+    for (int i = 0; ok && i < plan->count; i++) {
+        if (!plan->done[i]) {
+            stuck[stuckCount].name = planSource(plan, i);
+            stuck[stuckCount].op = i;
+            stuckCount++;
+        }
+    }
+    if (ok) {
+        qsort(stuck, stuckCount, sizeof(NamedOp), compareNamedOps);
+    }
+
+    char path[MOVER_PATH_LEN];
+    for (int i = 0; ok && i < postState->fileCount; i++) {
+        joinPath(path, stateFileOrigin(postState, i), stateFileName(postState, i));
+        NamedOp key = {path, -1};
+        const NamedOp *match = (const NamedOp *)bsearch(&key, stuck, stuckCount,
+                                                        sizeof(NamedOp), compareNamedOps);
+        if (match) {
+            incoming[match->op] = true;
+            continue;
+        }
+        ok = stateAddFile(left, stateFileOrigin(postState, i), stateFileName(postState, i));
+    }
+
+    for (int i = 0; ok && i < stuckCount; i++) {
+        int op = stuck[i].op;
+        if (incoming[op]) {
+            continue;
+        }
+        const char *home = plan->recovery == JOURNAL_ROLLBACK ? planSource(plan, op) : planDest(plan, op);
+        snprintf(path, sizeof(path), "%s", home);
+        const char *name = splitPath(path);
+        ok = stateAddFile(left, path, name);
+    }
+
+    free(stuck);
+    free(incoming);
+    return ok;
+}
+
+bool recoverJournal(void) {
+    MovePlan plan;
+    AppState postState;
+    stateInit(&postState);
+    if (!readJournal(&plan, &postState)) {
+        stateFree(&postState);
+        // A torn journal means the batch never started; just drop it
+        if (pathExists(JOURNAL_FILE)) {
+            planFinish();
+        }
+        return false;
+    }
+
+    // done[i] ends up true once op i's file is where the recovery wants it
+    bool complete = true;
+    for (int i = 0; i < plan.count; i++) {
+        const char *source = planSource(&plan, i);
+        const char *dest = planDest(&plan, i);
+        bool sourceExists = pathExists(source);
+        bool destExists = pathExists(dest);
+
+        if (plan.recovery == JOURNAL_ROLLBACK) {
+            plan.done[i] = sourceExists || !destExists || fsRenameFile(dest, source);
+        } else {
+            plan.done[i] = !sourceExists || (!destExists && fsRenameFile(source, dest));
+        }
+        complete = complete && plan.done[i];
+    }
+
+    if ((plan.flags & JOURNAL_CLEARS_STATE) && complete) {
+        clearState();
+    } else if ((plan.flags & JOURNAL_WRITES_STATE) && complete) {
+        saveState(&postState);
+    } else if (plan.flags & (JOURNAL_CLEARS_STATE | JOURNAL_WRITES_STATE)) {
+        // Like restoreCollection(), keep a state that matches what is in
+        // root, so stuck files go home on a later restore instead of to
+        // OLDMOFLEX. A restore still has its collection in the state file.
+        AppState left;
+        stateInit(&left);
+        bool built = buildLeftState(&plan, &postState, &left);
+        if (built && left.fileCount == 0) {
+            clearState();
+        } else if (built) {
+            AppState onCard;
+            stateInit(&onCard);
+            const char *sourceDir = stateFileOrigin(&left, 0);
+            if (plan.flags & JOURNAL_WRITES_STATE) {
+                sourceDir = postState.sourceDir;
+            } else if (plan.recovery == JOURNAL_REPLAY && loadState(&onCard)) {
+                sourceDir = onCard.sourceDir;
+            }
+            snprintf(left.sourceDir, sizeof(left.sourceDir), "%s", sourceDir);
+            left.filesActive = true;
+            saveState(&left);
+            stateFree(&onCard);
+        }
+        stateFree(&left);
+    }
+
+    planFinish();
+    planFree(&plan);
+    stateFree(&postState);
+    return true;
+}
@@ -0,0 +1,173 @@
+#ifndef MOVER_H
+#define MOVER_H
+
+#include "platform.h"
+
+#include "state.h"
+
+// Journaled move engine.
+//
+// Every batch of renames is planned up front and written to a small journal
+// before the first file moves. The renames then run back to back with a
+// single commit at the end, once the state file is up to date and the
+// journal is gone. If power is lost partway, the next launch finds the
+// journal and either replays or rolls back the batch.
+
+#ifndef JOURNAL_FILE
+#define JOURNAL_FILE    "sdmc:/.clownsec_journal"
+#endif
+#define JOURNAL_MAGIC   0x4E4A4C43 // "CLJN"
+#define JOURNAL_VERSION 1
+#define MOVER_PATH_LEN  512
+
+typedef enum {
+    JOURNAL_ROLLBACK = 0, // undo the renames that happened (move to root)
+    JOURNAL_REPLAY   = 1, // finish the renames that didn't (restore, cleanup)
+} JournalRecovery;
+
+#define JOURNAL_CLEARS_STATE 0x0001 // remove the state file once recovered
+#define JOURNAL_WRITES_STATE 0x0002 // install the embedded state once recovered
+
+typedef struct {
+    u32 sourceOffset; // into the string pool
+    u32 destOffset;
+} MoveOp;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 recovery;
+    u32 flags;
+    u32 opCount;
+    u32 stringSize;
+    u32 checksum;
+} JournalHeader;
+
+// Progress reported by a running batch. Events go through a single-producer,
+// single-consumer ring so the UI thread can drain them each frame without
+// ever blocking the thread doing the renames.
+#define MOVE_QUEUE_SIZE 32 // must be a power of two
+
+typedef enum {
+    MOVE_EVENT_PROGRESS,
+    MOVE_EVENT_FAILED,
+} MoveEventType;
+
+typedef struct {
+    MoveEventType type;
+    int done;
+    int total;
+    u32 filesPerSecond;
+    u32 etaMs;
+    char name[48]; // file just moved, or the one that failed
+} MoveEvent;
+
+typedef struct {
+    MoveEvent events[MOVE_QUEUE_SIZE];
+    u32 head;            // only advanced by the producer
+    u32 tail;            // only advanced by the consumer
+    volatile bool cancel; // set by the UI, polled between renames
+    LightEvent *notify;   // signalled after every event, may be NULL
+} MoveMonitor;
+
+void moveMonitorInit(MoveMonitor *monitor);
+bool moveMonitorPop(MoveMonitor *monitor, MoveEvent *event);
+
+typedef struct {
+    MoveOp *ops;
+    bool *done;
+    int count;
+    int capacity;
+    char *strings;
+    u32 stringSize;
+    u32 stringCapacity;
+    JournalRecovery recovery;
+    u32 flags;
+    const AppState *postState; // embedded when flags has JOURNAL_WRITES_STATE
+    MoveMonitor *monitor;      // NULL to report failures with printf
+} MovePlan;
+
+typedef struct {
+    int moved;
+    int failed;
+    u64 ticks;  // svcGetSystemTick() delta over the whole batch
+    bool empty; // the folder had nothing to move, which counts as a failure
+} MoveStats;
+
+void planInit(MovePlan *plan, JournalRecovery recovery, u32 flags);
+void planFree(MovePlan *plan);
+bool planAdd(MovePlan *plan, const char *sourcePath, const char *destPath);
+
+// Limits a batch to some of a folder's .moflex files, such as one volume of
+// a large collection. Functions taking one move every file when it is NULL.
+typedef struct {
+    const char **names; // sorted by moveSelectionSort()
+    int count;
+} MoveSelection;
+
+void moveSelectionSort(MoveSelection *selection);
+bool moveSelectionHas(const MoveSelection *selection, const char *name);
+
+// Plans a move of every .moflex file in sourceDir, or just the selected
+// ones, into destDir.
+bool planMoflexFiles(MovePlan *plan, const char *sourceDir, const char *destDir,
+                     const MoveSelection *only);
+
+static inline const char *planSource(const MovePlan *plan, int i) {
+    return plan->strings + plan->ops[i].sourceOffset;
+}
+
+static inline const char *planDest(const MovePlan *plan, int i) {
+    return plan->strings + plan->ops[i].destOffset;
+}
+
+// Journals and runs a plan, leaving the journal in place; planFinish()
+// removes it and commits once the caller has updated the state file.
+// Stops early, returning false, if the monitor asks to cancel.
+bool planExecute(MovePlan *plan, MoveStats *stats);
+void planRollback(MovePlan *plan);
+void planFinish(void);
+
+// Moves a collection, or the selected part of it, into destDir, recording every moved file in the
+// manifest and saving it as the active state. If any file fails, the ones
+// that did move are put back, no state is saved and the manifest is
+// cleared. With nothing to move it fails the same way, setting stats->empty.
+bool moveCollection(const char *sourceDir, const char *destDir, const MoveSelection *only,
+                    AppState *manifest, MoveStats *stats, MoveMonitor *monitor);
+
+// Moves the manifest's files from rootDir back to their origin folders and
+// clears the state, or saves just the files that could not be moved back
+// (or were not reached before a cancel).
+bool restoreCollection(AppState *state, const char *rootDir, MoveStats *stats,
+                       MoveMonitor *monitor);
+
+// Replaces the collection in rootDir with the one in sourceDir, or the
+// selected part of it, renaming only what differs: root files that came
+// from sourceDir and are still selected stay, and so do files identical to
+// the new collection's (same name, size and head/tail bytes). Switching
+// between volumes of one collection renames just the two volumes' files.
+// The state is updated in the same journaled step. On failure everything
+// is put back and the state is left untouched.
+bool swapCollection(AppState *state, const char *sourceDir, const MoveSelection *only,
+                    const char *rootDir, MoveStats *stats, MoveMonitor *monitor);
+
+// True if dir directly contains a .moflex file
+bool hasMoflexFiles(const char *dir);
+
+// Moves every .moflex file from sourceDir into destDir, no state involved.
+bool moveAllMoflex(const char *sourceDir, const char *destDir, MoveStats *stats,
+                   MoveMonitor *monitor);
+
+// Completes or undoes a batch interrupted by power loss. Files that can't be
+// put where the recovery wants them stay listed in the state file. Returns
+// true if a journal was found.
+bool recoverJournal(void);
+
+static inline u32 moveFilesPerSecond(const MoveStats *stats) {
+    if (stats->ticks == 0) {
+        return 0;
+    }
+    return (u32)((u64)stats->moved * SYSCLOCK_ARM11 / stats->ticks);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include "moveworker.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+#define MOVE_WORKER_STACK_SIZE (32 * 1024)
+
+static void moveWorkerMain(void *arg) {
+    MoveWorker *worker = (MoveWorker *)arg;
+
+    switch (worker->kind) {
+        case MOVE_JOB_COLLECTION:
+            worker->result = moveCollection(worker->sourceDir, worker->rootDir, worker->only,
+                                            worker->state, &worker->stats, &worker->monitor);
+            break;
+        case MOVE_JOB_SWAP:
+            worker->result = swapCollection(worker->state, worker->sourceDir, worker->only,
+                                            worker->rootDir, &worker->stats, &worker->monitor);
+            break;
+        case MOVE_JOB_RESTORE:
+            worker->result = restoreCollection(worker->state, worker->rootDir,
+                                               &worker->stats, &worker->monitor);
+            break;
+        case MOVE_JOB_SWEEP:
+            // Usually there is nothing to sweep, and the check is one listing
+            worker->result = true;
+            if (hasMoflexFiles(worker->rootDir)) {
+                mkdir(worker->sourceDir, 0777);
+                worker->result = moveAllMoflex(worker->rootDir, worker->sourceDir,
+                                               &worker->stats, &worker->monitor);
+            }
+            break;
+    }
+
+    LightEvent_Signal(&worker->finished);
+    if (worker->monitor.notify) {
+        LightEvent_Signal(worker->monitor.notify);
+    }
+}
+
+void moveWorkerStart(MoveWorker *worker, MoveJobKind kind, AppState *state,
+                     const char *sourceDir, const MoveSelection *only, const char *rootDir,
+                     LightEvent *notify) {
+    memset(worker, 0, sizeof(MoveWorker));
+    LightEvent_Init(&worker->finished, RESET_STICKY);
+    moveMonitorInit(&worker->monitor);
+    worker->monitor.notify = notify;
+
+    worker->kind = kind;
+    worker->state = state;
+    strncpy(worker->sourceDir, sourceDir ? sourceDir : "", MOVER_PATH_LEN - 1);
+    strncpy(worker->rootDir, rootDir, MOVER_PATH_LEN - 1);
+    worker->only = only;
+
+    // Just below the UI thread: the renames run whenever the UI is waiting
+    // for vblank, and a frame never waits on a rename
+    s32 priority = 0x30;
+    svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+    if (priority < 0x3F) {
+        priority++;
+    }
+
+    worker->thread = threadCreate(moveWorkerMain, worker, MOVE_WORKER_STACK_SIZE,
+                                  priority, -2, false);
+    if (!worker->thread) {
+        moveWorkerMain(worker);
+    }
+}
+
+bool moveWorkerJoin(MoveWorker *worker) {
+    LightEvent_Wait(&worker->finished);
+    if (worker->thread) {
+        threadJoin(worker->thread, U64_MAX);
+        threadFree(worker->thread);
+        worker->thread = NULL;
+    }
+    return worker->result;
+}
@@ -0,0 +1,51 @@
+#ifndef MOVEWORKER_H
+#define MOVEWORKER_H
+
+#include "platform.h"
+
+#include "mover.h"
+
+// Runs one move batch on its own thread so the UI can keep drawing
+// progress and offer a cancel while the renames happen.
+
+typedef enum {
+    MOVE_JOB_COLLECTION, // moveCollection(sourceDir -> rootDir) into state
+    MOVE_JOB_SWAP,       // swapCollection(state -> sourceDir)
+    MOVE_JOB_RESTORE,    // restoreCollection(state)
+    MOVE_JOB_SWEEP,      // moveAllMoflex(rootDir -> sourceDir), if root has any
+} MoveJobKind;
+
+typedef struct {
+    Thread thread;
+    LightEvent finished;
+    MoveMonitor monitor;
+
+    MoveJobKind kind;
+    AppState *state; // owned by the worker until moveWorkerJoin()
+    char sourceDir[MOVER_PATH_LEN];
+    char rootDir[MOVER_PATH_LEN];
+    const MoveSelection *only; // NULL for every file; the caller keeps it until moveWorkerJoin()
+
+    MoveStats stats;
+    bool result;
+} MoveWorker;
+
+// Starts the job; if no thread can be created it runs to completion here.
+// notify (may be NULL) is signalled on every progress event and when the
+// job finishes, so the UI can sleep in between.
+void moveWorkerStart(MoveWorker *worker, MoveJobKind kind, AppState *state,
+                     const char *sourceDir, const MoveSelection *only, const char *rootDir,
+                     LightEvent *notify);
+
+static inline bool moveWorkerFinished(MoveWorker *worker) {
+    return LightEvent_TryWait(&worker->finished);
+}
+
+static inline void moveWorkerCancel(MoveWorker *worker) {
+    worker->monitor.cancel = true;
+}
+
+// Waits for the completion signal and releases the thread
+bool moveWorkerJoin(MoveWorker *worker);
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// The few libctru pieces the file-management core relies on.
+//
+// On the console this is just <3ds.h>. Built for a PC (make host) it
+// provides the same types, tick clock, threads and light sync primitives on
+// top of POSIX, so library/state/mover/scanner compile unchanged and can be
+// benchmarked. The UI in main.c stays console-only.
+
+#ifdef __3DS__
+
+#include <3ds.h>
+
+#else
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef int64_t  s64;
+
+typedef s32 Result;
+typedef u32 Handle;
+
+#define BIT(n)           (1U << (n))
+#define R_SUCCEEDED(res) ((res) >= 0)
+#define R_FAILED(res)    ((res) < 0)
+
+#define U64_MAX            UINT64_MAX
+#define CUR_THREAD_HANDLE  0xFFFF8000
+#define SYSCLOCK_ARM11     268111856ULL
+#define CPU_TICKS_PER_MSEC (SYSCLOCK_ARM11 / 1000.0)
+
+u64 svcGetSystemTick(void);
+void svcSleepThread(s64 ns);
+Result svcGetThreadPriority(s32 *out, Handle handle);
+Result svcGetThreadId(u32 *out, Handle handle);
+
+typedef struct HostThread *Thread;
+typedef void (*ThreadFunc)(void *);
+
+// Priority and core are accepted for the same call sites and ignored
+Thread threadCreate(ThreadFunc entrypoint, void *arg, size_t stackSize, int prio, int coreId,
+                    bool detached);
+Result threadJoin(Thread thread, u64 timeoutNs);
+void threadFree(Thread thread);
+
+typedef s32 LightLock;
+
+void LightLock_Init(LightLock *lock);
+void LightLock_Lock(LightLock *lock);
+void LightLock_Unlock(LightLock *lock);
+
+typedef enum {
+    RESET_ONESHOT = 0,
+    RESET_STICKY  = 1,
+    RESET_PULSE   = 2,
+} ResetType;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool signalled;
+    ResetType type;
+} LightEvent;
+
+void LightEvent_Init(LightEvent *event, ResetType type);
+void LightEvent_Clear(LightEvent *event);
+void LightEvent_Signal(LightEvent *event);
+int LightEvent_TryWait(LightEvent *event);
+void LightEvent_Wait(LightEvent *event);
+
+// Simulated SD card for benchmarks: every FS request made by the host
+// shims in fsdir.c and fssession.c is counted and then delayed by
+// hostFsLatencyUs, like one IPC round trip to the FS service.
+extern u32 hostFsLatencyUs;
+extern u64 hostFsOps;
+extern bool hostFsSerial; // requests wait for each other, like one card
+void hostFsRequest(void);
+
+#endif
+
+#include <string.h>
+
+// Overwrites *dst with *src, except for the LightLock at lockOffset. The
+// caller holds that lock, and threads waiting on it are recorded in its
+// word, so the word must stay as it is. Use lockedReplace() below.
+static inline void lockedReplaceBytes(void *dst, const void *src, size_t size, size_t lockOffset) {
+    size_t after = lockOffset + sizeof(LightLock);
+    memcpy(dst, src, lockOffset);
+    memcpy((u8 *)dst + after, (const u8 *)src + after, size - after);
+}
+
+// Swaps in a rebuilt copy of a struct guarded by its own lock member
+#define lockedReplace(dst, src, lockMember) \
+    lockedReplaceBytes((dst), (src), sizeof(*(dst)), offsetof(__typeof__(*(dst)), lockMember))
+
+#endif
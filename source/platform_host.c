@@ -0,0 +1,155 @@
+#ifndef __3DS__
+
+#include "platform.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+u32 hostFsLatencyUs = 0;
+u64 hostFsOps = 0;
+bool hostFsSerial = false;
+
+static pthread_mutex_t hostFsCard = PTHREAD_MUTEX_INITIALIZER;
+
+u64 svcGetSystemTick(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * SYSCLOCK_ARM11 + (u64)now.tv_nsec * SYSCLOCK_ARM11 / 1000000000ULL;
+}
+
+void svcSleepThread(s64 ns) {
+    struct timespec delay = {ns / 1000000000LL, ns % 1000000000LL};
+    nanosleep(&delay, NULL);
+}
+
+Result svcGetThreadPriority(s32 *out, Handle handle) {
+    (void)handle;
+    *out = 0x30;
+    return 0;
+}
+
+Result svcGetThreadId(u32 *out, Handle handle) {
+    (void)handle;
+    *out = (u32)syscall(SYS_gettid);
+    return 0;
+}
+
+void hostFsRequest(void) {
+    __atomic_add_fetch(&hostFsOps, 1, __ATOMIC_RELAXED);
+    if (hostFsLatencyUs && hostFsSerial) {
+        pthread_mutex_lock(&hostFsCard);
+        svcSleepThread((s64)hostFsLatencyUs * 1000);
+        pthread_mutex_unlock(&hostFsCard);
+    } else if (hostFsLatencyUs) {
+        svcSleepThread((s64)hostFsLatencyUs * 1000);
+    }
+}
+
+struct HostThread {
+    pthread_t handle;
+    ThreadFunc entrypoint;
+    void *arg;
+};
+
+static void *threadMain(void *arg) {
+    struct HostThread *thread = (struct HostThread *)arg;
+    thread->entrypoint(thread->arg);
+    return NULL;
+}
+
+Thread threadCreate(ThreadFunc entrypoint, void *arg, size_t stackSize, int prio, int coreId,
+                    bool detached) {
+    (void)stackSize;
+    (void)prio;
+    (void)coreId;
+
+    struct HostThread *thread = (struct HostThread *)malloc(sizeof(struct HostThread));
+    if (!thread) {
+        return NULL;
+    }
+    thread->entrypoint = entrypoint;
+    thread->arg = arg;
+    if (pthread_create(&thread->handle, NULL, threadMain, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+    if (detached) {
+        pthread_detach(thread->handle);
+    }
+    return thread;
+}
+
+Result threadJoin(Thread thread, u64 timeoutNs) {
+    (void)timeoutNs;
+    return pthread_join(thread->handle, NULL) == 0 ? 0 : -1;
+}
+
+void threadFree(Thread thread) {
+    free(thread);
+}
+
+void LightLock_Init(LightLock *lock) {
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+void LightLock_Lock(LightLock *lock) {
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+}
+
+void LightLock_Unlock(LightLock *lock) {
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+void LightEvent_Init(LightEvent *event, ResetType type) {
+    pthread_mutex_init(&event->mutex, NULL);
+    pthread_cond_init(&event->cond, NULL);
+    event->signalled = false;
+    event->type = type;
+}
+
+void LightEvent_Clear(LightEvent *event) {
+    pthread_mutex_lock(&event->mutex);
+    event->signalled = false;
+    pthread_mutex_unlock(&event->mutex);
+}
+
+void LightEvent_Signal(LightEvent *event) {
+    pthread_mutex_lock(&event->mutex);
+    if (event->type != RESET_PULSE) {
+        event->signalled = true;
+    }
+    pthread_cond_broadcast(&event->cond);
+    pthread_mutex_unlock(&event->mutex);
+}
+
+int LightEvent_TryWait(LightEvent *event) {
+    pthread_mutex_lock(&event->mutex);
+    int signalled = event->signalled;
+    if (signalled && event->type == RESET_ONESHOT) {
+        event->signalled = false;
+    }
+    pthread_mutex_unlock(&event->mutex);
+    return signalled;
+}
+
+void LightEvent_Wait(LightEvent *event) {
+    pthread_mutex_lock(&event->mutex);
+    if (event->type == RESET_PULSE) {
+        pthread_cond_wait(&event->cond, &event->mutex);
+    } else {
+        while (!event->signalled) {
+            pthread_cond_wait(&event->cond, &event->mutex);
+        }
+        if (event->type == RESET_ONESHOT) {
+            event->signalled = false;
+        }
+    }
+    pthread_mutex_unlock(&event->mutex);
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include "recents.h"
+#include "hash.h"
+#include "library.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static u32 entriesChecksum(const RecentsList *list) {
+    return fnv1a32(FNV1A_32_INIT, list->entries, sizeof(RecentEntry) * list->count);
+}
+
+static int favoriteCount(const RecentsList *list) {
+    int count = 0;
+    while (count < list->count && (list->entries[count].flags & RECENT_FAVORITE)) {
+        count++;
+    }
+    return count;
+}
+
+// Takes entry i out, closing the gap
+static RecentEntry takeEntry(RecentsList *list, int i) {
+    RecentEntry entry = list->entries[i];
+    memmove(&list->entries[i], &list->entries[i + 1], sizeof(RecentEntry) * (list->count - i - 1));
+    list->count--;
+    return entry;
+}
+
+// Puts an entry at the front of its group; there is room
+static int placeEntry(RecentsList *list, const RecentEntry *entry) {
+    int at = (entry->flags & RECENT_FAVORITE) ? 0 : favoriteCount(list);
+    memmove(&list->entries[at + 1], &list->entries[at], sizeof(RecentEntry) * (list->count - at));
+    list->entries[at] = *entry;
+    list->count++;
+    list->dirty = true;
+    return at;
+}
+
+void recentsInit(RecentsList *list) {
+    memset(list, 0, sizeof(RecentsList));
+}
+
+bool recentsLoad(RecentsList *list, const char *file) {
+    recentsInit(list);
+    FILE *f = fopen(file, "rb");
+    if (!f) {
+        return false;
+    }
+    RecentsFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == RECENTS_MAGIC &&
+              header.version == RECENTS_VERSION && header.count <= RECENTS_MAX;
+    if (ok) {
+        list->count = (int)header.count;
+        ok = fread(list->entries, sizeof(RecentEntry), list->count, f) == (size_t)list->count &&
+             entriesChecksum(list) == header.checksum;
+    }
+    fclose(f);
+
+    for (int i = 0; ok && i < list->count; i++) {
+        list->entries[i].path[RECENTS_PATH_LEN - 1] = '\0';
+    }
+    if (!ok) {
+        recentsInit(list);
+    }
+    return ok;
+}
+
+bool recentsSave(RecentsList *list, const char *file) {
+    RecentsFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RECENTS_MAGIC;
+    header.version = RECENTS_VERSION;
+    header.count = (u32)list->count;
+    header.checksum = entriesChecksum(list);
+
+    FILE *f = fopen(file, "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(list->entries, sizeof(RecentEntry), list->count, f) == (size_t)list->count;
+    ok = fclose(f) == 0 && ok;
+    if (ok) {
+        list->dirty = false;
+    }
+    return ok;
+}
+
+int recentsFind(const RecentsList *list, const char *path) {
+    for (int i = 0; i < list->count; i++) {
+        if (strcmp(list->entries[i].path, path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int recentsRecord(RecentsList *list, const char *path, int moflexCount, int volume,
+                  const u32 *homeFingerprint, u32 movedFingerprint) {
+    RecentEntry entry;
+    int i = recentsFind(list, path);
+    if (i >= 0) {
+        entry = takeEntry(list, i);
+    } else {
+        memset(&entry, 0, sizeof(entry));
+        snprintf(entry.path, sizeof(entry.path), "%s", path);
+
+        // Make room by dropping the oldest non-favorite
+        if (list->count == RECENTS_MAX) {
+            if (favoriteCount(list) == RECENTS_MAX) {
+                return -1;
+            }
+            list->count--;
+        }
+    }
+
+    entry.moflexCount = moflexCount;
+    entry.volume = volume;
+    if (homeFingerprint) {
+        entry.homeFingerprint = *homeFingerprint;
+        entry.flags |= RECENT_HOME;
+    }
+    entry.movedFingerprint = movedFingerprint;
+    entry.flags |= RECENT_MOVED;
+    entry.launches++;
+    return placeEntry(list, &entry);
+}
+
+int recentsToggleFavorite(RecentsList *list, int i) {
+    RecentEntry entry = takeEntry(list, i);
+    entry.flags ^= RECENT_FAVORITE;
+    return placeEntry(list, &entry);
+}
+
+void recentsRemove(RecentsList *list, int i) {
+    takeEntry(list, i);
+    list->dirty = true;
+}
+
+bool recentsCheck(const RecentEntry *entry, bool inRoot) {
+    u32 flag = inRoot ? RECENT_MOVED : RECENT_HOME;
+    u32 known = inRoot ? entry->movedFingerprint : entry->homeFingerprint;
+    if (!(entry->flags & flag)) {
+        return false;
+    }
+
+    // Only the fingerprint is wanted, so the child list is never built
+    LibraryScan scan;
+    bool ok;
+    TRACE_SPAN("recents.check", inRoot, ok = libraryScan(entry->path, &known, &scan));
+    ok = ok && scan.fingerprint == known;
+    libraryScanFree(&scan);
+    return ok;
+}
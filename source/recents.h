@@ -0,0 +1,78 @@
+#ifndef RECENTS_H
+#define RECENTS_H
+
+#include "platform.h"
+
+// Collections launched lately, and the ones pinned as favorites, for the
+// screen the app opens on.
+//
+// Each entry keeps what the browser would otherwise have to work out again:
+// the folder, its movie count, the volume picked and the folder's
+// fingerprint (see library.h). Relaunching one costs a single directory
+// pass; if the fingerprint still matches, nothing in the folder changed and
+// the move can start right away.
+//
+// A folder has a different fingerprint while its movies sit in the SD root,
+// so both are kept: one taken while the folder held all its files, one
+// taken after the last move out of it.
+//
+// Favorites come first, then the rest from most recently launched. Only
+// non-favorites are dropped to make room.
+
+#define RECENTS_FILE     "sdmc:/.clownsec_recents"
+#define RECENTS_MAGIC    0x43524C43 // "CLRC"
+#define RECENTS_VERSION  1
+#define RECENTS_MAX      8
+#define RECENTS_PATH_LEN 512
+
+#define RECENT_FAVORITE 0x0001
+#define RECENT_HOME     0x0002 // homeFingerprint is valid
+#define RECENT_MOVED    0x0004 // movedFingerprint is valid
+
+typedef struct {
+    char path[RECENTS_PATH_LEN];
+    s32 moflexCount;      // folder and root together, as the browser shows it
+    s32 volume;           // picked last time, -1 for the whole collection
+    u32 homeFingerprint;  // all files in the folder
+    u32 movedFingerprint; // after the last move to root
+    u32 flags;
+    u32 launches;
+} RecentEntry;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 count;
+    u32 checksum; // FNV-1a over the entries
+} RecentsFileHeader;
+
+typedef struct {
+    RecentEntry entries[RECENTS_MAX];
+    int count;
+    bool dirty;
+} RecentsList;
+
+void recentsInit(RecentsList *list);
+bool recentsLoad(RecentsList *list, const char *file);
+bool recentsSave(RecentsList *list, const char *file);
+
+// Index of the entry for path, or -1
+int recentsFind(const RecentsList *list, const char *path);
+
+// Records a launch of path and moves it to the front of its group.
+// homeFingerprint is NULL when the folder was not whole at the time, in
+// which case the one already recorded is kept. Returns the entry's index,
+// or -1 when every slot is a favorite.
+int recentsRecord(RecentsList *list, const char *path, int moflexCount, int volume,
+                  const u32 *homeFingerprint, u32 movedFingerprint);
+
+// Pins or unpins an entry. Returns its new index.
+int recentsToggleFavorite(RecentsList *list, int i);
+void recentsRemove(RecentsList *list, int i);
+
+// One directory pass over the entry's folder, compared against the
+// fingerprint for where its files are now. False if the folder changed,
+// is gone or that fingerprint was never taken.
+bool recentsCheck(const RecentEntry *entry, bool inRoot);
+
+#endif
@@ -0,0 +1,217 @@
+#include "scanner.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define SCANNER_STACK_SIZE (16 * 1024)
+#define SCANNER_PRIORITY   0x3F // lowest; only runs while everything else waits
+#define SCANNER_PATH_LEN   512
+#define SCANNER_BATCH      (JOBS_MAX_WORKERS + 1) // the workers and this thread
+
+typedef struct {
+    Scanner *scanner;
+    char path[SCANNER_PATH_LEN];
+} ScanJob;
+
+// Copies the current request if it changed since we last looked. Returns
+// false if there is none.
+static bool takeRequest(Scanner *scanner, char **work, size_t *workCapacity, size_t *workSize,
+                        u32 *generation) {
+    bool ok = true;
+
+    LightLock_Lock(&scanner->lock);
+    if (scanner->generation != *generation) {
+        if (scanner->requestSize > *workCapacity) {
+            char *grown = (char *)realloc(*work, scanner->requestSize);
+            if (grown) {
+                *work = grown;
+                *workCapacity = scanner->requestSize;
+            }
+        }
+        if (scanner->requestSize <= *workCapacity) {
+            memcpy(*work, scanner->request, scanner->requestSize);
+            *workSize = scanner->requestSize;
+        } else {
+            ok = false;
+        }
+        *generation = scanner->generation;
+    }
+    LightLock_Unlock(&scanner->lock);
+
+    return ok && *workSize > 0;
+}
+
+// Scans one folder and stores its count unless it was already checked
+static void scanFolder(Scanner *scanner, const char *path) {
+    LibraryIndex *lib = scanner->library;
+
+    u32 known = 0;
+    bool haveKnown = false;
+    libraryLock(lib);
+    int node = libraryFind(lib, path);
+    if (node >= 0) {
+        if (lib->nodes[node].flags & LIBRARY_NODE_FRESH) {
+            libraryUnlock(lib);
+            return;
+        }
+        if (lib->nodes[node].flags & LIBRARY_NODE_SCANNED) {
+            known = lib->nodes[node].fingerprint;
+            haveKnown = true;
+        }
+    }
+    libraryUnlock(lib);
+
+    LibraryScan scan;
+    if (libraryScan(path, haveKnown ? &known : NULL, &scan)) {
+        libraryLock(lib);
+        libraryApply(lib, path, &scan, NULL);
+        libraryUnlock(lib);
+    }
+    libraryScanFree(&scan);
+
+    // Count failures too, so the UI notices a folder that vanished
+    __atomic_add_fetch(&scanner->completed, 1, __ATOMIC_RELEASE);
+    if (scanner->notify) {
+        LightEvent_Signal(scanner->notify);
+    }
+}
+
+static void scanJob(void *arg) {
+    ScanJob *job = (ScanJob *)arg;
+    TRACE_SPAN("scanner.folder", 0, scanFolder(job->scanner, job->path));
+}
+
+static void scannerMain(void *arg) {
+    Scanner *scanner = (Scanner *)arg;
+
+    char *work = NULL;
+    size_t workCapacity = 0;
+    size_t workSize = 0;
+    size_t position = 0;
+    u32 generation = 0;
+    ScanJob *batch = (ScanJob *)malloc(sizeof(ScanJob) * SCANNER_BATCH);
+    if (!batch) {
+        return;
+    }
+    int batchSize = scanner->jobs ? scanner->jobs->workerCount + 1 : 1;
+    JobGroup group;
+
+    while (!scanner->quit) {
+        u32 before = generation;
+        if (!takeRequest(scanner, &work, &workCapacity, &workSize, &generation)) {
+            LightEvent_Wait(&scanner->wake);
+            continue;
+        }
+        if (generation != before) {
+            position = strlen(work) + 1; // names start after the directory
+            u32 names = 0;
+            for (size_t i = position; i < workSize; i++) {
+                names += work[i] == '\0';
+            }
+            __atomic_store_n(&scanner->pending, names, __ATOMIC_RELAXED);
+        }
+        if (position >= workSize) {
+            LightEvent_Wait(&scanner->wake);
+            continue;
+        }
+        if (scanner->paused) {
+            svcSleepThread(10000000LL); // 10ms
+            continue;
+        }
+
+        // Nearest the cursor first, a batch at a time
+        u64 start = svcGetSystemTick();
+        jobGroupInit(&group);
+        for (int i = 0; i < batchSize && position < workSize; i++) {
+            const char *name = work + position;
+            position += strlen(name) + 1;
+            __atomic_sub_fetch(&scanner->pending, 1, __ATOMIC_RELAXED);
+
+            ScanJob *job = &batch[i];
+            int written = snprintf(job->path, sizeof(job->path), "%s%s", work, name);
+            if (written > 0 && written < (int)sizeof(job->path)) {
+                job->scanner = scanner;
+                jobSubmit(scanner->jobs, &group, scanJob, job);
+            }
+        }
+        jobGroupWait(scanner->jobs, &group);
+        __atomic_add_fetch(&scanner->busyTicks, svcGetSystemTick() - start, __ATOMIC_RELAXED);
+    }
+
+    free(batch);
+    free(work);
+}
+
+bool scannerStart(Scanner *scanner, LibraryIndex *library, JobPool *jobs, LightEvent *notify) {
+    memset(scanner, 0, sizeof(Scanner));
+    LightEvent_Init(&scanner->wake, RESET_ONESHOT);
+    LightLock_Init(&scanner->lock);
+    scanner->library = library;
+    scanner->jobs = jobs;
+    scanner->notify = notify;
+
+    // Pinned to the app core next to the UI, which it never preempts
+    scanner->thread = threadCreate(scannerMain, scanner, SCANNER_STACK_SIZE,
+                                   SCANNER_PRIORITY, -2, false);
+    return scanner->thread != NULL;
+}
+
+void scannerStop(Scanner *scanner) {
+    if (!scanner->thread) {
+        return;
+    }
+
+    scanner->quit = true;
+    LightEvent_Signal(&scanner->wake);
+    threadJoin(scanner->thread, U64_MAX);
+    threadFree(scanner->thread);
+    scanner->thread = NULL;
+
+    free(scanner->request);
+    scanner->request = NULL;
+    scanner->requestSize = 0;
+    scanner->requestCapacity = 0;
+}
+
+void scannerRequest(Scanner *scanner, const char *dirPath, const char *const *names, int count) {
+    if (!scanner->thread) {
+        return;
+    }
+
+    size_t needed = strlen(dirPath) + 1;
+    for (int i = 0; i < count; i++) {
+        needed += strlen(names[i]) + 1;
+    }
+
+    LightLock_Lock(&scanner->lock);
+    if (needed > scanner->requestCapacity) {
+        size_t capacity = scanner->requestCapacity ? scanner->requestCapacity : 1024;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        char *grown = (char *)realloc(scanner->request, capacity);
+        if (!grown) {
+            LightLock_Unlock(&scanner->lock);
+            return;
+        }
+        scanner->request = grown;
+        scanner->requestCapacity = capacity;
+    }
+
+    size_t size = 0;
+    size_t len = strlen(dirPath) + 1;
+    memcpy(scanner->request, dirPath, len);
+    size += len;
+    for (int i = 0; i < count; i++) {
+        len = strlen(names[i]) + 1;
+        memcpy(scanner->request + size, names[i], len);
+        size += len;
+    }
+    scanner->requestSize = size;
+    scanner->generation++;
+    LightLock_Unlock(&scanner->lock);
+
+    LightEvent_Signal(&scanner->wake);
+}
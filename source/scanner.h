@@ -0,0 +1,65 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include "platform.h"
+
+#include "library.h"
+#include "jobs.h"
+
+// Low-priority thread that fills in moflex counts for the folders on screen.
+//
+// The browser hands it a directory and the entry names it wants counted,
+// nearest to the cursor first. Each folder is scanned outside the library
+// lock and stored with libraryApply(), then marked fresh so it isn't looked
+// at again this session. A new request replaces the old one.
+//
+// With a job pool, the next few names are scanned at once: one job per
+// folder, as many as there are workers plus this thread, which runs jobs
+// while it waits. The request is checked again between batches.
+
+typedef struct {
+    Thread thread;
+    LightEvent wake;       // one-shot, signalled on a new request or stop
+    LightLock lock;        // guards the request below
+    LibraryIndex *library;
+    JobPool *jobs;         // may be NULL, then folders are scanned one by one here
+    LightEvent *notify;    // signalled whenever a count was stored, may be NULL
+
+    char *request;         // directory path, then entry names, each '\0'-terminated
+    size_t requestSize;
+    size_t requestCapacity;
+    u32 generation;        // bumped on every request
+
+    volatile bool paused;  // set while a move batch owns the SD card
+    volatile bool quit;
+    u32 completed;         // folders stored so far, read with scannerCompleted()
+    u32 pending;           // names left in the current request
+    u64 busyTicks;         // time spent scanning, for throughput
+} Scanner;
+
+bool scannerStart(Scanner *scanner, LibraryIndex *library, JobPool *jobs, LightEvent *notify);
+void scannerStop(Scanner *scanner);
+
+// Replaces the pending work with the given entries of dirPath
+void scannerRequest(Scanner *scanner, const char *dirPath, const char *const *names, int count);
+
+static inline void scannerPause(Scanner *scanner, bool paused) {
+    scanner->paused = paused;
+}
+
+// Changes whenever a count was stored; the UI polls it to know when to redraw
+static inline u32 scannerCompleted(Scanner *scanner) {
+    return __atomic_load_n(&scanner->completed, __ATOMIC_ACQUIRE);
+}
+
+static inline u32 scannerPending(Scanner *scanner) {
+    return __atomic_load_n(&scanner->pending, __ATOMIC_RELAXED);
+}
+
+// Folders stored per second of scanning, 0 before the first one
+static inline u32 scannerFoldersPerSecond(Scanner *scanner) {
+    u64 busy = __atomic_load_n(&scanner->busyTicks, __ATOMIC_RELAXED);
+    return busy ? (u32)((u64)scannerCompleted(scanner) * SYSCLOCK_ARM11 / busy) : 0;
+}
+
+#endif
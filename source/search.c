@@ -0,0 +1,621 @@
+#include "search.h"
+#include "array.h"
+#include "hash.h"
+#include "fsdir.h"
+#include "library.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define SEARCH_STACK_SIZE (32 * 1024)
+#define SEARCH_PRIORITY   0x3F // lowest, next to the scanner
+
+// Folded text: ASCII letters in lower case, everything else as it is
+static u8 foldByte(u8 c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Words are runs of letters and digits; UTF-8 bytes count as letters
+static bool isWordByte(u8 c) {
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+static bool isWordStart(const u8 *text, size_t i) {
+    return isWordByte(text[i]) && (i == 0 || !isWordByte(text[i - 1]));
+}
+
+// Items and their query stamps grow together
+static bool reserveItems(SearchIndex *index, int needed) {
+    int capacity = index->itemCapacity;
+    if (!arrayReserve((void **)&index->items, &capacity, needed, sizeof(SearchItem), 256)) {
+        return false;
+    }
+    if (capacity != index->itemCapacity) {
+        u32 *stamps = (u32 *)realloc(index->stamps, sizeof(u32) * capacity);
+        if (!stamps) {
+            return false;
+        }
+        memset(stamps + index->itemCapacity, 0, sizeof(u32) * (capacity - index->itemCapacity));
+        index->stamps = stamps;
+        index->itemCapacity = capacity;
+    }
+    return true;
+}
+
+static int addFolder(SearchIndex *index, const char *path, size_t len) {
+    int f = folderTableAdd(&index->table, path, len, index->itemCount);
+    index->dirty |= f >= 0;
+    return f;
+}
+
+// Appends an item with its folded copy and queues its word starts
+static bool addItem(SearchIndex *index, int folder, const char *name, u16 flags) {
+    size_t len = strlen(name);
+    size_t foldLength = len;
+    if (!(flags & SEARCH_ITEM_FOLDER) && isMoflexFile(name)) {
+        foldLength -= 7; // ".moflex" would match every file
+    }
+    if (len > 0xFFFF || !reserveItems(index, index->itemCount + 1) ||
+        !folderTableReserveStrings(&index->table, index->table.stringSize + len + foldLength + 2)) {
+        return false;
+    }
+
+    u32 offset = index->table.stringSize;
+    u32 foldOffset = offset + len + 1;
+    memcpy(index->table.strings + offset, name, len + 1);
+    u8 *folded = (u8 *)index->table.strings + foldOffset;
+    for (size_t i = 0; i < foldLength; i++) {
+        folded[i] = foldByte((u8)name[i]);
+    }
+    folded[foldLength] = '\0';
+
+    int words = 0;
+    for (size_t i = 0; i < foldLength; i++) {
+        words += isWordStart(folded, i);
+    }
+    if (!arrayReserve((void **)&index->tail, &index->tailCapacity, index->tailCount + words,
+                      sizeof(SearchWord), 1024)) {
+        return false;
+    }
+    for (size_t i = 0; i < foldLength; i++) {
+        if (isWordStart(folded, i)) {
+            index->tail[index->tailCount].keyOffset = foldOffset + (u32)i;
+            index->tail[index->tailCount].item = index->itemCount;
+            index->tailCount++;
+        }
+    }
+
+    index->table.stringSize = foldOffset + foldLength + 1;
+    SearchItem *item = &index->items[index->itemCount];
+    item->nameOffset = offset;
+    item->nameLength = (u16)len;
+    item->flags = flags;
+    item->folder = folder;
+    index->stamps[index->itemCount] = 0;
+    __atomic_store_n(&index->itemCount, index->itemCount + 1, __ATOMIC_RELAXED);
+    index->dirty = true;
+    return true;
+}
+
+// qsort has no context argument; only the thread that changes an index sorts
+static const char *sortStrings;
+
+static int compareWords(const void *a, const void *b) {
+    const SearchWord *x = (const SearchWord *)a;
+    const SearchWord *y = (const SearchWord *)b;
+    int result = strcmp(sortStrings + x->keyOffset, sortStrings + y->keyOffset);
+    return result != 0 ? result : x->item - y->item;
+}
+
+// Sorts the tail into the word table. The merge runs outside the lock, only
+// the swap of the tables happens under it.
+static bool mergeTail(SearchIndex *index) {
+    int tailCount = index->tailCount;
+    if (tailCount == 0) {
+        return true;
+    }
+
+    SearchWord *sorted = (SearchWord *)malloc(sizeof(SearchWord) * tailCount);
+    SearchWord *merged = (SearchWord *)malloc(sizeof(SearchWord) * (index->wordCount + tailCount));
+    if (!sorted || !merged) {
+        free(sorted);
+        free(merged);
+        return false;
+    }
+    memcpy(sorted, index->tail, sizeof(SearchWord) * tailCount);
+    sortStrings = index->table.strings;
+    qsort(sorted, tailCount, sizeof(SearchWord), compareWords);
+
+    int i = 0, j = 0, k = 0;
+    while (i < index->wordCount && j < tailCount) {
+        if (compareWords(&index->words[i], &sorted[j]) <= 0) {
+            merged[k++] = index->words[i++];
+        } else {
+            merged[k++] = sorted[j++];
+        }
+    }
+    while (i < index->wordCount) {
+        merged[k++] = index->words[i++];
+    }
+    while (j < tailCount) {
+        merged[k++] = sorted[j++];
+    }
+    free(sorted);
+
+    LightLock_Lock(&index->lock);
+    SearchWord *old = index->words;
+    index->words = merged;
+    index->wordCount = k;
+    index->wordCapacity = k;
+    index->tailCount = 0;
+    LightLock_Unlock(&index->lock);
+
+    free(old);
+    return true;
+}
+
+void searchInit(SearchIndex *index, const char *basePath) {
+    memset(index, 0, sizeof(SearchIndex));
+    LightLock_Init(&index->lock);
+    snprintf(index->basePath, sizeof(index->basePath), "%s", basePath);
+}
+
+void searchFree(SearchIndex *index) {
+    folderTableFree(&index->table);
+    free(index->items);
+    free(index->words);
+    free(index->tail);
+    free(index->stamps);
+    index->items = NULL;
+    index->words = NULL;
+    index->tail = NULL;
+    index->stamps = NULL;
+    index->itemCount = index->itemCapacity = 0;
+    index->wordCount = index->wordCapacity = 0;
+    index->tailCount = index->tailCapacity = 0;
+    index->stamp = 0;
+    index->dirty = false;
+}
+
+// --- queries ---------------------------------------------------------------
+
+static bool hasWordPrefix(const char *text, const char *word, size_t len) {
+    const u8 *t = (const u8 *)text;
+    for (size_t i = 0; t[i]; i++) {
+        if (isWordStart(t, i) && strncmp(text + i, word, len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    const char *text;
+    size_t length;
+} QueryWord;
+
+// Adds item to the results if it matches every query word and isn't there yet
+static bool considerItem(SearchIndex *index, s32 item, const QueryWord *words, int wordCount,
+                         SearchResult *result) {
+    const SearchItem *it = &index->items[item];
+    if ((it->flags & SEARCH_ITEM_DEAD) || index->stamps[item] == index->stamp) {
+        return false;
+    }
+    index->stamps[item] = index->stamp;
+
+    const char *folded = index->table.strings + it->nameOffset + it->nameLength + 1;
+    for (int w = 0; w < wordCount; w++) {
+        if (!hasWordPrefix(folded, words[w].text, words[w].length)) {
+            return false;
+        }
+    }
+
+    snprintf(result->name, sizeof(result->name), "%s", index->table.strings + it->nameOffset);
+    snprintf(result->folder, sizeof(result->folder), "%s", folderTablePath(&index->table, it->folder));
+    result->isFolder = (it->flags & SEARCH_ITEM_FOLDER) != 0;
+    return true;
+}
+
+// First table entry whose text starts with the word (or, with after, the
+// first one past those)
+static int wordBound(const SearchIndex *index, const QueryWord *word, bool after) {
+    int lo = 0, hi = index->wordCount;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int order = strncmp(index->table.strings + index->words[mid].keyOffset, word->text, word->length);
+        if (order < 0 || (after && order == 0)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int searchQuery(SearchIndex *index, const char *query, SearchResult *results, int maxResults) {
+    char folded[SEARCH_QUERY_LEN];
+    size_t len = 0;
+    for (; query[len] && len < sizeof(folded) - 1; len++) {
+        folded[len] = (char)foldByte((u8)query[len]);
+    }
+    folded[len] = '\0';
+
+    // Split into words
+    QueryWord words[SEARCH_MAX_WORDS];
+    int wordCount = 0;
+    for (size_t i = 0; i < len && wordCount < SEARCH_MAX_WORDS; i++) {
+        if (!isWordStart((const u8 *)folded, i)) {
+            continue;
+        }
+        size_t end = i;
+        while (end < len && isWordByte((u8)folded[end])) {
+            end++;
+        }
+        words[wordCount].text = folded + i;
+        words[wordCount].length = end - i;
+        wordCount++;
+    }
+    if (wordCount == 0 || maxResults <= 0) {
+        return 0;
+    }
+
+    int count = 0;
+    LightLock_Lock(&index->lock);
+    if (++index->stamp == 0) {
+        memset(index->stamps, 0, sizeof(u32) * index->itemCapacity);
+        index->stamp = 1;
+    }
+
+    // Walk the word with the fewest table entries; the others only filter
+    int first = 0, last = 0, probe = -1;
+    for (int w = 0; w < wordCount; w++) {
+        int lo = wordBound(index, &words[w], false);
+        int hi = wordBound(index, &words[w], true);
+        if (probe < 0 || hi - lo < last - first) {
+            first = lo;
+            last = hi;
+            probe = w;
+        }
+    }
+    const char *key = words[probe].text;
+    size_t keyLength = words[probe].length;
+
+    for (int i = first; i < last && count < maxResults; i++) {
+        count += considerItem(index, index->words[i].item, words, wordCount, &results[count]);
+    }
+
+    // Words stored since the last merge
+    for (int i = 0; i < index->tailCount && count < maxResults; i++) {
+        if (strncmp(index->table.strings + index->tail[i].keyOffset, key, keyLength) == 0) {
+            count += considerItem(index, index->tail[i].item, words, wordCount, &results[count]);
+        }
+    }
+    LightLock_Unlock(&index->lock);
+
+    return count;
+}
+
+// --- persistence -----------------------------------------------------------
+
+bool searchLoad(SearchIndex *index, const char *file) {
+    size_t size;
+    u8 *buffer = indexFileRead(file, sizeof(SearchFileHeader), &size);
+    if (!buffer) {
+        return false;
+    }
+
+    SearchFileHeader header;
+    memcpy(&header, buffer, sizeof(header));
+
+    size_t folderBytes = (size_t)header.folderCount * sizeof(IndexFolder);
+    size_t itemBytes = (size_t)header.itemCount * sizeof(SearchItem);
+    size_t wordBytes = (size_t)header.wordCount * sizeof(SearchWord);
+    if (header.magic != SEARCH_MAGIC ||
+        header.version != SEARCH_VERSION ||
+        header.folderCount > 0x100000 || header.itemCount > 0x1000000 ||
+        header.wordCount > 0x4000000 ||
+        sizeof(header) + folderBytes + itemBytes + wordBytes + header.stringSize != size) {
+        free(buffer);
+        return false;
+    }
+
+    const u8 *payload = buffer + sizeof(header);
+    if (fnv1a32(FNV1A_32_INIT, payload, size - sizeof(header)) != header.checksum) {
+        free(buffer);
+        return false;
+    }
+
+    const IndexFolder *folders = (const IndexFolder *)payload;
+    const SearchItem *items = (const SearchItem *)(payload + folderBytes);
+    const SearchWord *words = (const SearchWord *)(payload + folderBytes + itemBytes);
+    const char *strings = (const char *)(payload + folderBytes + itemBytes + wordBytes);
+    bool ok = folderTableCheck(folders, header.folderCount, header.itemCount, strings, header.stringSize);
+    for (u32 i = 0; ok && i < header.itemCount; i++) {
+        const SearchItem *item = &items[i];
+        ok = (u64)item->nameOffset + item->nameLength + 1 < header.stringSize &&
+             strings[item->nameOffset + item->nameLength] == '\0' &&
+             item->folder >= 0 && (u32)item->folder < header.folderCount;
+    }
+    for (u32 i = 0; ok && i < header.wordCount; i++) {
+        ok = words[i].keyOffset < header.stringSize &&
+             words[i].item >= 0 && (u32)words[i].item < header.itemCount;
+    }
+    if (!ok) {
+        free(buffer);
+        return false;
+    }
+
+    SearchIndex loaded;
+    searchInit(&loaded, index->basePath);
+    int itemCount = (int)header.itemCount;
+    int wordCount = (int)header.wordCount;
+    if (!folderTableLoad(&loaded.table, folders, (int)header.folderCount, strings, header.stringSize) ||
+        !reserveItems(&loaded, itemCount > 0 ? itemCount : 1) ||
+        !arrayReserve((void **)&loaded.words, &loaded.wordCapacity, wordCount > 0 ? wordCount : 1,
+                      sizeof(SearchWord), 1024)) {
+        searchFree(&loaded);
+        free(buffer);
+        return false;
+    }
+    memcpy(loaded.items, items, itemBytes);
+    memcpy(loaded.words, words, wordBytes);
+    loaded.itemCount = itemCount;
+    loaded.wordCount = wordCount;
+    free(buffer);
+
+    // The UI may be querying; it only ever sees the old or the new tables
+    LightLock_Lock(&index->lock);
+    searchFree(index);
+    lockedReplace(index, &loaded, lock);
+    LightLock_Unlock(&index->lock);
+    return true;
+}
+
+bool searchSave(SearchIndex *index, const char *file) {
+    // Compact into a fresh index: dead folders and items are dropped and the
+    // word table is rebuilt in one sort
+    SearchIndex out;
+    searchInit(&out, index->basePath);
+    bool ok = true;
+
+    for (int f = 0; f < index->table.folderCount && ok; f++) {
+        const IndexFolder *folder = &index->table.folders[f];
+        if (folder->flags & FOLDER_DEAD) {
+            continue;
+        }
+        int copy = addFolder(&out, folderTablePath(&index->table, f), folder->pathLength);
+        if (copy < 0) {
+            ok = false;
+            break;
+        }
+        out.table.folders[copy].flags = folder->flags & ~FOLDER_SEEN;
+        out.table.folders[copy].fingerprint = folder->fingerprint;
+        for (int i = folder->first; i < folder->first + folder->count; i++) {
+            const SearchItem *item = &index->items[i];
+            if (!(item->flags & SEARCH_ITEM_DEAD) &&
+                !addItem(&out, copy, index->table.strings + item->nameOffset, item->flags)) {
+                ok = false;
+                break;
+            }
+        }
+        out.table.folders[copy].count = out.itemCount - out.table.folders[copy].first;
+    }
+    ok = ok && mergeTail(&out);
+    if (!ok) {
+        searchFree(&out);
+        return false;
+    }
+
+    IndexSection sections[] = {
+        {out.table.folders, sizeof(IndexFolder) * out.table.folderCount},
+        {out.items, sizeof(SearchItem) * out.itemCount},
+        {out.words, sizeof(SearchWord) * out.wordCount},
+        {out.table.strings, out.table.stringSize},
+    };
+    SearchFileHeader header;
+    header.magic = SEARCH_MAGIC;
+    header.version = SEARCH_VERSION;
+    header.folderCount = out.table.folderCount;
+    header.itemCount = out.itemCount;
+    header.wordCount = out.wordCount;
+    header.stringSize = out.table.stringSize;
+    header.checksum = indexChecksum(sections, 4);
+    ok = indexFileWrite(file, &header, sizeof(header), sections, 4);
+
+    // Keep using the compacted copy
+    out.dirty = !ok;
+    LightLock_Lock(&index->lock);
+    searchFree(index);
+    lockedReplace(index, &out, lock);
+    LightLock_Unlock(&index->lock);
+    return ok;
+}
+
+// --- background walk -------------------------------------------------------
+
+// Stores a listing unless the folder is unchanged since it was indexed
+static void applyScan(SearchIndex *index, const char *path, const FolderScan *scan) {
+    LightLock_Lock(&index->lock);
+    size_t len = strlen(path);
+    int f = folderTableFind(&index->table, path, len);
+    if (f < 0) {
+        f = addFolder(index, path, len);
+    }
+    if (f < 0) {
+        LightLock_Unlock(&index->lock);
+        return;
+    }
+
+    IndexFolder *folder = &index->table.folders[f];
+    folder->flags |= FOLDER_SEEN;
+    folder->flags &= ~FOLDER_DEAD;
+    if ((folder->flags & FOLDER_LISTED) && folder->fingerprint == scan->fingerprint) {
+        LightLock_Unlock(&index->lock);
+        return;
+    }
+
+    for (int i = folder->first; i < folder->first + folder->count; i++) {
+        index->items[i].flags |= SEARCH_ITEM_DEAD;
+    }
+    int first = index->itemCount;
+    for (size_t off = 0; off < scan->size; off += strlen(scan->entries + off) + 1) {
+        u16 flags = scan->entries[off] == 'd' ? SEARCH_ITEM_FOLDER : 0;
+        if (!addItem(index, f, scan->entries + off + 1, flags)) {
+            break;
+        }
+    }
+
+    folder = &index->table.folders[f];
+    folder->first = first;
+    folder->count = index->itemCount - first;
+    folder->fingerprint = scan->fingerprint;
+    folder->flags |= FOLDER_LISTED;
+    index->dirty = true;
+    LightLock_Unlock(&index->lock);
+}
+
+// Subfolders of a held folder, from what the index already has. Returns
+// false if the folder was never listed.
+static bool heldChildren(SearchIndex *index, const char *path, FolderScan *scan) {
+    scan->size = 0;
+    LightLock_Lock(&index->lock);
+    int f = folderTableFind(&index->table, path, strlen(path));
+    bool found = f >= 0 && (index->table.folders[f].flags & FOLDER_LISTED);
+    if (found) {
+        IndexFolder *folder = &index->table.folders[f];
+        folder->flags |= FOLDER_SEEN;
+        for (int i = folder->first; i < folder->first + folder->count; i++) {
+            const SearchItem *item = &index->items[i];
+            if ((item->flags & SEARCH_ITEM_FOLDER) && !(item->flags & SEARCH_ITEM_DEAD)) {
+                folderScanPush(scan, 'd', index->table.strings + item->nameOffset);
+            }
+        }
+    }
+    LightLock_Unlock(&index->lock);
+    return found;
+}
+
+static bool isHeld(SearchIndexer *indexer, const char *fullPath) {
+    LightLock_Lock(&indexer->lock);
+    bool held = folderIsHeld(indexer->hold, fullPath);
+    LightLock_Unlock(&indexer->lock);
+    return held;
+}
+
+// Folders that weren't reached are gone from the card
+static void finishWalk(SearchIndex *index) {
+    LightLock_Lock(&index->lock);
+    for (int f = 0; f < index->table.folderCount; f++) {
+        IndexFolder *folder = &index->table.folders[f];
+        if (folder->flags & (FOLDER_SEEN | FOLDER_DEAD)) {
+            continue;
+        }
+        folder->flags |= FOLDER_DEAD;
+        for (int i = folder->first; i < folder->first + folder->count; i++) {
+            index->items[i].flags |= SEARCH_ITEM_DEAD;
+        }
+        index->dirty = true;
+    }
+    LightLock_Unlock(&index->lock);
+}
+
+static void indexerMain(void *arg) {
+    SearchIndexer *indexer = (SearchIndexer *)arg;
+    SearchIndex *index = indexer->index;
+
+    FolderQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    FolderScan scan;
+    memset(&scan, 0, sizeof(scan));
+    char path[SEARCH_PATH_LEN];
+    char fullPath[SEARCH_PATH_LEN + 256];
+
+    if (indexer->load) {
+        TRACE_SPAN("search.load", 0, searchLoad(index, indexer->file));
+        if (indexer->notify) {
+            LightEvent_Signal(indexer->notify);
+        }
+    }
+
+    bool ok = folderQueuePush(&queue, "");
+    while (ok && !indexer->quit) {
+        if (indexer->paused) {
+            svcSleepThread(10000000LL); // 10ms
+            continue;
+        }
+        if (!folderQueuePop(&queue, path, sizeof(path))) {
+            break;
+        }
+        snprintf(fullPath, sizeof(fullPath), "%s%s", index->basePath, path);
+
+        bool held = isHeld(indexer, fullPath);
+        bool listed = held && heldChildren(index, path, &scan);
+        if (!listed) {
+            // A held folder that was never listed is only walked through;
+            // its files are in the SD root until the collection goes back
+            TRACE_SPAN("search.scan", 0, listed = folderScan(fullPath, false, &scan));
+            if (listed && !held) {
+                TRACE_SPAN("search.apply", 0, applyScan(index, path, &scan));
+            }
+        }
+        if (listed) {
+            ok = folderQueueChildren(&queue, path, &scan);
+        }
+
+        if (index->tailCount >= SEARCH_TAIL_LIMIT) {
+            TRACE_SPAN("search.merge", index->tailCount, mergeTail(index));
+        }
+        __atomic_add_fetch(&indexer->folders, 1, __ATOMIC_RELEASE);
+        if (indexer->notify) {
+            LightEvent_Signal(indexer->notify);
+        }
+    }
+
+    if (ok && !indexer->quit) {
+        finishWalk(index);
+        TRACE_SPAN("search.merge", index->tailCount, mergeTail(index));
+        if (index->dirty) {
+            TRACE_SPAN("search.save", index->itemCount, searchSave(index, indexer->file));
+        }
+        indexer->done = true;
+        if (indexer->notify) {
+            LightEvent_Signal(indexer->notify);
+        }
+    }
+
+    folderQueueFree(&queue);
+    folderScanFree(&scan);
+}
+
+bool searchIndexerStart(SearchIndexer *indexer, SearchIndex *index, const char *file, bool load,
+                        LightEvent *notify) {
+    memset(indexer, 0, sizeof(SearchIndexer));
+    LightLock_Init(&indexer->lock);
+    indexer->index = index;
+    indexer->notify = notify;
+    indexer->load = load;
+    strncpy(indexer->file, file, sizeof(indexer->file) - 1);
+
+    // Pinned to the app core with the scanner; both only run while the UI waits
+    indexer->thread = threadCreate(indexerMain, indexer, SEARCH_STACK_SIZE,
+                                   SEARCH_PRIORITY, -2, false);
+    return indexer->thread != NULL;
+}
+
+void searchIndexerStop(SearchIndexer *indexer) {
+    if (!indexer->thread) {
+        return;
+    }
+    indexer->quit = true;
+    threadJoin(indexer->thread, U64_MAX);
+    threadFree(indexer->thread);
+    indexer->thread = NULL;
+}
+
+void searchIndexerHold(SearchIndexer *indexer, const char *path) {
+    LightLock_Lock(&indexer->lock);
+    snprintf(indexer->hold, sizeof(indexer->hold), "%s", path ? path : "");
+    LightLock_Unlock(&indexer->lock);
+}
@@ -0,0 +1,137 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "platform.h"
+#include "foldertable.h"
+
+// Library-wide search over every folder and .moflex file under basePath.
+//
+// Each name is stored once, followed by a folded copy (ASCII lower case,
+// no .moflex extension). Every word start in the folded copy goes into a
+// table sorted by the text from there on, so binary searches give the range
+// of entries starting with each query word. The narrowest range is walked
+// and its items are checked for the other words, so a keystroke costs a few
+// lookups plus the candidates of its rarest word, not a pass over the
+// library.
+//
+// The index is filled by a background walk (SearchIndexer) that stores each
+// folder as it is listed, so searches work while it runs. New words go to a
+// small unsorted tail that is merged into the sorted table every
+// SEARCH_TAIL_LIMIT words. Folders carry a fingerprint of their entries
+// like library nodes do, and an unchanged folder keeps its items. The whole
+// index is compacted and saved to SEARCH_FILE once a walk completes.
+
+#define SEARCH_FILE       "sdmc:/.clownsec_search"
+#define SEARCH_MAGIC      0x52534C43 // "CLSR"
+#define SEARCH_VERSION    1
+#define SEARCH_PATH_LEN   512
+#define SEARCH_NAME_LEN   256
+#define SEARCH_QUERY_LEN  64
+#define SEARCH_MAX_WORDS  8          // query words, the rest are ignored
+#define SEARCH_TAIL_LIMIT 4096
+
+#define SEARCH_ITEM_FOLDER 0x0001
+#define SEARCH_ITEM_DEAD   0x8000 // superseded by a newer listing, dropped on save
+
+typedef struct {
+    u32 nameOffset; // into the string pool, the folded copy follows the terminator
+    u16 nameLength;
+    u16 flags;
+    s32 folder;     // folder the item is listed in
+} SearchItem;
+
+typedef struct {
+    u32 keyOffset; // folded text from a word start to the end of the name
+    s32 item;
+} SearchWord;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 folderCount;
+    u32 itemCount;
+    u32 wordCount;
+    u32 stringSize;
+    u32 checksum; // FNV-1a over the tables and string pool
+} SearchFileHeader;
+
+typedef struct {
+    FolderTable table; // folders are ranges of items; names share its strings
+    SearchItem *items;
+    int itemCount;
+    int itemCapacity;
+    SearchWord *words; // sorted by key
+    int wordCount;
+    int wordCapacity;
+    SearchWord *tail;  // not sorted yet
+    int tailCount;
+    int tailCapacity;
+    u32 *stamps;       // per item, so a query reports each item once
+    u32 stamp;
+
+    char basePath[256]; // ends with '/'
+    bool dirty;
+    LightLock lock;     // held by queries and around every change
+} SearchIndex;
+
+// One hit, copied out so it outlives later changes to the index
+typedef struct {
+    char name[SEARCH_NAME_LEN];     // as on the card, .moflex included
+    char folder[SEARCH_PATH_LEN];   // folder it is in, relative to basePath
+    bool isFolder;
+} SearchResult;
+
+void searchInit(SearchIndex *index, const char *basePath);
+void searchFree(SearchIndex *index);
+bool searchLoad(SearchIndex *index, const char *file);
+
+// Compacts the index and writes it out. Only the thread that changes the
+// index may call this while it is shared.
+bool searchSave(SearchIndex *index, const char *file);
+
+// Finds items whose name has a word starting with each word of the query
+// (case-insensitive). Takes the lock. Returns the number of results.
+int searchQuery(SearchIndex *index, const char *query, SearchResult *results, int maxResults);
+
+static inline int searchItemCount(SearchIndex *index) {
+    return __atomic_load_n(&index->itemCount, __ATOMIC_RELAXED);
+}
+
+// Background walk of the whole tree, one folder at a time at the lowest
+// priority. It pauses like the scanner while a move batch owns the card.
+typedef struct {
+    Thread thread;
+    SearchIndex *index;
+    LightEvent *notify;    // signalled after each folder, may be NULL
+    char file[SEARCH_PATH_LEN];
+
+    LightLock lock;        // guards hold
+    char hold[SEARCH_PATH_LEN]; // folder whose files are in the SD root
+
+    volatile bool paused;
+    volatile bool quit;
+    volatile bool done;    // the walk finished and the index was saved
+    bool load;             // read file into the index before walking
+    u32 folders;           // folders walked so far
+} SearchIndexer;
+
+// With load set, the index is read from file on the indexer's thread, so
+// startup does not wait for it; queries find nothing until it is in.
+bool searchIndexerStart(SearchIndexer *indexer, SearchIndex *index, const char *file, bool load,
+                        LightEvent *notify);
+void searchIndexerStop(SearchIndexer *indexer);
+
+// The folder of the collection sitting in the SD root looks nearly empty on
+// the card; its indexed entries are kept instead of relisting it, and one
+// that was never indexed stays out until it is listed. NULL to clear.
+void searchIndexerHold(SearchIndexer *indexer, const char *path);
+
+static inline void searchIndexerPause(SearchIndexer *indexer, bool paused) {
+    indexer->paused = paused;
+}
+
+static inline u32 searchIndexerFolders(SearchIndexer *indexer) {
+    return __atomic_load_n(&indexer->folders, __ATOMIC_ACQUIRE);
+}
+
+#endif
@@ -0,0 +1,213 @@
+#include "state.h"
+#include "hash.h"
+#include "fssession.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define STATE_NO_ORIGIN 0xFFFFFFFFu
+
+// Layout written by v1.0: just the source folder and the active flag
+typedef struct {
+    char sourceDir[STATE_PATH_LEN];
+    bool filesActive;
+} LegacyAppState;
+
+static u32 addString(AppState *state, const char *str) {
+    size_t len = strlen(str) + 1;
+    if (state->stringSize + len > state->stringCapacity) {
+        u32 capacity = state->stringCapacity ? state->stringCapacity * 2 : 2048;
+        while (capacity < state->stringSize + len) {
+            capacity *= 2;
+        }
+        char *strings = (char *)realloc(state->strings, capacity);
+        if (!strings) {
+            return STATE_NO_ORIGIN;
+        }
+        state->strings = strings;
+        state->stringCapacity = capacity;
+    }
+
+    u32 offset = state->stringSize;
+    memcpy(state->strings + offset, str, len);
+    state->stringSize += len;
+    return offset;
+}
+
+void stateInit(AppState *state) {
+    memset(state, 0, sizeof(AppState));
+    state->lastOrigin = STATE_NO_ORIGIN;
+}
+
+void stateFree(AppState *state) {
+    free(state->files);
+    free(state->strings);
+    stateInit(state);
+}
+
+bool stateAddFile(AppState *state, const char *origin, const char *name) {
+    if (state->fileCount == state->fileCapacity) {
+        int capacity = state->fileCapacity ? state->fileCapacity * 2 : 128;
+        StateFile *files = (StateFile *)realloc(state->files, sizeof(StateFile) * capacity);
+        if (!files) {
+            return false;
+        }
+        state->files = files;
+        state->fileCapacity = capacity;
+    }
+
+    // Files are added a folder at a time, so only the last origin is shared
+    if (state->lastOrigin == STATE_NO_ORIGIN ||
+        strcmp(state->strings + state->lastOrigin, origin) != 0) {
+        u32 offset = addString(state, origin);
+        if (offset == STATE_NO_ORIGIN) {
+            return false;
+        }
+        state->lastOrigin = offset;
+    }
+
+    u32 nameOffset = addString(state, name);
+    if (nameOffset == STATE_NO_ORIGIN) {
+        return false;
+    }
+
+    state->files[state->fileCount].nameOffset = nameOffset;
+    state->files[state->fileCount].originOffset = state->lastOrigin;
+    state->fileCount++;
+    return true;
+}
+
+int stateFilesFrom(const AppState *state, const char *origin) {
+    int count = 0;
+    if (state->filesActive) {
+        for (int i = 0; i < state->fileCount; i++) {
+            if (strcmp(stateFileOrigin(state, i), origin) == 0) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+bool stateWrite(FILE *f, const AppState *state) {
+    StateFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = STATE_MAGIC;
+    header.version = STATE_VERSION;
+    header.filesActive = state->filesActive;
+    header.fileCount = state->fileCount;
+    header.stringSize = state->stringSize;
+    snprintf(header.sourceDir, sizeof(header.sourceDir), "%s", state->sourceDir);
+    header.checksum = fnv1a32(FNV1A_32_INIT, state->files, sizeof(StateFile) * state->fileCount);
+    header.checksum = fnv1a32(header.checksum, state->strings, state->stringSize);
+
+    return fwrite(&header, sizeof(header), 1, f) == 1 &&
+           fwrite(state->files, sizeof(StateFile), state->fileCount, f) == (size_t)state->fileCount &&
+           fwrite(state->strings, 1, state->stringSize, f) == state->stringSize;
+}
+
+// Reads the manifest that follows an already-read v2 header
+static bool readManifest(FILE *f, const StateFileHeader *header, AppState *state) {
+    if (header->version != STATE_VERSION ||
+        header->fileCount > 0x10000 || header->stringSize > 0x400000) {
+        return false;
+    }
+
+    StateFile *files = (StateFile *)malloc(sizeof(StateFile) * (header->fileCount + 1));
+    char *strings = (char *)malloc(header->stringSize + 1);
+    bool ok = files && strings &&
+              fread(files, sizeof(StateFile), header->fileCount, f) == header->fileCount &&
+              fread(strings, 1, header->stringSize, f) == header->stringSize;
+
+    if (ok) {
+        u32 checksum = fnv1a32(FNV1A_32_INIT, files, sizeof(StateFile) * header->fileCount);
+        ok = fnv1a32(checksum, strings, header->stringSize) == header->checksum &&
+             (header->stringSize == 0 || strings[header->stringSize - 1] == '\0');
+    }
+    for (u32 i = 0; ok && i < header->fileCount; i++) {
+        ok = files[i].nameOffset < header->stringSize && files[i].originOffset < header->stringSize;
+    }
+
+    if (!ok) {
+        free(files);
+        free(strings);
+        return false;
+    }
+
+    memcpy(state->sourceDir, header->sourceDir, STATE_PATH_LEN);
+    state->sourceDir[STATE_PATH_LEN - 1] = '\0';
+    state->filesActive = header->filesActive != 0;
+    state->files = files;
+    state->fileCount = header->fileCount;
+    state->fileCapacity = header->fileCount + 1;
+    state->strings = strings;
+    state->stringSize = header->stringSize;
+    state->stringCapacity = header->stringSize + 1;
+    return true;
+}
+
+bool stateRead(FILE *f, AppState *state) {
+    stateFree(state);
+
+    StateFileHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != STATE_MAGIC) {
+        return false;
+    }
+    return readManifest(f, &header, state);
+}
+
+static void writeStateFile(const AppState *state) {
+    FILE *f = fopen(STATE_FILE, "wb");
+    if (f) {
+        stateWrite(f, state);
+        fflush(f);
+        fclose(f);
+    }
+}
+
+static bool readStateFile(AppState *state) {
+    FILE *f = fopen(STATE_FILE, "rb");
+    if (!f) {
+        return false;
+    }
+
+    stateFree(state);
+
+    StateFileHeader header;
+    size_t read = fread(&header, 1, sizeof(header), f);
+
+    if (read >= sizeof(u32) && header.magic != STATE_MAGIC) {
+        // v1.0 state: no manifest, restore has to fall back to a root scan
+        fclose(f);
+        if (read != sizeof(LegacyAppState)) {
+            return false;
+        }
+        LegacyAppState legacy;
+        memcpy(&legacy, &header, sizeof(legacy));
+        memcpy(state->sourceDir, legacy.sourceDir, STATE_PATH_LEN);
+        state->sourceDir[STATE_PATH_LEN - 1] = '\0';
+        state->filesActive = legacy.filesActive;
+        state->legacy = true;
+        return true;
+    }
+
+    bool ok = read == sizeof(header) && readManifest(f, &header, state);
+    fclose(f);
+    return ok;
+}
+
+void saveState(const AppState *state) {
+    TRACE_SPAN("state.save", state->fileCount, writeStateFile(state));
+}
+
+bool loadState(AppState *state) {
+    bool ok;
+    TRACE_SPAN("state.load", 0, ok = readStateFile(state));
+    return ok;
+}
+
+void clearState(void) {
+    TRACE_SPAN("state.clear", 0, fsDeleteFile(STATE_FILE));
+}
@@ -0,0 +1,75 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include "platform.h"
+#include <stdio.h>
+
+// Launch state persisted across the trip to the 3D Movie Player.
+//
+// Besides the active collection, the state carries a manifest of every file
+// we put in the SD root and the folder it came from, so restoring is a fixed
+// list of renames rather than a sweep of sdmc:/.
+
+#ifndef STATE_FILE
+#define STATE_FILE      "sdmc:/.clownsec_state"
+#endif
+#define STATE_MAGIC     0x54534C43 // "CLST"
+#define STATE_VERSION   2
+#define STATE_PATH_LEN  512
+
+typedef struct {
+    u32 nameOffset;   // file name, into the string pool
+    u32 originOffset; // directory it was moved from, into the string pool
+} StateFile;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 filesActive;
+    u32 fileCount;
+    u32 stringSize;
+    u32 checksum;
+    char sourceDir[STATE_PATH_LEN];
+} StateFileHeader;
+
+typedef struct {
+    char sourceDir[STATE_PATH_LEN];
+    bool filesActive;
+    bool legacy; // loaded from a v1.0 state file, which has no manifest
+
+    // Every file we moved into root and the folder it came from
+    StateFile *files;
+    int fileCount;
+    int fileCapacity;
+    char *strings;
+    u32 stringSize;
+    u32 stringCapacity;
+    u32 lastOrigin; // offset of the most recently added origin, for reuse
+} AppState;
+
+void stateInit(AppState *state);
+void stateFree(AppState *state);
+bool stateAddFile(AppState *state, const char *origin, const char *name);
+
+static inline const char *stateFileName(const AppState *state, int i) {
+    return state->strings + state->files[i].nameOffset;
+}
+
+static inline const char *stateFileOrigin(const AppState *state, int i) {
+    return state->strings + state->files[i].originOffset;
+}
+
+// Number of manifest files that came from the given folder
+int stateFilesFrom(const AppState *state, const char *origin);
+
+// Serialized manifest, also embedded in move journals (see mover.h)
+bool stateWrite(FILE *f, const AppState *state);
+bool stateRead(FILE *f, AppState *state);
+
+// State changes are committed along with the move batch that caused them,
+// see planFinish() in mover.h
+void saveState(const AppState *state);
+bool loadState(AppState *state);
+void clearState(void);
+
+#endif
@@ -0,0 +1,71 @@
+#include "touchkeys.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define KEY_COLUMNS   10
+#define KEY_WIDTH     4  // console columns
+#define KEY_HEIGHT    3  // console rows
+#define KEY_FIRST_ROW 10 // console row (1-based) of the top of the first key row
+#define KEY_ROWS      5  // four rows of characters, then space, delete and clear
+
+static const char keyRows[KEY_ROWS - 1][KEY_COLUMNS + 1] = {
+    "1234567890",
+    "QWERTYUIOP",
+    "ASDFGHJKL'",
+    "ZXCVBNM-.&",
+};
+
+static PrintConsole *selectKeys(TouchKeys *keys) {
+    PrintConsole *top = consoleSelect(&keys->console);
+    if (!keys->initialized) {
+        consoleInit(GFX_BOTTOM, &keys->console);
+        keys->initialized = true;
+    }
+    return top;
+}
+
+void touchKeysShow(TouchKeys *keys) {
+    PrintConsole *top = selectKeys(keys);
+    consoleClear();
+
+    printf("\x1b[2;2HSearch the library");
+    printf("\x1b[4;2HTouch the keys to type");
+    printf("\x1b[5;2HX: full keyboard  B: delete");
+
+    for (int row = 0; row < KEY_ROWS - 1; row++) {
+        for (int column = 0; column < KEY_COLUMNS; column++) {
+            printf("\x1b[%d;%dH[%c]", KEY_FIRST_ROW + row * KEY_HEIGHT + 1,
+                   column * KEY_WIDTH + 1, keyRows[row][column]);
+        }
+    }
+
+    // Space over six keys, delete and clear over two each
+    printf("\x1b[%d;1H[         SPACE        ][  DEL ][ CLR ]",
+           KEY_FIRST_ROW + (KEY_ROWS - 1) * KEY_HEIGHT + 1);
+
+    consoleSelect(top);
+}
+
+void touchKeysHide(TouchKeys *keys) {
+    PrintConsole *top = selectKeys(keys);
+    consoleClear();
+    consoleSelect(top);
+}
+
+int touchKeysHit(const touchPosition *touch) {
+    int row = touch->py / 8 + 1 - KEY_FIRST_ROW;
+    int column = touch->px / (KEY_WIDTH * 8);
+    if (row < 0 || column < 0 || column >= KEY_COLUMNS) {
+        return 0;
+    }
+    row /= KEY_HEIGHT;
+
+    if (row < KEY_ROWS - 1) {
+        return keyRows[row][column];
+    }
+    if (row == KEY_ROWS - 1) {
+        return column < 6 ? ' ' : column < 8 ? TOUCHKEY_DELETE : TOUCHKEY_CLEAR;
+    }
+    return 0;
+}
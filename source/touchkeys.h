@@ -0,0 +1,28 @@
+#ifndef TOUCHKEYS_H
+#define TOUCHKEYS_H
+
+#include <3ds.h>
+
+// Letter keyboard on the bottom screen for type-ahead search.
+//
+// Keys are 4 console columns by 3 rows (32x24 pixels), ten to a row, so a
+// touch maps to a key with two divisions. The keyboard shares the bottom
+// screen with the HUD, which isn't drawn while the keyboard is up.
+
+#define TOUCHKEY_DELETE '\b'
+#define TOUCHKEY_CLEAR  0x7F
+
+typedef struct {
+    PrintConsole console;
+    bool initialized;
+} TouchKeys;
+
+// Both leave the top console selected
+void touchKeysShow(TouchKeys *keys);
+void touchKeysHide(TouchKeys *keys);
+
+// Returns the character of the key under the touch, TOUCHKEY_DELETE,
+// TOUCHKEY_CLEAR, or 0 if the touch missed the keys
+int touchKeysHit(const touchPosition *touch);
+
+#endif
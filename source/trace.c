@@ -0,0 +1,96 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+volatile bool traceEnabled = false;
+
+static TraceEvent *ring = NULL;
+static u32 head = 0;     // total events recorded, the slot is head & mask
+static u64 baseTick = 0; // timestamps are written relative to this
+
+bool traceConfigured(void) {
+    FILE *f = fopen(TRACE_CONFIG_FILE, "rb");
+    if (f) {
+        fclose(f);
+        return true;
+    }
+    return false;
+}
+
+bool traceStart(void) {
+    if (!ring) {
+        ring = (TraceEvent *)calloc(TRACE_CAPACITY, sizeof(TraceEvent));
+        if (!ring) {
+            return false;
+        }
+        baseTick = svcGetSystemTick();
+    }
+    traceEnabled = true;
+    return true;
+}
+
+void traceStop(void) {
+    traceEnabled = false;
+}
+
+void traceRecord(const char *name, u64 start, s32 arg) {
+    if (!traceEnabled || !ring) {
+        return;
+    }
+    u64 now = svcGetSystemTick();
+    u32 thread = 0;
+    svcGetThreadId(&thread, CUR_THREAD_HANDLE);
+
+    // Writers on different threads each claim their own slot
+    u32 slot = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED) & (TRACE_CAPACITY - 1);
+    TraceEvent *event = &ring[slot];
+    event->name = name;
+    event->start = start;
+    event->duration = (u32)(now - start);
+    event->thread = thread;
+    event->arg = arg;
+}
+
+static double ticksToUs(u64 ticks) {
+    return (double)ticks * 1000000.0 / SYSCLOCK_ARM11;
+}
+
+bool traceDump(const char *path) {
+    u32 end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    if (!ring || end == 0) {
+        return false;
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+
+    // Oldest surviving event first
+    u32 first = end > TRACE_CAPACITY ? end - TRACE_CAPACITY : 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (u32 i = first; i < end; i++) {
+        const TraceEvent *event = &ring[i & (TRACE_CAPACITY - 1)];
+        s64 start = (s64)(event->start - baseTick);
+        fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f,"
+                   "\"args\":{\"arg\":%ld}}\n",
+                i == first ? "" : ",", event->name, (unsigned long)event->thread,
+                start < 0 ? 0.0 : ticksToUs((u64)start), ticksToUs(event->duration),
+                (long)event->arg);
+    }
+    fprintf(f, "]}\n");
+
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+void traceShutdown(void) {
+    traceEnabled = false;
+    traceDump(TRACE_FILE);
+    free(ring);
+    ring = NULL;
+    head = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "platform.h"
+
+// Hot-path tracing.
+//
+// Spans are timed with svcGetSystemTick and kept in a fixed ring of the
+// most recent TRACE_CAPACITY events, shared by every thread. The ring is
+// written out as a Chrome trace (chrome://tracing, Perfetto) on demand.
+//
+// Tracing starts enabled when TRACE_CONFIG_FILE exists, and the browser
+// toggles it with L+R+SELECT. While it is off, a TRACE_SPAN costs one
+// branch on traceEnabled and nothing else.
+
+#define TRACE_FILE        "sdmc:/.clownsec_trace.json"
+#define TRACE_CONFIG_FILE "sdmc:/.clownsec_trace"
+#define TRACE_CAPACITY    4096 // events, must be a power of two
+
+typedef struct {
+    const char *name; // string literal
+    u64 start;        // ticks
+    u32 duration;     // ticks
+    u32 thread;
+    s32 arg;
+} TraceEvent;
+
+extern volatile bool traceEnabled;
+
+// True if the config file asks for tracing from startup
+bool traceConfigured(void);
+
+// Allocates the ring on first use and starts recording
+bool traceStart(void);
+void traceStop(void);
+
+// Writes the recorded events; returns false if there are none or the file
+// can't be written
+bool traceDump(const char *path);
+
+// Stops recording, dumps what was recorded and frees the ring. Call once
+// no other thread can be recording.
+void traceShutdown(void);
+
+// Records a span that began at start; does nothing while tracing is off
+void traceRecord(const char *name, u64 start, s32 arg);
+
+// Runs statement, recording it as a span named name when tracing is on
+#define TRACE_SPAN(name, arg, statement)                          \
+    do {                                                          \
+        if (__builtin_expect(traceEnabled, 0)) {                  \
+            u64 traceStart_ = svcGetSystemTick();                 \
+            statement;                                            \
+            traceRecord((name), traceStart_, (s32)(arg));         \
+        } else {                                                  \
+            statement;                                            \
+        }                                                         \
+    } while (0)
+
+#endif
@@ -0,0 +1,306 @@
+#include "verifier.h"
+#include "fsfile.h"
+#include "hash.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define VERIFIER_STACK_SIZE (16 * 1024)
+#define VERIFIER_PRIORITY   0x3F // lowest, next to the scanner
+#define VERIFIER_PATH_LEN   1024
+
+// Runs the structure check and digest over each buffer the reader fills,
+// in the order they were filled
+static void checkerMain(void *arg) {
+    Verifier *verifier = (Verifier *)arg;
+
+    for (int b = 0;; b ^= 1) {
+        LightEvent_Wait(&verifier->filled[b]);
+        if (verifier->checkerQuit) {
+            break;
+        }
+
+        const u8 *data = verifier->buffers[b];
+        u32 length = verifier->lengths[b];
+        moflexCheckFeed(&verifier->check, data, length);
+        verifier->digest = fnv1a32Words(verifier->digest, (const u32 *)data, length / 4);
+        verifier->digest = fnv1a32(verifier->digest, data + (length & ~3u), length & 3);
+
+        LightEvent_Signal(&verifier->drained[b]);
+    }
+}
+
+static bool shouldStop(Verifier *verifier, u32 generation) {
+    return verifier->paused || verifier->quit ||
+           __atomic_load_n(&verifier->generation, __ATOMIC_RELAXED) != generation;
+}
+
+// Reads a whole file through the pipeline and stores the verdict. Returns
+// false if it had to stop part way, leaving nothing stored.
+static bool verifyFile(Verifier *verifier, const char *collection, const char *dir, const char *name,
+                       u32 generation) {
+    char path[VERIFIER_PATH_LEN];
+    size_t dirLength = strlen(dir);
+    snprintf(path, sizeof(path), "%s%s%s", dir, (dirLength && dir[dirLength - 1] == '/') ? "" : "/", name);
+
+    u64 mtime = fileMtime(path);
+    FileReader reader;
+    if (!fileOpen(&reader, path)) {
+        return true; // moved or gone, the cache entry stays unchecked
+    }
+
+    moflexCheckInit(&verifier->check, reader.size);
+    verifier->digest = FNV1A_32_INIT;
+
+    // The checker is always one buffer behind: before a buffer is refilled,
+    // wait until it has been drained
+    static int next = 0; // the checker alternates across files too
+    bool inFlight[2] = {false, false};
+    bool stopped = false;
+    for (u64 offset = 0; offset < reader.size;) {
+        if (shouldStop(verifier, generation)) {
+            stopped = true;
+            break;
+        }
+        int b = next;
+        if (inFlight[b]) {
+            LightEvent_Wait(&verifier->drained[b]);
+            inFlight[b] = false;
+        }
+
+        u32 want = reader.size - offset < VERIFY_CHUNK ? (u32)(reader.size - offset) : VERIFY_CHUNK;
+        u32 read;
+        TRACE_SPAN("verifier.read", want >> 10, read = fileRead(&reader, offset, verifier->buffers[b], want));
+        if (read == 0) {
+            break; // the check reports the file as unreadable
+        }
+
+        verifier->lengths[b] = read;
+        inFlight[b] = true;
+        LightEvent_Signal(&verifier->filled[b]);
+        next ^= 1;
+        offset += read;
+        __atomic_add_fetch(&verifier->bytes, read, __ATOMIC_RELAXED);
+    }
+    for (int b = 0; b < 2; b++) {
+        if (inFlight[b]) {
+            LightEvent_Wait(&verifier->drained[b]);
+        }
+    }
+    fileClose(&reader);
+
+    if (stopped) {
+        return false;
+    }
+    MoflexVerdict verdict = moflexCheckFinish(&verifier->check);
+    metaRecordVerdict(verifier->cache, collection, name, reader.size, mtime, verdict, verifier->digest);
+    return true;
+}
+
+static void verifierMain(void *arg) {
+    Verifier *verifier = (Verifier *)arg;
+
+    char *work = NULL;
+    size_t workCapacity = 0;
+    size_t workSize = 0;
+    size_t position = 0;
+    u32 generation = 0;
+
+    while (!verifier->quit) {
+        // Take the current request if it changed since we last looked
+        LightLock_Lock(&verifier->lock);
+        if (verifier->generation != generation) {
+            generation = verifier->generation;
+            workSize = 0;
+            if (verifier->requestSize > workCapacity) {
+                char *grown = (char *)realloc(work, verifier->requestSize);
+                if (grown) {
+                    work = grown;
+                    workCapacity = verifier->requestSize;
+                }
+            }
+            if (verifier->requestSize <= workCapacity) {
+                memcpy(work, verifier->request, verifier->requestSize);
+                workSize = verifier->requestSize;
+            }
+            position = workSize ? strlen(work) + 1 : 0; // files start after the collection
+        }
+        LightLock_Unlock(&verifier->lock);
+
+        if (position >= workSize) {
+            __atomic_store_n(&verifier->pending, 0, __ATOMIC_RELAXED);
+            LightEvent_Wait(&verifier->wake);
+            continue;
+        }
+
+        // Announce the read before looking at paused, so a pause either
+        // sees it or is seen by it
+        __atomic_store_n(&verifier->reading, true, __ATOMIC_SEQ_CST);
+        if (verifier->paused) {
+            __atomic_store_n(&verifier->reading, false, __ATOMIC_SEQ_CST);
+            svcSleepThread(10000000LL); // 10ms
+            continue;
+        }
+
+        const char *dir = work + position;
+        const char *name = dir + strlen(dir) + 1;
+        u64 start = svcGetSystemTick();
+        bool done;
+        TRACE_SPAN("verifier.file", 0, done = verifyFile(verifier, work, dir, name, generation));
+        __atomic_store_n(&verifier->reading, false, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&verifier->busyTicks, svcGetSystemTick() - start, __ATOMIC_RELAXED);
+
+        if (done) {
+            position = (size_t)(name - work) + strlen(name) + 1;
+            __atomic_sub_fetch(&verifier->pending, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&verifier->completed, 1, __ATOMIC_RELEASE);
+            if (verifier->notify) {
+                LightEvent_Signal(verifier->notify);
+            }
+        }
+    }
+
+    free(work);
+}
+
+bool verifierStart(Verifier *verifier, MetaCache *cache, LightEvent *notify) {
+    memset(verifier, 0, sizeof(Verifier));
+    LightEvent_Init(&verifier->wake, RESET_ONESHOT);
+    LightLock_Init(&verifier->lock);
+    verifier->cache = cache;
+    verifier->notify = notify;
+    for (int b = 0; b < 2; b++) {
+        LightEvent_Init(&verifier->filled[b], RESET_ONESHOT);
+        LightEvent_Init(&verifier->drained[b], RESET_ONESHOT);
+        verifier->buffers[b] = (u8 *)malloc(VERIFY_CHUNK);
+    }
+    if (!verifier->buffers[0] || !verifier->buffers[1]) {
+        free(verifier->buffers[0]);
+        free(verifier->buffers[1]);
+        return false;
+    }
+
+    // Both on the app core next to the UI, which they never preempt
+    verifier->checker = threadCreate(checkerMain, verifier, VERIFIER_STACK_SIZE,
+                                     VERIFIER_PRIORITY, -2, false);
+    if (verifier->checker) {
+        verifier->thread = threadCreate(verifierMain, verifier, VERIFIER_STACK_SIZE,
+                                        VERIFIER_PRIORITY, -2, false);
+    }
+    if (!verifier->thread) {
+        verifierStop(verifier);
+        return false;
+    }
+    return true;
+}
+
+void verifierStop(Verifier *verifier) {
+    if (verifier->thread) {
+        verifier->quit = true;
+        LightEvent_Signal(&verifier->wake);
+        threadJoin(verifier->thread, U64_MAX);
+        threadFree(verifier->thread);
+        verifier->thread = NULL;
+    }
+
+    // The reader has waited for its last buffer, so the checker is idle
+    if (verifier->checker) {
+        verifier->checkerQuit = true;
+        LightEvent_Signal(&verifier->filled[0]);
+        LightEvent_Signal(&verifier->filled[1]);
+        threadJoin(verifier->checker, U64_MAX);
+        threadFree(verifier->checker);
+        verifier->checker = NULL;
+    }
+
+    for (int b = 0; b < 2; b++) {
+        free(verifier->buffers[b]);
+        verifier->buffers[b] = NULL;
+    }
+    free(verifier->request);
+    verifier->request = NULL;
+    verifier->requestSize = 0;
+    verifier->requestCapacity = 0;
+    verifier->pending = 0;
+}
+
+static bool appendString(Verifier *verifier, const char *text) {
+    size_t len = strlen(text) + 1;
+    if (verifier->requestSize + len > verifier->requestCapacity) {
+        size_t capacity = verifier->requestCapacity ? verifier->requestCapacity : 4096;
+        while (capacity < verifier->requestSize + len) {
+            capacity *= 2;
+        }
+        char *grown = (char *)realloc(verifier->request, capacity);
+        if (!grown) {
+            return false;
+        }
+        verifier->request = grown;
+        verifier->requestCapacity = capacity;
+    }
+    memcpy(verifier->request + verifier->requestSize, text, len);
+    verifier->requestSize += len;
+    return true;
+}
+
+// Where a file of the collection is right now
+static const char *fileDir(const char *path, const char *name, const AppState *active, const char *rootDir) {
+    if (active && active->filesActive) {
+        for (int i = 0; i < active->fileCount; i++) {
+            if (strcmp(stateFileName(active, i), name) == 0 && strcmp(stateFileOrigin(active, i), path) == 0) {
+                return rootDir;
+            }
+        }
+    }
+    return path;
+}
+
+int verifierRequest(Verifier *verifier, const char *path, const AppState *active, const char *rootDir) {
+    if (!verifier->thread) {
+        return 0;
+    }
+
+    MetaCache *cache = verifier->cache;
+    int queued = 0;
+    bool ok;
+
+    LightLock_Lock(&verifier->lock);
+    verifier->requestSize = 0;
+    ok = appendString(verifier, path);
+
+    metaLock(cache);
+    int collection = metaFindCollection(cache, path);
+    if (collection >= 0) {
+        const MetaCollection *c = &cache->collections[collection];
+        for (int i = c->firstEntry; ok && i < c->firstEntry + c->entryCount; i++) {
+            const MetaEntry *entry = &cache->entries[i];
+            if (entry->verdict != MOFLEX_UNCHECKED) {
+                continue;
+            }
+            const char *name = metaEntryName(cache, entry);
+            ok = appendString(verifier, fileDir(path, name, active, rootDir)) && appendString(verifier, name);
+            queued += ok;
+        }
+    }
+    metaUnlock(cache);
+
+    if (!ok || queued == 0) {
+        verifier->requestSize = 0; // out of memory or nothing to do
+        queued = 0;
+    }
+    __atomic_store_n(&verifier->pending, (u32)queued, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&verifier->generation, 1, __ATOMIC_RELAXED);
+    LightLock_Unlock(&verifier->lock);
+
+    LightEvent_Signal(&verifier->wake);
+    return queued;
+}
+
+void verifierPause(Verifier *verifier, bool paused) {
+    __atomic_store_n(&verifier->paused, paused, __ATOMIC_SEQ_CST);
+    while (paused && verifier->thread && __atomic_load_n(&verifier->reading, __ATOMIC_SEQ_CST)) {
+        svcSleepThread(1000000LL); // 1ms, a file stops at its next chunk
+    }
+}
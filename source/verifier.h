@@ -0,0 +1,84 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include "platform.h"
+
+#include "metacache.h"
+#include "state.h"
+
+// Background check of whole .moflex files, so damaged ones are flagged
+// before they are moved and handed to the Movie Player.
+//
+// Each file is read front to back in VERIFY_CHUNK pieces, alternating
+// between two buffers: while the next piece is read from the card, a second
+// thread runs the block-structure check (moflex.h) and the content digest
+// over the last one, so the card always has a large read outstanding. The
+// verdict and digest go to the metadata cache along with the size and mtime
+// they were taken at, and an unchanged file is never read again.
+//
+// Like the scanner it works on one request at a time, the unchecked files
+// of a collection, and a new request replaces the old one. While a move
+// batch owns the card it is paused with no file open.
+
+#define VERIFY_CHUNK (256 * 1024)
+
+typedef struct {
+    Thread thread;
+    Thread checker;
+    LightEvent wake;       // one-shot, signalled on a new request or stop
+    LightLock lock;        // guards the request below
+    MetaCache *cache;
+    LightEvent *notify;    // signalled after every file, may be NULL
+
+    char *request;         // collection path, then the folder and name of each file
+    size_t requestSize;
+    size_t requestCapacity;
+    u32 generation;        // bumped on every request
+
+    // Pipeline to the checker thread: a buffer is filled by the reader,
+    // then drained by the checker
+    u8 *buffers[2];
+    u32 lengths[2];
+    LightEvent filled[2];
+    LightEvent drained[2];
+    MoflexCheck check;
+    u32 digest;
+    volatile bool checkerQuit;
+
+    volatile bool paused;
+    volatile bool reading; // a file is open
+    volatile bool quit;
+    u32 completed;         // files checked so far
+    u32 pending;           // files left in the current request
+    u64 bytes;             // read so far
+    u64 busyTicks;         // time spent on files, for throughput
+} Verifier;
+
+bool verifierStart(Verifier *verifier, MetaCache *cache, LightEvent *notify);
+void verifierStop(Verifier *verifier);
+
+// Queues the unchecked files the cache has for the collection at path,
+// replacing the previous request. Files active has moved to rootDir are
+// read from there. Returns the number of files queued.
+int verifierRequest(Verifier *verifier, const char *path, const AppState *active, const char *rootDir);
+
+// Pausing waits until the current file is closed; it is checked again from
+// the start once unpaused
+void verifierPause(Verifier *verifier, bool paused);
+
+static inline u32 verifierCompleted(Verifier *verifier) {
+    return __atomic_load_n(&verifier->completed, __ATOMIC_ACQUIRE);
+}
+
+static inline u32 verifierPending(Verifier *verifier) {
+    return __atomic_load_n(&verifier->pending, __ATOMIC_RELAXED);
+}
+
+// Sustained read rate while working, 0 before the first file
+static inline u32 verifierBytesPerSecond(Verifier *verifier) {
+    u64 busy = __atomic_load_n(&verifier->busyTicks, __ATOMIC_RELAXED);
+    u64 bytes = __atomic_load_n(&verifier->bytes, __ATOMIC_RELAXED);
+    return busy ? (u32)((double)bytes * SYSCLOCK_ARM11 / busy) : 0;
+}
+
+#endif